@@ -1,14 +1,24 @@
 #pragma once
 
+#include <array>
 #include <limits>
 
 #include "application_base.h"
 #include "battery_charging_limits.h"
 #include "bms.h"
 #include "bxcan.h"
+#include "comm_timeouts.h"
+#include "current_regulator.h"
 #include "j1772.h"
+#include "loop_events.h"
+#include "profiler.h"
+#include "quantity.h"
+#include "scheduler.h"
 #include "skylab2_boards.h"
+#include "state_machine.h"
 #include "status_lights.h"
+#include "supervisor.h"
+#include "telemetry.h"
 #include "thunderstruck.h"
 #include "thunderstruck_constants.h"
 
@@ -36,8 +46,48 @@ enum class charge_state : uint16_t
     FAULT_RESETTABLE,
     CHARGING_DONE
 };
+static constexpr uint8_t CHARGE_STATES =
+    static_cast<uint8_t>(charge_state::CHARGING_DONE) + 1;
+
+/**
+ * @brief Steps of HV isolation, advanced one step per main loop pass.
+ * DISABLE_REQUESTED: Isolation was requested, chargers not yet told.
+ * WAITING_FOR_DECAY: Chargers disabled, waiting for their current to fall.
+ * CONTACTOR_OPEN: Current has decayed (or we gave up waiting), open AC.
+ * DONE: Isolated.
+ *
+ */
+enum class isolation_state : uint8_t
+{
+    DISABLE_REQUESTED,
+    WAITING_FOR_DECAY,
+    CONTACTOR_OPEN,
+    DONE
+};
+/**
+ * @brief Periodic jobs run by the scheduler, in the order of the job table.
+ * CHARGER_CONTROL: The next Thunderstruck's control packet, each unit in turn.
+ * CONTROL_UPDATE: A changed control packet, to the units that haven't had it.
+ * BMS_REQUEST: Charging request to the BMS on the car bus.
+ * CHARGER_STATE: Charger state and faults on the car bus.
+ * TELEMETRY: A telemetry sample, or the next frames of a running dump.
+ * LIGHTS: The next step of every status light pattern.
+ * PROX_DEBOUNCE: A proximity change that has held for PROX_DEBOUNCE_TIME.
+ *
+ */
+enum class scheduled_job : uint8_t
+{
+    CHARGER_CONTROL,
+    CONTROL_UPDATE,
+    BMS_REQUEST,
+    CHARGER_STATE,
+    TELEMETRY,
+    LIGHTS,
+    PROX_DEBOUNCE,
+    COUNT
+};
 // hard maximum on ac input current
-static constexpr float MAX_AC_CURRENT = 30.0f;
+static constexpr deci_amps MAX_AC_CURRENT = deci_amps(300);
 // maximum time to wait for current to drop low for hv isolation
 static constexpr uint32_t MAX_ISOLATE_WAIT = 500;  // ms
 
@@ -47,45 +97,148 @@ static constexpr uint32_t MAX_ISOLATE_WAIT = 500;  // ms
  */
 class Application : public ApplicationBase {
    private:
-    static constexpr float VOLTAGE_THRESHOLD =
-        2.0f;  // used to compare voltage target voltage -
-               // bms.get_pack_voltage()
-    static constexpr float CURRENT_MIN_VAL =
-        30.0f;  // temporary place holder value; TODO: will be replaced with the
-                // current limit packet from bms once that is implemented
-    charge_state charge_status = charge_state::IDLE;
+    // used to compare voltage target voltage - bms.get_pack_voltage()
+    static constexpr deci_volts VOLTAGE_THRESHOLD = deci_volts(20);
+    // temporary place holder value, per charger; TODO: will be replaced with
+    // the current limit packet from bms once that is implemented
+    static constexpr deci_amps CURRENT_MIN_VAL = deci_amps(300);
+    // after an unplug, the longest the chargers can take to slew from their
+    // full current to zero and report it; the AC stays closed until then
+    static constexpr uint32_t MAX_UNPLUG_ISOLATE_WAIT =
+        CURRENT_MIN_VAL.count() * 1000 / CHARGER_SLEW_PER_SECOND.count() +
+        CHARGER_STATUS_PERIOD;  // ms
+    // edges of the charge state machine, in priority order out of each state
+    static constexpr uint8_t CHARGE_TRANSITIONS = 22;
+    // both tables are defined constexpr in application.cc
+    static const std::array<state_hooks<Application>, CHARGE_STATES>
+        STATE_HOOKS;
+    static const std::array<state_transition<Application, charge_state>,
+                            CHARGE_TRANSITIONS>
+        STATE_TRANSITIONS;
+    StateMachine<Application, charge_state, CHARGE_STATES, CHARGE_TRANSITIONS>
+        charge_machine;
+    bool prox_connected = false;  // debounced, as of this pass
+    isolation_state isolation_status = isolation_state::DONE;
+    uint32_t isolation_started = 0;  // ms
+    uint32_t isolation_wait = MAX_ISOLATE_WAIT;  // ms, longest decay
+    uint32_t isolation_decay_time = 0;  // ms
+    // unplugged, and the chargers not yet reporting zero current
+    bool unplug_ramping = false;
+    uint32_t unplug_ramp_time = 0;  // ms
     bms_fault_type bms_fault_reason = bms_fault_type::NONE;
     charger_fault_type charger_fault_reason = charger_fault_type::NONE;
     float user_defined_current = std::numeric_limits<float>::max();
     float max_kWh = 20.15;
+    // battery current to charge at, all chargers together
+    deci_amps current_setpoint = CURRENT_MIN_VAL * NUMBER_CHARGERS;
+    CurrentRegulator current_regulator;
 
     can::bxcan_driver can_device;
     skylab2::charger_can skylab2;
+    // before bms and thunderstruck, which register their links with it
+    CommTimeouts comm_timeouts;
     Bms bms;
     Thunderstruck thunderstruck;
     Status_lights status_lights;
     J1772 openEVSE;
+    LoopEvents loop_events;
+    LoopSupervisor supervisor;
+    TelemetryLog telemetry;
+    uint8_t telemetry_rate = TELEMETRY_RATE_DEFAULT;  // Hz
+    PeriodicScheduler<Application, static_cast<uint8_t>(scheduled_job::COUNT)>
+        scheduler;
+    uint8_t next_control_unit = 0;
+    // set by a request on CAN1, taken by the main loop
+    volatile bool telemetry_dump_requested = false;
+    volatile uint8_t telemetry_rate_requested = 0;  // 0 for no change
+    volatile bool deadline_clear_requested = false;
+    // deadline report frames still to send, set by a request on CAN1
+    volatile uint8_t deadline_report_next = 0;
+    volatile uint8_t deadline_report_end = 0;
+#ifdef CHARGER_PROFILE
+    // profile points still to report, set by a request on CAN1
+    volatile uint8_t profile_report_next = 0;
+    volatile uint8_t profile_report_end = 0;
+
+    void profile_request(const can::packet& request);
+    void send_profile_report();
+#endif
 
     void init();
-    void enable_charge();
-    void set_current_limit();
+    void init_diagnostic_requests();
+    void telemetry_request(const can::packet& request);
+    void deadline_request(const can::packet& request);
+    void send_deadline_report();
+    void set_telemetry_rate(uint16_t rate);
+    void update_telemetry();
+    void update_lights();
+    void record_telemetry();
+    // state machine guards
+    bool latching_fault() const;
+    bool resettable_fault() const;
+    bool faults_cleared() const;
+    bool plugged_in() const;
+    bool unplugged() const;
+    bool ready_to_charge() const;
+    bool bms_not_ready() const;
+    bool chargers_alive() const;
+    bool charge_complete() const;
+    // state machine hooks
+    void request_charging();
+    void power_on_chargers();
+    void start_charging();
+    void stop_charging();
+    void command_current();
+    void begin_fault_isolate();
+    void release_trip();
+    void regulate_current();
+    void begin_HV_isolate();
+    void begin_unplug_isolate();
     void HV_isolate();
-    float find_current_limit(void);
+    deci_amps find_current_limit(void);
     // void check_user_defined_values(); will not be adding to development
     // because untested
 
    public:
     Application();
     void main();
+    void start();
+    void step();
+    charge_state get_charge_state() const;
+    loop_stats get_loop_stats() const;
+    bms_fault_type get_bms_fault() const;
+    charger_fault_type get_charger_fault() const;
+    isolation_state get_isolation_state() const;
+    uint32_t get_isolation_decay_time() const;
+    uint32_t get_unplug_ramp_time() const;
+    const prox_stats& get_prox_stats() const;
+    void set_current_setpoint(deci_amps setpoint);
+    deci_amps get_current_command() const;
+    telemetry_stats get_telemetry_stats() const;
+    const job_stats& get_job_stats(scheduled_job job) const;
+    deadline_record get_deadline_record() const;
+    float get_pack_energy() const;
+    float get_charger_output_energy() const;
+    ring_stats get_bms_rx_stats() const;
+    ring_stats get_charger_rx_stats(uint8_t unit) const;
+    const control_tx_stats& get_control_stats() const;
+    const comm_link_stats& get_comm_link_stats(comm_link link) const;
+    const light_stats& get_light_stats() const;
     void check_faults();
-    void update_state_connected();
-    void update_state_disconnected();
-    void state_action();
-    void broadcast_charger_can();
-    void broadcast_car_can();
-    void pwm_measure();
+    const state_stats& get_state_stats(charge_state state) const;
+    uint32_t get_state_residency(charge_state state) const;
+    uint8_t get_transition_count() const;
+    const state_transition<Application, charge_state>& get_transition(
+        uint8_t i) const;
+    uint32_t get_transition_taken(uint8_t i) const;
+    void scheduler_tick();
+    void send_charger_control();
+    void send_control_updates();
+    void send_bms_request();
+    void send_charger_state();
 
     void can1_rx_callback(void);
+    void can1_rx1_callback(void);
     void can1_tx_callback(void);
 
     CAN_HandleTypeDef* get_can1_handle();
@@ -95,7 +248,10 @@ class Application : public ApplicationBase {
 
     CAN_HandleTypeDef* get_can2_handle();
 
-    TIM_HandleTypeDef* get_pwm_handle();
+    void prox_callback(void);
+    void telemetry_tick(void);
+    void step_lights(void);
+    void debounce_prox(void);
 };
 }  // namespace charger
 }  // namespace umnsvp
@@ -1,17 +1,35 @@
 #pragma once
 
-#include <optional>
+#include <array>
 
 #include "battery_charging_limits.h"
+#include "bxcan.h"
+#include "comm_timeouts.h"
 #include "hal.h"
 #include "limits"
 #include "pwm_driver.h"
+#include "quantity.h"
 #include "skylab2_boards.h"
+#include "spsc_ring.h"
 #include "thunderstruck.h"
 #include "thunderstruck_constants.h"
 
 namespace umnsvp {
 namespace charger {
+// The shared battery limits, in the resolution the BMS reports each value in
+static constexpr centi_volts PACK_VOLTAGE_MAX =
+    centi_volts::from(BATTERY_VOLTAGE_MAX);
+static constexpr centi_volts PACK_VOLTAGE_MIN =
+    centi_volts::from(BATTERY_VOLTAGE_MIN);
+static constexpr centi_volts PACK_VOLTAGE_CHARGING_TARGET =
+    centi_volts::from(BATTERY_VOLTAGE_CHARGING_TARGET);
+static constexpr milli_volts CELL_VOLTAGE_CHARGING_TARGET =
+    milli_volts::from(CELL_CHARGE_TARGET_VOLTAGE);
+static constexpr centi_celsius CELL_TEMP_CHARGING_LIMIT =
+    centi_celsius::from(CHARGING_TEMP_LIMIT_FOR_BATTERY);
+static constexpr milli_amps PACK_CURRENT_CHARGING_TARGET =
+    milli_amps::from(BATTERY_CURRENT_CHARGING_TARGET);
+
 /**
  * @brief Enum describing BMS faults
  *
@@ -26,6 +44,35 @@ enum class bms_fault_type : uint8_t
     BMS_CAN_TIMEOUT = 0b1 << 4
 };
 
+/**
+ * @brief BMS packets the charger listens to. Each has a dirty bit, set when
+ * a new frame arrives and cleared when the main loop decodes it, except
+ * MEASUREMENT, which is queued so pack energy is integrated over every frame.
+ *
+ */
+enum class bms_packet : uint8_t
+{
+    MEASUREMENT,
+    BATTERY_STATUS,
+    MODULE_MIN_MAX,
+    CAPACITY,
+    CHARGER_RESPONSE,
+    COUNT
+};
+
+// BMS measurement frames kept until the main loop reads them, 0 for only the
+// latest
+static constexpr size_t BMS_MEASUREMENT_RX_DEPTH = 8;
+
+/**
+ * @brief A raw BMS frame and the tick it arrived at.
+ *
+ */
+struct bms_rx_frame {
+    uint8_t data[8];
+    uint32_t tick;
+};
+
 /**
  * @brief This class is the main driver for battery communication abstraction
  * between the charger and battery.
@@ -34,46 +81,69 @@ enum class bms_fault_type : uint8_t
 
 class Bms {
    private:
-    // conversion factor from 10mV to V for CAN packet resolution
-    static constexpr float PACK_VOLTAGE_CONVERSION = 0.01;
-    // conversion factor from mV to V for CAN packet resolution
-    static constexpr float CELL_VOLTAGE_CONVERSION = 0.001;
-    // conversion factor from 100 degree C to degree C for CAN packet resolution
-    static constexpr float CELL_TEMP_CONVERSION = 0.01;
     // max milliseconds between packets before comms are considered dead
     static constexpr uint32_t TIMEOUT = 2500;
 
     bool charging_ready = false;
     bool charging_requested = false;
-    float max_cell_voltage = MAX_CELL_VOLTAGE;              // volts
-    float max_cell_temp = CHARGING_TEMP_LIMIT_FOR_BATTERY;  // Celsius
-    float pack_voltage = BATTERY_VOLTAGE_MAX;               // volts
+    // kept in the CAN packet resolutions: 1 mV cells, 10 mV pack, 0.01 C
+    milli_volts max_cell_voltage = milli_volts::from(MAX_CELL_VOLTAGE);
+    centi_celsius max_cell_temp = CELL_TEMP_CHARGING_LIMIT;
+    centi_volts pack_voltage = PACK_VOLTAGE_MAX;
     bool killed = false;
-    float current_battery_pack_capacity = 0;
-    float battery_current = 0;
-
-    std::optional<uint32_t> received_min_max = std::nullopt;
-    std::optional<uint32_t> received_charging_ready = std::nullopt;
-    std::optional<uint32_t> received_killed = std::nullopt;
-    std::optional<uint32_t> received_pack_voltage = std::nullopt;
+    float current_battery_pack_capacity = 0;  // kWh
+    milli_amps battery_current;
+    // pack energy counts are 10 mV x 1 mA x 1 ms
+    static constexpr float PACK_ENERGY_PER_WH = 3.6e11f;
+    int64_t pack_energy = 0;
 
     skylab2::charger_can &skylab2;
+    // refreshed as each tracked packet is decoded
+    CommTimeouts &timeouts;
+
+    // latest raw frame of each packet, stamped with the tick it arrived at,
+    // and which ones are new, written by the CAN1 RX interrupt
+    bms_rx_frame rx_frames[static_cast<uint8_t>(bms_packet::COUNT)];
+    volatile uint32_t dirty = 0;
+    // HV_KILL or BATTERY_OVERVOLT seen by the CAN1 RX interrupt, until
+    // check_current_fault() reports it
+    volatile bms_fault_type urgent_fault = bms_fault_type::NONE;
+    rx_queue<bms_rx_frame, BMS_MEASUREMENT_RX_DEPTH> measurement_rx;
+
+    void decode_measurement(const uint8_t *data, uint32_t tick);
+    void decode_battery_status(const uint8_t *data, uint32_t tick);
+    void decode_module_min_max(const uint8_t *data, uint32_t tick);
+    void decode_capacity(const uint8_t *data);
+    void decode_charger_response(const uint8_t *data, uint32_t tick);
 
    public:
-    Bms(skylab2::charger_can &skylab2);
+    // CAN ID of each bms_packet, in bms_packet order
+    static constexpr std::array<skylab2::CANPacketId,
+                                static_cast<size_t>(bms_packet::COUNT)>
+        RX_IDS = {skylab2::CANPacketId::CAN_PACKET_BMS_MEASUREMENT,
+                  skylab2::CANPacketId::CAN_PACKET_BATTERY_STATUS,
+                  skylab2::CANPacketId::CAN_PACKET_BMS_MODULE_MIN_MAX,
+                  skylab2::CANPacketId::CAN_PACKET_BMS_CAPACITY,
+                  skylab2::CANPacketId::CAN_PACKET_BMS_CHARGER_RESPONSE};
+
+    Bms(skylab2::charger_can &skylab2, CommTimeouts &timeouts);
     void can_send_charging_request_status();
     void set_charging_request_true();
     void set_charging_request_false();
-    bool check_ready_to_charge();
-    float get_max_cell_voltage() const;
-    float get_max_cell_temp() const;
-    float get_pack_voltage() const;
+    bool check_ready_to_charge() const;
+    milli_volts get_max_cell_voltage() const;
+    centi_celsius get_max_cell_temp() const;
+    centi_volts get_pack_voltage() const;
     bool check_battery_killed();
     bms_fault_type check_current_fault();
+    bool receive(const can::packet &p);
+    bms_fault_type get_urgent_fault() const;
     void update_can_values();
     bool check_comms_alive();
     float get_battery_capacity() const;
-    float get_battery_current() const;
+    milli_amps get_battery_current() const;
+    float get_pack_energy() const;
+    ring_stats get_rx_stats() const;
 };
 
 }  // namespace charger
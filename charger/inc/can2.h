@@ -1,14 +1,47 @@
 
 #pragma once
 
+#include <optional>
+
 #include "bxcan.h"
+#include "can_filters.h"
 #include "circular_buffer.h"
 #include "hal.h"
 #include "skylab2_packets.h"
-#include "triple_buffer.h"
+#include "spsc_ring.h"
+#include "thunderstruck_constants.h"
+#include "thunderstruck_frames.h"
 
 namespace umnsvp {
 namespace charger {
+/**
+ * @brief Counters for the CAN2 transmit queue.
+ * enqueued: frames accepted for sending
+ * coalesced: control frames replaced by a newer one before they were sent
+ * dropped: frames refused because the queue was full
+ * retried: sends that found every mailbox busy and waited for TX complete
+ *
+ */
+struct tx_queue_stats {
+    uint32_t enqueued = 0;
+    uint32_t coalesced = 0;
+    uint32_t dropped = 0;
+    uint32_t retried = 0;
+};
+
+// status frames kept per charger until the main loop reads them, 0 for only
+// the latest; each unit reports every 100 ms
+static constexpr size_t THUNDERSTRUCK_STATUS_RX_DEPTH = 8;
+
+/**
+ * @brief A charger status frame and the tick it arrived at.
+ *
+ */
+struct thunderstruck_status_rx {
+    skylab2::can_packet_thunderstruck_status_message msg;
+    uint32_t tick;
+};
+
 /**
  * @brief Abstraction of charger control board and thunderstrucks.
  *
@@ -17,21 +50,38 @@ class CAN2Device {
    private:
     can::bxcan_driver can_device;
     umnsvp::circular_buffer::CircularBuffer<can::packet, 75> tx_buffer;
+    // newest control message per charger waiting for a mailbox, only the
+    // latest setpoint matters so it is replaced rather than queued behind a
+    // stale one
+    std::optional<can::packet> pending_control[NUMBER_CHARGERS];
+    uint8_t next_control = 0;  // unit to look at first, for round robin
+    bool control_sent_last = false;
+    tx_queue_stats tx_stats;
+
+    can::status enqueue(const can::packet& p,
+                        std::optional<uint8_t> control_unit);
+    std::optional<uint8_t> next_pending_control();
+    void drain_tx();
+    bool tx_pending();
 
    public:
+    // frames let through the CAN2 filters: each charger's status
+    static constexpr std::array<uint32_t, NUMBER_CHARGERS> RX_IDS =
+        thunderstruck_frames::status_ids<NUMBER_CHARGERS>();
+
     void start();
     void tx_handler();
-    triple_buffer::TripleBuffer<
-        skylab2::can_packet_thunderstruck_control_message>
-        thunderstruck_control_message_buffer;
-    triple_buffer::TripleBuffer<
-        skylab2::can_packet_thunderstruck_status_message>
-        thunderstruck_status_message_buffer;
+    const tx_queue_stats& get_tx_stats() const;
+    // status from each charger, indexed by unit
+    rx_queue<thunderstruck_status_rx, THUNDERSTRUCK_STATUS_RX_DEPTH>
+        thunderstruck_status_message_buffer[NUMBER_CHARGERS];
     CAN2Device();
     CAN_HandleTypeDef* get_handle();
     void receive();
     can::status send_thunderstruck_control_message(
-        skylab2::can_packet_thunderstruck_control_message msg);
+        skylab2::can_packet_thunderstruck_control_message msg, uint8_t unit);
+    can::status send_thunderstruck_control_frame(const uint8_t* payload,
+                                                 uint8_t unit);
     can::status send_thunderstruck_status_message(
         skylab2::can_packet_thunderstruck_status_message msg);
 };
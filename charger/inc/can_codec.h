@@ -0,0 +1,179 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <ratio>
+#include <type_traits>
+#include <utility>
+
+#include "bxcan.h"
+#include "quantity.h"
+
+namespace umnsvp {
+namespace charger {
+namespace can_codec {
+
+enum class byte_order : uint8_t
+{
+    LITTLE,
+    BIG
+};
+
+/**
+ * @brief Compile time description of one field in a CAN frame, bound to the
+ * packet struct member that holds its raw value.
+ *
+ * @tparam Member Pointer to the raw value in the packet struct.
+ * @tparam Offset First byte of the field in the frame.
+ * @tparam Width Field width in bytes.
+ * @tparam Order Byte order on the wire.
+ * @tparam Scale Physical units per raw count, as a std::ratio.
+ * @tparam Bias Physical value of a raw 0, as a std::ratio.
+ */
+template <auto Member, uint8_t Offset, uint8_t Width,
+          byte_order Order = byte_order::LITTLE, class Scale = std::ratio<1>,
+          class Bias = std::ratio<0>>
+class field {
+   private:
+    template <class T, class M>
+    static M member_type(M T::*);
+    template <class T, class M>
+    static T owner_type(M T::*);
+
+    template <size_t I>
+    static constexpr uint8_t shift() {
+        return 8 * (Order == byte_order::LITTLE ? I : Width - 1 - I);
+    }
+
+    // a ratio of whole units as counts of 1/PerUnit
+    template <class Ratio, int32_t PerUnit>
+    static constexpr int32_t in_counts() {
+        static_assert(Ratio::num * PerUnit % Ratio::den == 0,
+                      "scale and bias must be whole counts at this resolution");
+        return static_cast<int32_t>(Ratio::num * PerUnit / Ratio::den);
+    }
+
+    template <size_t... I>
+    static constexpr void pack_bytes(uint64_t raw, uint8_t* data,
+                                     std::index_sequence<I...>) {
+        ((data[Offset + I] = static_cast<uint8_t>(raw >> shift<I>())), ...);
+    }
+
+    template <size_t... I>
+    static constexpr uint64_t unpack_bytes(const uint8_t* data,
+                                           std::index_sequence<I...>) {
+        return ((static_cast<uint64_t>(data[Offset + I]) << shift<I>()) | ...);
+    }
+
+   public:
+    using raw_type = decltype(member_type(Member));
+    using message_type = decltype(owner_type(Member));
+    static constexpr uint8_t offset = Offset;
+    static constexpr uint8_t width = Width;
+    // one bit per byte of the frame this field occupies
+    static constexpr uint8_t byte_mask = ((1u << Width) - 1) << Offset;
+
+    static_assert(std::is_integral_v<raw_type>, "raw values are integers");
+    static_assert(Width > 0 && Width <= sizeof(raw_type),
+                  "field wider than the member that holds it");
+    static_assert(Offset + Width <= 8, "field runs past the end of a frame");
+
+    static constexpr void pack(const message_type& msg, uint8_t* data) {
+        pack_bytes(static_cast<uint64_t>(msg.*Member), data,
+                   std::make_index_sequence<Width>{});
+    }
+
+    static constexpr void unpack(message_type& msg, const uint8_t* data) {
+        msg.*Member = static_cast<raw_type>(
+            unpack_bytes(data, std::make_index_sequence<Width>{}));
+    }
+
+    /**
+     * @brief Convert a raw value to a quantity. Integer math; Scale and Bias
+     * must be whole counts at the quantity's resolution.
+     *
+     * @tparam Q The quantity type to read the value as, e.g. deci_amps.
+     */
+    template <class Q>
+    static constexpr Q to_physical(raw_type raw) {
+        return Q(static_cast<int32_t>(raw) * in_counts<Scale, Q::per_unit>() +
+                 in_counts<Bias, Q::per_unit>());
+    }
+
+    /**
+     * @brief Convert a quantity to raw counts, truncating toward zero like
+     * the casts it replaces.
+     *
+     */
+    template <class Unit, int32_t PerUnit>
+    static constexpr raw_type from_physical(quantity<Unit, PerUnit> value) {
+        return static_cast<raw_type>(
+            (value.count() - in_counts<Bias, PerUnit>()) /
+            in_counts<Scale, PerUnit>());
+    }
+};
+
+/**
+ * @brief Compile time description of a whole CAN frame.
+ *
+ * @tparam Message The packet struct the fields live in.
+ * @tparam Id CAN identifier.
+ * @tparam Length Data length code.
+ * @tparam Extended True for a 29 bit identifier.
+ * @tparam Fields field<> descriptors, in any order, that must not overlap.
+ */
+template <class Message, uint32_t Id, uint8_t Length, bool Extended,
+          class... Fields>
+class frame {
+   private:
+    static constexpr bool disjoint() {
+        uint8_t used = 0;
+        for (uint8_t mask : {Fields::byte_mask...}) {
+            if (used & mask) {
+                return false;
+            }
+            used |= mask;
+        }
+        return true;
+    }
+
+   public:
+    static constexpr uint32_t id = Id;
+    static constexpr uint8_t length = Length;
+    static constexpr bool extended = Extended;
+
+    static_assert(Length <= 8, "classic CAN frames carry at most 8 bytes");
+    static_assert((std::is_same_v<typename Fields::message_type, Message> &&
+                   ...),
+                  "every field must belong to this frame's message");
+    static_assert(((Fields::offset + Fields::width <= Length) && ...),
+                  "field runs past the frame length");
+    static_assert(disjoint(), "fields overlap");
+
+    static constexpr void pack(const Message& msg, uint8_t* data) {
+        (Fields::pack(msg, data), ...);
+    }
+
+    static constexpr Message unpack(const uint8_t* data) {
+        Message msg = {};
+        (Fields::unpack(msg, data), ...);
+        return msg;
+    }
+
+    /**
+     * @brief Encode a message into a frame.
+     *
+     * @param msg The message to encode.
+     * @param id CAN ID, for frames whose ID carries an address.
+     * @return can::packet
+     */
+    static can::packet to_packet(const Message& msg, uint32_t id = Id) {
+        uint8_t data[8] = {0};
+        pack(msg, data);
+        return can::packet(id, Length, data, Extended);
+    }
+};
+
+}  // namespace can_codec
+}  // namespace charger
+}  // namespace umnsvp
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+#include "hal.h"
+
+namespace umnsvp {
+namespace charger {
+/**
+ * @brief bxCAN acceptance filters built at compile time from the IDs each
+ * subsystem consumes, so only those frames reach a FIFO and raise an RX
+ * interrupt. The F405 shares 28 filter banks between the two CAN instances:
+ * CAN1 owns banks below CAN2_FIRST_BANK and CAN2 the rest.
+ *
+ */
+namespace can_filters {
+
+static constexpr uint32_t CAN2_FIRST_BANK = 14;
+static constexpr uint32_t NUM_BANKS = 28;
+
+/**
+ * @brief An ID as laid out in a 32 bit filter register: STID in bits 21-31
+ * or EXID in bits 3-31 with IDE set, RTR clear.
+ *
+ */
+constexpr uint32_t filter_register(uint32_t id, bool extended) {
+    return extended ? (id << 3) | 0b100 : id << 21;
+}
+
+/**
+ * @brief Filter banks in 32 bit ID list mode, two IDs per bank; an odd ID
+ * out fills both slots of its bank.
+ *
+ * @param ids IDs to accept, any integer or enum type.
+ * @param extended True if the IDs are 29 bit.
+ * @param fifo CAN_FILTER_FIFO0 or CAN_FILTER_FIFO1.
+ * @param first_bank Bank to start at.
+ * @return std::array<CAN_FilterTypeDef, (N + 1) / 2>
+ */
+template <class T, size_t N>
+constexpr std::array<CAN_FilterTypeDef, (N + 1) / 2> id_list(
+    const std::array<T, N> &ids, bool extended, uint32_t fifo,
+    uint32_t first_bank) {
+    std::array<CAN_FilterTypeDef, (N + 1) / 2> banks = {};
+    for (size_t i = 0; i < banks.size(); i++) {
+        const uint32_t first =
+            filter_register(static_cast<uint32_t>(ids[2 * i]), extended);
+        const uint32_t second =
+            2 * i + 1 < N ? filter_register(
+                                static_cast<uint32_t>(ids[2 * i + 1]), extended)
+                          : first;
+        CAN_FilterTypeDef &bank = banks[i];
+        bank.FilterIdHigh = first >> 16;
+        bank.FilterIdLow = first & 0xFFFF;
+        bank.FilterMaskIdHigh = second >> 16;
+        bank.FilterMaskIdLow = second & 0xFFFF;
+        bank.FilterFIFOAssignment = fifo;
+        bank.FilterBank = first_bank + i;
+        bank.FilterMode = CAN_FILTERMODE_IDLIST;
+        bank.FilterScale = CAN_FILTERSCALE_32BIT;
+        bank.FilterActivation = ENABLE;
+        bank.SlaveStartFilterBank = CAN2_FIRST_BANK;
+    }
+    return banks;
+}
+
+/**
+ * @brief Load filter banks into the peripheral. Loading bank 0 (CAN1) or
+ * CAN2_FIRST_BANK (CAN2) replaces the accept-all filter set by
+ * bxcan_driver::filter_all().
+ *
+ */
+template <size_t N>
+void configure(CAN_HandleTypeDef *handle,
+               const std::array<CAN_FilterTypeDef, N> &banks) {
+    for (const CAN_FilterTypeDef &bank : banks) {
+        CAN_FilterTypeDef config = bank;
+        HAL_CAN_ConfigFilter(handle, &config);
+    }
+}
+
+}  // namespace can_filters
+}  // namespace charger
+}  // namespace umnsvp
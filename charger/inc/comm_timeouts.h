@@ -0,0 +1,130 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+
+#include "thunderstruck_constants.h"
+
+namespace umnsvp {
+namespace charger {
+
+/**
+ * @brief Links the charger expects regular frames on. Each charger's status
+ * frames are a link of their own, from CHARGER_STATUS on.
+ *
+ */
+enum class comm_link : uint8_t
+{
+    BMS_MEASUREMENT,
+    BMS_BATTERY_STATUS,
+    BMS_MIN_MAX,
+    BMS_CHARGER_RESPONSE,
+    CHARGER_STATUS,
+    COUNT = CHARGER_STATUS + NUMBER_CHARGERS
+};
+
+constexpr comm_link charger_status_link(uint8_t unit) {
+    return static_cast<comm_link>(
+        static_cast<uint8_t>(comm_link::CHARGER_STATUS) + unit);
+}
+
+// bit of a link in the masks taken by CommTimeouts
+constexpr uint32_t link_bit(comm_link link) {
+    return 0b1 << static_cast<uint8_t>(link);
+}
+
+/**
+ * @brief Counters of one link.
+ * expiries: times it went quiet for longer than its timeout
+ * worst_gap: longest time between two of its frames, in ms
+ *
+ */
+struct comm_link_stats {
+    uint32_t expiries = 0;
+    uint32_t worst_gap = 0;
+};
+
+/**
+ * @brief Receive timeouts of every link, in one place. A link's deadline is
+ * pushed back each time a frame arrives on it, and the armed deadlines are
+ * kept in a min-heap, so poll() only looks at the earliest one unless
+ * something has expired. A link counts as alive from its first frame until
+ * its deadline passes, and as expired from then until its next frame.
+ * Main loop only.
+ *
+ */
+class CommTimeouts {
+   private:
+    static constexpr uint8_t LINKS = static_cast<uint8_t>(comm_link::COUNT);
+    static_assert(LINKS <= 32, "link masks are 32 bits");
+    static constexpr uint8_t NOT_ARMED = 0xFF;
+
+    std::array<uint32_t, LINKS> timeouts = {};  // ms, 0 if not tracked
+    std::array<uint32_t, LINKS> deadlines = {};  // tick
+    std::array<uint32_t, LINKS> last_frames = {};  // tick
+    // armed links, earliest deadline first, and where each link sits in it
+    std::array<uint8_t, LINKS> heap = {};
+    std::array<uint8_t, LINKS> positions = {};
+    uint8_t armed = 0;
+    uint32_t heard_links = 0;  // one bit per link heard from at least once
+    uint32_t alive_links = 0;
+    std::array<comm_link_stats, LINKS> stats = {};
+
+    bool earlier(uint8_t a, uint8_t b) const;
+    void swap(uint8_t i, uint8_t j);
+    void sift_up(uint8_t i);
+    void sift_down(uint8_t i);
+    void remove(uint8_t i);
+    bool expire(uint32_t now);
+
+   public:
+    CommTimeouts();
+    void track(comm_link link, uint32_t timeout);
+    void refresh(comm_link link, uint32_t tick);
+    void forget(comm_link link);
+    uint32_t last_frame(comm_link link) const;
+    const comm_link_stats &get_stats(comm_link link) const;
+
+    // The checks below run several times a pass, so they stay inline.
+
+    /**
+     * @brief Expire every link whose deadline has passed. Call once per main
+     * loop pass, before anything asks whether a link is alive. Only the
+     * earliest deadline is looked at unless one has passed.
+     *
+     * @param now Current tick.
+     * @return true If a link expired on this call.
+     */
+    bool poll(uint32_t now) {
+        if (armed == 0 ||
+            static_cast<int32_t>(now - deadlines[heap[0]]) < 0) {
+            return false;
+        }
+        return expire(now);
+    }
+
+    bool heard(comm_link link) const {
+        return heard_links & link_bit(link);
+    }
+
+    bool alive(comm_link link) const {
+        return alive_links & link_bit(link);
+    }
+
+    // true if every link in the mask is alive
+    bool all_alive(uint32_t links) const {
+        return (alive_links & links) == links;
+    }
+
+    bool any_alive(uint32_t links) const {
+        return (alive_links & links) != 0;
+    }
+
+    // true if a link in the mask was heard from and has since gone quiet
+    bool any_expired(uint32_t links) const {
+        return (heard_links & ~alive_links & links) != 0;
+    }
+};
+
+}  // namespace charger
+}  // namespace umnsvp
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <cstdint>
+
+#include "quantity.h"
+
+namespace umnsvp {
+namespace charger {
+
+/**
+ * @brief PI gains in 1/REGULATOR_GAIN_ONE, per control period for ki.
+ *
+ */
+struct regulator_gains {
+    int32_t kp;
+    int32_t ki;
+};
+
+static constexpr int32_t REGULATOR_GAIN_ONE = 256;
+// tuned with bench_current_regulator on the host models of the chargers and
+// pack
+static constexpr regulator_gains REGULATOR_GAINS = {64, 64};
+// chargers reporting this close to the last command have finished slewing
+static constexpr deci_amps REGULATOR_TRACKING_BAND = deci_amps(10);
+
+/**
+ * @brief Feed-forward plus PI regulator of battery current. The setpoint is
+ * fed forward as the charger command, and the PI terms make up whatever the
+ * pack doesn't see of it, e.g. the car's low voltage load on the charger
+ * output.
+ *
+ * The command never goes past [0, ceiling], the most the EVSE and the
+ * chargers allow. The integrator is held inside the same range, so it can't
+ * wind up while the ceiling is the limit and recovers at once when it isn't.
+ * The error is taken against the target the last command was sent for,
+ * since that is what the measurement shows the result of. The chargers also
+ * slew only a few amps a period, so after a step the error is mostly the ramp
+ * still to come; the PI terms hold until the chargers report they have
+ * reached the last command.
+ *
+ * All integer math; the integrator keeps REGULATOR_GAIN_ONE fractional counts
+ * per 0.1 A so small errors still accumulate.
+ *
+ */
+class CurrentRegulator {
+   private:
+    regulator_gains gains;
+    int32_t integral = 0;  // deci-amps * REGULATOR_GAIN_ONE
+    deci_amps target;      // setpoint inside [0, ceiling] of the last command
+    deci_amps output;
+
+   public:
+    explicit CurrentRegulator(regulator_gains gains = REGULATOR_GAINS);
+    void reset(deci_amps setpoint, deci_amps ceiling);
+    deci_amps update(deci_amps setpoint, deci_amps measured,
+                     deci_amps ceiling, deci_amps charger_output);
+    deci_amps get_output() const;
+};
+
+}  // namespace charger
+}  // namespace umnsvp
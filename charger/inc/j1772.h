@@ -3,15 +3,36 @@
 
 #include "hal.h"
 #include "pwm_driver.h"
+#include "quantity.h"
 
 static GPIO_TypeDef* const PROX_PORT = GPIOA;
 constexpr uint16_t PROX_PIN = GPIO_PIN_6;
+constexpr IRQn_Type PROX_IRQn = EXTI9_5_IRQn;
 
 static GPIO_TypeDef* const CONTROL_PORT = GPIOA;
 constexpr uint16_t CONTROL_PIN = GPIO_PIN_4;
 
 namespace umnsvp {
 namespace charger {
+
+// how long the proximity pin must hold a level before it counts
+static constexpr uint32_t PROX_DEBOUNCE_TIME = 20;  // ms
+// how often a pending proximity change is checked for
+static constexpr uint16_t PROX_DEBOUNCE_PERIOD = 5;  // ms
+
+/**
+ * @brief Proximity pin counters.
+ * edges: pin edges taken by the EXTI interrupt
+ * bounces: edges undone or superseded within PROX_DEBOUNCE_TIME
+ * changes: debounced plugs and unplugs
+ *
+ */
+struct prox_stats {
+    uint32_t edges = 0;
+    uint32_t bounces = 0;
+    uint32_t changes = 0;
+};
+
 /**
  * @brief Abstraction for communication between J1772 and charger board.
  *
@@ -19,15 +40,27 @@ namespace charger {
 class J1772 {
    private:
     pwm_driver pwm;
+    // debounced proximity, and the edges that may change it
+    volatile bool prox_connected = false;
+    volatile bool prox_settling = false;
+    volatile uint32_t prox_first_edge = 0;  // tick, of the pending change
+    volatile uint32_t prox_last_edge = 0;   // tick
+    volatile uint32_t prox_pending_edges = 0;
+    uint32_t prox_changed_at = 0;  // tick of the first edge of the last change
+    prox_stats prox_counts;
 
    public:
     J1772() {
     }
-    void measure_control_pilot_duty();
-    float get_j1772_current_limit();
-    TIM_HandleTypeDef* get_pwm_timer_handle();
+    void update_control_pilot();
+    deci_amps get_j1772_current_limit();
+    uint16_t get_pilot_duty() const;
     void init();
-    bool check_prox_connected();
+    bool check_prox_connected() const;
+    bool prox_edge(uint32_t tick);
+    bool debounce_prox(uint32_t now);
+    uint32_t get_prox_changed_at() const;
+    const prox_stats& get_prox_stats() const;
     void output_ac();
     void isolate_interface();
 };
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+
+#include "pwm_driver.h"
+#include "quantity.h"
+
+namespace umnsvp {
+namespace charger {
+namespace j1772_table {
+
+/**
+ * @brief Current limit signalled by the control pilot.
+ *
+ */
+struct pilot_limit {
+    deci_amps current;
+    // frequency and duty cycle are inside a SAE J1772 Table 6 band
+    bool valid;
+};
+
+// pilot periods, in capture counts, that are within 600-1400 Hz
+static constexpr uint16_t PERIOD_MIN =
+    (pwm_driver::timer_ref_clock + 1400 - 1) / 1400;
+static constexpr uint16_t PERIOD_MAX = pwm_driver::timer_ref_clock / 600;
+// duty cycle steps per 100 %. 0.05 % steps put the 10, 86 and 96 % band
+// edges on step boundaries and keep each step under 0.1 A.
+static constexpr uint16_t DUTY_STEPS = 2000;
+
+namespace detail {
+static constexpr uint16_t VALID = 0b1 << 15;
+static constexpr uint16_t CURRENT_MASK = VALID - 1;
+
+/**
+ * @brief Table 6 at the middle of a duty cycle step, with the same float
+ * bands and formulas J1772 used before the table.
+ *
+ */
+constexpr uint16_t entry(uint16_t step) {
+    const float duty_cycle = (step + 0.5f) / DUTY_STEPS;
+    if (duty_cycle > 0.1f && duty_cycle < 0.86f) {
+        return VALID | deci_amps::from(duty_cycle * 60).count();
+    }
+    if (duty_cycle >= 0.86f && duty_cycle <= 0.96f) {
+        return VALID | deci_amps::from((duty_cycle * 100 - 64) * 2.5f).count();
+    }
+    return 0;
+}
+
+constexpr std::array<uint16_t, DUTY_STEPS> make_table() {
+    std::array<uint16_t, DUTY_STEPS> table = {};
+    for (uint16_t step = 0; step < DUTY_STEPS; step++) {
+        table[step] = entry(step);
+    }
+    return table;
+}
+}  // namespace detail
+
+// deci-amps and the valid bit for each duty cycle step
+inline constexpr std::array<uint16_t, DUTY_STEPS> TABLE = detail::make_table();
+
+/**
+ * @brief Current limit for a pilot measured in TIM1 capture counts. A bounds
+ * check on the period, one integer divide for the duty cycle step and a
+ * table lookup.
+ *
+ * @param period Pilot period, counts.
+ * @param high_time Time the pilot is high each period, counts.
+ */
+constexpr pilot_limit decode(uint16_t period, uint16_t high_time) {
+    if (period < PERIOD_MIN || period > PERIOD_MAX || high_time >= period) {
+        return {deci_amps(0), false};
+    }
+    const uint16_t entry =
+        TABLE[static_cast<uint32_t>(high_time) * DUTY_STEPS / period];
+    return {deci_amps(entry & detail::CURRENT_MASK),
+            (entry & detail::VALID) != 0};
+}
+
+}  // namespace j1772_table
+}  // namespace charger
+}  // namespace umnsvp
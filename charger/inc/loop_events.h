@@ -0,0 +1,75 @@
+#pragma once
+
+#include <cstdint>
+
+#include "hal.h"
+
+namespace umnsvp {
+namespace charger {
+/**
+ * @brief Sources that wake the main loop. Interrupts post these, the main
+ * loop consumes them all at once.
+ *
+ */
+enum class loop_event : uint32_t
+{
+    NONE = 0,
+    CHARGER_RX = 0b1 << 0,    // Thunderstruck status on CAN2
+    CAR_RX = 0b1 << 1,        // BMS and car bus traffic on CAN1
+    CHARGER_TICK = 0b1 << 2,  // control packet period
+    CAR_TICK = 0b1 << 3,      // car CAN state broadcast period
+    PROX = 0b1 << 4,          // debounced proximity change
+    PROFILE = 0b1 << 5,       // profile summary requested on CAN1
+    TELEMETRY = 0b1 << 6,     // sample period or a request on CAN1
+    DEADLINE = 0b1 << 7       // deadline statistics requested on CAN1
+};
+
+constexpr uint32_t operator|(loop_event a, loop_event b) {
+    return static_cast<uint32_t>(a) | static_cast<uint32_t>(b);
+}
+
+constexpr uint32_t operator|(uint32_t a, loop_event b) {
+    return a | static_cast<uint32_t>(b);
+}
+
+constexpr bool operator&(uint32_t events, loop_event e) {
+    return (events & static_cast<uint32_t>(e)) != 0;
+}
+
+/**
+ * @brief Time spent awake and asleep in cycles, and the delay between the
+ * first event of a wakeup being posted and the main loop picking it up.
+ * The cycle counter may stop in WFI, so asleep is the time since init() by
+ * the SysTick, less the time awake.
+ *
+ */
+struct loop_stats {
+    uint64_t awake_cycles = 0;
+    uint64_t asleep_cycles = 0;
+    uint32_t wakeups = 0;
+    uint64_t total_latency_cycles = 0;
+    uint32_t max_latency_cycles = 0;
+};
+
+/**
+ * @brief Event flags between interrupts and the main loop. The main loop
+ * sleeps in WFI until at least one flag is set.
+ *
+ */
+class LoopEvents {
+   private:
+    volatile uint32_t pending = 0;
+    volatile uint32_t first_posted = 0;  // CYCCNT of the first pending post
+    uint32_t woke_at = 0;                // CYCCNT when the last wait returned
+    uint32_t started = 0;                // tick of init()
+    loop_stats stats;
+
+   public:
+    void init();
+    void post(loop_event event);
+    uint32_t wait();
+    loop_stats get_stats() const;
+};
+
+}  // namespace charger
+}  // namespace umnsvp
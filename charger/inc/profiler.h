@@ -0,0 +1,128 @@
+#pragma once
+
+#include <cstdint>
+
+#include "bxcan.h"
+#include "can_codec.h"
+#include "hal.h"
+
+namespace umnsvp {
+namespace charger {
+/**
+ * @brief Code that is timed: the stages of a main loop pass and the
+ * interrupt handlers.
+ *
+ */
+enum class profile_point : uint8_t
+{
+    RECEIVE_STATUS_PACKET,
+    UPDATE_CAN_VALUES,
+    PILOT_UPDATE,
+    CHECK_FAULTS,
+    PROX_READ,
+    UPDATE_STATE,
+    STATE_ACTION,
+    REGULATE_CURRENT,
+    TELEMETRY,
+    CAN1_RX0_ISR,
+    CAN1_RX1_ISR,
+    CAN1_TX_ISR,
+    CAN2_RX1_ISR,
+    CAN2_TX_ISR,
+    TIM6_ISR,
+    EXTI9_5_ISR,
+    COUNT
+};
+
+// car CAN IDs for profile summaries, next to the charger's skylab2 packets
+static constexpr uint32_t PROFILE_REQUEST_ID = 0x57E;
+static constexpr uint32_t PROFILE_REPORT_ID = 0x57F;
+// request byte 0 value asking for every profile point
+static constexpr uint8_t PROFILE_REQUEST_ALL = 0xFF;
+
+#ifdef CHARGER_PROFILE
+
+// bin i counts samples of fewer than 2^i cycles, the last bin the rest
+static constexpr uint8_t PROFILE_HISTOGRAM_BINS = 16;
+// reported cycle counts are divided by 2^PROFILE_REPORT_SHIFT, 100 ns at
+// 160 MHz
+static constexpr uint8_t PROFILE_REPORT_SHIFT = 4;
+
+/**
+ * @brief Summary of one point sent on the car bus. Cycle counts are in units
+ * of 2^PROFILE_REPORT_SHIFT cycles, saturated.
+ *
+ */
+struct profile_report {
+    uint8_t point;
+    uint8_t peak_bin;  // histogram bin with the most samples
+    uint16_t min;
+    uint16_t mean;
+    uint16_t max;
+};
+
+using profile_report_frame = can_codec::frame<
+    profile_report, PROFILE_REPORT_ID, 8, false,
+    can_codec::field<&profile_report::point, 0, 1>,
+    can_codec::field<&profile_report::peak_bin, 1, 1>,
+    can_codec::field<&profile_report::min, 2, 2>,
+    can_codec::field<&profile_report::mean, 4, 2>,
+    can_codec::field<&profile_report::max, 6, 2>>;
+
+/**
+ * @brief Cycle counts for one profile point.
+ *
+ */
+struct profile_stats {
+    uint32_t count = 0;
+    uint32_t min_cycles = UINT32_MAX;
+    uint32_t max_cycles = 0;
+    uint64_t total_cycles = 0;
+    uint32_t histogram[PROFILE_HISTOGRAM_BINS] = {0};
+
+    uint32_t mean_cycles() const;
+};
+
+namespace profiler {
+
+void record(profile_point point, uint32_t cycles);
+profile_stats get(profile_point point);
+void reset();
+can::packet summary(profile_point point);
+
+}  // namespace profiler
+
+/**
+ * @brief Times the enclosing scope with the DWT cycle counter. Started by
+ * LoopEvents::init().
+ *
+ */
+class ProfileScope {
+   private:
+    profile_point point;
+    uint32_t start;
+
+   public:
+    explicit ProfileScope(profile_point point)
+        : point(point), start(DWT->CYCCNT) {
+    }
+    ~ProfileScope() {
+        profiler::record(point, DWT->CYCCNT - start);
+    }
+};
+
+#define PROFILE_CONCAT_(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_(a, b)
+// Time the rest of the enclosing scope as the given profile_point.
+#define PROFILE_SCOPE(point)                    \
+    ::umnsvp::charger::ProfileScope PROFILE_CONCAT( \
+        profile_scope_, __LINE__)(point)
+
+#else
+
+#define PROFILE_SCOPE(point)
+
+#endif
+
+}  // namespace charger
+}  // namespace umnsvp
@@ -1,4 +1,3 @@
-
 #pragma once
 
 #include "hal.h"
@@ -10,21 +9,39 @@ namespace charger {
 /**
  * @brief Class handles PWM and duty cycle.
  *
+ * TIM1 captures the control pilot period (CH1) and low time (CH2) and DMA
+ * copies every capture into a circular buffer, so no interrupt fires per
+ * pilot period. update() turns the captures that arrived since the last call
+ * into one period and high time, in capture counts.
+ *
  */
 
 class pwm_driver {
    private:
+    // captures kept per channel, 64 ms of pilot at 1 kHz with the /2
+    // capture prescaler
+    static constexpr uint16_t PILOT_SAMPLES = 32;
+    // fewer fresh captures than this since the last update means no pilot
+    static constexpr uint16_t PILOT_MIN_SAMPLES = 3;
+
     void duty_cycle_measure_timer_init();
+    void capture_dma_init();
     TIM_HandleTypeDef htim_handle = {0};
-    float duty_cycle;
+    DMA_HandleTypeDef period_dma = {0};
+    DMA_HandleTypeDef low_dma = {0};
+    // written by DMA, update() zeroes the slots it has consumed
+    volatile uint16_t period_samples[PILOT_SAMPLES] = {0};
+    volatile uint16_t low_samples[PILOT_SAMPLES] = {0};
+    // capture counts as of the last update(), 0 without a pilot
+    uint16_t period = 0;
+    uint16_t high_time = 0;
 
    public:
     void init();
-    void measure_duty();
-    uint16_t get_capture_period();
+    void update();
     TIM_HandleTypeDef* get_handler();
-    float get_frequency();
-    float get_duty() const;
+    uint16_t get_period() const;
+    uint16_t get_high_time() const;
     static constexpr uint64_t timer_ref_clock =
         800000;  // reference clock for timer 1 (in MHz)
 };
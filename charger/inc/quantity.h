@@ -0,0 +1,158 @@
+#pragma once
+
+#include <cstdint>
+#include <type_traits>
+
+namespace umnsvp {
+namespace charger {
+
+/**
+ * @brief Units a quantity can carry. Quantities only compare and add within
+ * the same unit.
+ *
+ */
+namespace unit {
+struct volt;
+struct amp;
+struct celsius;
+}  // namespace unit
+
+/**
+ * @brief A physical value held as a whole number of counts, each 1/PerUnit
+ * of the unit. Everything except to_float() is integer math, so telemetry
+ * stays in the resolution it arrives in on CAN and the F405 never touches
+ * soft-float double routines for it.
+ *
+ * Quantities of the same unit at different resolutions compare by moving to
+ * the finer one, which is exact. Going to a coarser resolution truncates and
+ * has to be asked for with quantity_cast.
+ *
+ * @tparam Unit One of the unit tags.
+ * @tparam PerUnit Counts per whole unit, e.g. 10 for deci-units.
+ */
+template <class Unit, int32_t PerUnit>
+class quantity {
+   private:
+    int32_t counts = 0;
+
+   public:
+    using unit_type = Unit;
+    static constexpr int32_t per_unit = PerUnit;
+    static_assert(PerUnit > 0, "resolution must be a positive count per unit");
+
+    constexpr quantity() = default;
+    constexpr explicit quantity(int32_t counts) : counts(counts) {
+    }
+
+    /**
+     * @brief The nearest quantity to a value in whole units. Meant for
+     * compile time constants and values that arrive as floats; it is single
+     * precision all the way.
+     *
+     */
+    static constexpr quantity from(float units) {
+        return quantity(static_cast<int32_t>(units * PerUnit +
+                                             (units < 0 ? -0.5f : 0.5f)));
+    }
+
+    constexpr int32_t count() const {
+        return counts;
+    }
+
+    // value in whole units, for interfaces that carry floats
+    constexpr float to_float() const {
+        return counts * (1.0f / PerUnit);
+    }
+
+    constexpr quantity operator-() const {
+        return quantity(-counts);
+    }
+    constexpr quantity operator+(quantity other) const {
+        return quantity(counts + other.counts);
+    }
+    constexpr quantity operator-(quantity other) const {
+        return quantity(counts - other.counts);
+    }
+    constexpr quantity operator*(int32_t factor) const {
+        return quantity(counts * factor);
+    }
+    // truncates toward zero
+    constexpr quantity operator/(int32_t divisor) const {
+        return quantity(counts / divisor);
+    }
+    quantity &operator+=(quantity other) {
+        counts += other.counts;
+        return *this;
+    }
+    quantity &operator-=(quantity other) {
+        counts -= other.counts;
+        return *this;
+    }
+};
+
+using volts = quantity<unit::volt, 1>;
+using deci_volts = quantity<unit::volt, 10>;
+using centi_volts = quantity<unit::volt, 100>;
+using milli_volts = quantity<unit::volt, 1000>;
+using deci_amps = quantity<unit::amp, 10>;
+using milli_amps = quantity<unit::amp, 1000>;
+using celsius = quantity<unit::celsius, 1>;
+using centi_celsius = quantity<unit::celsius, 100>;
+
+/**
+ * @brief Change resolution. Finer is exact, coarser truncates toward zero.
+ *
+ */
+template <class To, class Unit, int32_t PerUnit>
+constexpr To quantity_cast(quantity<Unit, PerUnit> q) {
+    static_assert(std::is_same_v<typename To::unit_type, Unit>,
+                  "quantity_cast cannot change the unit");
+    static_assert(To::per_unit % PerUnit == 0 || PerUnit % To::per_unit == 0,
+                  "resolutions must be multiples of each other");
+    if constexpr (To::per_unit >= PerUnit) {
+        return To(q.count() * (To::per_unit / PerUnit));
+    } else {
+        return To(q.count() / (PerUnit / To::per_unit));
+    }
+}
+
+namespace detail {
+// the finer of two resolutions of the same unit
+template <class Unit, int32_t A, int32_t B>
+using finer = quantity<Unit, (A > B ? A : B)>;
+}  // namespace detail
+
+template <class Unit, int32_t A, int32_t B>
+constexpr bool operator==(quantity<Unit, A> a, quantity<Unit, B> b) {
+    using common = detail::finer<Unit, A, B>;
+    return quantity_cast<common>(a).count() == quantity_cast<common>(b).count();
+}
+
+template <class Unit, int32_t A, int32_t B>
+constexpr bool operator<(quantity<Unit, A> a, quantity<Unit, B> b) {
+    using common = detail::finer<Unit, A, B>;
+    return quantity_cast<common>(a).count() < quantity_cast<common>(b).count();
+}
+
+template <class Unit, int32_t A, int32_t B>
+constexpr bool operator!=(quantity<Unit, A> a, quantity<Unit, B> b) {
+    return !(a == b);
+}
+
+template <class Unit, int32_t A, int32_t B>
+constexpr bool operator>(quantity<Unit, A> a, quantity<Unit, B> b) {
+    return b < a;
+}
+
+template <class Unit, int32_t A, int32_t B>
+constexpr bool operator<=(quantity<Unit, A> a, quantity<Unit, B> b) {
+    return !(b < a);
+}
+
+template <class Unit, int32_t A, int32_t B>
+constexpr bool operator>=(quantity<Unit, A> a, quantity<Unit, B> b) {
+    return !(a < b);
+}
+
+}  // namespace charger
+}  // namespace umnsvp
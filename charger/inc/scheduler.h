@@ -0,0 +1,208 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+
+#include "hal.h"
+
+namespace umnsvp {
+namespace charger {
+
+// rate of the hardware tick that drives the scheduler, also its time unit
+static constexpr uint32_t SCHEDULER_TICK_RATE = 1000;  // Hz
+
+/**
+ * @brief One periodic job: a member of the scheduler's owner, its period and
+ * the offset of its first release from the start, both in ms.
+ *
+ */
+template <class Owner>
+struct periodic_job {
+    void (Owner::*run)();
+    uint16_t period;
+    uint16_t phase;
+};
+
+/**
+ * @brief Timing of one job in core clock cycles. Jitter is how far the time
+ * from one start to the next strays from the period. A start is timed as its
+ * tick plus the cycles into the tick interrupt, so no count spans a sleep.
+ *
+ */
+struct job_stats {
+    uint32_t runs = 0;
+    // releases dropped because the job was a whole period late
+    uint32_t overruns = 0;
+    uint32_t max_jitter_cycles = 0;
+    uint64_t total_jitter_cycles = 0;  // over runs - 1 intervals
+    uint32_t max_run_cycles = 0;
+};
+
+/**
+ * @brief Runs periodic jobs from one hardware tick, earliest release first.
+ *
+ * Each job has its own period and phase, so frames with the same period can
+ * be spread out instead of going out in one burst, and adding a job needs no
+ * new timer. Time is the number of ticks taken. The cycle counter can stop
+ * while the core sleeps in WFI, so it only times work inside the tick
+ * interrupt. A tick missed because interrupts were masked for longer than
+ * its period is lost: the schedule slips by one tick and whatever fell due
+ * runs on the next one. A job that falls a whole period behind drops the
+ * releases it missed rather than running back to back.
+ *
+ * tick() runs in the timer interrupt. The main loop may only call
+ * request_period(), which takes effect on the next tick, and read stats.
+ *
+ */
+template <class Owner, uint8_t N>
+class PeriodicScheduler {
+   private:
+    Owner &owner;
+    std::array<periodic_job<Owner>, N> jobs;
+    uint32_t now = 0;          // ticks since the first after start()
+    bool running = false;
+    uint32_t tick_entry = 0;   // CYCCNT when the current tick was taken
+    uint32_t cycles_per_tick = 0;
+    std::array<uint32_t, N> release = {};  // ms of the next release
+    std::array<uint8_t, N> order = {};     // job indices by release
+    std::array<uint32_t, N> last_tick = {};    // tick of the last start
+    std::array<uint32_t, N> last_offset = {};  // cycles into that tick
+    std::array<bool, N> started = {};          // last start is valid
+    std::array<job_stats, N> stats = {};
+    std::array<volatile uint16_t, N> requested_period = {};  // 0 for none
+
+    static bool before(uint32_t a, uint32_t b) {
+        return static_cast<int32_t>(a - b) < 0;
+    }
+
+    // move order[from] down the list to its place by release
+    void sift(uint8_t from) {
+        for (uint8_t i = from; i + 1 < N &&
+                               before(release[order[i + 1]], release[order[i]]);
+             i++) {
+            const uint8_t swap = order[i];
+            order[i] = order[i + 1];
+            order[i + 1] = swap;
+        }
+    }
+
+    void sort() {
+        for (uint8_t i = N; i-- > 0;) {
+            sift(i);
+        }
+    }
+
+    void apply_requests(uint32_t now) {
+        bool changed = false;
+        for (uint8_t job = 0; job < N; job++) {
+            const uint16_t period = requested_period[job];
+            if (period != 0) {
+                requested_period[job] = 0;
+                jobs[job].period = period;
+                release[job] = now + period;
+                // no jitter for the interval across the change
+                started[job] = false;
+                changed = true;
+            }
+        }
+        if (changed) {
+            sort();
+        }
+    }
+
+    void run(uint8_t job) {
+        job_stats &s = stats[job];
+        const uint32_t start = DWT->CYCCNT;
+        const uint32_t offset = start - tick_entry;
+        if (started[job]) {
+            // whole ticks off the period, plus the change in offset
+            const int64_t ticks_off =
+                static_cast<int32_t>(now - last_tick[job] - jobs[job].period);
+            const int64_t deviation =
+                ticks_off * cycles_per_tick +
+                (static_cast<int64_t>(offset) - last_offset[job]);
+            const uint32_t jitter =
+                static_cast<uint32_t>(deviation < 0 ? -deviation : deviation);
+            s.total_jitter_cycles += jitter;
+            if (jitter > s.max_jitter_cycles) {
+                s.max_jitter_cycles = jitter;
+            }
+        }
+        last_tick[job] = now;
+        last_offset[job] = offset;
+        started[job] = true;
+        (owner.*jobs[job].run)();
+        const uint32_t run_cycles = DWT->CYCCNT - start;
+        if (run_cycles > s.max_run_cycles) {
+            s.max_run_cycles = run_cycles;
+        }
+        s.runs++;
+
+        release[job] += jobs[job].period;
+        if (!before(now, release[job])) {
+            const uint32_t missed = (now - release[job]) / jobs[job].period + 1;
+            s.overruns += missed;
+            release[job] += missed * jobs[job].period;
+        }
+    }
+
+   public:
+    PeriodicScheduler(Owner &owner,
+                      const std::array<periodic_job<Owner>, N> &jobs)
+        : owner(owner), jobs(jobs) {
+    }
+
+    /**
+     * @brief Set every job's first release relative to the next tick.
+     *
+     */
+    void start() {
+        running = false;
+        now = 0;
+        cycles_per_tick = SystemCoreClock / SCHEDULER_TICK_RATE;
+        for (uint8_t job = 0; job < N; job++) {
+            release[job] = now + jobs[job].phase;
+            order[job] = job;
+            started[job] = false;
+            stats[job] = job_stats();
+        }
+        sort();
+    }
+
+    /**
+     * @brief Run every job that is due, earliest release first. Call from the
+     * tick interrupt.
+     *
+     */
+    void tick() {
+        tick_entry = DWT->CYCCNT;
+        if (!running) {
+            // the first tick is time zero
+            running = true;
+        } else {
+            now++;
+        }
+
+        apply_requests(now);
+        while (!before(now, release[order[0]])) {
+            run(order[0]);
+            sift(0);
+        }
+    }
+
+    /**
+     * @brief Change a job's period from the main loop. The job next runs one
+     * new period after the tick that applies it.
+     *
+     */
+    void request_period(uint8_t job, uint16_t period) {
+        requested_period[job] = period;
+    }
+
+    const job_stats &get_stats(uint8_t job) const {
+        return stats[job];
+    }
+};
+
+}  // namespace charger
+}  // namespace umnsvp
@@ -0,0 +1,126 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+
+#include "triple_buffer.h"
+
+namespace umnsvp {
+namespace charger {
+
+/**
+ * @brief Counters for one receive ring.
+ * overruns: items refused because the consumer had not made room
+ * high_water: most items ever waiting at once
+ *
+ */
+struct ring_stats {
+    uint32_t overruns = 0;
+    uint32_t high_water = 0;
+};
+
+/**
+ * @brief Lock-free FIFO from one producer, such as a CAN RX interrupt, to one
+ * consumer, such as the main loop, so the consumer sees every item rather
+ * than only the latest.
+ *
+ * The producer only writes head and the consumer only writes tail, so
+ * neither side masks interrupts. A push onto a full ring is refused and
+ * counted: the items already queued are kept in order and the consumer sees
+ * the gap after them. Same interface as the triple buffer, so either can sit
+ * behind rx_queue.
+ *
+ * @tparam T Item type, copied in and out.
+ * @tparam N Depth, a power of two so the free running indices wrap cleanly.
+ */
+template <class T, size_t N>
+class SpscRing {
+   private:
+    static_assert(N > 0 && (N & (N - 1)) == 0, "depth must be a power of two");
+
+    T items[N];
+    T front;
+    std::atomic<uint32_t> head{0};  // next slot to write, producer only
+    std::atomic<uint32_t> tail{0};  // next slot to read, consumer only
+    // written by the producer, read anywhere
+    std::atomic<uint32_t> overruns{0};
+    std::atomic<uint32_t> high_water{0};
+
+   public:
+    /**
+     * @brief Queue an item. Producer side.
+     *
+     * @return true If there was room, false if it was dropped.
+     */
+    bool push(const T &item) {
+        const uint32_t h = head.load(std::memory_order_relaxed);
+        const uint32_t waiting = h - tail.load(std::memory_order_acquire);
+        if (waiting >= N) {
+            overruns.store(overruns.load(std::memory_order_relaxed) + 1,
+                           std::memory_order_relaxed);
+            return false;
+        }
+        items[h & (N - 1)] = item;
+        head.store(h + 1, std::memory_order_release);
+        if (waiting + 1 > high_water.load(std::memory_order_relaxed)) {
+            high_water.store(waiting + 1, std::memory_order_relaxed);
+        }
+        return true;
+    }
+
+    /**
+     * @brief Take the oldest item into output(). Consumer side.
+     *
+     * @return true If there was one.
+     */
+    bool pop() {
+        const uint32_t t = tail.load(std::memory_order_relaxed);
+        if (t == head.load(std::memory_order_acquire)) {
+            return false;
+        }
+        front = items[t & (N - 1)];
+        tail.store(t + 1, std::memory_order_release);
+        return true;
+    }
+
+    // the item taken by the last successful pop()
+    const T &output() const {
+        return front;
+    }
+
+    uint32_t size() const {
+        return head.load(std::memory_order_acquire) -
+               tail.load(std::memory_order_acquire);
+    }
+
+    ring_stats get_stats() const {
+        ring_stats stats;
+        stats.overruns = overruns.load(std::memory_order_relaxed);
+        stats.high_water = high_water.load(std::memory_order_relaxed);
+        return stats;
+    }
+};
+
+/**
+ * @brief Receive path for one message type: latest value only for a depth of
+ * 0, otherwise a ring holding that many.
+ *
+ */
+template <class T, size_t Depth>
+using rx_queue = std::conditional_t<Depth == 0, triple_buffer::TripleBuffer<T>,
+                                    SpscRing<T, Depth>>;
+
+template <class T>
+ring_stats get_rx_stats(const triple_buffer::TripleBuffer<T> &) {
+    return ring_stats();  // overwrites are not counted
+}
+
+template <class T, size_t N>
+ring_stats get_rx_stats(const SpscRing<T, N> &ring) {
+    return ring.get_stats();
+}
+
+}  // namespace charger
+}  // namespace umnsvp
@@ -0,0 +1,191 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+namespace umnsvp {
+namespace charger {
+
+/**
+ * @brief Actions of one state, members of the state machine's owner. entry
+ * runs on every transition into the state, exit on every transition out of
+ * it and activity on each pass spent in it. Any of them may be nullptr.
+ *
+ */
+template <class Owner>
+struct state_hooks {
+    void (Owner::*entry)();
+    void (Owner::*exit)();
+    void (Owner::*activity)();
+};
+
+/**
+ * @brief One edge of the state machine, taken when its guard, a member of
+ * the owner, holds.
+ *
+ */
+template <class Owner, class State>
+struct state_transition {
+    State from;
+    State to;
+    bool (Owner::*guard)() const;
+};
+
+/**
+ * @brief Check a transition table at compile time. Every edge needs a guard
+ * and a different state to go to, which also catches rows left empty by a
+ * table longer than its initializer. The edges out of a state must be
+ * together, since their order is their priority.
+ *
+ */
+template <class Owner, class State, size_t N>
+constexpr bool valid_transitions(
+    const std::array<state_transition<Owner, State>, N> &transitions) {
+    for (size_t i = 0; i < N; i++) {
+        const state_transition<Owner, State> &t = transitions[i];
+        if (t.guard == nullptr || t.from == t.to) {
+            return false;
+        }
+        if (i == 0 || t.from == transitions[i - 1].from) {
+            continue;
+        }
+        // the first edge out of t.from, so none may come before it
+        for (size_t j = 0; j < i; j++) {
+            if (transitions[j].from == t.from) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief Time in a state and times it was entered. residency leaves out the
+ * stay in progress, see StateMachine::residency().
+ *
+ */
+struct state_stats {
+    uint32_t entries = 0;
+    uint32_t residency = 0;  // ms
+};
+
+/**
+ * @brief Runs a state machine described by two constexpr tables: the hooks
+ * of each state, indexed by state, and the transitions. Each update() takes
+ * at most one transition, the first in table order whose from is the current
+ * state and whose guard holds, so the table order is the priority of the
+ * edges out of a state.
+ *
+ * The first update() enters the initial state, running its entry hook. Both
+ * update() and run() belong to the main loop.
+ *
+ */
+template <class Owner, class State, uint8_t STATES, uint8_t TRANSITIONS>
+class StateMachine {
+   private:
+    Owner &owner;
+    const std::array<state_hooks<Owner>, STATES> &hooks;
+    const std::array<state_transition<Owner, State>, TRANSITIONS> &transitions;
+    State state;
+    bool started = false;
+    uint32_t entered_at = 0;  // ms
+    std::array<state_stats, STATES> stats = {};
+    std::array<uint32_t, TRANSITIONS> taken = {};
+
+    static uint8_t index(State s) {
+        return static_cast<uint8_t>(s);
+    }
+
+    void call(void (Owner::*hook)()) {
+        if (hook != nullptr) {
+            (owner.*hook)();
+        }
+    }
+
+    void enter(State to, uint32_t now) {
+        state = to;
+        entered_at = now;
+        stats[index(to)].entries++;
+        call(hooks[index(to)].entry);
+    }
+
+   public:
+    StateMachine(
+        Owner &owner, const std::array<state_hooks<Owner>, STATES> &hooks,
+        const std::array<state_transition<Owner, State>, TRANSITIONS>
+            &transitions,
+        State initial)
+        : owner(owner), hooks(hooks), transitions(transitions), state(initial) {
+    }
+
+    /**
+     * @brief Take the first transition out of the current state whose guard
+     * holds, running the exit hook of the old state and then the entry hook
+     * of the new one.
+     *
+     * @param now ms
+     * @return true A transition was taken, or the initial state entered.
+     */
+    bool update(uint32_t now) {
+        if (!started) {
+            started = true;
+            enter(state, now);
+            return true;
+        }
+        for (uint8_t i = 0; i < TRANSITIONS; i++) {
+            const state_transition<Owner, State> &t = transitions[i];
+            if (t.from != state || !(owner.*t.guard)()) {
+                continue;
+            }
+            stats[index(state)].residency += now - entered_at;
+            call(hooks[index(state)].exit);
+            taken[i]++;
+            enter(t.to, now);
+            return true;
+        }
+        return false;
+    }
+
+    /**
+     * @brief Run the current state's activity.
+     *
+     */
+    void run() {
+        call(hooks[index(state)].activity);
+    }
+
+    State get_state() const {
+        return state;
+    }
+
+    const state_stats &get_stats(State s) const {
+        return stats[index(s)];
+    }
+
+    /**
+     * @brief Total time spent in a state, the stay in progress included.
+     *
+     * @param now ms
+     * @return uint32_t ms
+     */
+    uint32_t residency(State s, uint32_t now) const {
+        uint32_t total = stats[index(s)].residency;
+        if (started && s == state) {
+            total += now - entered_at;
+        }
+        return total;
+    }
+
+    const state_transition<Owner, State> &get_transition(uint8_t i) const {
+        return transitions[i];
+    }
+
+    // times transition i of the table was taken
+    uint32_t get_taken(uint8_t i) const {
+        return taken[i];
+    }
+};
+
+}  // namespace charger
+}  // namespace umnsvp
@@ -10,6 +10,9 @@
  */
 #pragma once
 
+#include <array>
+#include <cstdint>
+
 #include "hal.h"
 
 static GPIO_TypeDef* const PORT_COMM_LIGHT_1 = GPIOB;
@@ -32,10 +35,109 @@ constexpr uint16_t CHARGER_CONTACTOR_CLOSE_INDICATOR_LED = GPIO_PIN_2;
 namespace umnsvp {
 namespace charger {
 
-/** @brief wrapper for charger board communication lights*/
+// time each step of a pattern is shown for
+static constexpr uint16_t LIGHT_STEP_PERIOD = 100;  // ms
+
+/**
+ * @brief The board LEDs, all lit by pulling their pin low.
+ * CAR_CAN: Comm light 1, toggles with each charger state frame.
+ * CHARGER_CAN: Comm light 2, toggles with each round of control frames.
+ * FAULT: Comm light 3, blinks the code of each fault.
+ * STATE: Comm light 4, the pattern of the charge state.
+ * PROX: J1772 proximity connected.
+ * AC: AC contactor closed.
+ *
+ */
+enum class status_light : uint8_t
+{
+    CAR_CAN,
+    CHARGER_CAN,
+    FAULT,
+    STATE,
+    PROX,
+    AC,
+    COUNT
+};
+
+/**
+ * @brief A repeating on/off sequence of LIGHT_STEP_PERIOD steps. Bit i of
+ * steps is the LED during step i.
+ *
+ */
+struct led_pattern {
+    uint64_t steps;
+    uint8_t length;
+
+    constexpr bool operator==(const led_pattern& other) const {
+        return steps == other.steps && length == other.length;
+    }
+    constexpr bool operator!=(const led_pattern& other) const {
+        return !(*this == other);
+    }
+};
+
+static constexpr led_pattern LED_OFF = {0, 1};
+static constexpr led_pattern LED_ON = {1, 1};
+
+// on for on steps, then off for off steps
+constexpr led_pattern led_blink(uint8_t on, uint8_t off) {
+    return {(uint64_t(1) << on) - 1, static_cast<uint8_t>(on + off)};
+}
+
+// a, then b; the two must fit in 64 steps together
+constexpr led_pattern led_then(led_pattern a, led_pattern b) {
+    return {a.steps | (b.steps << a.length),
+            static_cast<uint8_t>(a.length + b.length)};
+}
+
+// blink code: code blinks of 200 ms, then a pause to tell codes apart
+static constexpr uint8_t LED_CODE_BLINK = 2;  // steps on, and off
+static constexpr uint8_t LED_CODE_PAUSE = 6;  // steps
+constexpr led_pattern led_code(uint8_t code) {
+    led_pattern pattern = {0, LED_CODE_PAUSE};
+    for (uint8_t i = 0; i < code; i++) {
+        pattern =
+            led_then(led_blink(LED_CODE_BLINK, LED_CODE_BLINK), pattern);
+    }
+    return pattern;
+}
+
+/**
+ * @brief Counters of the pattern engine.
+ * posts: patterns changed by the main loop
+ * steps: pattern steps played
+ * port_writes: BSRR writes, at most one per port per step
+ *
+ */
+struct light_stats {
+    uint32_t posts = 0;
+    uint32_t steps = 0;
+    uint32_t port_writes = 0;
+};
+
+/** @brief wrapper for charger board communication lights. The main loop
+ * posts a pattern per LED when it changes; a scheduler job steps every
+ * pattern and writes each GPIO port at most once, through BSRR.
+ */
 class Status_lights {
+   private:
+    static constexpr uint8_t LIGHTS =
+        static_cast<uint8_t>(status_light::COUNT);
+
+    std::array<led_pattern, LIGHTS> patterns;
+    std::array<uint8_t, LIGHTS> positions = {};
+    // CAN lights, flipped by the jobs that send the frames
+    uint8_t can_toggles = 0;
+    // LEDs held on from an interrupt regardless of their pattern
+    uint8_t forced_on = 0;
+    uint8_t lit = 0;  // LEDs on after the last step
+    light_stats stats;
+
    public:
+    Status_lights();
     void init();
+    void show(status_light light, led_pattern pattern);
+    void step();
     void indicate_fault();
     void toggle_charger_can_light();
     void toggle_car_can_light();
@@ -45,7 +147,8 @@ class Status_lights {
 
     void indicate_ac_connected();
     void indicate_ac_isolated();
+    const light_stats& get_stats() const;
 };
 
 }  // namespace charger
-}  // namespace umnsvp
\ No newline at end of file
+}  // namespace umnsvp
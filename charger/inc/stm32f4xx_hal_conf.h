@@ -58,7 +58,7 @@ extern "C" {
 //#define HAL_I2C_MODULE_ENABLED
 // #define HAL_SMBUS_MODULE_ENABLED
 //#define HAL_I2S_MODULE_ENABLED
-// #define HAL_IWDG_MODULE_ENABLED
+#define HAL_IWDG_MODULE_ENABLED
 // #define HAL_LTDC_MODULE_ENABLED
 // #define HAL_DSI_MODULE_ENABLED
 #define HAL_PWR_MODULE_ENABLED
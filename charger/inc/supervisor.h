@@ -0,0 +1,182 @@
+#pragma once
+
+#include <cstdint>
+
+#include "bxcan.h"
+#include "can_codec.h"
+#include "hal.h"
+
+namespace umnsvp {
+namespace charger {
+
+// car CAN IDs for the deadline statistics, below the telemetry IDs
+static constexpr uint32_t DEADLINE_REQUEST_ID = 0x57A;
+static constexpr uint32_t DEADLINE_REPORT_ID = 0x57B;
+
+/**
+ * @brief Byte 0 of a request on DEADLINE_REQUEST_ID.
+ *
+ */
+enum class deadline_command : uint8_t
+{
+    REPORT = 0x01,  // send both deadline_report frames
+    CLEAR = 0x02,   // start the statistics over
+};
+
+/**
+ * @brief Stages of a main loop pass that check in with the supervisor, in
+ * the order they run. STARTUP is the wait for the BMS before the first pass.
+ *
+ */
+enum class loop_phase : uint8_t
+{
+    WAKE,
+    RECEIVE_STATUS_PACKET,
+    UPDATE_CAN_VALUES,
+    PILOT_UPDATE,
+    CHECK_FAULTS,
+    PROX_READ,
+    UPDATE_STATE,
+    STATE_ACTION,
+    REGULATE_CURRENT,
+    TELEMETRY,
+    STARTUP,
+    COUNT
+};
+
+/**
+ * @brief How the charger came out of its last reset.
+ * NONE: Power on or a reset the charger didn't cause.
+ * DEADLINE: The supervisor isolated HV and reset after a hard deadline miss.
+ * WATCHDOG: The independent watchdog expired.
+ *
+ */
+enum class reset_cause : uint8_t
+{
+    NONE,
+    DEADLINE,
+    WATCHDOG
+};
+
+// a pass over this is counted, one over the hard deadline resets the charger
+static constexpr uint32_t LOOP_PASS_DEADLINE = 2000;  // us
+static constexpr uint32_t LOOP_HARD_DEADLINE = 100;   // ms
+// time between telling the chargers to stop and the reset, for the disable
+// frames to go out and the charger current to fall before the AC opens
+static constexpr uint32_t DEADLINE_ISOLATE_TIME = 100;  // ms
+// IWDG: LSI / 64 with a reload of 250 is 500 ms nominal, 340 ms with the
+// fastest LSI. Above the longest sleep between passes, the 100 ms control
+// period, and the hard deadline plus the isolation time.
+static constexpr uint32_t WATCHDOG_PRESCALER = IWDG_PRESCALER_64;
+static constexpr uint32_t WATCHDOG_RELOAD = 250;
+
+/**
+ * @brief Deadline statistics, kept in backup SRAM so they survive the reset
+ * they may have caused. phase is the stage running now, so after a watchdog
+ * reset it is the one that hung.
+ *
+ */
+struct deadline_record {
+    uint32_t magic;
+    uint32_t worst_pass_cycles;
+    uint32_t pass_overruns;      // passes over LOOP_PASS_DEADLINE
+    uint32_t phase_overruns;     // phases over their own deadline
+    uint8_t worst_pass_phase;    // longest phase of the worst pass
+    uint8_t last_overrun_phase;  // loop_phase
+    uint8_t phase;               // loop_phase
+    uint8_t reset_phase;         // phase running when the last reset was due
+    uint8_t last_reset;          // reset_cause of the last start
+    uint8_t pending_reset;       // reset_cause set just before resetting
+    uint8_t deadline_resets;
+    uint8_t watchdog_resets;
+};
+
+/**
+ * @brief The two frames sent on DEADLINE_REPORT_ID, told apart by byte 0.
+ * Counters saturate.
+ *
+ */
+struct deadline_report {
+    uint8_t index;
+    uint8_t worst_pass_phase;
+    uint32_t worst_pass_us;  // 24 bits
+    uint16_t pass_overruns;
+    uint8_t last_overrun_phase;
+    uint16_t phase_overruns;
+    uint8_t deadline_resets;
+    uint8_t watchdog_resets;
+    uint8_t last_reset;
+    uint8_t reset_phase;
+};
+
+using deadline_pass_frame = can_codec::frame<
+    deadline_report, DEADLINE_REPORT_ID, 8, false,
+    can_codec::field<&deadline_report::index, 0, 1>,
+    can_codec::field<&deadline_report::worst_pass_phase, 1, 1>,
+    can_codec::field<&deadline_report::worst_pass_us, 2, 3>,
+    can_codec::field<&deadline_report::pass_overruns, 5, 2>,
+    can_codec::field<&deadline_report::last_overrun_phase, 7, 1>>;
+
+using deadline_reset_frame = can_codec::frame<
+    deadline_report, DEADLINE_REPORT_ID, 7, false,
+    can_codec::field<&deadline_report::index, 0, 1>,
+    can_codec::field<&deadline_report::phase_overruns, 1, 2>,
+    can_codec::field<&deadline_report::deadline_resets, 3, 1>,
+    can_codec::field<&deadline_report::watchdog_resets, 4, 1>,
+    can_codec::field<&deadline_report::last_reset, 5, 1>,
+    can_codec::field<&deadline_report::reset_phase, 6, 1>>;
+
+/**
+ * @brief What the tick interrupt has to do about a hard deadline miss.
+ * ISOLATE: The pass just ran over; stop the chargers.
+ * HOLD: Keep them stopped while the isolation time runs.
+ * RESET: The isolation time is up; open the AC and call reset().
+ *
+ */
+enum class deadline_action : uint8_t
+{
+    NONE,
+    ISOLATE,
+    HOLD,
+    RESET
+};
+
+/**
+ * @brief Bounds the time of a main loop pass. Each stage checks in as it
+ * starts, and the supervisor times the stages and the whole pass against
+ * their deadlines. The tick interrupt catches a pass that runs past the hard
+ * deadline, so the charger can isolate HV before resetting itself; the
+ * independent watchdog, fed at the end of each pass, resets a core that
+ * can't even take the tick.
+ *
+ */
+class LoopSupervisor {
+   private:
+    IWDG_HandleTypeDef watchdog = {};
+    deadline_record *record = nullptr;
+    uint32_t cycles_per_us = 0;
+    uint32_t hard_deadline_cycles = 0;
+    volatile bool in_pass = false;
+    volatile uint32_t pass_start = 0;  // CYCCNT
+    uint32_t phase_start = 0;          // CYCCNT
+    uint32_t longest_phase_cycles = 0;
+    loop_phase longest_phase = loop_phase::WAKE;
+    bool isolating = false;
+    uint32_t isolate_started = 0;  // ms
+
+    void close_phase(uint32_t now);
+
+   public:
+    void init();
+    void begin_pass();
+    void check_in(loop_phase phase);
+    void end_pass();
+    deadline_action tick();
+    [[noreturn]] void reset();
+    void clear();
+    deadline_record get_record() const;
+    can::packet report(uint8_t index) const;
+};
+
+}  // namespace charger
+}  // namespace umnsvp
@@ -0,0 +1,254 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+#include "bxcan.h"
+#include "thunderstruck_constants.h"
+
+namespace umnsvp {
+namespace charger {
+
+// car CAN IDs for the telemetry log, next to the profile IDs
+static constexpr uint32_t TELEMETRY_REQUEST_ID = 0x57C;
+static constexpr uint32_t TELEMETRY_DUMP_ID = 0x57D;
+
+/**
+ * @brief Byte 0 of a request on TELEMETRY_REQUEST_ID.
+ *
+ */
+enum class telemetry_command : uint8_t
+{
+    DUMP = 0x01,      // send the whole log on TELEMETRY_DUMP_ID
+    SET_RATE = 0x02,  // byte 1 is the new sample rate in Hz
+};
+
+static constexpr uint8_t TELEMETRY_RATE_DEFAULT = 10;  // Hz
+static constexpr uint8_t TELEMETRY_RATE_MAX = 100;     // Hz
+// the sample job paces a dump instead while one is running, a little slower
+// than the car bus can take frames
+static constexpr uint16_t TELEMETRY_DUMP_RATE = 1000;  // Hz
+
+/**
+ * @brief Values in a telemetry sample, in the resolution the charger keeps
+ * them in. Each charger has a voltage and a current, unit i at
+ * CHARGER_VOLTAGE + 2 i and CHARGER_CURRENT + 2 i.
+ *
+ */
+enum class telemetry_field : uint8_t
+{
+    CHARGE_STATE,     // charge_state
+    PILOT_DUTY,       // 0.1 %
+    PACK_VOLTAGE,     // 10 mV
+    BATTERY_CURRENT,  // mA
+    CHARGER_TEMP,     // C, hottest charger
+    CHARGER_VOLTAGE,  // 100 mV
+    CHARGER_CURRENT   // 100 mA
+};
+
+static constexpr uint8_t TELEMETRY_FIELDS =
+    static_cast<uint8_t>(telemetry_field::CHARGER_VOLTAGE) +
+    2 * NUMBER_CHARGERS;
+// most fields a log can hold, for decoders that don't know NUMBER_CHARGERS
+static constexpr uint8_t TELEMETRY_MAX_FIELDS =
+    static_cast<uint8_t>(telemetry_field::CHARGER_VOLTAGE) + 2 * MAX_CHARGERS;
+
+using telemetry_sample = std::array<int32_t, TELEMETRY_FIELDS>;
+
+/**
+ * @brief The log layout, shared by the recorder and host decoders.
+ *
+ * The log is a ring of blocks. A block starts with a header, then holds
+ * records, each of which is:
+ *   - varint milliseconds since the previous record (the header tick for
+ *     the first record of a block)
+ *   - varint mask of the fields that changed, bit i for field i
+ *   - a zigzag varint delta for each field in the mask, in field order
+ * Every block starts from an all zero sample, so blocks decode on their own
+ * and the oldest can be dropped when the ring is full.
+ *
+ * A dump is a start frame with the sequence number 0, then the blocks
+ * oldest first, each cut to its used length. The stream is sent 6 bytes per
+ * frame after a little endian uint16_t sequence number, from 1.
+ *
+ */
+namespace telemetry_format {
+static constexpr uint8_t VERSION = 1;
+// block header: uint32_t tick of the block, uint16_t used bytes including
+// the header, uint8_t field count, uint8_t VERSION, all little endian
+static constexpr uint8_t HEADER_SIZE = 8;
+// dump start frame: uint16_t 0, uint32_t stream bytes, uint8_t blocks,
+// uint8_t VERSION
+static constexpr uint8_t DUMP_PAYLOAD = 6;
+static constexpr uint8_t VARINT_MAX = 5;
+
+constexpr uint32_t zigzag(int32_t value) {
+    return (static_cast<uint32_t>(value) << 1) ^
+           static_cast<uint32_t>(value >> 31);
+}
+
+constexpr int32_t unzigzag(uint32_t value) {
+    return static_cast<int32_t>(value >> 1) ^ -static_cast<int32_t>(value & 1);
+}
+
+/**
+ * @brief Write value 7 bits a byte, low bits first, high bit set on every
+ * byte but the last.
+ *
+ * @return uint8_t bytes written, at most VARINT_MAX
+ */
+inline uint8_t put_varint(uint8_t *out, uint32_t value) {
+    uint8_t n = 0;
+    while (value >= 0x80) {
+        out[n++] = static_cast<uint8_t>(value | 0x80);
+        value >>= 7;
+    }
+    out[n++] = static_cast<uint8_t>(value);
+    return n;
+}
+
+/**
+ * @brief Read a varint that must end before end.
+ *
+ * @return uint8_t bytes read, 0 if it runs past end or is too long
+ */
+inline uint8_t get_varint(const uint8_t *in, const uint8_t *end,
+                          uint32_t &value) {
+    value = 0;
+    for (uint8_t n = 0; n < VARINT_MAX && in + n < end; n++) {
+        value |= static_cast<uint32_t>(in[n] & 0x7F) << (7 * n);
+        if ((in[n] & 0x80) == 0) {
+            return n + 1;
+        }
+    }
+    return 0;
+}
+
+inline uint32_t read_u32(const uint8_t *data) {
+    return data[0] | (data[1] << 8) | (data[2] << 16) |
+           (static_cast<uint32_t>(data[3]) << 24);
+}
+
+inline uint16_t read_u16(const uint8_t *data) {
+    return static_cast<uint16_t>(data[0] | (data[1] << 8));
+}
+
+/**
+ * @brief Decode one block, calling fn(tick, values, field_count) with the
+ * full sample after each record.
+ *
+ * @return size_t bytes the block takes, 0 if it is malformed
+ */
+template <class Fn>
+size_t decode_block(const uint8_t *data, size_t size, Fn fn) {
+    if (size < HEADER_SIZE) {
+        return 0;
+    }
+    uint32_t tick = read_u32(data);
+    const uint16_t used = read_u16(data + 4);
+    const uint8_t fields = data[6];
+    if (data[7] != VERSION || used < HEADER_SIZE || used > size ||
+        fields > TELEMETRY_MAX_FIELDS) {
+        return 0;
+    }
+    int32_t values[TELEMETRY_MAX_FIELDS] = {0};
+    const uint8_t *in = data + HEADER_SIZE;
+    const uint8_t *const end = data + used;
+    while (in < end) {
+        uint32_t elapsed;
+        uint32_t mask;
+        uint8_t n = get_varint(in, end, elapsed);
+        if (n == 0) {
+            return 0;
+        }
+        in += n;
+        if ((n = get_varint(in, end, mask)) == 0 || (mask >> fields) != 0) {
+            return 0;
+        }
+        in += n;
+        for (uint8_t field = 0; field < fields; field++) {
+            if (mask & (0b1u << field)) {
+                uint32_t delta;
+                if ((n = get_varint(in, end, delta)) == 0) {
+                    return 0;
+                }
+                in += n;
+                values[field] += unzigzag(delta);
+            }
+        }
+        tick += elapsed;
+        fn(tick, static_cast<const int32_t *>(values), fields);
+    }
+    return used;
+}
+}  // namespace telemetry_format
+
+/**
+ * @brief How much the log holds.
+ *
+ */
+struct telemetry_stats {
+    uint32_t records = 0;  // records in the log
+    uint32_t bytes = 0;    // bytes in use, block headers included
+    uint32_t oldest = 0;   // tick of the oldest record
+    uint32_t newest = 0;   // tick of the newest record
+    uint32_t dropped = 0;  // samples not recorded because a dump was running
+};
+
+/**
+ * @brief RAM ring of delta encoded telemetry samples, and the dump of it
+ * over the car bus. A sample is only stored if a field changed, so an idle
+ * charger costs nothing and minutes of a session fit in a few KB.
+ *
+ */
+class TelemetryLog {
+   private:
+    static constexpr uint16_t BLOCK_SIZE = 256;
+    static constexpr uint8_t BLOCKS = 32;
+    // the elapsed time and mask varints and a full varint per field
+    static constexpr uint16_t MAX_RECORD =
+        (2 + TELEMETRY_FIELDS) * telemetry_format::VARINT_MAX;
+    static_assert(telemetry_format::HEADER_SIZE + MAX_RECORD <= BLOCK_SIZE);
+    static_assert(TELEMETRY_MAX_FIELDS <= 31, "field mask is 32 bits");
+
+    /**
+     * @brief Position of a dump in the log: a block, counted from the oldest,
+     * and a byte in it.
+     *
+     */
+    struct dump_cursor {
+        uint8_t block = 0;
+        uint16_t byte = 0;
+    };
+
+    uint8_t blocks[BLOCKS][BLOCK_SIZE];
+    uint16_t block_records[BLOCKS] = {0};
+    uint8_t newest = BLOCKS - 1;  // block being written
+    uint8_t count = 0;            // blocks holding records
+    uint16_t used = 0;            // bytes used in the newest block
+    telemetry_sample last = {};
+    uint32_t last_tick = 0;
+    uint32_t records = 0;
+    uint32_t dropped = 0;
+
+    // recording stops until a dump has been sent
+    bool dumping = false;
+    uint16_t dump_sequence = 0;  // 0 is the start frame
+    dump_cursor dump_at;
+
+    uint8_t block_index(uint8_t from_oldest) const;
+    uint16_t block_used(uint8_t from_oldest) const;
+    void open_block(uint32_t tick);
+    can::packet dump_frame(uint16_t sequence, dump_cursor &at) const;
+
+   public:
+    void record(const telemetry_sample &sample, uint32_t tick);
+    void start_dump();
+    bool dump_pending() const;
+    bool send_dump(can::bxcan_driver &can_device, uint8_t keep_free);
+    telemetry_stats get_stats() const;
+};
+
+}  // namespace charger
+}  // namespace umnsvp
@@ -1,10 +1,13 @@
 #pragma once
+#include <array>
 #include <limits>
 #include <optional>
 
 #include "battery_charging_limits.h"
 #include "can2.h"
+#include "comm_timeouts.h"
 #include "hal.h"
+#include "quantity.h"
 #include "thunderstruck_constants.h"
 
 namespace umnsvp {
@@ -21,27 +24,57 @@ enum class charger_fault_type : uint8_t
     CHARGER_CAN_TIMEOUT = 0b1 << 2
 };
 
+// least time between two control frames to one charger, so a setpoint that
+// changes on every pass can't flood the charger bus
+static constexpr uint32_t CONTROL_MIN_SPACING = 10;  // ms
+
+/**
+ * @brief Control frames sent to the chargers, all units together.
+ * heartbeats: periodic frames from the control job
+ * updates: extra frames sent because the control message changed
+ * changes: times the control message changed
+ *
+ */
+struct control_tx_stats {
+    uint32_t heartbeats = 0;
+    uint32_t updates = 0;
+    uint32_t changes = 0;
+};
+
+/**
+ * @brief Latest telemetry from one charger.
+ *
+ */
+struct charger_unit {
+    deci_amps charging_current;   // DC output
+    deci_volts charging_voltage;  // DC output
+    std::optional<celsius> charger_temp;
+};
+
 class Thunderstruck {
    private:
-    // converstion from V to 100mV for CAN packet resolution
-    static constexpr uint16_t VOLTAGE_LIMIT_INT_CONVERSION = 10;
-    // converstion from A to 100mA for CAN packet resolution
-    static constexpr uint16_t CURRENT_LIMIT_INT_CONVERSION = 10;
-
-    float charging_current = 0;  // AC current
-    float charging_voltage = 0;  // votlage
-    // this is room temp, if you have a better idea lmk
-    std::optional<float> charger_temp;  // celsius
+    std::array<charger_unit, NUMBER_CHARGERS> units;
     CAN2Device CANDevice;
+    // each unit's status frames are a link, refreshed as they are taken
+    CommTimeouts &timeouts;
+    // sent to every unit, carrying each unit's share of the current limit
     skylab2::can_packet_thunderstruck_control_message control_packet = {0};
+    // control_packet packed, rebuilt only when a field changes
+    uint8_t control_payload[8] = {0};
+    // units not yet sent the current payload, one bit each
+    volatile uint8_t control_pending = 0;
+    // tick of the last control frame to each unit
+    std::array<uint32_t, NUMBER_CHARGERS> control_sent = {};
+    control_tx_stats control_stats;
+    // set by trip() from an interrupt, holds the chargers disabled
+    volatile bool tripped = false;
+    // set by hold_current() from an interrupt, holds the current limit at 0
+    volatile bool current_held = false;
 
-    /** offset for charging current values in skylab.
-     * the charging current and charging current limit
-     *  in skylab are set as skylabValue = offset - current,
-     * in 100 mA
-     */
-    static constexpr uint16_t charging_current_packet_offset = 3200;
     static constexpr uint32_t TIMEOUT = 2000;  // CAN specific time out
+    // output energy counts are 100 mV x 100 mA x 1 ms
+    static constexpr float OUTPUT_ENERGY_PER_WH = 3.6e8f;
+    int64_t output_energy = 0;
 
     // value in CAN packet to enable thunderstruck
     static constexpr uint8_t CONTROL_PACKET_ENABLE = 0xFC;
@@ -50,7 +83,29 @@ class Thunderstruck {
     // for more info on thunderstruck CAN packets see
     // https://wiki.umnsvp.org/uberwiki/G1:Charger#TSM2500_CAN_Packet_Encoding
 
-    std::optional<uint32_t> received_status;
+    void send_control_frame(uint8_t unit);
+
+    /**
+     * @brief Change one field of the control message. A change repacks the
+     * payload and queues it for every unit. Safe from interrupts.
+     *
+     */
+    template <class T>
+    void set_control_field(
+        T skylab2::can_packet_thunderstruck_control_message::*field, T value) {
+        if (control_packet.*field == value) {
+            return;
+        }
+        const uint32_t primask = __get_PRIMASK();
+        __disable_irq();
+        control_packet.*field = value;
+        thunderstruck_frames::control::pack(control_packet, control_payload);
+        control_pending = (0b1 << NUMBER_CHARGERS) - 1;
+        control_stats.changes++;
+        if (primask == 0) {
+            __enable_irq();
+        }
+    }
 
    public:
     void init();
@@ -58,30 +113,43 @@ class Thunderstruck {
     void receive_callback();
     void tx_callback();
     // Send function for can packets to charger
-    void send_control_packet();
+    void send_control_packet(uint8_t unit);
+    void send_control_updates();
     void receive_status_packet();
 
-    Thunderstruck();
+    Thunderstruck(CommTimeouts &timeouts);
 
-    // Getters and setters for current and voltage.
-    // IMPORTANT: Beware that the receiving messages from these functions won't
-    // be able to differentiate between different chargers on the same bus
-    // because of the shared CAN IDs
-    float get_charging_voltage();
-    void set_charging_voltage_limit(float limit);
+    // Getters and setters for current and voltage. Each charger reports on its
+    // own CAN address; the getters combine the last report from every unit.
+    // A unit whose status link expires reports nothing until its next frame.
+    // Both are in the 100 mV / 100 mA resolution of the CAN packets.
+    deci_volts get_charging_voltage();
+    void set_charging_voltage_limit(deci_volts limit);
 
-    float get_charging_current();
-    void set_charging_current_limit(float limit);
+    deci_amps get_charging_current();
+    void set_charging_current_limit(deci_amps limit);
 
-    float get_charger_temp();
+    celsius get_charger_temp();
+    const charger_unit &get_unit(uint8_t unit) const;
+    float get_output_energy() const;
+    ring_stats get_rx_stats(uint8_t unit) const;
 
     charger_fault_type check_current_fault(void);
+    void drop_expired_units();
 
     void enable_charging(void);
     void disable_charging(void);
-    bool coms_alive();
+    void trip();
+    void clear_trip();
+    bool is_tripped() const;
+    void hold_current();
+    void release_current();
+    bool is_current_held() const;
+    bool coms_alive() const;
 
     CAN_HandleTypeDef *get_can_handle();
+    const tx_queue_stats &get_tx_stats() const;
+    const control_tx_stats &get_control_stats() const;
 };
 
 }  // namespace charger
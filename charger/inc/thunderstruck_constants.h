@@ -1,22 +1,32 @@
 #pragma once
+#include <cstdint>
+
 #include "battery_charging_limits.h"
+#include "quantity.h"
 
 namespace umnsvp {
 namespace charger {
 
 // Calculated by max battery cell voltage * numbers of series cells
-static constexpr float CHARGER_VOLTAGE_MAX =
-    MAX_CELL_VOLTAGE * NUM_SERIES_CELLS;  // volts
+static constexpr deci_volts CHARGER_VOLTAGE_MAX =
+    deci_volts::from(MAX_CELL_VOLTAGE * NUM_SERIES_CELLS);
 // Temperature is given by the thunderstruck documentation
-static constexpr float CHARGER_TEMP_MAX = 54.0;  // Celsius
+static constexpr celsius CHARGER_TEMP_MAX = celsius(54);
 // Charger efficiency is given by the thunderstruck documentation
-static constexpr float CHARGER_EFFICIENCY = 0.95;  // Percent
-// Number of chargers being used
-static constexpr float NUMBER_CHARGERS = 2;
+static constexpr int32_t CHARGER_EFFICIENCY_PERCENT = 95;
+// Output current slew of each charger, per second
+static constexpr deci_amps CHARGER_SLEW_PER_SECOND = deci_amps(200);
+// Each charger reports its output this often
+static constexpr uint32_t CHARGER_STATUS_PERIOD = 100;  // ms
+// Number of chargers being used, each on its own CAN address
+static constexpr uint8_t NUMBER_CHARGERS = 2;
+// Most chargers the per-unit addressing and bookkeeping is sized for
+static constexpr uint8_t MAX_CHARGERS = 4;
+static_assert(NUMBER_CHARGERS > 0 && NUMBER_CHARGERS <= MAX_CHARGERS);
 // Allows a distinction between level 1 and level 2 charging
-static constexpr float AC_VOLTAGE_INPUT_1 = 110;  // AC Volt
-static constexpr float AC_VOLTAGE_INPUT_2 = 240;  // AC volts
+static constexpr volts AC_VOLTAGE_INPUT_1 = volts(110);
+static constexpr volts AC_VOLTAGE_INPUT_2 = volts(240);
 // The ability to charge over this current indicates level 2 charging
-static constexpr float AC_VOLTAGE_CHANGE_POINT = 17.3;  // Amps
+static constexpr deci_amps AC_VOLTAGE_CHANGE_POINT = deci_amps(173);
 }  // namespace charger
 }  // namespace umnsvp
\ No newline at end of file
@@ -0,0 +1,109 @@
+#pragma once
+
+#include <array>
+#include <optional>
+
+#include "can_codec.h"
+#include "skylab2_packets.h"
+
+namespace umnsvp {
+namespace charger {
+/**
+ * @brief Wire layout of the TSM2500 frames on CAN2. For more info on
+ * thunderstruck CAN packets see
+ * https://wiki.umnsvp.org/uberwiki/G1:Charger#TSM2500_CAN_Packet_Encoding
+ *
+ */
+namespace thunderstruck_frames {
+
+using can_codec::byte_order;
+using can_codec::field;
+using control_message = skylab2::can_packet_thunderstruck_control_message;
+using status_message = skylab2::can_packet_thunderstruck_status_message;
+
+// control message, charger <- us
+using control_enable = field<&control_message::Enable, 0, 1>;
+using control_voltage = field<&control_message::CHARGE_VOLTAGE, 1, 2,
+                              byte_order::LITTLE, std::ratio<1, 10>>;
+// current is sent as an offset from 320 A in 100 mA counts
+using control_current =
+    field<&control_message::CHARGE_CURRENT, 3, 2, byte_order::LITTLE,
+          std::ratio<-1, 10>, std::ratio<320>>;
+using control_led = field<&control_message::LED_BLINK_PATTERN, 5, 1>;
+using control_reserved = field<&control_message::RESERVED, 6, 2>;
+
+using control = can_codec::frame<
+    control_message,
+    static_cast<uint32_t>(
+        skylab2::CANPacketId::CAN_PACKET_THUNDERSTRUCK_CONTROL_MESSAGE),
+    skylab2::CAN_LENGTH_THUNDERSTRUCK_CONTROL_MESSAGE, true, control_enable,
+    control_voltage, control_current, control_led, control_reserved>;
+
+// status message, charger -> us
+using status_flags = field<&status_message::STATUS_FLAGS, 0, 1>;
+using status_charge_flags = field<&status_message::CHARGE_FLAGS, 1, 1>;
+using status_voltage = field<&status_message::OUTPUT_VOLTAGE, 2, 2,
+                             byte_order::LITTLE, std::ratio<1, 10>>;
+using status_current =
+    field<&status_message::OUTPUT_CURRENT, 4, 2, byte_order::LITTLE,
+          std::ratio<-1, 10>, std::ratio<320>>;
+// temperature is sent offset by 40 C
+using status_temp = field<&status_message::CHARGER_TEMP, 6, 1,
+                          byte_order::LITTLE, std::ratio<1>, std::ratio<-40>>;
+using status_reserved = field<&status_message::RESERVED, 7, 1>;
+
+using status = can_codec::frame<
+    status_message,
+    static_cast<uint32_t>(
+        skylab2::CANPacketId::CAN_PACKET_THUNDERSTRUCK_STATUS_MESSAGE),
+    skylab2::CAN_LENGTH_THUNDERSTRUCK_STATUS_MESSAGE, true, status_flags,
+    status_charge_flags, status_voltage, status_current, status_temp,
+    status_reserved>;
+
+// The IDs are J1939 style: control frames carry the charger's address as the
+// destination (bits 8-15), status frames carry it as the source (bits 0-7).
+// Unit n is configured with address FIRST_ADDRESS + n, so unit 0 keeps the
+// factory IDs above.
+static constexpr uint8_t FIRST_ADDRESS = 0x40;
+static constexpr uint32_t DESTINATION_MASK = 0xFF << 8;
+static constexpr uint32_t SOURCE_MASK = 0xFF;
+
+constexpr uint32_t control_id(uint8_t unit) {
+    return (control::id & ~DESTINATION_MASK) |
+           (static_cast<uint32_t>(FIRST_ADDRESS + unit) << 8);
+}
+
+constexpr uint32_t status_id(uint8_t unit) {
+    return (status::id & ~SOURCE_MASK) | (FIRST_ADDRESS + unit);
+}
+
+/**
+ * @brief Status IDs of the first N units.
+ *
+ */
+template <size_t N>
+constexpr std::array<uint32_t, N> status_ids() {
+    std::array<uint32_t, N> ids = {};
+    for (size_t unit = 0; unit < N; unit++) {
+        ids[unit] = status_id(unit);
+    }
+    return ids;
+}
+
+/**
+ * @brief Find which unit sent a status frame.
+ *
+ * @param id CAN ID of a received frame.
+ * @return std::optional<uint8_t> unit index, nullopt if not a status frame
+ */
+constexpr std::optional<uint8_t> status_unit(uint32_t id) {
+    if ((id & ~SOURCE_MASK) != (status::id & ~SOURCE_MASK) ||
+        (id & SOURCE_MASK) < FIRST_ADDRESS) {
+        return std::nullopt;
+    }
+    return static_cast<uint8_t>((id & SOURCE_MASK) - FIRST_ADDRESS);
+}
+
+}  // namespace thunderstruck_frames
+}  // namespace charger
+}  // namespace umnsvp
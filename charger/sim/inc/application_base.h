@@ -0,0 +1,17 @@
+/**
+ * @file application_base.h
+ * @brief Host simulation stand-in for the umnsvp application base class.
+ *
+ */
+#pragma once
+
+namespace umnsvp {
+
+class ApplicationBase {
+   protected:
+    // clocks and flash are not modelled on the host
+    void sys_init() {
+    }
+};
+
+}  // namespace umnsvp
@@ -0,0 +1,28 @@
+/**
+ * @file battery_charging_limits.h
+ * @brief Host simulation stand-in for the shared battery limits header.
+ *
+ * Values describe a 35s lithium ion pack. Keep them in step with the car's
+ * limits when using the simulation to reason about real sessions.
+ *
+ */
+#pragma once
+
+#include <cstdint>
+
+namespace umnsvp {
+
+static constexpr uint16_t NUM_SERIES_CELLS = 35;
+static constexpr float MAX_CELL_VOLTAGE = 4.2f;                 // volts
+static constexpr float MIN_CELL_VOLTAGE = 2.5f;                 // volts
+static constexpr float CELL_CHARGE_TARGET_VOLTAGE = 4.15f;      // volts
+static constexpr float CHARGING_TEMP_LIMIT_FOR_BATTERY = 45.0f; // Celsius
+static constexpr float BATTERY_VOLTAGE_MAX =
+    MAX_CELL_VOLTAGE * NUM_SERIES_CELLS;  // volts
+static constexpr float BATTERY_VOLTAGE_MIN =
+    MIN_CELL_VOLTAGE * NUM_SERIES_CELLS;  // volts
+static constexpr float BATTERY_VOLTAGE_CHARGING_TARGET =
+    CELL_CHARGE_TARGET_VOLTAGE * NUM_SERIES_CELLS;  // volts
+static constexpr float BATTERY_CURRENT_CHARGING_TARGET = 1.0f;  // amps
+
+}  // namespace umnsvp
@@ -0,0 +1,84 @@
+/**
+ * @file bxcan.h
+ * @brief Host simulation stand-in for the umnsvp bxCAN driver.
+ *
+ * Frames sent through a driver are handed to the simulated bus attached to
+ * its CAN instance, and received frames come out of that bus's FIFOs. See
+ * sim.h for the bus side of the model.
+ *
+ */
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+
+#include "hal.h"
+
+namespace umnsvp {
+namespace can {
+
+enum class status
+{
+    OK,
+    ERROR,
+    BUSY
+};
+
+enum class fifo
+{
+    FIFO0 = 0,
+    FIFO1 = 1
+};
+
+enum class baud_rate
+{
+    BAUD_RATE_125,
+    BAUD_RATE_250,
+    BAUD_RATE_500,
+    BAUD_RATE_1000
+};
+
+class packet {
+   private:
+    uint32_t id = 0;
+    uint8_t length = 0;
+    uint8_t data[8] = {0};
+    bool extended = false;
+
+   public:
+    packet() {
+    }
+    packet(uint32_t id, uint8_t length, const uint8_t* data, bool extended)
+        : id(id), length(length > 8 ? 8 : length), extended(extended) {
+        std::memcpy(this->data, data, this->length);
+    }
+    uint32_t get_id() const {
+        return id;
+    }
+    uint8_t get_length() const {
+        return length;
+    }
+    const uint8_t* get_data() const {
+        return data;
+    }
+    bool is_extended() const {
+        return extended;
+    }
+};
+
+class bxcan_driver {
+   private:
+    CAN_HandleTypeDef handle;
+
+   public:
+    explicit bxcan_driver(CAN_TypeDef* instance);
+    void init(baud_rate rate, bool use_interrupts);
+    void start();
+    void filter_all();
+    status send(const packet& p);
+    status receive(packet& p, fifo f);
+    CAN_HandleTypeDef* get_handle();
+};
+
+}  // namespace can
+}  // namespace umnsvp
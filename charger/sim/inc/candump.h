@@ -0,0 +1,52 @@
+/**
+ * @file candump.h
+ * @brief Reading and writing can-utils candump traces.
+ *
+ * Both the log format written by `candump -l`:
+ *
+ *     (1654012345.123456) can0 18FF50E5#0102030405060708
+ *
+ * and the console format of `candump -ta` (or without `-t`, in which case
+ * the frame has no timestamp) are understood:
+ *
+ *     (1654012345.123456)  can0  18FF50E5   [8]  01 02 03 04 05 06 07 08
+ *
+ * IDs of more than three hex digits are extended, as candump prints them.
+ * Remote and CAN FD frames are skipped.
+ *
+ */
+#pragma once
+
+#include <cstdio>
+#include <optional>
+#include <string>
+
+#include "bxcan.h"
+
+namespace umnsvp {
+namespace charger {
+namespace sim {
+namespace candump {
+
+struct record {
+    std::optional<double> timestamp;  // seconds
+    std::string interface;
+    can::packet packet;
+};
+
+/**
+ * @brief Parse one trace line.
+ *
+ * @return std::nullopt for blank lines, comments and frames that can't be
+ * replayed.
+ */
+std::optional<record> parse_line(const std::string& line);
+
+// Write one frame in the candump -l log format.
+void write(std::FILE* file, double timestamp, const char* interface,
+           const can::packet& p);
+
+}  // namespace candump
+}  // namespace sim
+}  // namespace charger
+}  // namespace umnsvp
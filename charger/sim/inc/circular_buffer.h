@@ -0,0 +1,62 @@
+/**
+ * @file circular_buffer.h
+ * @brief Host simulation stand-in for the umnsvp circular buffer.
+ *
+ */
+#pragma once
+
+#include <cstddef>
+
+namespace umnsvp {
+namespace circular_buffer {
+
+/**
+ * @brief Fixed size FIFO. peek() and pop() load the oldest element into the
+ * output slot, pop() also removes it.
+ *
+ */
+template <class T, size_t N>
+class CircularBuffer {
+   private:
+    T storage[N];
+    T out;
+    size_t head = 0;
+    size_t count = 0;
+
+   public:
+    bool push(const T& item) {
+        if (count == N) {
+            return false;
+        }
+        storage[(head + count) % N] = item;
+        count++;
+        return true;
+    }
+    bool peek() {
+        if (count == 0) {
+            return false;
+        }
+        out = storage[head];
+        return true;
+    }
+    bool pop() {
+        if (!peek()) {
+            return false;
+        }
+        head = (head + 1) % N;
+        count--;
+        return true;
+    }
+    T output() const {
+        return out;
+    }
+    size_t size() const {
+        return count;
+    }
+    bool empty() const {
+        return count == 0;
+    }
+};
+
+}  // namespace circular_buffer
+}  // namespace umnsvp
@@ -0,0 +1,102 @@
+/**
+ * @file devices.h
+ * @brief Stand-ins for the other nodes the charger talks to: the BMS on the
+ * car bus and the Thunderstruck TSM2500s on the charger bus.
+ *
+ */
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "pack_model.h"
+#include "skylab2_packets.h"
+
+namespace umnsvp {
+namespace charger {
+namespace sim {
+
+/**
+ * @brief One TSM2500 at CAN address FIRST_ADDRESS + index. Follows the most
+ * recent control frame sent to it and reports its output in periodic status
+ * frames.
+ *
+ * The output slews toward the commanded current, held under the unit's
+ * output power and backed off near the commanded voltage. Conversion losses
+ * heat the unit, which a fan cools toward ambient.
+ *
+ */
+class ThunderstruckModel {
+   private:
+    static constexpr float MAX_POWER = 2500.0f;     // W, output
+    static constexpr float EFFICIENCY = 0.93f;
+    static constexpr float CV_GAIN = 5.0f;          // A per V under the limit
+    static constexpr float HEAT_CAPACITY = 1800.0f;  // J/K
+    static constexpr float COOLING = 10.0f;         // W/K
+    uint8_t index;
+    uint64_t status_period_us;
+    skylab2::can_packet_thunderstruck_control_message command = {0};
+
+   public:
+    static constexpr float RAMP_RATE = 20.0f;  // A/s
+
+    float output_current = 0;  // A
+    float output_voltage = 0;  // V
+    float temperature = 25;    // Celsius
+    float ambient = 25;        // Celsius
+    bool silent = false;  // stop reporting status, as if off the bus
+
+    ThunderstruckModel(uint8_t index, uint64_t status_period_us);
+    void attach();
+    void update(float dt, float pack_voltage, bool ac_present);
+    float input_power() const;
+    bool enabled() const;
+    float commanded_current() const;
+    float commanded_voltage() const;
+};
+
+/**
+ * @brief Battery pack and BMS. The BMS reports the pack model's terminal
+ * voltage, current and temperature, and grants charging whenever it is
+ * requested.
+ *
+ */
+class BmsModel {
+   private:
+    bool charging_requested = false;
+
+   public:
+    PackModel pack;
+    bool killed = false;
+    bool silent = false;  // stop publishing, to provoke a CAN timeout
+    bool refusing = false;  // don't grant charging when requested
+
+    void attach(uint64_t period_us);
+    void update(float dt, float charge_current);
+    float pack_voltage() const;
+    float max_cell_voltage() const;
+    float max_cell_temp() const;
+    void publish();
+};
+
+/**
+ * @brief The BMS, the chargers and the AC side, stepped together.
+ *
+ */
+class Plant {
+   public:
+    BmsModel bms;
+    std::vector<ThunderstruckModel> chargers;
+    // A the car's low voltage converter draws from the pack, whether or not
+    // the chargers are running
+    float aux_load = 0;
+    float ac_energy_Wh = 0;  // drawn by the chargers from the EVSE
+
+    Plant(uint8_t number_chargers, uint64_t status_period_us);
+    void attach(uint64_t step_us);
+    float total_charger_current() const;
+};
+
+}  // namespace sim
+}  // namespace charger
+}  // namespace umnsvp
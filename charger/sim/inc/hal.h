@@ -0,0 +1,490 @@
+/**
+ * @file hal.h
+ * @brief Host simulation stand-in for the STM32F4 HAL.
+ *
+ * Only the registers, types and functions the charger firmware touches are
+ * modelled. Peripheral state lives in plain structs so the simulation engine
+ * (see sim.h) can drive inputs and observe outputs.
+ *
+ */
+#pragma once
+
+#include <cstdint>
+
+/* Status -------------------------------------------------------------------*/
+typedef enum
+{
+    HAL_OK = 0x00U,
+    HAL_ERROR = 0x01U,
+    HAL_BUSY = 0x02U,
+    HAL_TIMEOUT = 0x03U
+} HAL_StatusTypeDef;
+
+typedef enum
+{
+    DISABLE = 0U,
+    ENABLE = !DISABLE
+} FunctionalState;
+
+uint32_t HAL_GetTick(void);
+void HAL_IncTick(void);
+
+/* Cortex -------------------------------------------------------------------*/
+typedef enum
+{
+    TIM1_CC_IRQn,
+    TIM5_IRQn,
+    TIM6_DAC_IRQn,
+    TIM7_IRQn,
+    CAN1_TX_IRQn,
+    CAN1_RX0_IRQn,
+    CAN1_RX1_IRQn,
+    CAN2_TX_IRQn,
+    CAN2_RX0_IRQn,
+    CAN2_RX1_IRQn,
+    EXTI9_5_IRQn,
+    NUM_SIM_IRQn
+} IRQn_Type;
+
+void HAL_NVIC_SetPriority(IRQn_Type IRQn, uint32_t PreemptPriority,
+                          uint32_t SubPriority);
+void HAL_NVIC_EnableIRQ(IRQn_Type IRQn);
+void HAL_NVIC_DisableIRQ(IRQn_Type IRQn);
+
+void __WFI(void);
+void __disable_irq(void);
+void __enable_irq(void);
+uint32_t __get_PRIMASK(void);
+
+extern uint32_t SystemCoreClock;
+
+typedef struct {
+    volatile uint32_t CTRL;
+    volatile uint32_t CYCCNT;
+} DWT_Type;
+
+typedef struct {
+    volatile uint32_t DEMCR;
+} CoreDebug_Type;
+
+extern DWT_Type sim_DWT;
+extern CoreDebug_Type sim_CoreDebug;
+#define DWT (&sim_DWT)
+#define CoreDebug (&sim_CoreDebug)
+#define DWT_CTRL_CYCCNTENA_Msk (1UL)
+#define CoreDebug_DEMCR_TRCENA_Msk (1UL << 24)
+
+// Resets the core; the simulation unwinds to the harness, see
+// sim::system_reset.
+[[noreturn]] void NVIC_SystemReset(void);
+
+/* RCC ----------------------------------------------------------------------*/
+// Only the reset flags are modelled. They survive a system reset, as on the
+// chip, until the firmware clears them.
+typedef struct {
+    volatile uint32_t CSR;
+} RCC_TypeDef;
+
+extern RCC_TypeDef sim_RCC;
+#define RCC (&sim_RCC)
+
+#define RCC_FLAG_SFTRST ((uint8_t)0x7CU)
+#define RCC_FLAG_IWDGRST ((uint8_t)0x7DU)
+#define __HAL_RCC_GET_FLAG(__FLAG__) \
+    (((RCC->CSR) >> ((__FLAG__)&0x1FU)) & 1U)
+#define __HAL_RCC_CLEAR_RESET_FLAGS() (RCC->CSR &= 0x00FFFFFFU)
+
+#define __HAL_RCC_GPIOA_CLK_ENABLE() \
+    do {                             \
+    } while (0)
+#define __HAL_RCC_GPIOB_CLK_ENABLE() \
+    do {                             \
+    } while (0)
+#define __HAL_RCC_GPIOC_CLK_ENABLE() \
+    do {                             \
+    } while (0)
+#define __HAL_RCC_SYSCFG_CLK_ENABLE() \
+    do {                              \
+    } while (0)
+#define __HAL_RCC_TIM1_CLK_ENABLE() \
+    do {                            \
+    } while (0)
+#define __HAL_RCC_TIM5_CLK_ENABLE() \
+    do {                            \
+    } while (0)
+#define __HAL_RCC_TIM6_CLK_ENABLE() \
+    do {                            \
+    } while (0)
+#define __HAL_RCC_TIM7_CLK_ENABLE() \
+    do {                            \
+    } while (0)
+#define __HAL_RCC_DMA2_CLK_ENABLE() \
+    do {                            \
+    } while (0)
+#define __HAL_RCC_PWR_CLK_ENABLE() \
+    do {                           \
+    } while (0)
+#define __HAL_RCC_BKPSRAM_CLK_ENABLE() \
+    do {                               \
+    } while (0)
+
+/* PWR and backup SRAM ------------------------------------------------------*/
+// 4 KB, kept across sim::reset() like backup SRAM across a system reset
+extern uint32_t sim_BKPSRAM[1024];
+#define BKPSRAM_BASE (reinterpret_cast<uintptr_t>(sim_BKPSRAM))
+
+void HAL_PWR_EnableBkUpAccess(void);
+HAL_StatusTypeDef HAL_PWREx_EnableBkUpReg(void);
+
+/* IWDG ---------------------------------------------------------------------*/
+// Counts down from the reload value at LSI / prescaler, with a nominal
+// 32 kHz LSI. Running out resets the core, see sim::system_reset.
+typedef struct {
+    volatile uint32_t KR;
+    volatile uint32_t PR;
+    volatile uint32_t RLR;
+} IWDG_TypeDef;
+
+extern IWDG_TypeDef sim_IWDG;
+#define IWDG (&sim_IWDG)
+
+typedef struct {
+    uint32_t Prescaler;
+    uint32_t Reload;
+} IWDG_InitTypeDef;
+
+typedef struct {
+    IWDG_TypeDef* Instance;
+    IWDG_InitTypeDef Init;
+} IWDG_HandleTypeDef;
+
+#define IWDG_PRESCALER_4 0x00000000U
+#define IWDG_PRESCALER_8 0x00000001U
+#define IWDG_PRESCALER_16 0x00000002U
+#define IWDG_PRESCALER_32 0x00000003U
+#define IWDG_PRESCALER_64 0x00000004U
+#define IWDG_PRESCALER_128 0x00000005U
+#define IWDG_PRESCALER_256 0x00000006U
+
+HAL_StatusTypeDef HAL_IWDG_Init(IWDG_HandleTypeDef* hiwdg);
+HAL_StatusTypeDef HAL_IWDG_Refresh(IWDG_HandleTypeDef* hiwdg);
+
+/* GPIO ---------------------------------------------------------------------*/
+// A write to BSRR sets and resets ODR bits, set winning, as on the chip. It
+// must directly follow ODR in GPIO_TypeDef.
+struct gpio_bsrr {
+    volatile uint32_t value;
+    void operator=(uint32_t bits);
+};
+
+typedef struct {
+    volatile uint32_t MODER;
+    volatile uint32_t OTYPER;
+    volatile uint32_t OSPEEDR;
+    volatile uint32_t PUPDR;
+    volatile uint32_t IDR;
+    volatile uint32_t ODR;
+    gpio_bsrr BSRR;
+    volatile uint32_t LCKR;
+    volatile uint32_t AFR[2];
+} GPIO_TypeDef;
+
+typedef enum
+{
+    GPIO_PIN_RESET = 0,
+    GPIO_PIN_SET
+} GPIO_PinState;
+
+typedef struct {
+    uint32_t Pin;
+    uint32_t Mode;
+    uint32_t Pull;
+    uint32_t Speed;
+    uint32_t Alternate;
+} GPIO_InitTypeDef;
+
+#define GPIO_PIN_0 ((uint16_t)0x0001)
+#define GPIO_PIN_1 ((uint16_t)0x0002)
+#define GPIO_PIN_2 ((uint16_t)0x0004)
+#define GPIO_PIN_3 ((uint16_t)0x0008)
+#define GPIO_PIN_4 ((uint16_t)0x0010)
+#define GPIO_PIN_5 ((uint16_t)0x0020)
+#define GPIO_PIN_6 ((uint16_t)0x0040)
+#define GPIO_PIN_7 ((uint16_t)0x0080)
+#define GPIO_PIN_8 ((uint16_t)0x0100)
+#define GPIO_PIN_9 ((uint16_t)0x0200)
+#define GPIO_PIN_10 ((uint16_t)0x0400)
+#define GPIO_PIN_11 ((uint16_t)0x0800)
+#define GPIO_PIN_12 ((uint16_t)0x1000)
+#define GPIO_PIN_13 ((uint16_t)0x2000)
+#define GPIO_PIN_14 ((uint16_t)0x4000)
+#define GPIO_PIN_15 ((uint16_t)0x8000)
+
+#define GPIO_MODE_INPUT 0x00000000U
+#define GPIO_MODE_OUTPUT_PP 0x00000001U
+#define GPIO_MODE_OUTPUT_OD 0x00000011U
+#define GPIO_MODE_AF_PP 0x00000002U
+#define GPIO_MODE_IT_RISING_FALLING 0x10310000U
+
+#define GPIO_NOPULL 0x00000000U
+#define GPIO_PULLUP 0x00000001U
+#define GPIO_PULLDOWN 0x00000002U
+
+#define GPIO_SPEED_FREQ_LOW 0x00000000U
+#define GPIO_SPEED_FREQ_MEDIUM 0x00000001U
+#define GPIO_SPEED_FREQ_HIGH 0x00000002U
+#define GPIO_SPEED_FREQ_VERY_HIGH 0x00000003U
+#define GPIO_SPEED_LOW GPIO_SPEED_FREQ_LOW
+#define GPIO_SPEED_MEDIUM GPIO_SPEED_FREQ_MEDIUM
+#define GPIO_SPEED_FAST GPIO_SPEED_FREQ_HIGH
+#define GPIO_SPEED_HIGH GPIO_SPEED_FREQ_VERY_HIGH
+
+#define GPIO_AF1_TIM1 ((uint8_t)0x01)
+
+void HAL_GPIO_Init(GPIO_TypeDef* GPIOx, GPIO_InitTypeDef* GPIO_Init);
+GPIO_PinState HAL_GPIO_ReadPin(GPIO_TypeDef* GPIOx, uint16_t GPIO_Pin);
+void HAL_GPIO_WritePin(GPIO_TypeDef* GPIOx, uint16_t GPIO_Pin,
+                       GPIO_PinState PinState);
+void HAL_GPIO_TogglePin(GPIO_TypeDef* GPIOx, uint16_t GPIO_Pin);
+void HAL_GPIO_EXTI_IRQHandler(uint16_t GPIO_Pin);
+
+extern GPIO_TypeDef sim_GPIOA;
+extern GPIO_TypeDef sim_GPIOB;
+extern GPIO_TypeDef sim_GPIOC;
+#define GPIOA (&sim_GPIOA)
+#define GPIOB (&sim_GPIOB)
+#define GPIOC (&sim_GPIOC)
+
+/* DMA ----------------------------------------------------------------------*/
+// Only circular peripheral to memory transfers from timer captures are
+// modelled, see HAL_TIM_IC_Start_DMA().
+typedef struct {
+    volatile uint32_t CR;
+    volatile uint32_t NDTR;
+} DMA_Stream_TypeDef;
+
+extern DMA_Stream_TypeDef sim_DMA2_Stream1;
+extern DMA_Stream_TypeDef sim_DMA2_Stream2;
+#define DMA2_Stream1 (&sim_DMA2_Stream1)
+#define DMA2_Stream2 (&sim_DMA2_Stream2)
+
+typedef struct {
+    uint32_t Channel;
+    uint32_t Direction;
+    uint32_t PeriphInc;
+    uint32_t MemInc;
+    uint32_t PeriphDataAlignment;
+    uint32_t MemDataAlignment;
+    uint32_t Mode;
+    uint32_t Priority;
+    uint32_t FIFOMode;
+} DMA_InitTypeDef;
+
+typedef struct __DMA_HandleTypeDef {
+    DMA_Stream_TypeDef* Instance;
+    DMA_InitTypeDef Init;
+    void* Parent;
+} DMA_HandleTypeDef;
+
+#define DMA_CHANNEL_6 0x0C000000U
+#define DMA_PERIPH_TO_MEMORY 0x00000000U
+#define DMA_PINC_DISABLE 0x00000000U
+#define DMA_MINC_ENABLE 0x00000400U
+#define DMA_PDATAALIGN_HALFWORD 0x00000800U
+#define DMA_MDATAALIGN_HALFWORD 0x00002000U
+#define DMA_CIRCULAR 0x00000100U
+#define DMA_PRIORITY_LOW 0x00000000U
+#define DMA_FIFOMODE_DISABLE 0x00000000U
+
+#define __HAL_LINKDMA(__HANDLE__, __PPP_DMA_FIELD__, __DMA_HANDLE__) \
+    do {                                                          \
+        (__HANDLE__)->__PPP_DMA_FIELD__ = &(__DMA_HANDLE__);      \
+        (__DMA_HANDLE__).Parent = (__HANDLE__);                   \
+    } while (0)
+
+HAL_StatusTypeDef HAL_DMA_Init(DMA_HandleTypeDef* hdma);
+
+/* TIM ----------------------------------------------------------------------*/
+typedef struct {
+    volatile uint32_t CR1;
+    volatile uint32_t DIER;
+    volatile uint32_t SR;
+    volatile uint32_t CNT;
+    volatile uint32_t PSC;
+    volatile uint32_t ARR;
+    volatile uint32_t CCR1;
+    volatile uint32_t CCR2;
+} TIM_TypeDef;
+
+extern TIM_TypeDef sim_TIM1;
+extern TIM_TypeDef sim_TIM5;
+extern TIM_TypeDef sim_TIM6;
+extern TIM_TypeDef sim_TIM7;
+#define TIM1 (&sim_TIM1)
+#define TIM5 (&sim_TIM5)
+#define TIM6 (&sim_TIM6)
+#define TIM7 (&sim_TIM7)
+
+typedef struct {
+    uint32_t Prescaler;
+    uint32_t CounterMode;
+    uint32_t Period;
+    uint32_t ClockDivision;
+    uint32_t RepetitionCounter;
+    uint32_t AutoReloadPreload;
+} TIM_Base_InitTypeDef;
+
+typedef enum
+{
+    HAL_TIM_ACTIVE_CHANNEL_1 = 0x01U,
+    HAL_TIM_ACTIVE_CHANNEL_2 = 0x02U,
+    HAL_TIM_ACTIVE_CHANNEL_CLEARED = 0x00U
+} HAL_TIM_ActiveChannel;
+
+typedef struct __TIM_HandleTypeDef {
+    TIM_TypeDef* Instance;
+    TIM_Base_InitTypeDef Init;
+    HAL_TIM_ActiveChannel Channel;
+    void (*PeriodElapsedCallback)(struct __TIM_HandleTypeDef* htim);
+    void (*IC_CaptureCallback)(struct __TIM_HandleTypeDef* htim);
+    DMA_HandleTypeDef* hdma[7];
+} TIM_HandleTypeDef;
+
+typedef void (*pTIM_CallbackTypeDef)(TIM_HandleTypeDef* htim);
+
+typedef enum
+{
+    HAL_TIM_PERIOD_ELAPSED_CB_ID = 0x0EU,
+    HAL_TIM_IC_CAPTURE_CB_ID = 0x12U
+} HAL_TIM_CallbackIDTypeDef;
+
+typedef struct {
+    uint32_t SlaveMode;
+    uint32_t InputTrigger;
+    uint32_t TriggerPolarity;
+    uint32_t TriggerPrescaler;
+    uint32_t TriggerFilter;
+} TIM_SlaveConfigTypeDef;
+
+typedef struct {
+    uint32_t ICPolarity;
+    uint32_t ICSelection;
+    uint32_t ICPrescaler;
+    uint32_t ICFilter;
+} TIM_IC_InitTypeDef;
+
+typedef struct {
+    uint32_t MasterOutputTrigger;
+    uint32_t MasterSlaveMode;
+} TIM_MasterConfigTypeDef;
+
+#define TIM_CHANNEL_1 0x00000000U
+#define TIM_CHANNEL_2 0x00000004U
+#define TIM_COUNTERMODE_UP 0x00000000U
+#define TIM_CLOCKDIVISION_DIV1 0x00000000U
+#define TIM_AUTORELOAD_PRELOAD_DISABLE 0x00000000U
+#define TIM_SLAVEMODE_RESET 0x00000004U
+#define TIM_TS_TI1FP1 0x00000050U
+#define TIM_INPUTCHANNELPOLARITY_RISING 0x00000000U
+#define TIM_INPUTCHANNELPOLARITY_FALLING 0x00000002U
+#define TIM_ICPSC_DIV1 0x00000000U
+#define TIM_ICPSC_DIV2 0x00000004U
+#define TIM_ICSELECTION_DIRECTTI 0x00000001U
+#define TIM_ICSELECTION_INDIRECTTI 0x00000002U
+#define TIM_TRGO_RESET 0x00000000U
+#define TIM_MASTERSLAVEMODE_DISABLE 0x00000000U
+#define TIM_IT_UPDATE 0x00000001U
+#define TIM_DMA_ID_CC1 ((uint16_t)0x0001)
+#define TIM_DMA_ID_CC2 ((uint16_t)0x0002)
+
+#define __HAL_TIM_CLEAR_IT(__HANDLE__, __INTERRUPT__) \
+    ((__HANDLE__)->Instance->SR = ~(__INTERRUPT__))
+// A new auto-reload value is picked up at the next update event; the
+// running period is not cut short.
+#define __HAL_TIM_SET_AUTORELOAD(__HANDLE__, __AUTORELOAD__) \
+    do {                                                     \
+        (__HANDLE__)->Instance->ARR = (__AUTORELOAD__);      \
+        (__HANDLE__)->Init.Period = (__AUTORELOAD__);        \
+    } while (0)
+#define __HAL_TIM_SET_COUNTER(__HANDLE__, __COUNTER__) \
+    ((__HANDLE__)->Instance->CNT = (__COUNTER__))
+
+HAL_StatusTypeDef HAL_TIM_Base_Init(TIM_HandleTypeDef* htim);
+HAL_StatusTypeDef HAL_TIM_Base_Start_IT(TIM_HandleTypeDef* htim);
+HAL_StatusTypeDef HAL_TIM_IC_Init(TIM_HandleTypeDef* htim);
+HAL_StatusTypeDef HAL_TIM_IC_Start(TIM_HandleTypeDef* htim, uint32_t Channel);
+HAL_StatusTypeDef HAL_TIM_IC_Start_IT(TIM_HandleTypeDef* htim,
+                                     uint32_t Channel);
+HAL_StatusTypeDef HAL_TIM_IC_Start_DMA(TIM_HandleTypeDef* htim,
+                                      uint32_t Channel, uint32_t* pData,
+                                      uint16_t Length);
+HAL_StatusTypeDef HAL_TIM_IC_ConfigChannel(TIM_HandleTypeDef* htim,
+                                          TIM_IC_InitTypeDef* sConfig,
+                                          uint32_t Channel);
+HAL_StatusTypeDef HAL_TIM_SlaveConfigSynchro(
+    TIM_HandleTypeDef* htim, TIM_SlaveConfigTypeDef* sSlaveConfig);
+HAL_StatusTypeDef HAL_TIMEx_MasterConfigSynchronization(
+    TIM_HandleTypeDef* htim, TIM_MasterConfigTypeDef* sMasterConfig);
+HAL_StatusTypeDef HAL_TIM_RegisterCallback(
+    TIM_HandleTypeDef* htim, HAL_TIM_CallbackIDTypeDef CallbackID,
+    pTIM_CallbackTypeDef pCallback);
+void HAL_TIM_IRQHandler(TIM_HandleTypeDef* htim);
+uint32_t HAL_TIM_ReadCapturedValue(TIM_HandleTypeDef* htim, uint32_t Channel);
+
+/* CAN ----------------------------------------------------------------------*/
+typedef struct {
+    volatile uint32_t TSR;
+    volatile uint32_t IER;
+} CAN_TypeDef;
+
+extern CAN_TypeDef sim_CAN1;
+extern CAN_TypeDef sim_CAN2;
+#define CAN1 (&sim_CAN1)
+#define CAN2 (&sim_CAN2)
+
+typedef struct {
+    CAN_TypeDef* Instance;
+} CAN_HandleTypeDef;
+
+#define CAN_IT_TX_MAILBOX_EMPTY 0x00000001U
+#define CAN_IT_RX_FIFO0_MSG_PENDING 0x00000002U
+#define CAN_IT_RX_FIFO1_MSG_PENDING 0x00000010U
+
+#define CAN_FLAG_RQCP0 0x00000500U
+#define CAN_FLAG_RQCP1 0x00000508U
+#define CAN_FLAG_RQCP2 0x00000510U
+
+#define __HAL_CAN_CLEAR_FLAG(__HANDLE__, __FLAG__) \
+    ((__HANDLE__)->Instance->TSR = (1U << ((__FLAG__)&0x1FU)))
+#define __HAL_CAN_ENABLE_IT(__HANDLE__, __INTERRUPT__) \
+    (((__HANDLE__)->Instance->IER) |= (__INTERRUPT__))
+#define __HAL_CAN_DISABLE_IT(__HANDLE__, __INTERRUPT__) \
+    (((__HANDLE__)->Instance->IER) &= ~(__INTERRUPT__))
+
+typedef struct {
+    uint32_t FilterIdHigh;
+    uint32_t FilterIdLow;
+    uint32_t FilterMaskIdHigh;
+    uint32_t FilterMaskIdLow;
+    uint32_t FilterFIFOAssignment;
+    uint32_t FilterBank;
+    uint32_t FilterMode;
+    uint32_t FilterScale;
+    uint32_t FilterActivation;
+    uint32_t SlaveStartFilterBank;
+} CAN_FilterTypeDef;
+
+#define CAN_FILTERMODE_IDMASK 0x00000000U
+#define CAN_FILTERMODE_IDLIST 0x00000001U
+#define CAN_FILTERSCALE_16BIT 0x00000000U
+#define CAN_FILTERSCALE_32BIT 0x00000001U
+#define CAN_FILTER_FIFO0 0x00000000U
+#define CAN_FILTER_FIFO1 0x00000001U
+
+// Only 32 bit scale filter banks are modelled.
+HAL_StatusTypeDef HAL_CAN_ConfigFilter(CAN_HandleTypeDef* hcan,
+                                       CAN_FilterTypeDef* sFilterConfig);
+HAL_StatusTypeDef HAL_CAN_ActivateNotification(CAN_HandleTypeDef* hcan,
+                                               uint32_t ActiveITs);
+uint32_t HAL_CAN_GetTxMailboxesFreeLevel(CAN_HandleTypeDef* hcan);
+void HAL_CAN_IRQHandler(CAN_HandleTypeDef* hcan);
@@ -0,0 +1,61 @@
+/**
+ * @file pack_model.h
+ * @brief Equivalent circuit and thermal model of the battery pack, for charge
+ * sessions on the host.
+ *
+ * Each cell is an open circuit voltage that follows state of charge, a series
+ * resistance and one RC pair for the slower polarisation. The pack is
+ * NUM_SERIES_CELLS of those in series, each a parallel group of identical
+ * cells, with the cell curve pinned to MAX_CELL_VOLTAGE at full charge. The
+ * whole pack is one thermal mass heated by its resistive losses and cooled
+ * towards ambient.
+ *
+ */
+#pragma once
+
+#include <cstdint>
+
+#include "battery_charging_limits.h"
+
+namespace umnsvp {
+namespace charger {
+namespace sim {
+
+/**
+ * @brief Cell and pack constants. The defaults are 18650 class NMC cells.
+ *
+ */
+struct pack_params {
+    uint16_t series = NUM_SERIES_CELLS;
+    uint16_t parallel = 12;
+    float cell_capacity_Ah = 3.35f;
+    float cell_r0 = 0.030f;              // ohms, series resistance
+    float cell_r1 = 0.020f;              // ohms, polarisation
+    float cell_tau1 = 40.0f;             // s, polarisation time constant
+    float cell_heat_capacity = 42.0f;    // J/K
+    float cooling = 10.0f;               // W/K, whole pack to ambient
+    float ambient = 25.0f;               // Celsius
+};
+
+class PackModel {
+   public:
+    pack_params params;
+    float soc = 0.5f;           // 0..1
+    float current = 0;          // A, positive into the pack
+    float polarisation = 0;     // V across the pack's RC pairs
+    float temperature = 25.0f;  // Celsius
+    float energy_Wh = 0;        // into the terminals since construction
+
+    explicit PackModel(const pack_params& params = pack_params());
+    void update(float dt, float current);
+    float capacity_Ah() const;
+    float resistance() const;
+    float cell_open_circuit_voltage() const;
+    float open_circuit_voltage() const;
+    float terminal_voltage() const;
+    float heat() const;
+};
+
+}  // namespace sim
+}  // namespace charger
+}  // namespace umnsvp
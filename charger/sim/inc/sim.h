@@ -0,0 +1,146 @@
+/**
+ * @file sim.h
+ * @brief Simulation engine behind the host HAL and bxCAN stand-ins.
+ *
+ * Simulated time only moves when the engine is told to advance it. Every
+ * HAL_GetTick() poll from firmware costs a small, configurable amount of
+ * simulated time so busy-wait loops terminate, and the harness charges a
+ * fixed cost for each pass of the main loop. Interrupts (timers, pilot
+ * capture, CAN RX/TX) fire from inside advance() in timestamp order.
+ *
+ */
+#pragma once
+
+#include <cstdint>
+#include <functional>
+
+#include "bxcan.h"
+#include "hal.h"
+
+namespace umnsvp {
+namespace charger {
+namespace sim {
+
+using isr = std::function<void()>;
+using can_listener = std::function<void(const can::packet&)>;
+
+/**
+ * @brief Current simulated time.
+ *
+ * @return uint64_t microseconds since reset
+ */
+uint64_t now_us();
+
+/**
+ * @brief Move simulated time forward, firing every interrupt and scheduled
+ * event that falls due on the way.
+ *
+ * @param us Microseconds to advance.
+ */
+void advance_us(uint64_t us);
+
+/**
+ * @brief Advance to the next pending interrupt or event, as the core would
+ * while halted in WFI. Returns immediately if nothing is scheduled.
+ *
+ */
+void sleep_until_event();
+
+// simulated cost of one HAL_GetTick() poll
+void set_tick_poll_cost_us(uint32_t us);
+
+/**
+ * @brief Call fn every period_us, starting at first_us.
+ *
+ */
+void every(uint64_t period_us, uint64_t first_us, isr fn);
+
+/**
+ * @brief Call fn once at absolute time at_us.
+ *
+ */
+void at(uint64_t at_us, isr fn);
+
+// Route a peripheral interrupt to a handler, as the vector table would.
+void set_irq_handler(IRQn_Type irq, isr handler);
+
+// GPIO
+void set_input_pin(GPIO_TypeDef* port, uint16_t pin, bool high);
+bool read_output_pin(GPIO_TypeDef* port, uint16_t pin);
+
+/**
+ * @brief Drive the J1772 control pilot seen by TIM1 input capture.
+ *
+ * @param frequency Pilot frequency in Hz, 0 for no pilot.
+ * @param duty High time as a fraction of the period.
+ */
+void set_pilot(float frequency, float duty);
+
+// A noise spike on the pilot: an extra rising edge now, falling 1 us later.
+void glitch_pilot();
+
+// CAN
+static constexpr uint32_t CAN_FRAME_TIME_US = 540;  // 29 bit frame at 250k
+
+/**
+ * @brief Queue a frame from another node for reception on a CAN instance.
+ *
+ */
+void inject(CAN_TypeDef* instance, can::fifo fifo, const can::packet& p);
+
+// Hold the bus for a frame from another node, delaying our transmissions.
+void occupy_bus(CAN_TypeDef* instance, uint32_t us);
+
+// Observe every frame a CAN instance puts on the bus.
+void on_transmit(CAN_TypeDef* instance, can_listener listener);
+
+// Observe every frame other nodes put on the bus, before filtering.
+void on_receive(CAN_TypeDef* instance, can_listener listener);
+
+/**
+ * @brief Bus-level counters for one CAN instance.
+ *
+ */
+struct can_stats {
+    uint32_t tx_frames = 0;
+    uint32_t tx_mailbox_full = 0;
+    uint32_t rx_frames = 0;
+    uint32_t rx_filtered = 0;  // rejected by the acceptance filters
+    uint32_t rx_overruns = 0;
+    uint32_t rx_interrupts = 0;
+};
+can_stats get_can_stats(CAN_TypeDef* instance);
+
+/**
+ * @brief GPIO output register writes, all ports together.
+ * pin_writes: HAL_GPIO_WritePin() and HAL_GPIO_TogglePin() calls
+ * bsrr_writes: direct writes to a BSRR
+ *
+ */
+struct gpio_stats {
+    uint32_t pin_writes = 0;
+    uint32_t bsrr_writes = 0;
+};
+gpio_stats get_gpio_stats();
+
+/**
+ * @brief Thrown out of whatever firmware code is running when the core
+ * resets, by NVIC_SystemReset() or by the watchdog running out. The harness
+ * catches it, calls reset() and starts a new Application; backup SRAM and the
+ * RCC reset flags carry over as they do on the chip.
+ *
+ */
+struct system_reset {
+    bool watchdog;
+};
+
+// Discard all peripheral and scheduler state, back to t = 0. Backup SRAM
+// and the reset flags are kept.
+void reset();
+
+// Lose backup SRAM, as a power cycle without VBAT would.
+void clear_backup_sram();
+
+}  // namespace sim
+}  // namespace charger
+}  // namespace umnsvp
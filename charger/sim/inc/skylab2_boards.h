@@ -0,0 +1,47 @@
+/**
+ * @file skylab2_boards.h
+ * @brief Host simulation stand-in for the generated skylab2 charger board
+ * interface.
+ *
+ */
+#pragma once
+
+#include "bxcan.h"
+#include "skylab2_packets.h"
+#include "triple_buffer.h"
+
+namespace umnsvp {
+namespace skylab2 {
+
+class charger_can {
+   private:
+    can::bxcan_driver& can_device;
+    can::fifo rx_fifo;
+
+    template <class T>
+    can::status send(CANPacketId id, uint8_t length, const T& msg);
+
+   public:
+    charger_can(can::bxcan_driver& can_device, can::fifo rx_fifo);
+    void init();
+    void main_bus_rx_handler();
+    void main_bus_tx_handler();
+
+    can::status send_charger_state(can_packet_charger_state msg);
+    can::status send_charger_bms_request(can_packet_charger_bms_request msg);
+
+    triple_buffer::TripleBuffer<can_packet_bms_measurement>
+        bms_measurement_buffer;
+    triple_buffer::TripleBuffer<can_packet_battery_status>
+        battery_status_buffer;
+    triple_buffer::TripleBuffer<can_packet_bms_module_min_max>
+        bms_module_min_max_buffer;
+    triple_buffer::TripleBuffer<can_packet_bms_capacity> bms_capacity_buffer;
+    triple_buffer::TripleBuffer<can_packet_bms_charger_response>
+        bms_charger_response_buffer;
+    triple_buffer::TripleBuffer<can_packet_charger_current_voltage>
+        charger_current_voltage_buffer;
+};
+
+}  // namespace skylab2
+}  // namespace umnsvp
@@ -0,0 +1,139 @@
+/**
+ * @file skylab2_packets.h
+ * @brief Host simulation stand-in for the generated skylab2 packet
+ * definitions. Only the packets the charger produces or consumes exist here.
+ *
+ */
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+
+namespace umnsvp {
+namespace skylab2 {
+
+enum class CANPacketId : uint32_t
+{
+    CAN_PACKET_BMS_MEASUREMENT = 0x010,
+    CAN_PACKET_BATTERY_STATUS = 0x011,
+    CAN_PACKET_BMS_MODULE_MIN_MAX = 0x012,
+    CAN_PACKET_BMS_CAPACITY = 0x013,
+    CAN_PACKET_BMS_CHARGER_RESPONSE = 0x014,
+    CAN_PACKET_CHARGER_STATE = 0x573,
+    CAN_PACKET_CHARGER_BMS_REQUEST = 0x574,
+    CAN_PACKET_CHARGER_CURRENT_VOLTAGE = 0x575,
+    CAN_PACKET_THUNDERSTRUCK_CONTROL_MESSAGE = 0x18E54024,
+    CAN_PACKET_THUNDERSTRUCK_STATUS_MESSAGE = 0x18EB2440
+};
+
+static constexpr uint8_t CAN_LENGTH_BMS_MEASUREMENT = 8;
+static constexpr uint8_t CAN_LENGTH_BATTERY_STATUS = 1;
+static constexpr uint8_t CAN_LENGTH_BMS_MODULE_MIN_MAX = 8;
+static constexpr uint8_t CAN_LENGTH_BMS_CAPACITY = 4;
+static constexpr uint8_t CAN_LENGTH_BMS_CHARGER_RESPONSE = 1;
+static constexpr uint8_t CAN_LENGTH_CHARGER_STATE = 8;
+static constexpr uint8_t CAN_LENGTH_CHARGER_BMS_REQUEST = 1;
+static constexpr uint8_t CAN_LENGTH_CHARGER_CURRENT_VOLTAGE = 8;
+static constexpr uint8_t CAN_LENGTH_THUNDERSTRUCK_CONTROL_MESSAGE = 8;
+static constexpr uint8_t CAN_LENGTH_THUNDERSTRUCK_STATUS_MESSAGE = 8;
+
+struct can_packet_bms_measurement {
+    uint16_t battery_voltage;  // 10 mV
+    uint16_t reserved;
+    float current;  // A, positive into the pack
+};
+
+struct can_packet_battery_status {
+    struct {
+        uint8_t killed : 1;
+        uint8_t reserved : 7;
+    } battery_state;
+};
+
+struct can_packet_bms_module_min_max {
+    int16_t module_max_temp;      // 0.01 C
+    int16_t module_min_temp;      // 0.01 C
+    uint16_t module_max_voltage;  // mV
+    uint16_t module_min_voltage;  // mV
+};
+
+struct can_packet_bms_capacity {
+    float Wh;
+};
+
+struct can_packet_bms_charger_response {
+    struct {
+        uint8_t charging_ready : 1;
+        uint8_t reserved : 7;
+    } response_flags;
+};
+
+struct can_packet_charger_state {
+    struct {
+        uint8_t CHARGER_CAN_TIMEOUT : 1;
+        uint8_t CHARGER_OVERTEMP : 1;
+        uint8_t CHARGER_OVERVOLT : 1;
+        uint8_t BATTERY_UNDERVOLT : 1;
+        uint8_t BATTERY_OVERVOLT : 1;
+        uint8_t BATTERY_CAN_TIMEOUT : 1;
+        uint8_t BATTERY_CELL_OVERTEMP : 1;
+        uint8_t BATTERY_HV_KILL : 1;
+    } fault;
+    struct {
+        uint8_t charger_plugged : 1;
+        uint8_t reserved : 7;
+    } state_flags;
+    uint16_t charger_max_temp;  // 0.001 C
+    float charging_current;     // A
+};
+
+struct can_packet_charger_bms_request {
+    struct {
+        uint8_t charging_requested : 1;
+        uint8_t reserved : 7;
+    } request_flags;
+};
+
+struct can_packet_charger_current_voltage {
+    float max_current;
+    float max_capacity;
+};
+
+struct can_packet_thunderstruck_control_message {
+    uint8_t Enable;
+    uint16_t CHARGE_VOLTAGE;
+    uint16_t CHARGE_CURRENT;
+    uint8_t LED_BLINK_PATTERN;
+    uint16_t RESERVED;
+};
+
+struct can_packet_thunderstruck_status_message {
+    uint8_t STATUS_FLAGS;
+    uint8_t CHARGE_FLAGS;
+    uint16_t OUTPUT_VOLTAGE;
+    uint16_t OUTPUT_CURRENT;
+    uint8_t CHARGER_TEMP;
+    uint8_t RESERVED;
+};
+
+/**
+ * @brief Wire encoding used by the simulated car bus. The real generated code
+ * packs fields explicitly; the host model only needs both ends to agree.
+ *
+ */
+template <class T>
+void pack(const T& msg, uint8_t* data) {
+    static_assert(sizeof(T) <= 8, "skylab2 packets fit in one CAN frame");
+    std::memcpy(data, &msg, sizeof(T));
+}
+
+template <class T>
+T unpack(const uint8_t* data) {
+    static_assert(sizeof(T) <= 8, "skylab2 packets fit in one CAN frame");
+    T msg;
+    std::memcpy(&msg, data, sizeof(T));
+    return msg;
+}
+
+}  // namespace skylab2
+}  // namespace umnsvp
@@ -0,0 +1,115 @@
+/**
+ * @file state_names.h
+ * @brief Printable names for Application state, shared by the host tools.
+ *
+ */
+#pragma once
+
+#include <string>
+
+#include "application.h"
+
+namespace umnsvp {
+namespace charger {
+namespace sim {
+
+inline const char* state_name(charge_state state) {
+    switch (state) {
+        case charge_state::IDLE:
+            return "IDLE";
+        case charge_state::CONNECTED:
+            return "CONNECTED";
+        case charge_state::THUNDERSTRUCK_POWER_ON:
+            return "THUNDERSTRUCK_POWER_ON";
+        case charge_state::CHARGING:
+            return "CHARGING";
+        case charge_state::FAULT_LATCHING:
+            return "FAULT_LATCHING";
+        case charge_state::FAULT_RESETTABLE:
+            return "FAULT_RESETTABLE";
+        case charge_state::CHARGING_DONE:
+            return "CHARGING_DONE";
+    }
+    return "?";
+}
+
+inline const char* isolation_name(isolation_state state) {
+    switch (state) {
+        case isolation_state::DISABLE_REQUESTED:
+            return "DISABLE_REQUESTED";
+        case isolation_state::WAITING_FOR_DECAY:
+            return "WAITING_FOR_DECAY";
+        case isolation_state::CONTACTOR_OPEN:
+            return "CONTACTOR_OPEN";
+        case isolation_state::DONE:
+            return "DONE";
+    }
+    return "?";
+}
+
+inline const char* phase_name(uint8_t phase) {
+    static const char* const names[] = {
+        "WAKE",         "RECEIVE_STATUS_PACKET", "UPDATE_CAN_VALUES",
+        "PILOT_UPDATE", "CHECK_FAULTS",          "PROX_READ",
+        "UPDATE_STATE", "STATE_ACTION",          "REGULATE_CURRENT",
+        "TELEMETRY",    "STARTUP"};
+    static_assert(sizeof(names) / sizeof(names[0]) ==
+                  static_cast<size_t>(loop_phase::COUNT));
+    return phase < static_cast<uint8_t>(loop_phase::COUNT) ? names[phase]
+                                                           : "?";
+}
+
+inline const char* reset_cause_name(uint8_t cause) {
+    switch (static_cast<reset_cause>(cause)) {
+        case reset_cause::NONE:
+            return "NONE";
+        case reset_cause::DEADLINE:
+            return "DEADLINE";
+        case reset_cause::WATCHDOG:
+            return "WATCHDOG";
+    }
+    return "?";
+}
+
+// "charger 0", "charger 1", ... for the charger status links
+inline std::string link_name(comm_link link) {
+    static const char* const names[] = {"bms measurement", "battery status",
+                                        "bms min/max", "charger response"};
+    const uint8_t i = static_cast<uint8_t>(link);
+    const uint8_t first_charger =
+        static_cast<uint8_t>(comm_link::CHARGER_STATUS);
+    if (i < first_charger) {
+        return names[i];
+    }
+    return "charger " + std::to_string(i - first_charger);
+}
+
+// set flags joined with '|', "-" if none
+inline std::string fault_names(bms_fault_type fault) {
+    static const char* const names[] = {"HV_KILL", "BATTERY_UNDERVOLT",
+                                        "BATTERY_OVERVOLT", "CELL_OVERTEMP",
+                                        "BMS_CAN_TIMEOUT"};
+    std::string text;
+    for (size_t i = 0; i < sizeof(names) / sizeof(names[0]); i++) {
+        if (static_cast<uint8_t>(fault) & (0b1 << i)) {
+            text += text.empty() ? names[i] : std::string("|") + names[i];
+        }
+    }
+    return text.empty() ? "-" : text;
+}
+
+inline std::string fault_names(charger_fault_type fault) {
+    static const char* const names[] = {"CHARGER_OVERVOLT", "CHARGER_OVERTEMP",
+                                        "CHARGER_CAN_TIMEOUT"};
+    std::string text;
+    for (size_t i = 0; i < sizeof(names) / sizeof(names[0]); i++) {
+        if (static_cast<uint8_t>(fault) & (0b1 << i)) {
+            text += text.empty() ? names[i] : std::string("|") + names[i];
+        }
+    }
+    return text.empty() ? "-" : text;
+}
+
+}  // namespace sim
+}  // namespace charger
+}  // namespace umnsvp
@@ -0,0 +1,6 @@
+/**
+ * @file stm32f4xx_hal_gpio.h
+ * @brief Host simulation stand-in. Everything the charger uses from this HAL
+ * module is declared in the simulation hal.h.
+ */
+#pragma once
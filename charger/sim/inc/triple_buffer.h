@@ -0,0 +1,42 @@
+/**
+ * @file triple_buffer.h
+ * @brief Host simulation stand-in for the umnsvp triple buffer.
+ *
+ */
+#pragma once
+
+namespace umnsvp {
+namespace triple_buffer {
+
+/**
+ * @brief Latest-value mailbox between an interrupt and the main loop. A push
+ * overwrites any value the consumer has not popped yet.
+ *
+ */
+template <class T>
+class TripleBuffer {
+   private:
+    T back;
+    T front;
+    bool fresh = false;
+
+   public:
+    void push(const T& item) {
+        back = item;
+        fresh = true;
+    }
+    bool pop() {
+        if (!fresh) {
+            return false;
+        }
+        front = back;
+        fresh = false;
+        return true;
+    }
+    T output() const {
+        return front;
+    }
+};
+
+}  // namespace triple_buffer
+}  // namespace umnsvp
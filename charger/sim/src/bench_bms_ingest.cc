@@ -0,0 +1,350 @@
+/**
+ * @file bench_bms_ingest.cc
+ * @brief Host cost of taking BMS packets off the car bus, per main loop pass,
+ * for the skylab2 triple buffer path and the dirty bit dispatch in Bms.
+ *
+ * Idle: no BMS frame arrives between passes. Saturated: all five BMS
+ * packets arrive before every pass. One frame: a single BMS packet, each in
+ * turn. The cost of a pass is the RX interrupt work for the frames that
+ * arrived plus update_can_values(). The old path's two halves lived in other
+ * files, so they are kept out of line here as Bms's are.
+ *
+ * The old path refreshes its own CommTimeouts for the four tracked packets,
+ * as Bms does, so both columns pay for the same link bookkeeping. Bms also
+ * queues every measurement frame and integrates pack energy over it, which
+ * the old path has no counterpart for; the last row times that part alone.
+ * Along with the urgent fault check and the arrival tick it makes every
+ * frame cost more than before; only the idle pass is cheaper.
+ *
+ * Usage: bench_bms_ingest [passes]
+ *
+ */
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#include "bms.h"
+#include "sim.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define HAVE_TSC 1
+#endif
+
+using namespace umnsvp::charger;
+namespace skylab2 = umnsvp::skylab2;
+using umnsvp::can::packet;
+
+namespace {
+template <class T>
+packet make_packet(skylab2::CANPacketId id, uint8_t length, const T& msg) {
+    uint8_t data[8] = {0};
+    skylab2::pack(msg, data);
+    return packet(static_cast<uint32_t>(id), length, data, false);
+}
+
+/**
+ * @brief The previous path: the skylab2 RX handler decodes every frame into
+ * a triple buffer and the main loop polls all five buffers.
+ *
+ */
+struct LegacyBms {
+    static constexpr float PACK_VOLTAGE_CONVERSION = 0.01;
+    static constexpr float CELL_VOLTAGE_CONVERSION = 0.001;
+    static constexpr float CELL_TEMP_CONVERSION = 0.01;
+
+    umnsvp::triple_buffer::TripleBuffer<skylab2::can_packet_bms_measurement>
+        bms_measurement_buffer;
+    umnsvp::triple_buffer::TripleBuffer<skylab2::can_packet_battery_status>
+        battery_status_buffer;
+    umnsvp::triple_buffer::TripleBuffer<skylab2::can_packet_bms_module_min_max>
+        bms_module_min_max_buffer;
+    umnsvp::triple_buffer::TripleBuffer<skylab2::can_packet_bms_capacity>
+        bms_capacity_buffer;
+    umnsvp::triple_buffer::TripleBuffer<
+        skylab2::can_packet_bms_charger_response>
+        bms_charger_response_buffer;
+
+    bool charging_ready = false;
+    float max_cell_voltage = 0;
+    float max_cell_temp = 0;
+    float pack_voltage = 0;
+    bool killed = false;
+    float current_battery_pack_capacity = 0;
+    float battery_current = 0;
+    CommTimeouts timeouts;
+
+    LegacyBms() {
+        timeouts.track(comm_link::BMS_MEASUREMENT, 2500);
+        timeouts.track(comm_link::BMS_BATTERY_STATUS, 2500);
+        timeouts.track(comm_link::BMS_MIN_MAX, 2500);
+        timeouts.track(comm_link::BMS_CHARGER_RESPONSE, 2500);
+    }
+
+    __attribute__((noinline)) void rx_handler(const packet& p) {
+        const uint8_t* data = p.get_data();
+        switch (static_cast<skylab2::CANPacketId>(p.get_id())) {
+            case skylab2::CANPacketId::CAN_PACKET_BMS_MEASUREMENT:
+                bms_measurement_buffer.push(
+                    skylab2::unpack<skylab2::can_packet_bms_measurement>(
+                        data));
+                break;
+            case skylab2::CANPacketId::CAN_PACKET_BATTERY_STATUS:
+                battery_status_buffer.push(
+                    skylab2::unpack<skylab2::can_packet_battery_status>(data));
+                break;
+            case skylab2::CANPacketId::CAN_PACKET_BMS_MODULE_MIN_MAX:
+                bms_module_min_max_buffer.push(
+                    skylab2::unpack<skylab2::can_packet_bms_module_min_max>(
+                        data));
+                break;
+            case skylab2::CANPacketId::CAN_PACKET_BMS_CAPACITY:
+                bms_capacity_buffer.push(
+                    skylab2::unpack<skylab2::can_packet_bms_capacity>(data));
+                break;
+            case skylab2::CANPacketId::CAN_PACKET_BMS_CHARGER_RESPONSE:
+                bms_charger_response_buffer.push(
+                    skylab2::unpack<skylab2::can_packet_bms_charger_response>(
+                        data));
+                break;
+            default:
+                break;
+        }
+    }
+
+    __attribute__((noinline)) void update_can_values() {
+        if (bms_module_min_max_buffer.pop()) {
+            skylab2::can_packet_bms_module_min_max msg =
+                bms_module_min_max_buffer.output();
+            max_cell_voltage = msg.module_max_voltage * CELL_VOLTAGE_CONVERSION;
+            max_cell_temp = msg.module_max_temp * CELL_TEMP_CONVERSION;
+            timeouts.refresh(comm_link::BMS_MIN_MAX, HAL_GetTick());
+        }
+        if (bms_charger_response_buffer.pop()) {
+            skylab2::can_packet_bms_charger_response msg =
+                bms_charger_response_buffer.output();
+            charging_ready = msg.response_flags.charging_ready == 1;
+            timeouts.refresh(comm_link::BMS_CHARGER_RESPONSE, HAL_GetTick());
+        }
+        if (battery_status_buffer.pop()) {
+            skylab2::can_packet_battery_status msg =
+                battery_status_buffer.output();
+            killed = msg.battery_state.killed;
+            timeouts.refresh(comm_link::BMS_BATTERY_STATUS, HAL_GetTick());
+        }
+        if (bms_measurement_buffer.pop()) {
+            skylab2::can_packet_bms_measurement msg =
+                bms_measurement_buffer.output();
+            pack_voltage = msg.battery_voltage * PACK_VOLTAGE_CONVERSION;
+            battery_current = msg.current;
+            timeouts.refresh(comm_link::BMS_MEASUREMENT, HAL_GetTick());
+        }
+        if (bms_capacity_buffer.pop()) {
+            skylab2::can_packet_bms_capacity msg = bms_capacity_buffer.output();
+            current_battery_pack_capacity = msg.Wh / 1000;
+        }
+    }
+};
+
+struct cost {
+    double ns;
+    double tsc;
+};
+
+// keep the optimizer from discarding the work being timed
+void clobber() {
+    asm volatile("" ::: "memory");
+}
+
+// timing rounds per row, alternating between the paths so a stray
+// preemption of the host or a frequency step lands on both alike
+constexpr int ROUNDS = 15;
+
+template <class Fn>
+cost time_round(int passes, Fn pass) {
+#ifdef HAVE_TSC
+    const uint64_t tsc_start = __rdtsc();
+#endif
+    const auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < passes; i++) {
+        pass(i);
+        clobber();
+    }
+    const auto elapsed = std::chrono::steady_clock::now() - start;
+    cost c;
+    c.ns = std::chrono::duration<double, std::nano>(elapsed).count() / passes;
+#ifdef HAVE_TSC
+    c.tsc = static_cast<double>(__rdtsc() - tsc_start) / passes;
+#else
+    c.tsc = 0;
+#endif
+    return c;
+}
+
+/**
+ * @brief Both paths' fastest rounds, and after over before in the median
+ * round.
+ *
+ */
+struct row {
+    cost before;
+    cost after;
+    double ratio;
+};
+
+template <class Before, class After>
+row time_both(int passes, Before before, After after) {
+    row r = {};
+    std::array<double, ROUNDS> ratios;
+    for (int round = 0; round < ROUNDS; round++) {
+        const cost b = time_round(passes, before);
+        const cost a = time_round(passes, after);
+        if (round == 0 || b.ns < r.before.ns) {
+            r.before = b;
+        }
+        if (round == 0 || a.ns < r.after.ns) {
+            r.after = a;
+        }
+        ratios[round] = a.ns / b.ns;
+    }
+    std::nth_element(ratios.begin(), ratios.begin() + ROUNDS / 2,
+                     ratios.end());
+    r.ratio = ratios[ROUNDS / 2];
+    return r;
+}
+
+void print(const char* name, const row& r) {
+    std::printf("%-10s %8.1f ns %8.0f tsc | %8.1f ns %8.0f tsc | %6.2fx\n",
+                name, r.before.ns, r.before.tsc, r.after.ns, r.after.tsc,
+                r.ratio);
+}
+}  // namespace
+
+int main(int argc, char** argv) {
+    const int passes = argc > 1 ? std::atoi(argv[1]) : 1000000;
+
+    sim::reset();
+    umnsvp::can::bxcan_driver can_device(CAN1);
+    skylab2::charger_can skylab(can_device, umnsvp::can::fifo::FIFO0);
+    CommTimeouts timeouts;
+    Bms bms(skylab, timeouts);
+    LegacyBms legacy;
+
+    // a few distinct frame sets so every pass decodes different values
+    std::vector<std::vector<packet>> traffic;
+    for (int i = 0; i < 16; i++) {
+        std::vector<packet> frames;
+        skylab2::can_packet_bms_measurement measurement = {};
+        measurement.battery_voltage = 13000 + i;
+        measurement.current = 10.0f + i;
+        frames.push_back(
+            make_packet(skylab2::CANPacketId::CAN_PACKET_BMS_MEASUREMENT,
+                        skylab2::CAN_LENGTH_BMS_MEASUREMENT, measurement));
+        skylab2::can_packet_battery_status status = {};
+        status.battery_state.killed = i & 1;
+        frames.push_back(
+            make_packet(skylab2::CANPacketId::CAN_PACKET_BATTERY_STATUS,
+                        skylab2::CAN_LENGTH_BATTERY_STATUS, status));
+        skylab2::can_packet_bms_module_min_max min_max = {};
+        min_max.module_max_voltage = 4000 + i;
+        min_max.module_max_temp = 2500 + i;
+        frames.push_back(
+            make_packet(skylab2::CANPacketId::CAN_PACKET_BMS_MODULE_MIN_MAX,
+                        skylab2::CAN_LENGTH_BMS_MODULE_MIN_MAX, min_max));
+        skylab2::can_packet_bms_capacity capacity = {};
+        capacity.Wh = 10000.0f + i;
+        frames.push_back(
+            make_packet(skylab2::CANPacketId::CAN_PACKET_BMS_CAPACITY,
+                        skylab2::CAN_LENGTH_BMS_CAPACITY, capacity));
+        skylab2::can_packet_bms_charger_response response = {};
+        response.response_flags.charging_ready = 1;
+        frames.push_back(
+            make_packet(skylab2::CANPacketId::CAN_PACKET_BMS_CHARGER_RESPONSE,
+                        skylab2::CAN_LENGTH_BMS_CHARGER_RESPONSE, response));
+        traffic.push_back(frames);
+    }
+
+    // both paths must land on the same values
+    for (const packet& p : traffic.back()) {
+        legacy.rx_handler(p);
+        bms.receive(p);
+    }
+    legacy.update_can_values();
+    bms.update_can_values();
+    const bool agree =
+        centi_volts::from(legacy.pack_voltage) == bms.get_pack_voltage() &&
+        milli_amps::from(legacy.battery_current) ==
+            bms.get_battery_current() &&
+        milli_volts::from(legacy.max_cell_voltage) ==
+            bms.get_max_cell_voltage() &&
+        centi_celsius::from(legacy.max_cell_temp) == bms.get_max_cell_temp() &&
+        legacy.killed == bms.check_battery_killed() &&
+        legacy.charging_ready == bms.check_ready_to_charge() &&
+        legacy.current_battery_pack_capacity == bms.get_battery_capacity();
+    std::printf("decoded values agree: %s\n\n", agree ? "yes" : "NO");
+
+    std::printf("%-10s %23s | %23s | %7s\n", "per pass",
+                "triple buffers (before)", "dirty bits (after)", "median");
+
+    // Timed from inside a simulated interrupt, so HAL_GetTick() is a plain
+    // read of the tick, as on the board, rather than a step of the sim clock
+    // that would charge whichever path reads it more often.
+    sim::at(sim::now_us(), [&] {
+        print("idle",
+              time_both(
+                  passes, [&](int) { legacy.update_can_values(); },
+                  [&](int) { bms.update_can_values(); }));
+
+        print("saturated", time_both(
+                               passes,
+                               [&](int i) {
+                                   for (const packet& p :
+                                        traffic[i % traffic.size()]) {
+                                       legacy.rx_handler(p);
+                                   }
+                                   legacy.update_can_values();
+                               },
+                               [&](int i) {
+                                   for (const packet& p :
+                                        traffic[i % traffic.size()]) {
+                                       bms.receive(p);
+                                   }
+                                   bms.update_can_values();
+                               }));
+
+        // one BMS frame a pass, each packet in turn, about what the car bus
+        // delivers to the main loop while charging
+        print("one frame", time_both(
+                               passes,
+                               [&](int i) {
+                                   legacy.rx_handler(
+                                       traffic[i % traffic.size()]
+                                              [i % traffic[0].size()]);
+                                   legacy.update_can_values();
+                               },
+                               [&](int i) {
+                                   bms.receive(traffic[i % traffic.size()]
+                                                      [i % traffic[0].size()]);
+                                   bms.update_can_values();
+                               }));
+
+        // the measurement frame alone: a triple buffer against the queue and
+        // the pack energy count
+        print("measure", time_both(
+                             passes,
+                             [&](int i) {
+                                 legacy.rx_handler(
+                                     traffic[i % traffic.size()][0]);
+                                 legacy.update_can_values();
+                             },
+                             [&](int i) {
+                                 bms.receive(traffic[i % traffic.size()][0]);
+                                 bms.update_can_values();
+                             }));
+    });
+    sim::advance_us(0);
+    return agree ? 0 : 1;
+}
@@ -0,0 +1,87 @@
+/**
+ * @file bench_can2_queue.cc
+ * @brief Throughput of the CAN2 transmit queue on a saturated charger bus.
+ *
+ * Another node holds the bus half of the time while the charger offers
+ * control and status frames faster than the remaining bandwidth can carry.
+ * Reports the queue counters, delivered frame rates and the host cost of an
+ * enqueue.
+ *
+ * Usage: bench_can2_queue [simulated seconds]
+ *
+ */
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+
+#include "can2.h"
+#include "sim.h"
+
+using namespace umnsvp::charger;
+
+namespace {
+constexpr uint64_t CONTROL_PERIOD_US = 1000;
+constexpr uint64_t STATUS_PERIOD_US = 1000;
+// other traffic: one frame every two frame times, 50 % bus load
+constexpr uint64_t BACKGROUND_PERIOD_US = 2 * sim::CAN_FRAME_TIME_US;
+}  // namespace
+
+int main(int argc, char** argv) {
+    const double duration_s = argc > 1 ? std::atof(argv[1]) : 10.0;
+    const uint64_t duration_us = static_cast<uint64_t>(duration_s * 1e6);
+
+    sim::reset();
+    CAN2Device device;
+    device.start();
+    sim::set_irq_handler(CAN2_TX_IRQn, [&device] { device.tx_handler(); });
+
+    uint32_t control_delivered = 0;
+    uint32_t status_delivered = 0;
+    sim::on_transmit(CAN2, [&](const umnsvp::can::packet& p) {
+        if (p.get_id() ==
+            static_cast<uint32_t>(umnsvp::skylab2::CANPacketId::
+                                      CAN_PACKET_THUNDERSTRUCK_CONTROL_MESSAGE)) {
+            control_delivered++;
+        } else {
+            status_delivered++;
+        }
+    });
+
+    sim::every(BACKGROUND_PERIOD_US, 0,
+               [] { sim::occupy_bus(CAN2, sim::CAN_FRAME_TIME_US); });
+
+    uint32_t offered = 0;
+    std::chrono::steady_clock::duration enqueue_time{};
+    umnsvp::skylab2::can_packet_thunderstruck_control_message control = {0};
+    umnsvp::skylab2::can_packet_thunderstruck_status_message status = {0};
+    sim::every(CONTROL_PERIOD_US, 0, [&] {
+        control.CHARGE_CURRENT++;
+        const auto start = std::chrono::steady_clock::now();
+        device.send_thunderstruck_control_message(control, 0);
+        enqueue_time += std::chrono::steady_clock::now() - start;
+        offered++;
+    });
+    sim::every(STATUS_PERIOD_US, STATUS_PERIOD_US / 2, [&] {
+        status.OUTPUT_CURRENT++;
+        const auto start = std::chrono::steady_clock::now();
+        device.send_thunderstruck_status_message(status);
+        enqueue_time += std::chrono::steady_clock::now() - start;
+        offered++;
+    });
+
+    sim::advance_us(duration_us);
+
+    const tx_queue_stats& stats = device.get_tx_stats();
+    std::printf("offered   %8u frames (%.0f /s)\n", offered,
+                offered / duration_s);
+    std::printf("enqueued  %8u\n", stats.enqueued);
+    std::printf("coalesced %8u\n", stats.coalesced);
+    std::printf("dropped   %8u\n", stats.dropped);
+    std::printf("retried   %8u\n", stats.retried);
+    std::printf("delivered %8.0f control /s, %.0f status /s\n",
+                control_delivered / duration_s, status_delivered / duration_s);
+    std::printf("enqueue   %8.0f ns mean (host)\n",
+                std::chrono::duration<double, std::nano>(enqueue_time).count() /
+                    offered);
+    return 0;
+}
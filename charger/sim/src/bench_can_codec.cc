@@ -0,0 +1,225 @@
+/**
+ * @file bench_can_codec.cc
+ * @brief Host cost of the descriptor generated Thunderstruck codec against
+ * the hand written shifts it replaced in can2.cc.
+ *
+ * Both encoders first run over the same random messages and must produce
+ * identical bytes; then each is timed packing and unpacking the set, in
+ * alternating rounds. The fastest round of each is printed, with the codec's
+ * time over the hand written code's in the median round. Exits non-zero on a
+ * mismatch or if that median is over 1 + TOLERANCE.
+ *
+ * Usage: bench_can_codec [passes]
+ *
+ */
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <vector>
+
+#include "thunderstruck_frames.h"
+
+using namespace umnsvp::charger;
+using control_message = umnsvp::skylab2::can_packet_thunderstruck_control_message;
+using status_message = umnsvp::skylab2::can_packet_thunderstruck_status_message;
+
+namespace {
+constexpr size_t MESSAGES = 4096;
+
+struct frame_bytes {
+    uint8_t data[8];
+};
+
+// the previous can2.cc implementation
+void hand_pack(const control_message& msg, uint8_t* data) {
+    data[0] = msg.Enable >> 0;
+    data[1] = msg.CHARGE_VOLTAGE >> 0;
+    data[2] = msg.CHARGE_VOLTAGE >> 8;
+    data[3] = msg.CHARGE_CURRENT >> 0;
+    data[4] = msg.CHARGE_CURRENT >> 8;
+    data[5] = msg.LED_BLINK_PATTERN >> 0;
+    data[6] = msg.RESERVED >> 0;
+    data[7] = msg.RESERVED >> 8;
+}
+
+void hand_pack(const status_message& msg, uint8_t* data) {
+    data[0] = msg.STATUS_FLAGS >> 0;
+    data[1] = msg.CHARGE_FLAGS >> 0;
+    data[2] = msg.OUTPUT_VOLTAGE >> 0;
+    data[3] = msg.OUTPUT_VOLTAGE >> 8;
+    data[4] = msg.OUTPUT_CURRENT >> 0;
+    data[5] = msg.OUTPUT_CURRENT >> 8;
+    data[6] = msg.CHARGER_TEMP >> 0;
+    data[7] = msg.RESERVED >> 0;
+}
+
+status_message hand_unpack_status(const uint8_t* data) {
+    status_message msg;
+    msg.STATUS_FLAGS = (uint8_t)((data[0] << 0));
+    msg.CHARGE_FLAGS = (uint8_t)((data[1] << 0));
+    msg.OUTPUT_VOLTAGE = (uint16_t)((data[2] << 0) | (data[3] << 8));
+    msg.OUTPUT_CURRENT = (uint16_t)((data[4] << 0) | (data[5] << 8));
+    msg.CHARGER_TEMP = (uint8_t)((data[6] << 0));
+    msg.RESERVED = (uint8_t)((data[7] << 0));
+    return msg;
+}
+
+uint32_t sum(const status_message& msg) {
+    return msg.STATUS_FLAGS + msg.CHARGE_FLAGS + msg.OUTPUT_VOLTAGE +
+           msg.OUTPUT_CURRENT + msg.CHARGER_TEMP + msg.RESERVED;
+}
+
+// keep the optimizer from discarding the work being timed
+void clobber() {
+    asm volatile("" ::: "memory");
+}
+
+// Each path gets its own copy of these loops, kept out of main, so the hand
+// and codec timings differ only in the encoder, not in how the surrounding
+// code was scheduled.
+template <class Message, class Pack>
+__attribute__((noinline)) void pack_all(const std::vector<Message>& msgs,
+                                        std::vector<frame_bytes>& frames,
+                                        Pack pack) {
+    for (size_t i = 0; i < MESSAGES; i++) {
+        pack(msgs[i], frames[i].data);
+    }
+}
+
+template <class Unpack>
+__attribute__((noinline)) uint32_t unpack_all(
+    const std::vector<frame_bytes>& frames, Unpack unpack) {
+    uint32_t checksum = 0;
+    for (size_t i = 0; i < MESSAGES; i++) {
+        checksum += sum(unpack(frames[i].data));
+    }
+    return checksum;
+}
+
+// timing rounds, alternating between the paths so a stray preemption of the
+// host or a frequency step lands on both alike
+constexpr int ROUNDS = 15;
+// the codec fails if, in the median round, it is this much slower than the
+// hand written code; both compile to the same loads and stores, so anything
+// past round to round noise is a regression
+constexpr double TOLERANCE = 0.03;
+
+template <class Fn>
+double time_ns(int passes, Fn fn) {
+    const auto start = std::chrono::steady_clock::now();
+    for (int pass = 0; pass < passes; pass++) {
+        fn();
+        clobber();
+    }
+    const auto elapsed = std::chrono::steady_clock::now() - start;
+    return std::chrono::duration<double, std::nano>(elapsed).count() /
+           (static_cast<double>(passes) * MESSAGES);
+}
+
+struct best {
+    double hand = 0;   // ns, fastest round
+    double codec = 0;  // ns, fastest round
+    double ratio = 0;  // codec over hand, median round
+
+    bool ok() const {
+        return ratio <= 1 + TOLERANCE;
+    }
+};
+
+template <class Hand, class Codec>
+best time_both(int passes, Hand hand, Codec codec) {
+    best b;
+    std::array<double, ROUNDS> ratios;
+    for (int round = 0; round < ROUNDS; round++) {
+        const double h = time_ns(passes, hand);
+        const double c = time_ns(passes, codec);
+        if (round == 0 || h < b.hand) {
+            b.hand = h;
+        }
+        if (round == 0 || c < b.codec) {
+            b.codec = c;
+        }
+        ratios[round] = c / h;
+    }
+    std::nth_element(ratios.begin(), ratios.begin() + ROUNDS / 2,
+                     ratios.end());
+    b.ratio = ratios[ROUNDS / 2];
+    return b;
+}
+
+void print(const char* name, best b) {
+    std::printf("%-17s %6.2f ns hand, %6.2f ns codec, %5.3fx median%s\n",
+                name, b.hand, b.codec, b.ratio, b.ok() ? "" : "  SLOWER");
+}
+}  // namespace
+
+int main(int argc, char** argv) {
+    const int passes = argc > 1 ? std::atoi(argv[1]) : 2000;
+
+    std::mt19937 rng(1);
+    std::vector<control_message> controls(MESSAGES);
+    std::vector<status_message> statuses(MESSAGES);
+    for (size_t i = 0; i < MESSAGES; i++) {
+        controls[i] = {static_cast<uint8_t>(rng()), static_cast<uint16_t>(rng()),
+                       static_cast<uint16_t>(rng()), static_cast<uint8_t>(rng()),
+                       static_cast<uint16_t>(rng())};
+        statuses[i] = {static_cast<uint8_t>(rng()), static_cast<uint8_t>(rng()),
+                       static_cast<uint16_t>(rng()), static_cast<uint16_t>(rng()),
+                       static_cast<uint8_t>(rng()), static_cast<uint8_t>(rng())};
+    }
+
+    std::vector<frame_bytes> hand(MESSAGES);
+    std::vector<frame_bytes> generated(MESSAGES);
+    size_t mismatches = 0;
+    for (size_t i = 0; i < MESSAGES; i++) {
+        hand_pack(controls[i], hand[i].data);
+        thunderstruck_frames::control::pack(controls[i], generated[i].data);
+        mismatches += std::memcmp(hand[i].data, generated[i].data, 8) != 0;
+        hand_pack(statuses[i], hand[i].data);
+        thunderstruck_frames::status::pack(statuses[i], generated[i].data);
+        mismatches += std::memcmp(hand[i].data, generated[i].data, 8) != 0;
+        const status_message a = hand_unpack_status(hand[i].data);
+        const status_message b =
+            thunderstruck_frames::status::unpack(generated[i].data);
+        mismatches += std::memcmp(&a, &b, sizeof(a)) != 0;
+    }
+    std::printf("mismatches        %zu\n", mismatches);
+
+    const best pack = time_both(
+        passes,
+        [&] {
+            pack_all(controls, hand,
+                     [](const control_message& msg, uint8_t* data) {
+                         hand_pack(msg, data);
+                     });
+        },
+        [&] {
+            pack_all(controls, generated,
+                     [](const control_message& msg, uint8_t* data) {
+                         thunderstruck_frames::control::pack(msg, data);
+                     });
+        });
+
+    uint32_t checksum = 0;
+    const best unpack = time_both(
+        passes,
+        [&] {
+            checksum += unpack_all(hand, [](const uint8_t* data) {
+                return hand_unpack_status(data);
+            });
+        },
+        [&] {
+            checksum += unpack_all(hand, [](const uint8_t* data) {
+                return thunderstruck_frames::status::unpack(data);
+            });
+        });
+
+    print("pack control", pack);
+    print("unpack status", unpack);
+    std::printf("checksum          %08x\n", checksum);
+    return mismatches == 0 && pack.ok() && unpack.ok() ? 0 : 1;
+}
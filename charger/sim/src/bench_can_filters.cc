@@ -0,0 +1,109 @@
+/**
+ * @file bench_can_filters.cc
+ * @brief RX interrupts taken on a busy car bus with the accept-all filter the
+ * charger used to run with, and with the ID list filters built from
+ * Bms::RX_IDS.
+ *
+ * The trace mixes the five BMS packets with traffic from the rest of the car
+ * (motor controllers, telemetry, lights) at about 70 % bus load. Each run
+ * counts the RX interrupts, the frames the filters rejected and the BMS
+ * frames that reached Bms::receive(); the last must match.
+ *
+ * Usage: bench_can_filters [simulated seconds]
+ *
+ */
+#include <cstdio>
+#include <cstdlib>
+
+#include "bms.h"
+#include "can_filters.h"
+#include "sim.h"
+
+using namespace umnsvp::charger;
+namespace skylab2 = umnsvp::skylab2;
+using umnsvp::can::packet;
+
+namespace {
+// other car nodes, standard IDs the charger does not consume
+constexpr uint32_t OTHER_FIRST_ID = 0x100;
+constexpr uint32_t OTHER_IDS = 48;
+constexpr uint64_t OTHER_PERIOD_US = 40000;
+constexpr uint64_t BMS_PERIOD_US = 100000;
+
+struct result {
+    uint32_t interrupts;
+    uint32_t filtered;
+    uint32_t bms_frames;
+};
+
+result replay(uint64_t duration_us, bool filtered) {
+    sim::reset();
+    umnsvp::can::bxcan_driver can_device(CAN1);
+    skylab2::charger_can skylab(can_device, umnsvp::can::fifo::FIFO0);
+    CommTimeouts timeouts;
+    Bms bms(skylab, timeouts);
+    skylab.init();
+    if (filtered) {
+        can_filters::configure(
+            can_device.get_handle(),
+            can_filters::id_list(Bms::RX_IDS, false, CAN_FILTER_FIFO0, 0));
+    }
+
+    uint32_t bms_frames = 0;
+    sim::set_irq_handler(CAN1_RX0_IRQn, [&] {
+        packet p;
+        if (can_device.receive(p, umnsvp::can::fifo::FIFO0) ==
+                umnsvp::can::status::OK &&
+            bms.receive(p)) {
+            bms_frames++;
+        }
+    });
+
+    const uint8_t data[8] = {0};
+    for (size_t i = 0; i < Bms::RX_IDS.size(); i++) {
+        const uint32_t id = static_cast<uint32_t>(Bms::RX_IDS[i]);
+        sim::every(BMS_PERIOD_US, i * sim::CAN_FRAME_TIME_US, [id, &data] {
+            sim::inject(CAN1, umnsvp::can::fifo::FIFO0,
+                        packet(id, 8, data, false));
+        });
+    }
+    for (uint32_t i = 0; i < OTHER_IDS; i++) {
+        const uint32_t id = OTHER_FIRST_ID + i;
+        // spread the other nodes over the frame slots the BMS leaves free
+        const uint64_t first =
+            (Bms::RX_IDS.size() + i) * sim::CAN_FRAME_TIME_US;
+        sim::every(OTHER_PERIOD_US, first, [id, &data] {
+            sim::inject(CAN1, umnsvp::can::fifo::FIFO0,
+                        packet(id, 8, data, false));
+        });
+    }
+
+    sim::advance_us(duration_us);
+    const sim::can_stats stats = sim::get_can_stats(CAN1);
+    return {stats.rx_interrupts, stats.rx_filtered, bms_frames};
+}
+}  // namespace
+
+int main(int argc, char** argv) {
+    const double duration_s = argc > 1 ? std::atof(argv[1]) : 10.0;
+    const uint64_t duration_us = static_cast<uint64_t>(duration_s * 1e6);
+
+    const result all = replay(duration_us, false);
+    const result list = replay(duration_us, true);
+
+    const double bus_load =
+        (Bms::RX_IDS.size() * 1e6 / BMS_PERIOD_US +
+         OTHER_IDS * 1e6 / OTHER_PERIOD_US) *
+        sim::CAN_FRAME_TIME_US / 1e6;
+    std::printf("car bus load %.0f %%, %.1f s simulated\n\n", bus_load * 100,
+                duration_s);
+    std::printf("%-12s %12s %12s %12s\n", "filter", "rx irq /s", "rejected /s",
+                "bms rx /s");
+    std::printf("%-12s %12.0f %12.0f %12.0f\n", "accept all",
+                all.interrupts / duration_s, all.filtered / duration_s,
+                all.bms_frames / duration_s);
+    std::printf("%-12s %12.0f %12.0f %12.0f\n", "id list",
+                list.interrupts / duration_s, list.filtered / duration_s,
+                list.bms_frames / duration_s);
+    return all.bms_frames == list.bms_frames ? 0 : 1;
+}
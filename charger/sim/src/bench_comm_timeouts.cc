@@ -0,0 +1,246 @@
+/**
+ * @file bench_comm_timeouts.cc
+ * @brief Checks CommTimeouts against the per-link timestamp checks it
+ * replaced, and times the liveness checks of a main loop pass both ways.
+ *
+ * Every link gets frames at random intervals, mostly around the 100 ms the
+ * BMS and chargers send at, sometimes after a silence longer than its
+ * timeout, and the chargers are forgotten now and then the way
+ * Thunderstruck::disable_charging() does. The tick starts just short of
+ * wrapping. After each 1 ms poll every link must be alive, heard and expired
+ * exactly when the old "tick - last frame < timeout" check says so, and the
+ * expiry counts and worst gaps must match at the end. Exits non-zero on any
+ * mismatch.
+ *
+ * Usage: bench_comm_timeouts [simulated ms] [timed passes]
+ *
+ */
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <optional>
+#include <random>
+
+#include "comm_timeouts.h"
+
+using namespace umnsvp::charger;
+
+namespace {
+constexpr uint8_t LINKS = static_cast<uint8_t>(comm_link::COUNT);
+constexpr uint8_t FIRST_CHARGER =
+    static_cast<uint8_t>(comm_link::CHARGER_STATUS);
+constexpr uint32_t BMS_TIMEOUT = 2500;      // ms, as in Bms
+constexpr uint32_t CHARGER_TIMEOUT = 2000;  // ms, as in Thunderstruck
+constexpr uint32_t START_TICK = 0xFFFFFFFF - 30000;
+
+uint32_t timeout_of(uint8_t link) {
+    return link < FIRST_CHARGER ? BMS_TIMEOUT : CHARGER_TIMEOUT;
+}
+
+/**
+ * @brief The checks as they were: a timestamp per link, compared against
+ * the tick every time a link's state is asked for.
+ *
+ */
+struct LegacyLinks {
+    std::optional<uint32_t> received[LINKS];
+    comm_link_stats stats[LINKS];
+    bool was_alive[LINKS] = {};
+
+    void refresh(uint8_t link, uint32_t tick) {
+        if (received[link].has_value()) {
+            stats[link].worst_gap = std::max(stats[link].worst_gap,
+                                             tick - received[link].value());
+        }
+        received[link] = tick;
+    }
+
+    bool alive(uint8_t link, uint32_t tick) const {
+        return received[link].has_value() &&
+               tick - received[link].value() < timeout_of(link);
+    }
+
+    // count the links that went quiet since the last call
+    void poll(uint32_t tick) {
+        for (uint8_t link = 0; link < LINKS; link++) {
+            const bool now_alive = alive(link, tick);
+            if (was_alive[link] && !now_alive && received[link].has_value()) {
+                stats[link].expiries++;
+            }
+            was_alive[link] = now_alive;
+        }
+    }
+
+    // a main loop pass: Bms::check_comms_alive(), the two charger loops in
+    // Thunderstruck::check_current_fault() and Thunderstruck::coms_alive()
+    bool pass(uint32_t tick) const {
+        bool bms = true;
+        for (uint8_t link = 0; link < FIRST_CHARGER; link++) {
+            bms = bms && alive(link, tick);
+        }
+        uint8_t cold = 0;
+        bool timed_out = false;
+        bool any = false;
+        for (uint8_t link = FIRST_CHARGER; link < LINKS; link++) {
+            cold += !alive(link, tick);
+        }
+        for (uint8_t link = FIRST_CHARGER; link < LINKS; link++) {
+            timed_out = timed_out ||
+                        (received[link].has_value() && !alive(link, tick));
+        }
+        for (uint8_t link = FIRST_CHARGER; link < LINKS; link++) {
+            any = any || alive(link, tick);
+        }
+        return bms ^ timed_out ^ any ^ (cold != 0);
+    }
+};
+
+uint32_t charger_mask() {
+    uint32_t mask = 0;
+    for (uint8_t link = FIRST_CHARGER; link < LINKS; link++) {
+        mask |= link_bit(static_cast<comm_link>(link));
+    }
+    return mask;
+}
+
+uint32_t bms_mask() {
+    return link_bit(comm_link::CHARGER_STATUS) - 1;
+}
+
+// the same pass against CommTimeouts
+bool pass(CommTimeouts& timeouts, uint32_t tick, uint32_t chargers,
+          uint32_t bms) {
+    timeouts.poll(tick);
+    uint8_t cold = 0;
+    for (uint8_t unit = 0; unit < NUMBER_CHARGERS; unit++) {
+        cold += !timeouts.alive(charger_status_link(unit));
+    }
+    return timeouts.all_alive(bms) ^ timeouts.any_expired(chargers) ^
+           timeouts.any_alive(chargers) ^ (cold != 0);
+}
+
+// keep the optimizer from discarding the work being timed
+void clobber() {
+    asm volatile("" ::: "memory");
+}
+
+template <class Fn>
+double time_passes(uint32_t passes, Fn fn) {
+    const auto start = std::chrono::steady_clock::now();
+    bool sink = false;
+    for (uint32_t i = 0; i < passes; i++) {
+        // inside every timeout, so nothing expires while timed
+        sink ^= fn(START_TICK + 100 + (i & 1023));
+        clobber();
+    }
+    const auto elapsed = std::chrono::steady_clock::now() - start;
+    volatile bool keep = sink;
+    (void)keep;
+    return std::chrono::duration<double, std::nano>(elapsed).count() / passes;
+}
+}  // namespace
+
+int main(int argc, char** argv) {
+    const uint32_t duration = argc > 1 ? std::atoi(argv[1]) : 600000;
+    const uint32_t passes = argc > 2 ? std::atoi(argv[2]) : 10000000;
+    std::mt19937 rng(1);
+    std::uniform_int_distribution<uint32_t> period(80, 120);
+    std::uniform_int_distribution<uint32_t> silence(1500, 3500);
+    std::uniform_int_distribution<uint32_t> percent(0, 99);
+
+    CommTimeouts timeouts;
+    LegacyLinks legacy;
+    for (uint8_t link = 0; link < LINKS; link++) {
+        timeouts.track(static_cast<comm_link>(link), timeout_of(link));
+    }
+    const uint32_t chargers = charger_mask();
+    uint32_t next_frame[LINKS];
+    for (uint8_t link = 0; link < LINKS; link++) {
+        next_frame[link] = START_TICK + period(rng);
+    }
+
+    uint32_t mismatches = 0;
+    uint32_t forgets = 0;
+    for (uint32_t ms = 0; ms < duration; ms++) {
+        const uint32_t tick = START_TICK + ms;
+        for (uint8_t link = 0; link < LINKS; link++) {
+            if (tick != next_frame[link]) {
+                continue;
+            }
+            timeouts.refresh(static_cast<comm_link>(link), tick);
+            legacy.refresh(link, tick);
+            // one gap in twenty is long enough to time out, or nearly
+            next_frame[link] =
+                tick + (percent(rng) < 5 ? silence(rng) : period(rng));
+        }
+        if (ms % 1000 == 0 && percent(rng) < 2) {
+            for (uint8_t link = FIRST_CHARGER; link < LINKS; link++) {
+                timeouts.forget(static_cast<comm_link>(link));
+                legacy.received[link].reset();
+                legacy.was_alive[link] = false;
+            }
+            forgets++;
+        }
+        timeouts.poll(tick);
+        legacy.poll(tick);
+        for (uint8_t link = 0; link < LINKS; link++) {
+            const comm_link l = static_cast<comm_link>(link);
+            const bool heard = legacy.received[link].has_value();
+            const bool alive = legacy.alive(link, tick);
+            const bool expired = heard && !alive;
+            if (timeouts.alive(l) != alive || timeouts.heard(l) != heard ||
+                timeouts.any_expired(link_bit(l)) != expired ||
+                (heard && timeouts.last_frame(l) != *legacy.received[link])) {
+                mismatches++;
+            }
+        }
+    }
+
+    std::printf("%u links over %.0f s from tick 0x%08X, chargers forgotten "
+                "%u times\n\n",
+                LINKS, duration / 1e3, START_TICK, forgets);
+    std::printf("%-18s %9s %9s %12s %12s\n", "link", "expiries", "(before)",
+                "worst gap ms", "(before)");
+    for (uint8_t link = 0; link < LINKS; link++) {
+        const comm_link_stats& s =
+            timeouts.get_stats(static_cast<comm_link>(link));
+        const comm_link_stats& before = legacy.stats[link];
+        const char* const bms_names[] = {"bms measurement", "battery status",
+                                         "bms min/max", "charger response"};
+        char name[32];
+        if (link < FIRST_CHARGER) {
+            std::snprintf(name, sizeof(name), "%s", bms_names[link]);
+        } else {
+            std::snprintf(name, sizeof(name), "charger %u",
+                          link - FIRST_CHARGER);
+        }
+        std::printf("%-18s %9u %9u %12u %12u\n", name, s.expiries,
+                    before.expiries, s.worst_gap, before.worst_gap);
+        if (s.expiries != before.expiries || s.worst_gap != before.worst_gap) {
+            mismatches++;
+        }
+    }
+    std::printf("\nstate mismatches: %u\n", mismatches);
+
+    // timed with every link alive, the common case
+    CommTimeouts idle;
+    LegacyLinks idle_legacy;
+    for (uint8_t link = 0; link < LINKS; link++) {
+        idle.track(static_cast<comm_link>(link), timeout_of(link));
+        idle.refresh(static_cast<comm_link>(link), START_TICK + link);
+        idle_legacy.refresh(link, START_TICK + link);
+    }
+    const uint32_t bms = bms_mask();
+    const double before =
+        time_passes(passes, [&](uint32_t tick) {
+            return idle_legacy.pass(tick);
+        });
+    const double after = time_passes(passes, [&](uint32_t tick) {
+        return pass(idle, tick, chargers, bms);
+    });
+    std::printf("liveness checks per pass: %.2f ns timestamps (before), "
+                "%.2f ns CommTimeouts (host)\n",
+                before, after);
+    return mismatches == 0 ? 0 : 1;
+}
@@ -0,0 +1,264 @@
+/**
+ * @file bench_current_regulator.cc
+ * @brief Step response and steady-state error of the battery current
+ * regulator, against the open loop command it replaced.
+ *
+ * The car's low voltage converter draws AUX_LOAD from the pack, so an open
+ * loop charger command that equals the wanted battery current falls short by
+ * that much. Each scenario is a setpoint step, and one drops the EVSE limit
+ * below the setpoint for a while to show the regulator does not wind up.
+ *
+ * First the regulator alone is run against a small model of the chargers
+ * (slew limited, one control period of command delay, pack current seen once
+ * a BMS period), open loop (no PI terms) and closed loop. Then the whole
+ * Application is run closed loop against the simulated BMS and Thunderstrucks
+ * over CAN. The exit code is non-zero if a closed loop run misses its
+ * steady-state or overshoot bounds.
+ *
+ * Usage: bench_current_regulator
+ *
+ */
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <functional>
+#include <vector>
+
+#include "application.h"
+#include "current_regulator.h"
+#include "devices.h"
+#include "j1772.h"
+#include "main.h"
+#include "sim.h"
+
+using namespace umnsvp::charger;
+
+umnsvp::charger::Application app;
+
+void timer_handler_callback(TIM_HandleTypeDef* htim) {
+    if (htim->Instance == TIM6) {
+        app.scheduler_tick();
+    }
+}
+
+namespace {
+constexpr float AUX_LOAD = 3.0f;           // A
+constexpr float SETTLE_BAND = 0.5f;        // A
+constexpr float MAX_STEADY_ERROR = 0.3f;   // A
+constexpr float MAX_OVERSHOOT = 10.0f;     // % of the step
+constexpr uint64_t LOOP_COST_US = 20;
+constexpr uint64_t PLANT_STEP_US = 10000;
+constexpr uint64_t STATUS_PERIOD_US = 100000;
+
+struct sample {
+    double t;  // s
+    float current;  // A into the pack
+};
+
+/**
+ * @brief A change of setpoint or EVSE limit and the window its response is
+ * judged over, from the battery current at the start of the window.
+ *
+ */
+struct step {
+    const char* name;
+    double from;  // s
+    double to;    // s
+    float after;  // A, setpoint
+};
+
+struct response {
+    double rise = NAN;      // 10-90 %, s
+    double settling = NAN;  // last time outside SETTLE_BAND, s after the step
+    float overshoot = 0;    // % of the step
+    float steady_error = 0;  // setpoint - mean over the last second, A
+};
+
+response measure(const std::vector<sample>& samples, const step& s) {
+    response r;
+    float before = NAN;
+    for (const sample& x : samples) {
+        if (x.t >= s.from) {
+            before = x.current;
+            break;
+        }
+    }
+    const float span = s.after - before;
+    double t10 = NAN;
+    double t90 = NAN;
+    double last_outside = s.from;
+    float peak = 0;
+    float tail = 0;
+    int tail_count = 0;
+    for (const sample& x : samples) {
+        if (x.t < s.from || x.t > s.to) {
+            continue;
+        }
+        const float progress = (x.current - before) / span;
+        if (std::isnan(t10) && progress >= 0.1f) {
+            t10 = x.t;
+        }
+        if (std::isnan(t90) && progress >= 0.9f) {
+            t90 = x.t;
+        }
+        peak = std::max(peak, progress - 1.0f);
+        if (std::fabs(x.current - s.after) > SETTLE_BAND) {
+            last_outside = x.t;
+        }
+        if (x.t >= s.to - 1.0) {
+            tail += x.current;
+            tail_count++;
+        }
+    }
+    r.rise = t90 - t10;
+    r.settling = last_outside - s.from;
+    r.overshoot = 100.0f * peak;
+    r.steady_error = s.after - tail / std::max(tail_count, 1);
+    return r;
+}
+
+void print(const char* run, const step& s, const response& r) {
+    std::printf("%-12s %-22s %6.2f s %7.2f s %8.1f %% %8.2f A\n", run, s.name,
+                r.rise, r.settling, r.overshoot, r.steady_error);
+}
+
+bool within_bounds(const response& r) {
+    return std::fabs(r.steady_error) <= MAX_STEADY_ERROR &&
+           r.overshoot <= MAX_OVERSHOOT;
+}
+
+/**
+ * @brief Setpoint and EVSE limit over a run: 15 A, a step to 30 A, the EVSE
+ * dropping to 10 A of AC for five seconds, then a step down to 20 A. The
+ * steps stay under the chargers' output power at the pack voltage.
+ *
+ */
+const step STEPS[] = {
+    {"15 -> 30 A", 10, 20, 30},
+    {"EVSE limit lifted", 25, 35, 30},
+    {"30 -> 20 A", 35, 45, 20},
+};
+constexpr double EVSE_LIMITED_FROM = 20;
+constexpr double EVSE_LIMITED_TO = 25;
+constexpr double RUN_END = 45;
+
+float setpoint_at(double t) {
+    return t < 10 ? 15.0f : (t < 35 ? 30.0f : 20.0f);
+}
+
+bool evse_limited_at(double t) {
+    return t >= EVSE_LIMITED_FROM && t < EVSE_LIMITED_TO;
+}
+
+/**
+ * @brief The chargers as the regulator sees them: a command that takes
+ * effect one control period late and slews at the two units' combined rate,
+ * and a pack current reported once a BMS period.
+ *
+ */
+std::vector<sample> run_model(regulator_gains gains) {
+    constexpr float SLEW = 40.0f;  // A/s, both units
+    constexpr float PACK_VOLTAGE = 125.0f;
+    const deci_amps charger_limit = deci_amps(300) * NUMBER_CHARGERS;
+    CurrentRegulator regulator(gains);
+    float output = 0;
+    float sent = 0;
+    float reported = 0;
+    std::vector<sample> samples;
+    regulator.reset(deci_amps::from(setpoint_at(0)), charger_limit);
+    for (uint32_t tick = 0; tick * 0.01 < RUN_END; tick++) {
+        const double t = tick * 0.01;
+        if (tick % 10 == 0) {
+            const float evse = evse_limited_at(t) ? 10.0f : 30.0f;
+            const float ac_voltage = evse <= 17.3f ? 110.0f : 240.0f;
+            const deci_amps ceiling = std::min(
+                deci_amps::from(0.95f * ac_voltage * evse / PACK_VOLTAGE),
+                charger_limit);
+            reported = output;
+            sent = regulator.get_output().to_float();
+            regulator.update(deci_amps::from(setpoint_at(t)),
+                             deci_amps::from(reported - AUX_LOAD), ceiling,
+                             deci_amps::from(reported));
+        }
+        const float step = SLEW * 0.01f;
+        output = std::clamp(sent, output - step, output + step);
+        samples.push_back({t, output - AUX_LOAD});
+    }
+    return samples;
+}
+
+/**
+ * @brief The Application against the simulated BMS and Thunderstrucks. The
+ * pack starts low enough that the chargers never reach their voltage limit.
+ *
+ */
+std::vector<sample> run_application() {
+    sim::reset();
+    sim::set_irq_handler(CAN1_RX0_IRQn, [] { app.can1_rx_callback(); });
+    sim::set_irq_handler(CAN1_RX1_IRQn, [] { app.can1_rx1_callback(); });
+    sim::set_irq_handler(CAN1_TX_IRQn, [] { app.can1_tx_callback(); });
+    sim::set_irq_handler(CAN2_RX1_IRQn, [] { app.can2_rx_callback(); });
+    sim::set_irq_handler(CAN2_TX_IRQn, [] { app.can2_tx_callback(); });
+    sim::set_irq_handler(EXTI9_5_IRQn, [] { app.prox_callback(); });
+
+    sim::Plant plant(static_cast<uint8_t>(NUMBER_CHARGERS), STATUS_PERIOD_US);
+    plant.bms.pack.soc = 0.2f;
+    plant.aux_load = AUX_LOAD;
+    plant.attach(PLANT_STEP_US);
+
+    std::vector<sample> samples;
+    sim::every(PLANT_STEP_US, 0, [&] {
+        samples.push_back({sim::now_us() / 1e6, plant.bms.pack.current});
+    });
+    sim::set_input_pin(PROX_PORT, PROX_PIN, true);
+    sim::set_pilot(1000.0f, 0.5f);
+    sim::at(static_cast<uint64_t>(EVSE_LIMITED_FROM * 1e6),
+            [] { sim::set_pilot(1000.0f, 10.0f / 60.0f); });
+    sim::at(static_cast<uint64_t>(EVSE_LIMITED_TO * 1e6),
+            [] { sim::set_pilot(1000.0f, 0.5f); });
+    for (const step& s : STEPS) {
+        const float after = s.after;
+        sim::at(static_cast<uint64_t>(s.from * 1e6), [after] {
+            app.set_current_setpoint(deci_amps::from(after));
+        });
+    }
+    app.set_current_setpoint(deci_amps::from(setpoint_at(0)));
+
+    sim::advance_us(STATUS_PERIOD_US);
+    app.start();
+    while (sim::now_us() < RUN_END * 1e6) {
+        app.step();
+        sim::advance_us(LOOP_COST_US);
+    }
+    return samples;
+}
+}  // namespace
+
+int main() {
+    std::printf("aux load %.1f A, settled within %.1f A\n\n", AUX_LOAD,
+                SETTLE_BAND);
+    std::printf("%-12s %-22s %8s %9s %10s %10s\n", "run", "step", "rise",
+                "settling", "overshoot", "ss error");
+
+    bool pass = true;
+    const std::vector<sample> open_loop = run_model({0, 0});
+    const std::vector<sample> model = run_model(REGULATOR_GAINS);
+    const std::vector<sample> application = run_application();
+    for (const step& s : STEPS) {
+        print("open loop", s, measure(open_loop, s));
+    }
+    for (const step& s : STEPS) {
+        const response r = measure(model, s);
+        print("PI, model", s, r);
+        pass &= within_bounds(r);
+    }
+    for (const step& s : STEPS) {
+        const response r = measure(application, s);
+        print("PI, sim", s, r);
+        pass &= within_bounds(r);
+    }
+    std::printf("\nsteady-state error within %.1f A, overshoot within %.0f %%: "
+                "%s\n",
+                MAX_STEADY_ERROR, MAX_OVERSHOOT, pass ? "yes" : "NO");
+    return pass ? 0 : 1;
+}
@@ -0,0 +1,239 @@
+/**
+ * @file bench_fault_fast_path.cc
+ * @brief Latency from a BMS fault frame arriving on the car bus to the
+ * chargers being told to stop on the charger bus.
+ *
+ * Each trial boots the real Application against the sim plant, charges, and
+ * then injects a BMS HV kill or a pack overvolt measurement at a random
+ * point in the charger control period. It times three things from the
+ * frame's arrival:
+ *
+ *   fast:  every charger has a disable frame from the CAN1 RX interrupt
+ *   loop:  the main loop has reached the fault state
+ *   job:   every charger has a disable frame from the control job, which is
+ *          all the charger did before the fast path
+ *
+ * It also checks that no charger is sent an enable once tripped. Exits
+ * non-zero if a trial misses the fault, re-enables a charger or the fast
+ * path takes longer than a frame per charger plus one in flight.
+ *
+ * Usage: bench_fault_fast_path [trials per fault]
+ *
+ */
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <optional>
+#include <random>
+#include <vector>
+
+#include "application.h"
+#include "devices.h"
+#include "main.h"
+#include "sim.h"
+#include "thunderstruck_frames.h"
+
+using namespace umnsvp::charger;
+using umnsvp::skylab2::CANPacketId;
+
+namespace {
+std::optional<Application> board;
+}  // namespace
+
+void timer_handler_callback(TIM_HandleTypeDef* htim) {
+    if (htim->Instance == TIM6) {
+        board->scheduler_tick();
+    }
+}
+
+namespace {
+constexpr uint64_t LOOP_COST_US = 20;
+constexpr uint64_t PLANT_STEP_US = 10000;
+constexpr uint64_t STATUS_PERIOD_US = 100000;
+constexpr uint64_t PLUG_IN_US = 1000000;
+constexpr uint64_t CHARGE_US = 10000000;       // from boot to a steady current
+constexpr uint64_t CONTROL_PERIOD_US = 100000;  // each charger's control frame
+constexpr uint64_t SETTLE_US = 300000;  // after the fault, for the job frames
+constexpr uint8_t CONTROL_ENABLE = 0xFC;   // Enable byte of a control frame
+constexpr uint8_t CONTROL_DISABLE = 0xFF;
+// a frame per charger, behind one already on the bus
+constexpr uint64_t FAST_BOUND_US =
+    (NUMBER_CHARGERS + 1) * sim::CAN_FRAME_TIME_US;
+
+enum class fault
+{
+    HV_KILL,
+    OVERVOLT
+};
+
+struct trial {
+    uint64_t fast_us = 0;  // 0 if it never happened
+    uint64_t loop_us = 0;
+    uint64_t job_us = 0;
+    bool reenabled = false;
+};
+
+template <class T>
+umnsvp::can::packet car_packet(CANPacketId id, uint8_t length, const T& msg) {
+    uint8_t data[8] = {0};
+    umnsvp::skylab2::pack(msg, data);
+    return umnsvp::can::packet(static_cast<uint32_t>(id), length, data, false);
+}
+
+umnsvp::can::packet fault_frame(fault kind) {
+    using namespace umnsvp::skylab2;
+    if (kind == fault::HV_KILL) {
+        can_packet_battery_status status = {};
+        status.battery_state.killed = true;
+        return car_packet(CANPacketId::CAN_PACKET_BATTERY_STATUS,
+                          CAN_LENGTH_BATTERY_STATUS, status);
+    }
+    can_packet_bms_measurement measurement = {};
+    measurement.battery_voltage =
+        static_cast<uint16_t>(PACK_VOLTAGE_MAX.count());
+    return car_packet(CANPacketId::CAN_PACKET_BMS_MEASUREMENT,
+                      CAN_LENGTH_BMS_MEASUREMENT, measurement);
+}
+
+bool is_fault_state(charge_state state) {
+    return state == charge_state::FAULT_LATCHING ||
+           state == charge_state::FAULT_RESETTABLE;
+}
+
+void run(uint64_t us) {
+    const uint64_t end = sim::now_us() + us;
+    while (sim::now_us() < end) {
+        board->step();
+        sim::advance_us(LOOP_COST_US);
+    }
+}
+
+trial run_trial(fault kind, uint64_t offset_us) {
+    sim::reset();
+    board.emplace();
+    sim::set_irq_handler(CAN1_RX0_IRQn, [] { board->can1_rx_callback(); });
+    sim::set_irq_handler(CAN1_RX1_IRQn, [] { board->can1_rx1_callback(); });
+    sim::set_irq_handler(CAN1_TX_IRQn, [] { board->can1_tx_callback(); });
+    sim::set_irq_handler(CAN2_RX1_IRQn, [] { board->can2_rx_callback(); });
+    sim::set_irq_handler(CAN2_TX_IRQn, [] { board->can2_tx_callback(); });
+    sim::set_irq_handler(EXTI9_5_IRQn, [] { board->prox_callback(); });
+    sim::Plant plant(static_cast<uint8_t>(NUMBER_CHARGERS), STATUS_PERIOD_US);
+    plant.attach(PLANT_STEP_US);
+    sim::at(PLUG_IN_US, [] {
+        sim::set_input_pin(PROX_PORT, PROX_PIN, true);
+        sim::set_pilot(1000.0f, 0.5f);
+    });
+    sim::advance_us(STATUS_PERIOD_US);
+    board->start();
+    run(CHARGE_US + offset_us);
+
+    trial t;
+    if (board->get_charge_state() != charge_state::CHARGING) {
+        return t;
+    }
+    const uint64_t fault_us = sim::now_us();
+    // disable frames seen per charger since the fault; the first is the
+    // fast path's, the next the control job's
+    std::vector<uint8_t> disables(NUMBER_CHARGERS, 0);
+    std::vector<uint64_t> fast(NUMBER_CHARGERS, 0);
+    std::vector<uint64_t> job(NUMBER_CHARGERS, 0);
+    sim::on_transmit(CAN2, [&](const umnsvp::can::packet& p) {
+        for (uint8_t unit = 0; unit < NUMBER_CHARGERS; unit++) {
+            if (p.get_id() != thunderstruck_frames::control_id(unit)) {
+                continue;
+            }
+            const uint8_t enable = p.get_data()[0];
+            if (enable == CONTROL_ENABLE && disables[unit] != 0) {
+                t.reenabled = true;
+            } else if (enable == CONTROL_DISABLE && disables[unit] < 2) {
+                (disables[unit]++ == 0 ? fast : job)[unit] =
+                    sim::now_us() - fault_us;
+            }
+        }
+    });
+
+    if (kind == fault::HV_KILL) {
+        plant.bms.killed = true;
+    }
+    sim::inject(CAN1, umnsvp::can::fifo::FIFO0, fault_frame(kind));
+    const uint64_t end = fault_us + SETTLE_US;
+    while (sim::now_us() < end) {
+        board->step();
+        if (t.loop_us == 0 && is_fault_state(board->get_charge_state())) {
+            t.loop_us = sim::now_us() - fault_us;
+        }
+        sim::advance_us(LOOP_COST_US);
+    }
+    const bool all_fast = std::count(fast.begin(), fast.end(), 0) == 0;
+    const bool all_job = std::count(job.begin(), job.end(), 0) == 0;
+    t.fast_us = all_fast ? *std::max_element(fast.begin(), fast.end()) : 0;
+    t.job_us = all_job ? *std::max_element(job.begin(), job.end()) : 0;
+    return t;
+}
+
+struct summary {
+    uint64_t total = 0;
+    uint64_t worst = 0;
+    uint32_t missed = 0;
+
+    void add(uint64_t us) {
+        if (us == 0) {
+            missed++;
+            return;
+        }
+        total += us;
+        worst = std::max(worst, us);
+    }
+
+    void print(const char* name, uint32_t trials) const {
+        const uint32_t counted = trials - missed;
+        std::printf("  %-5s %9.3f ms mean %9.3f ms worst", name,
+                    counted ? total / 1e3 / counted : 0.0, worst / 1e3);
+        if (missed != 0) {
+            std::printf("  %u missed", missed);
+        }
+        std::printf("\n");
+    }
+};
+}  // namespace
+
+int main(int argc, char** argv) {
+    const uint32_t trials = argc > 1 ? std::atoi(argv[1]) : 40;
+    std::mt19937 rng(1);
+    std::uniform_int_distribution<uint64_t> phase(0, CONTROL_PERIOD_US - 1);
+
+    std::printf("%u chargers, control frame every %.0f ms each, %u trials "
+                "per fault, fast path bound %.3f ms\n",
+                NUMBER_CHARGERS, CONTROL_PERIOD_US / 1e3, trials,
+                FAST_BOUND_US / 1e3);
+    bool ok = true;
+    for (const fault kind : {fault::HV_KILL, fault::OVERVOLT}) {
+        summary fast;
+        summary loop;
+        summary job;
+        uint32_t reenabled = 0;
+        for (uint32_t i = 0; i < trials; i++) {
+            const trial t = run_trial(kind, phase(rng));
+            fast.add(t.fast_us);
+            loop.add(t.loop_us);
+            job.add(t.job_us);
+            reenabled += t.reenabled;
+        }
+        std::printf("\n%s, fault frame in to:\n",
+                    kind == fault::HV_KILL ? "HV kill" : "pack overvolt");
+        fast.print("fast", trials);
+        loop.print("loop", trials);
+        job.print("job", trials);
+        if (reenabled != 0) {
+            std::printf("  FAIL: %u trials enabled a charger after the trip\n",
+                        reenabled);
+        }
+        if (fast.missed != 0 || loop.missed != 0 ||
+            fast.worst > FAST_BOUND_US) {
+            std::printf("  FAIL: fault missed or disable late\n");
+        }
+        ok = ok && reenabled == 0 && fast.missed == 0 && loop.missed == 0 &&
+             fast.worst <= FAST_BOUND_US;
+    }
+    return ok ? 0 : 1;
+}
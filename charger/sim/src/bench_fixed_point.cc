@@ -0,0 +1,296 @@
+/**
+ * @file bench_fixed_point.cc
+ * @brief Host cycles for the charger's CAN scaling, fault thresholds and
+ * current limit, in the previous float/double form and in fixed point.
+ *
+ * Each row runs the same inputs through both forms, written out here as the
+ * firmware has them. The host has a double precision FPU, so this understates
+ * the gap on the F405, where every double operation in the old form (the
+ * 10.0 divides in the Thunderstruck decode, the 0.1/0.86/0.96 compares in
+ * J1772) is a soft-float library call. For F405 cycles, build the firmware
+ * with CHARGER_PROFILE and compare the receive_status_packet, check_faults and
+ * state_action profile points.
+ *
+ * Usage: bench_fixed_point [passes]
+ *
+ */
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#include "bms.h"
+#include "quantity.h"
+#include "thunderstruck_constants.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define HAVE_TSC 1
+#endif
+
+using namespace umnsvp;
+using namespace umnsvp::charger;
+
+namespace {
+constexpr uint16_t CURRENT_OFFSET = 3200;
+constexpr int SETS = 64;
+
+struct status_frame {
+    uint16_t output_voltage;
+    uint16_t output_current;
+    uint8_t charger_temp;
+};
+
+struct bms_frame {
+    uint16_t pack_voltage;   // 10 mV
+    int16_t max_cell_temp;   // 0.01 C
+    uint16_t max_cell_voltage;  // mV
+};
+
+struct limit_inputs {
+    float j1772_duty;
+    float pack_voltage;  // V
+};
+
+// the previous forms
+struct legacy {
+    struct unit {
+        float charging_current;
+        float charging_voltage;
+        float charger_temp;
+    };
+    struct bms {
+        float pack_voltage;
+        float max_cell_temp;
+        float max_cell_voltage;
+    };
+
+    static unit decode_status(const status_frame& msg) {
+        unit u;
+        u.charging_voltage = msg.output_voltage / 10.0;
+        u.charging_current = (CURRENT_OFFSET - msg.output_current) / 10.0;
+        u.charger_temp = msg.charger_temp - 40;
+        return u;
+    }
+
+    static bms decode_bms(const bms_frame& f) {
+        static constexpr float PACK_VOLTAGE_CONVERSION = 0.01;
+        static constexpr float CELL_VOLTAGE_CONVERSION = 0.001;
+        static constexpr float CELL_TEMP_CONVERSION = 0.01;
+        return {f.pack_voltage * PACK_VOLTAGE_CONVERSION,
+                f.max_cell_temp * CELL_TEMP_CONVERSION,
+                f.max_cell_voltage * CELL_VOLTAGE_CONVERSION};
+    }
+
+    static uint8_t faults(const bms& b, const unit& u) {
+        constexpr float CHARGER_VOLTAGE_MAX =
+            MAX_CELL_VOLTAGE * NUM_SERIES_CELLS;
+        constexpr float CHARGER_TEMP_MAX = 54.0;
+        return (b.pack_voltage <= BATTERY_VOLTAGE_MIN) << 0 |
+               (b.pack_voltage >= BATTERY_VOLTAGE_MAX) << 1 |
+               (b.max_cell_temp >= CHARGING_TEMP_LIMIT_FOR_BATTERY) << 2 |
+               (u.charging_voltage >= CHARGER_VOLTAGE_MAX) << 3 |
+               (u.charger_temp >= CHARGER_TEMP_MAX) << 4;
+    }
+
+    static float j1772_limit(float duty_cycle) {
+        if (duty_cycle > 0.1 && duty_cycle < 0.86) {
+            return duty_cycle * 60;
+        }
+        if (duty_cycle >= 0.86 && duty_cycle <= 0.96) {
+            return (duty_cycle * 100 - 64) * 2.5;
+        }
+        return 0;
+    }
+
+    static float current_limit(const limit_inputs& in) {
+        constexpr float CHARGER_EFFICIENCY = 0.95;
+        const float max_ac_current =
+            std::min(j1772_limit(in.j1772_duty), 30.0f);
+        const float ac_voltage = (max_ac_current <= 17.3f) ? 110.0f : 240.0f;
+        return std::min(
+            (CHARGER_EFFICIENCY * ac_voltage * max_ac_current) /
+                in.pack_voltage,
+            30.0f * NUMBER_CHARGERS);
+    }
+};
+
+// the fixed point forms, as in Thunderstruck, Bms and Application
+struct fixed {
+    struct unit {
+        deci_amps charging_current;
+        deci_volts charging_voltage;
+        celsius charger_temp;
+    };
+    struct bms {
+        centi_volts pack_voltage;
+        centi_celsius max_cell_temp;
+        milli_volts max_cell_voltage;
+    };
+
+    static unit decode_status(const status_frame& msg) {
+        return {deci_amps(CURRENT_OFFSET - msg.output_current),
+                deci_volts(msg.output_voltage),
+                celsius(msg.charger_temp - 40)};
+    }
+
+    static bms decode_bms(const bms_frame& f) {
+        return {centi_volts(f.pack_voltage), centi_celsius(f.max_cell_temp),
+                milli_volts(f.max_cell_voltage)};
+    }
+
+    static uint8_t faults(const bms& b, const unit& u) {
+        return (b.pack_voltage <= PACK_VOLTAGE_MIN) << 0 |
+               (b.pack_voltage >= PACK_VOLTAGE_MAX) << 1 |
+               (b.max_cell_temp >= CELL_TEMP_CHARGING_LIMIT) << 2 |
+               (u.charging_voltage >= CHARGER_VOLTAGE_MAX) << 3 |
+               (u.charger_temp >= CHARGER_TEMP_MAX) << 4;
+    }
+
+    static deci_amps j1772_limit(float duty_cycle) {
+        if (duty_cycle > 0.1f && duty_cycle < 0.86f) {
+            return deci_amps::from(duty_cycle * 60);
+        }
+        if (duty_cycle >= 0.86f && duty_cycle <= 0.96f) {
+            return deci_amps::from((duty_cycle * 100 - 64) * 2.5f);
+        }
+        return deci_amps(0);
+    }
+
+    static deci_amps current_limit(float duty, centi_volts pack_voltage) {
+        const deci_amps max_ac_current =
+            std::min(j1772_limit(duty), deci_amps(300));
+        const volts ac_voltage = (max_ac_current <= AC_VOLTAGE_CHANGE_POINT)
+                                     ? AC_VOLTAGE_INPUT_1
+                                     : AC_VOLTAGE_INPUT_2;
+        const deci_amps charger_limit = deci_amps(300) * NUMBER_CHARGERS;
+        if (pack_voltage <= centi_volts(0)) {
+            return charger_limit;
+        }
+        const deci_amps dc_current(CHARGER_EFFICIENCY_PERCENT *
+                                   ac_voltage.count() *
+                                   max_ac_current.count() /
+                                   pack_voltage.count());
+        return std::min(dc_current, charger_limit);
+    }
+};
+
+struct cost {
+    double ns;
+    double tsc;
+};
+
+// keep the optimizer from discarding the work being timed
+void clobber() {
+    asm volatile("" ::: "memory");
+}
+
+template <class Fn>
+cost time_passes(int passes, Fn pass) {
+#ifdef HAVE_TSC
+    const uint64_t tsc_start = __rdtsc();
+#endif
+    const auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < passes; i++) {
+        pass(i % SETS);
+        clobber();
+    }
+    const auto elapsed = std::chrono::steady_clock::now() - start;
+    cost c;
+    c.ns = std::chrono::duration<double, std::nano>(elapsed).count() / passes;
+#ifdef HAVE_TSC
+    c.tsc = static_cast<double>(__rdtsc() - tsc_start) / passes;
+#else
+    c.tsc = 0;
+#endif
+    return c;
+}
+
+void print(const char* name, cost before, cost after) {
+    std::printf("%-15s %8.1f ns %8.0f tsc | %8.1f ns %8.0f tsc\n", name,
+                before.ns, before.tsc, after.ns, after.tsc);
+}
+
+template <class T>
+void sink(const T& value) {
+    asm volatile("" : : "g"(&value) : "memory");
+}
+}  // namespace
+
+int main(int argc, char** argv) {
+    const int passes = argc > 1 ? std::atoi(argv[1]) : 1000000;
+
+    // inputs spread over and past the fault thresholds and the J1772 ranges
+    std::vector<status_frame> status(SETS);
+    std::vector<bms_frame> bms(SETS);
+    std::vector<limit_inputs> limits(SETS);
+    for (int i = 0; i < SETS; i++) {
+        status[i] = {static_cast<uint16_t>(1300 + 3 * i),
+                     static_cast<uint16_t>(3000 + i),
+                     static_cast<uint8_t>(60 + i / 2)};
+        bms[i] = {static_cast<uint16_t>(8500 + 100 * i),
+                  static_cast<int16_t>(2000 + 50 * i),
+                  static_cast<uint16_t>(3600 + 10 * i)};
+        // whole percent duties, as EVSEs signal them
+        limits[i] = {(11 + i * 88 / SETS) / 100.0f, 90.0f + i};
+    }
+
+    // both forms must agree: decode and faults exactly, limits to the
+    // 0.1 A resolution of the charger control packet
+    bool agree = true;
+    for (int i = 0; i < SETS; i++) {
+        const legacy::unit lu = legacy::decode_status(status[i]);
+        const fixed::unit fu = fixed::decode_status(status[i]);
+        const legacy::bms lb = legacy::decode_bms(bms[i]);
+        const fixed::bms fb = fixed::decode_bms(bms[i]);
+        agree &= deci_amps::from(lu.charging_current) == fu.charging_current;
+        agree &= deci_volts::from(lu.charging_voltage) == fu.charging_voltage;
+        agree &= centi_volts::from(lb.pack_voltage) == fb.pack_voltage;
+        agree &= legacy::faults(lb, lu) == fixed::faults(fb, fu);
+        const float before = legacy::current_limit(limits[i]);
+        const deci_amps after = fixed::current_limit(
+            limits[i].j1772_duty, centi_volts::from(limits[i].pack_voltage));
+        agree &= std::abs(before * 10 - after.count()) <= 1.0f;
+    }
+    std::printf("fixed point agrees with float: %s\n\n", agree ? "yes" : "NO");
+
+    std::printf("%-15s %23s | %23s\n", "per call", "float/double (before)",
+                "fixed point (after)");
+    print("status decode",
+          time_passes(passes,
+                      [&](int i) { sink(legacy::decode_status(status[i])); }),
+          time_passes(passes,
+                      [&](int i) { sink(fixed::decode_status(status[i])); }));
+    print("bms decode",
+          time_passes(passes,
+                      [&](int i) { sink(legacy::decode_bms(bms[i])); }),
+          time_passes(passes,
+                      [&](int i) { sink(fixed::decode_bms(bms[i])); }));
+
+    std::vector<legacy::unit> legacy_units(SETS);
+    std::vector<fixed::unit> fixed_units(SETS);
+    std::vector<legacy::bms> legacy_bms(SETS);
+    std::vector<fixed::bms> fixed_bms(SETS);
+    std::vector<centi_volts> packs(SETS);
+    for (int i = 0; i < SETS; i++) {
+        legacy_units[i] = legacy::decode_status(status[i]);
+        fixed_units[i] = fixed::decode_status(status[i]);
+        legacy_bms[i] = legacy::decode_bms(bms[i]);
+        fixed_bms[i] = fixed::decode_bms(bms[i]);
+        packs[i] = centi_volts::from(limits[i].pack_voltage);
+    }
+    print("fault checks", time_passes(passes, [&](int i) {
+              sink(legacy::faults(legacy_bms[i], legacy_units[i]));
+          }),
+          time_passes(passes, [&](int i) {
+              sink(fixed::faults(fixed_bms[i], fixed_units[i]));
+          }));
+    print("current limit", time_passes(passes, [&](int i) {
+              sink(legacy::current_limit(limits[i]));
+          }),
+          time_passes(passes, [&](int i) {
+              sink(fixed::current_limit(limits[i].j1772_duty, packs[i]));
+          }));
+    return agree ? 0 : 1;
+}
@@ -0,0 +1,181 @@
+/**
+ * @file bench_j1772_table.cc
+ * @brief Check the J1772 current limit table against the float formula it
+ * replaced, then time both.
+ *
+ * Every pilot the capture can report from 600 to 1400 Hz (and a margin past
+ * both ends) is decoded at every high time, and the table must give the same
+ * validity and a current within one 0.1 A count of the formula. A pilot
+ * whose duty cycle sits exactly on a 10, 86 or 96 % band edge is skipped:
+ * there the formula's answer comes down to float rounding. The sweep is then
+ * repeated in physical terms, 600-1400 Hz in 1 Hz steps and 10-96 % duty in
+ * 0.1 % steps, through the nearest capture counts.
+ *
+ * Usage: bench_j1772_table [passes]
+ *
+ */
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#include "j1772_table.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define HAVE_TSC 1
+#endif
+
+using namespace umnsvp::charger;
+
+namespace {
+constexpr uint16_t PERIOD_MARGIN = 50;
+
+/**
+ * @brief The previous decode: frequency and duty cycle from the capture
+ * counts, as pwm_driver::update() did, then J1772's Table 6 bands.
+ *
+ */
+j1772_table::pilot_limit formula(uint16_t period, uint16_t high_time) {
+    if (period == 0) {
+        return {deci_amps(0), false};
+    }
+    const float low = period - high_time;
+    const float frequency =
+        static_cast<float>(pwm_driver::timer_ref_clock) / period;
+    const float duty_cycle = 1.00f - low / period;
+    if (frequency <= 1400 && frequency >= 600) {
+        if (duty_cycle > 0.1f && duty_cycle < 0.86f) {
+            return {deci_amps::from(duty_cycle * 60), true};
+        }
+        if (duty_cycle >= 0.86f && duty_cycle <= 0.96f) {
+            return {deci_amps::from((duty_cycle * 100 - 64) * 2.5f), true};
+        }
+    }
+    return {deci_amps(0), false};
+}
+
+bool on_band_edge(uint16_t period, uint16_t high_time) {
+    const uint32_t high = high_time * 100u;
+    return high == 10u * period || high == 86u * period ||
+           high == 96u * period;
+}
+
+struct sweep {
+    uint32_t pilots = 0;
+    uint32_t skipped = 0;
+    uint32_t mismatches = 0;
+    int32_t worst_error = 0;  // deci-amps
+
+    void check(uint16_t period, uint16_t high_time) {
+        if (on_band_edge(period, high_time)) {
+            skipped++;
+            return;
+        }
+        pilots++;
+        const j1772_table::pilot_limit expected = formula(period, high_time);
+        const j1772_table::pilot_limit actual =
+            j1772_table::decode(period, high_time);
+        const int32_t error =
+            std::abs(expected.current.count() - actual.current.count());
+        worst_error = error > worst_error ? error : worst_error;
+        if (expected.valid != actual.valid || error > 1) {
+            if (mismatches++ < 10) {
+                std::printf("mismatch at %u/%u counts: formula %s %.1f A, "
+                            "table %s %.1f A\n",
+                            period, high_time,
+                            expected.valid ? "valid" : "invalid",
+                            expected.current.to_float(),
+                            actual.valid ? "valid" : "invalid",
+                            actual.current.to_float());
+            }
+        }
+    }
+
+    void print(const char* name) const {
+        std::printf("%-20s %7u pilots, %3u on a band edge, %u mismatches, "
+                    "worst %.1f A\n",
+                    name, pilots, skipped, mismatches, worst_error / 10.0);
+    }
+};
+
+struct cost {
+    double ns;
+    double tsc;
+};
+
+template <class Fn>
+cost time_passes(int passes, Fn pass) {
+#ifdef HAVE_TSC
+    const uint64_t tsc_start = __rdtsc();
+#endif
+    const auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < passes; i++) {
+        pass(i);
+    }
+    const auto elapsed = std::chrono::steady_clock::now() - start;
+    cost c;
+    c.ns = std::chrono::duration<double, std::nano>(elapsed).count() / passes;
+#ifdef HAVE_TSC
+    c.tsc = static_cast<double>(__rdtsc() - tsc_start) / passes;
+#else
+    c.tsc = 0;
+#endif
+    return c;
+}
+
+template <class T>
+void sink(const T& value) {
+    asm volatile("" : : "g"(&value) : "memory");
+}
+}  // namespace
+
+int main(int argc, char** argv) {
+    const int passes = argc > 1 ? std::atoi(argv[1]) : 1000000;
+
+    std::printf("table: %u duty steps, periods %u-%u counts, %zu bytes\n\n",
+                j1772_table::DUTY_STEPS, j1772_table::PERIOD_MIN,
+                j1772_table::PERIOD_MAX, sizeof(j1772_table::TABLE));
+
+    sweep counts;
+    for (uint16_t period = j1772_table::PERIOD_MIN - PERIOD_MARGIN;
+         period <= j1772_table::PERIOD_MAX + PERIOD_MARGIN; period++) {
+        for (uint16_t high_time = 0; high_time <= period; high_time++) {
+            counts.check(period, high_time);
+        }
+    }
+    sweep physical;
+    for (int hz = 600; hz <= 1400; hz++) {
+        for (int permille = 100; permille <= 960; permille++) {
+            const double period =
+                static_cast<double>(pwm_driver::timer_ref_clock) / hz;
+            physical.check(static_cast<uint16_t>(std::lround(period)),
+                           static_cast<uint16_t>(
+                               std::lround(period * permille / 1000)));
+        }
+    }
+    counts.print("counts");
+    physical.print("600-1400 Hz, 10-96 %");
+    const bool agree = counts.mismatches == 0 && physical.mismatches == 0;
+    std::printf("table agrees with formula: %s\n\n", agree ? "yes" : "NO");
+
+    // a spread of pilots, mostly in range
+    std::vector<std::pair<uint16_t, uint16_t>> pilots;
+    for (uint16_t i = 0; i < 256; i++) {
+        const uint16_t period = 540 + (i * 7) % 840;
+        pilots.push_back({period, static_cast<uint16_t>(period * i / 256)});
+    }
+    const cost before = time_passes(passes, [&](int i) {
+        const auto& p = pilots[i % pilots.size()];
+        sink(formula(p.first, p.second));
+    });
+    const cost after = time_passes(passes, [&](int i) {
+        const auto& p = pilots[i % pilots.size()];
+        sink(j1772_table::decode(p.first, p.second));
+    });
+    std::printf("%-9s %8s %8s\n", "per call", "ns", "tsc");
+    std::printf("%-9s %8.1f %8.0f\n", "formula", before.ns, before.tsc);
+    std::printf("%-9s %8.1f %8.0f\n", "table", after.ns, after.tsc);
+    return agree ? 0 : 1;
+}
@@ -0,0 +1,294 @@
+/**
+ * @file bench_loop_supervisor.cc
+ * @brief Drives the real charger Application into slow and hung main loop
+ * passes and checks what the loop supervisor does about them.
+ *
+ * Each boot reconstructs the Application on a reset simulated core, keeping
+ * backup SRAM and the reset flags the way a real reset does, while the pack
+ * and charger models carry on. Scenarios, in order, each while charging:
+ *
+ *   slow passes:  every tick poll costs 3 ms for a while. Passes run over
+ *                 LOOP_PASS_DEADLINE and are counted; nothing resets.
+ *   hung pass:    one tick poll takes longer than the hard deadline. The
+ *                 chargers must all be sent a disable before the AC opens,
+ *                 and the core resets with reset_cause::DEADLINE.
+ *   stuck loop:   the main loop never wakes again. Only the watchdog can
+ *                 notice, and the next boot reports reset_cause::WATCHDOG.
+ *   CAN report:   the statistics are read back over CAN1 with a REPORT
+ *                 request, then cleared with CLEAR.
+ *
+ * Exits non-zero if any check fails.
+ *
+ * Usage: bench_loop_supervisor
+ *
+ */
+#include <cstdio>
+#include <optional>
+#include <vector>
+
+#include "application.h"
+#include "devices.h"
+#include "main.h"
+#include "sim.h"
+#include "state_names.h"
+#include "thunderstruck_frames.h"
+
+using namespace umnsvp::charger;
+
+namespace {
+std::optional<Application> board;
+std::vector<umnsvp::can::packet> report_frames;  // since the last request
+}  // namespace
+
+void timer_handler_callback(TIM_HandleTypeDef* htim) {
+    if (htim->Instance == TIM6) {
+        board->scheduler_tick();
+    }
+}
+
+namespace {
+constexpr uint64_t LOOP_COST_US = 20;
+constexpr uint64_t PLANT_STEP_US = 10000;
+constexpr uint64_t STATUS_PERIOD_US = 100000;
+constexpr uint64_t PLUG_IN_US = 1000000;
+constexpr uint64_t CHARGE_US = 10000000;  // from boot to a steady current
+constexpr uint32_t SLOW_POLL_US = 3000;
+constexpr uint64_t SLOW_US = 2000000;
+constexpr uint32_t HUNG_POLL_US = 150000;
+constexpr uint64_t STUCK_US = 2000000;
+constexpr uint8_t CONTROL_DISABLE = 0xFF;  // Enable byte of a control frame
+
+bool ok = true;
+
+void check(bool pass, const char* what) {
+    if (!pass) {
+        std::printf("  FAIL: %s\n", what);
+        ok = false;
+    }
+}
+
+/**
+ * @brief Power the charger up, or bring it back from a reset, and plug in.
+ *
+ */
+void boot(sim::Plant& plant) {
+    sim::reset();
+    board.emplace();
+    sim::set_irq_handler(CAN1_RX0_IRQn, [] { board->can1_rx_callback(); });
+    sim::set_irq_handler(CAN1_RX1_IRQn, [] { board->can1_rx1_callback(); });
+    sim::set_irq_handler(CAN1_TX_IRQn, [] { board->can1_tx_callback(); });
+    sim::set_irq_handler(CAN2_RX1_IRQn, [] { board->can2_rx_callback(); });
+    sim::set_irq_handler(CAN2_TX_IRQn, [] { board->can2_tx_callback(); });
+    sim::set_irq_handler(EXTI9_5_IRQn, [] { board->prox_callback(); });
+    plant.attach(PLANT_STEP_US);
+    sim::on_transmit(CAN1, [](const umnsvp::can::packet& p) {
+        if (p.get_id() == DEADLINE_REPORT_ID) {
+            report_frames.push_back(p);
+        }
+    });
+    sim::at(PLUG_IN_US, [] {
+        sim::set_input_pin(PROX_PORT, PROX_PIN, true);
+        sim::set_pilot(1000.0f, 0.5f);
+    });
+    sim::advance_us(STATUS_PERIOD_US);
+    board->start();
+}
+
+/**
+ * @brief Step the main loop for a while.
+ *
+ * @return true If the core reset before the time was up.
+ */
+bool run(uint64_t us, sim::system_reset* reset = nullptr) {
+    const uint64_t end = sim::now_us() + us;
+    try {
+        while (sim::now_us() < end) {
+            board->step();
+            sim::advance_us(LOOP_COST_US);
+        }
+    } catch (const sim::system_reset& r) {
+        if (reset != nullptr) {
+            *reset = r;
+        }
+        return true;
+    }
+    return false;
+}
+
+void print_record(const deadline_record& r) {
+    std::printf("  worst pass %.1f ms (longest phase %s), %u passes over "
+                "%u us, %u phases over their deadline (last %s)\n",
+                r.worst_pass_cycles / (SystemCoreClock / 1e3),
+                sim::phase_name(r.worst_pass_phase), r.pass_overruns,
+                LOOP_PASS_DEADLINE, r.phase_overruns,
+                sim::phase_name(r.last_overrun_phase));
+    std::printf("  last reset %s in %s, %u deadline resets, %u watchdog "
+                "resets\n",
+                sim::reset_cause_name(r.last_reset),
+                sim::phase_name(r.reset_phase), r.deadline_resets,
+                r.watchdog_resets);
+}
+
+void slow_passes(sim::Plant& plant) {
+    std::printf("slow passes: %u us per tick poll for %.1f s\n", SLOW_POLL_US,
+                SLOW_US / 1e6);
+    sim::set_tick_poll_cost_us(SLOW_POLL_US);
+    const bool reset = run(SLOW_US);
+    sim::set_tick_poll_cost_us(1);
+    const deadline_record r = board->get_deadline_record();
+    print_record(r);
+    check(!reset, "reset on passes under the hard deadline");
+    check(r.pass_overruns > 0, "slow passes not counted");
+    check(board->get_charge_state() == charge_state::CHARGING,
+          "stopped charging");
+    check(plant.total_charger_current() > 1.0f, "no charger current");
+}
+
+void hung_pass(sim::Plant& plant) {
+    std::printf("hung pass: %u us tick poll\n", HUNG_POLL_US);
+    const uint64_t hang_us = sim::now_us();
+    const float current = plant.total_charger_current();
+    std::vector<uint64_t> disabled_us(NUMBER_CHARGERS, 0);
+    sim::on_transmit(CAN2, [&](const umnsvp::can::packet& p) {
+        for (uint8_t unit = 0; unit < NUMBER_CHARGERS; unit++) {
+            if (p.get_id() == thunderstruck_frames::control_id(unit) &&
+                p.get_data()[0] == CONTROL_DISABLE &&
+                disabled_us[unit] == 0) {
+                disabled_us[unit] = sim::now_us();
+            }
+        }
+    });
+
+    sim::set_tick_poll_cost_us(HUNG_POLL_US);
+    sim::system_reset reset = {};
+    const bool did_reset = run(STUCK_US, &reset);
+    sim::set_tick_poll_cost_us(1);
+    const uint64_t reset_us = sim::now_us();
+    const bool ac_on = sim::read_output_pin(CONTROL_PORT, CONTROL_PIN);
+    bool all_disabled = true;
+    for (uint8_t unit = 0; unit < NUMBER_CHARGERS; unit++) {
+        std::printf("  charger %u disabled %.1f ms after the hang, %s\n", unit,
+                    (disabled_us[unit] - hang_us) / 1e3,
+                    plant.chargers[unit].enabled() ? "still enabled"
+                                                   : "off at the reset");
+        all_disabled = all_disabled && disabled_us[unit] != 0 &&
+                       !plant.chargers[unit].enabled();
+    }
+    std::printf("  reset %.1f ms after the hang, AC %s, %.1f A -> %.1f A\n",
+                (reset_us - hang_us) / 1e3, ac_on ? "on" : "open", current,
+                plant.total_charger_current());
+    check(did_reset && !reset.watchdog, "no deadline reset");
+    check(all_disabled, "a charger was not disabled before the reset");
+    check(!ac_on, "AC still on at the reset");
+    check(reset_us - hang_us <=
+              (LOOP_HARD_DEADLINE + DEADLINE_ISOLATE_TIME + 2) * 1000,
+          "reset late");
+
+    boot(plant);
+    const deadline_record r = board->get_deadline_record();
+    print_record(r);
+    check(r.last_reset == static_cast<uint8_t>(reset_cause::DEADLINE),
+          "reset not recorded as a deadline miss");
+    check(r.deadline_resets == 1, "deadline resets not counted");
+    check(r.worst_pass_cycles / (SystemCoreClock / 1000) >=
+              LOOP_HARD_DEADLINE + DEADLINE_ISOLATE_TIME,
+          "hung pass not the worst");
+    run(CHARGE_US);
+    check(board->get_charge_state() == charge_state::CHARGING,
+          "not charging again after the reset");
+}
+
+void stuck_loop(sim::Plant& plant) {
+    std::printf("stuck loop: main loop not woken for %.1f s\n", STUCK_US / 1e6);
+    const uint64_t stuck_us = sim::now_us();
+    bool did_reset = false;
+    bool watchdog = false;
+    try {
+        sim::advance_us(STUCK_US);
+    } catch (const sim::system_reset& r) {
+        did_reset = true;
+        watchdog = r.watchdog;
+    }
+    std::printf("  reset %.1f ms after the last pass\n",
+                (sim::now_us() - stuck_us) / 1e3);
+    check(did_reset && watchdog, "no watchdog reset");
+
+    boot(plant);
+    const deadline_record r = board->get_deadline_record();
+    print_record(r);
+    check(r.last_reset == static_cast<uint8_t>(reset_cause::WATCHDOG),
+          "reset not recorded as the watchdog");
+    check(r.reset_phase == static_cast<uint8_t>(loop_phase::WAKE),
+          "hung phase not recorded");
+    check(r.watchdog_resets == 1 && r.deadline_resets == 1,
+          "reset counts lost across the reset");
+}
+
+// send a deadline_command on CAN1 and collect the report frames it brings
+std::vector<umnsvp::can::packet> request(deadline_command command) {
+    report_frames.clear();
+    const uint8_t data = static_cast<uint8_t>(command);
+    sim::inject(CAN1, umnsvp::can::fifo::FIFO1,
+                umnsvp::can::packet(DEADLINE_REQUEST_ID, 1, &data, false));
+    run(STATUS_PERIOD_US);
+    return report_frames;
+}
+
+void can_report() {
+    std::printf("CAN report:\n");
+    const deadline_record r = board->get_deadline_record();
+    std::vector<umnsvp::can::packet> frames =
+        request(deadline_command::REPORT);
+    check(frames.size() == 2, "not two report frames");
+    if (frames.size() != 2) {
+        return;
+    }
+    const deadline_report pass = deadline_pass_frame::unpack(
+        frames[0].get_data());
+    const deadline_report resets = deadline_reset_frame::unpack(
+        frames[1].get_data());
+    std::printf("  worst pass %u us in %s, %u pass overruns, %u phase "
+                "overruns, resets %u deadline %u watchdog, last %s in %s\n",
+                pass.worst_pass_us, sim::phase_name(pass.worst_pass_phase),
+                pass.pass_overruns, resets.phase_overruns,
+                resets.deadline_resets, resets.watchdog_resets,
+                sim::reset_cause_name(resets.last_reset),
+                sim::phase_name(resets.reset_phase));
+    check(pass.index == 0 && resets.index == 1, "frames out of order");
+    check(pass.worst_pass_us ==
+              r.worst_pass_cycles / (SystemCoreClock / 1000000),
+          "worst pass differs from the record");
+    check(pass.pass_overruns == r.pass_overruns &&
+              resets.deadline_resets == r.deadline_resets &&
+              resets.watchdog_resets == r.watchdog_resets &&
+              resets.last_reset == r.last_reset,
+          "counts differ from the record");
+
+    request(deadline_command::CLEAR);
+    frames = request(deadline_command::REPORT);
+    check(frames.size() == 2, "no report after CLEAR");
+    if (frames.size() != 2) {
+        return;
+    }
+    const deadline_report cleared = deadline_reset_frame::unpack(
+        frames[1].get_data());
+    check(cleared.deadline_resets == 0 && cleared.watchdog_resets == 0,
+          "CLEAR left the reset counts");
+}
+}  // namespace
+
+int main() {
+    sim::Plant plant(static_cast<uint8_t>(NUMBER_CHARGERS), STATUS_PERIOD_US);
+    // power on: nothing in backup SRAM yet
+    sim::clear_backup_sram();
+    boot(plant);
+    run(CHARGE_US);
+    std::printf("charging at %.1f A\n\n", plant.total_charger_current());
+
+    slow_passes(plant);
+    hung_pass(plant);
+    stuck_loop(plant);
+    run(CHARGE_US);
+    can_report();
+    return ok ? 0 : 1;
+}
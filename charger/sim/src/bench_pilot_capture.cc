@@ -0,0 +1,148 @@
+/**
+ * @file bench_pilot_capture.cc
+ * @brief J1772 current limit under control pilot glitches, for the previous
+ * capture interrupt path and the DMA capture with batched medians.
+ *
+ * A 1 kHz, 50 % pilot (30 A) carries noise spikes at random times. The
+ * interrupt path recomputes duty and frequency from the capture registers on
+ * every period, as pwm_driver::measure_duty() did; the DMA path is the real
+ * J1772 and pwm_driver, updated at the main loop's 100 ms control rate. Both
+ * limits are sampled every millisecond.
+ *
+ * The J1772 limit is 0 A while unplugged, so the plug in goes through the
+ * firmware's proximity path: the EXTI interrupt timestamps the edge and the
+ * debounce job, at its scheduler period, takes the settled level.
+ *
+ * Usage: bench_pilot_capture [simulated seconds] [glitches per second]
+ *
+ */
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+
+#include "j1772.h"
+#include "sim.h"
+
+using namespace umnsvp::charger;
+
+namespace {
+constexpr uint64_t UPDATE_PERIOD_US = 100000;
+constexpr uint64_t SAMPLE_PERIOD_US = 1000;
+constexpr float PILOT_LIMIT = 30.0f;
+
+/**
+ * @brief The previous path: a capture interrupt per pilot period computing
+ * duty and frequency from the last CH1/CH2 captures.
+ *
+ */
+struct LegacyPilot {
+    TIM_HandleTypeDef handle = {};
+    float duty = 0;
+    float frequency = 0;
+    uint32_t interrupts = 0;
+
+    void measure() {
+        const float period = HAL_TIM_ReadCapturedValue(&handle, TIM_CHANNEL_1);
+        const float low = HAL_TIM_ReadCapturedValue(&handle, TIM_CHANNEL_2);
+        duty = 1.00f - low / period;
+        frequency = pwm_driver::timer_ref_clock / period;
+        interrupts++;
+    }
+
+    // J1772::get_j1772_current_limit() on these values
+    float current_limit() const {
+        if (frequency <= 1400 && frequency >= 600) {
+            if (duty > 0.1 && duty < 0.86) {
+                return duty * 60;
+            }
+            if (duty >= 0.86 && duty <= 0.96) {
+                return (duty * 100 - 64) * 2.5;
+            }
+        }
+        return 0;
+    }
+};
+
+LegacyPilot legacy;
+
+struct limit_stats {
+    uint32_t samples = 0;
+    uint32_t off_samples = 0;  // limit not the 30 A the pilot asks for
+    uint32_t zero_samples = 0;
+    float min = PILOT_LIMIT;
+
+    void add(float limit) {
+        samples++;
+        off_samples += limit != PILOT_LIMIT;
+        zero_samples += limit == 0;
+        min = limit < min ? limit : min;
+    }
+};
+
+void print(const char* name, const limit_stats& s, double per_second) {
+    std::printf("%-10s %10.0f %12.2f %12.2f %8.1f\n", name, per_second,
+                100.0 * s.off_samples / s.samples,
+                100.0 * s.zero_samples / s.samples, s.min);
+}
+}  // namespace
+
+int main(int argc, char** argv) {
+    const double duration_s = argc > 1 ? std::atof(argv[1]) : 60.0;
+    const double glitch_rate = argc > 2 ? std::atof(argv[2]) : 5.0;
+    const uint64_t duration_us = static_cast<uint64_t>(duration_s * 1e6);
+
+    sim::reset();
+    J1772 evse;
+    evse.init();
+    // the old path on the same timer, with its capture interrupt
+    legacy.handle.Instance = TIM1;
+    HAL_TIM_RegisterCallback(&legacy.handle, HAL_TIM_IC_CAPTURE_CB_ID,
+                             [](TIM_HandleTypeDef*) { legacy.measure(); });
+    HAL_TIM_IC_Start_IT(&legacy.handle, TIM_CHANNEL_1);
+
+    // Application::prox_callback() and debounce_prox(), less the chargers
+    sim::set_irq_handler(EXTI9_5_IRQn,
+                         [&evse] { evse.prox_edge(HAL_GetTick()); });
+    sim::every(PROX_DEBOUNCE_PERIOD * 1000, PROX_DEBOUNCE_PERIOD * 1000,
+               [&evse] {
+                   __disable_irq();
+                   evse.debounce_prox(HAL_GetTick());
+                   __enable_irq();
+               });
+    sim::set_input_pin(PROX_PORT, PROX_PIN, true);
+    sim::set_pilot(1000.0f, 0.5f);
+
+    uint32_t updates = 0;
+    sim::every(UPDATE_PERIOD_US, UPDATE_PERIOD_US, [&evse, &updates] {
+        evse.update_control_pilot();
+        updates++;
+    });
+
+    std::mt19937 rng(1);
+    std::exponential_distribution<double> gap_s(glitch_rate);
+    uint32_t glitches = 0;
+    if (glitch_rate > 0) {
+        for (double t = 1.0 + gap_s(rng); t < duration_s; t += gap_s(rng)) {
+            sim::at(static_cast<uint64_t>(t * 1e6), [] { sim::glitch_pilot(); });
+            glitches++;
+        }
+    }
+
+    // skip the first second while both paths settle
+    limit_stats before;
+    limit_stats after;
+    sim::every(SAMPLE_PERIOD_US, 1000000, [&] {
+        before.add(legacy.current_limit());
+        after.add(evse.get_j1772_current_limit().to_float());
+    });
+
+    sim::advance_us(duration_us);
+
+    std::printf("%.0f s of 1 kHz 50 %% pilot (%.0f A), %u glitches\n\n",
+                duration_s, PILOT_LIMIT, glitches);
+    std::printf("%-10s %10s %12s %12s %8s\n", "path", "cpu runs/s",
+                "% not 30 A", "% at 0 A", "min A");
+    print("interrupt", before, legacy.interrupts / duration_s);
+    print("dma", after, updates / duration_s);
+    return after.off_samples == 0 ? 0 : 1;
+}
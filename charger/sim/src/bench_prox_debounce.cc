@@ -0,0 +1,279 @@
+/**
+ * @file bench_prox_debounce.cc
+ * @brief Bouncing proximity contacts against the real Application: plugging
+ * in, a brief glitch while charging, and unplugging while charging.
+ *
+ * Each trial boots the sim plant and drives the proximity pin through a
+ * random train of bounces, a few to a dozen edges up to 10 ms apart in all,
+ * at a random point in the control period. Sampling every millisecond, it
+ * records:
+ *
+ *   flips:   charge state changes between IDLE and the plugged in states
+ *   command: from the first unplug edge until every charger is commanded
+ *            zero current
+ *   zero:    from the first unplug edge until the chargers put out no current
+ *   ac open: from the first unplug edge until the AC is opened, and the
+ *            charger current at that moment
+ *
+ * along with the firmware's own bounce count and unplug ramp time. Exits
+ * non-zero if a plug in flips the state more than once, a glitch stops the
+ * charge, an unplug is missed or opens the AC with more than 10 mA still
+ * flowing, or the bounce count is off.
+ *
+ * Usage: bench_prox_debounce [trials per scenario]
+ *
+ */
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <optional>
+#include <random>
+
+#include "application.h"
+#include "devices.h"
+#include "main.h"
+#include "sim.h"
+
+using namespace umnsvp::charger;
+
+namespace {
+std::optional<Application> board;
+}  // namespace
+
+void timer_handler_callback(TIM_HandleTypeDef* htim) {
+    if (htim->Instance == TIM6) {
+        board->scheduler_tick();
+    }
+}
+
+namespace {
+constexpr uint64_t LOOP_COST_US = 20;
+constexpr uint64_t PLANT_STEP_US = 1000;  // fine enough to time the ramp
+constexpr uint64_t STATUS_PERIOD_US = 100000;
+constexpr uint64_t PLUG_IN_US = 1000000;
+constexpr uint64_t CHARGE_US = 10000000;  // from boot to a steady current
+constexpr uint64_t SAMPLE_US = 1000;
+constexpr uint64_t AFTER_US = 2000000;  // watched after the bounces start
+constexpr uint32_t MAX_EDGES = 12;
+constexpr uint64_t MAX_EDGE_GAP_US = 2000;
+constexpr float ZERO_CURRENT = 0.01f;  // A
+
+enum class scenario
+{
+    PLUG_IN,
+    GLITCH,
+    UNPLUG
+};
+
+const char* const SCENARIO_NAMES[] = {"plug in", "glitch, charging",
+                                      "unplug, charging"};
+
+bool plugged_in(charge_state state) {
+    return state != charge_state::IDLE;
+}
+
+/**
+ * @brief What the millisecond probe saw, in us from the first edge, or 0
+ * if it didn't happen.
+ *
+ */
+struct probe {
+    uint64_t first_edge = 0;
+    uint64_t command_us = 0;
+    uint64_t zero_us = 0;
+    uint64_t ac_open_us = 0;
+    float current_at_ac_open = 0;
+    uint32_t flips = 0;
+    bool left_charging = false;
+    charge_state last_state = charge_state::IDLE;
+};
+
+probe seen;
+
+void sample(const sim::Plant& plant) {
+    const uint64_t now = sim::now_us();
+    const charge_state state = board->get_charge_state();
+    if (plugged_in(state) != plugged_in(seen.last_state)) {
+        seen.flips++;
+    }
+    if (state != charge_state::CHARGING &&
+        seen.last_state == charge_state::CHARGING) {
+        seen.left_charging = true;
+    }
+    seen.last_state = state;
+    if (seen.first_edge == 0 || now < seen.first_edge) {
+        return;
+    }
+    const uint64_t since = now - seen.first_edge;
+    const bool commanded_zero = std::all_of(
+        plant.chargers.begin(), plant.chargers.end(),
+        [](const sim::ThunderstruckModel& c) {
+            return !c.enabled() || c.commanded_current() == 0;
+        });
+    if (seen.command_us == 0 && commanded_zero) {
+        seen.command_us = std::max<uint64_t>(since, 1);
+    }
+    if (seen.zero_us == 0 && plant.total_charger_current() < ZERO_CURRENT) {
+        seen.zero_us = std::max<uint64_t>(since, 1);
+    }
+    if (seen.ac_open_us == 0 &&
+        !sim::read_output_pin(CONTROL_PORT, CONTROL_PIN)) {
+        seen.ac_open_us = std::max<uint64_t>(since, 1);
+        seen.current_at_ac_open = plant.total_charger_current();
+    }
+}
+
+void run(uint64_t us) {
+    const uint64_t end = sim::now_us() + us;
+    while (sim::now_us() < end) {
+        board->step();
+        sim::advance_us(LOOP_COST_US);
+    }
+}
+
+/**
+ * @brief Schedule a bounce train from the pin's current level, ending on
+ * level. The edges are gap_us apart at random, up to MAX_EDGE_GAP_US.
+ *
+ * @return uint32_t Edges scheduled.
+ */
+uint32_t bounce(std::mt19937& rng, uint64_t start, bool from, bool to) {
+    std::uniform_int_distribution<uint32_t> pairs(0, (MAX_EDGES - 2) / 2);
+    std::uniform_int_distribution<uint64_t> gap(50, MAX_EDGE_GAP_US);
+    // an odd number of edges changes the level, an even number returns to it
+    const uint32_t edges = 2 * pairs(rng) + (from != to ? 1 : 2);
+    uint64_t when = start;
+    bool level = from;
+    for (uint32_t i = 0; i < edges; i++) {
+        level = !level;
+        sim::at(when, [level] {
+            sim::set_input_pin(PROX_PORT, PROX_PIN, level);
+        });
+        when += gap(rng);
+    }
+    return edges;
+}
+
+struct result {
+    probe seen;
+    uint32_t edges = 0;           // scheduled
+    prox_stats stats;             // the firmware's
+    uint32_t unplug_ramp_time = 0;  // ms, the firmware's
+    bool ok = true;
+};
+
+result trial(scenario s, std::mt19937& rng) {
+    sim::reset();
+    board.emplace();
+    seen = probe();
+    sim::set_irq_handler(CAN1_RX0_IRQn, [] { board->can1_rx_callback(); });
+    sim::set_irq_handler(CAN1_RX1_IRQn, [] { board->can1_rx1_callback(); });
+    sim::set_irq_handler(CAN1_TX_IRQn, [] { board->can1_tx_callback(); });
+    sim::set_irq_handler(CAN2_RX1_IRQn, [] { board->can2_rx_callback(); });
+    sim::set_irq_handler(CAN2_TX_IRQn, [] { board->can2_tx_callback(); });
+    sim::set_irq_handler(EXTI9_5_IRQn, [] { board->prox_callback(); });
+    sim::Plant plant(static_cast<uint8_t>(NUMBER_CHARGERS), STATUS_PERIOD_US);
+    plant.attach(PLANT_STEP_US);
+    sim::set_pilot(1000.0f, 0.5f);
+    sim::every(SAMPLE_US, SAMPLE_US, [&plant] { sample(plant); });
+
+    result r;
+    std::uniform_int_distribution<uint64_t> offset(0, 100000);
+    sim::advance_us(STATUS_PERIOD_US);
+    board->start();
+    if (s == scenario::PLUG_IN) {
+        seen.first_edge = PLUG_IN_US + offset(rng);
+        r.edges = bounce(rng, seen.first_edge, false, true);
+        run(seen.first_edge + AFTER_US - sim::now_us());
+    } else {
+        sim::at(PLUG_IN_US, [] {
+            sim::set_input_pin(PROX_PORT, PROX_PIN, true);
+        });
+        run(CHARGE_US);
+        // the plug in is done with
+        const uint32_t plug_edges = board->get_prox_stats().edges;
+        seen.flips = 0;
+        seen.first_edge = sim::now_us() + offset(rng);
+        r.edges = plug_edges + bounce(rng, seen.first_edge, true,
+                                      s == scenario::GLITCH);
+        run(seen.first_edge + AFTER_US - sim::now_us());
+    }
+    r.seen = seen;
+    r.stats = board->get_prox_stats();
+    r.unplug_ramp_time = board->get_unplug_ramp_time();
+
+    switch (s) {
+        case scenario::PLUG_IN:
+            r.ok = seen.flips == 1;
+            break;
+        case scenario::GLITCH:
+            r.ok = seen.flips == 0 && !seen.left_charging;
+            break;
+        case scenario::UNPLUG:
+            r.ok = seen.flips == 1 && seen.ac_open_us != 0 &&
+                   seen.zero_us != 0 &&
+                   seen.current_at_ac_open <= ZERO_CURRENT;
+            break;
+    }
+    // every edge but the changes bounced
+    r.ok = r.ok && r.stats.edges == r.edges &&
+           r.stats.bounces + r.stats.changes == r.stats.edges;
+    return r;
+}
+
+double ms(uint64_t us) {
+    return us / 1e3;
+}
+}  // namespace
+
+int main(int argc, char** argv) {
+    const uint32_t trials = argc > 1 ? std::atoi(argv[1]) : 50;
+    std::mt19937 rng(1);
+
+    std::printf("%-18s %6s %7s %7s %8s %12s %10s %10s %10s %9s %10s\n",
+                "scenario", "trials", "edges", "bounce", "flips",
+                "left charge", "command", "zero", "ac open", "A at ac",
+                "fw ramp");
+    std::printf("%-18s %6s %7s %7s %8s %12s %10s %10s %10s %9s %10s\n", "", "",
+                "(sum)", "(fw)", "(worst)", "", "ms worst", "ms worst",
+                "ms worst", "worst", "ms worst");
+    bool ok = true;
+    for (uint8_t i = 0; i <= static_cast<uint8_t>(scenario::UNPLUG); i++) {
+        const scenario s = static_cast<scenario>(i);
+        uint32_t edges = 0;
+        uint32_t bounces = 0;
+        uint32_t worst_flips = 0;
+        uint32_t left_charging = 0;
+        uint32_t failed = 0;
+        uint64_t command = 0;
+        uint64_t zero = 0;
+        uint64_t ac_open = 0;
+        float current_at_ac_open = 0;
+        uint32_t ramp = 0;
+        for (uint32_t t = 0; t < trials; t++) {
+            const result r = trial(s, rng);
+            edges += r.edges;
+            bounces += r.stats.bounces;
+            worst_flips = std::max(worst_flips, r.seen.flips);
+            left_charging += r.seen.left_charging;
+            failed += !r.ok;
+            if (s == scenario::UNPLUG) {
+                command = std::max(command, r.seen.command_us);
+                zero = std::max(zero, r.seen.zero_us);
+                ac_open = std::max(ac_open, r.seen.ac_open_us);
+                current_at_ac_open =
+                    std::max(current_at_ac_open, r.seen.current_at_ac_open);
+                ramp = std::max(ramp, r.unplug_ramp_time);
+            }
+        }
+        std::printf("%-18s %6u %7u %7u %8u %12u", SCENARIO_NAMES[i], trials,
+                    edges, bounces, worst_flips, left_charging);
+        if (s == scenario::UNPLUG) {
+            std::printf(" %10.1f %10.1f %10.1f %9.2f %10u", ms(command),
+                        ms(zero), ms(ac_open), current_at_ac_open, ramp);
+        }
+        std::printf("%s\n", failed ? "  FAIL" : "");
+        ok = ok && failed == 0;
+    }
+    return ok ? 0 : 1;
+}
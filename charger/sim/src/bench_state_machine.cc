@@ -0,0 +1,362 @@
+/**
+ * @file bench_state_machine.cc
+ * @brief Drives the real Application over every edge of the charge state
+ * machine and checks the path each scenario takes.
+ *
+ * Each scenario boots the sim plant, optionally with a BMS that won't grant
+ * charging, chargers that don't report (so THUNDERSTRUCK_POWER_ON lasts) or
+ * a pack near its charging target (so CHARGING_DONE comes quickly), then
+ * plugs in and provokes faults, unplugs or withdraws the grant at set times. The states
+ * the main loop passes through must be exactly the expected path. When a
+ * charger goes quiet mid charge, the current reported to the car must drop
+ * with the chargers still talking, not hold the quiet one's last report.
+ *
+ * Afterwards every row of the transition table must have been taken, each
+ * state's entry count must match the transitions into it, and the chargers
+ * must be disabled once the BMS withdraws its grant mid charge. The
+ * residency and transition counts summed over the scenarios are printed.
+ * Exits non-zero on any mismatch.
+ *
+ * Usage: bench_state_machine
+ *
+ */
+#include <algorithm>
+#include <cstdio>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "application.h"
+#include "devices.h"
+#include "main.h"
+#include "sim.h"
+#include "state_names.h"
+
+using namespace umnsvp::charger;
+namespace skylab2 = umnsvp::skylab2;
+
+namespace {
+std::optional<Application> board;
+}  // namespace
+
+void timer_handler_callback(TIM_HandleTypeDef* htim) {
+    if (htim->Instance == TIM6) {
+        board->scheduler_tick();
+    }
+}
+
+namespace {
+constexpr uint64_t LOOP_COST_US = 20;
+constexpr uint64_t PLANT_STEP_US = 10000;
+constexpr uint64_t STATUS_PERIOD_US = 100000;
+constexpr uint64_t PLUG_IN_US = 1000000;
+constexpr uint64_t SETTLE_US = 3000000;  // run on after the last action
+constexpr float HOT = 80;                // Celsius
+constexpr float FULL_SOC = 0.9f;
+
+enum class action
+{
+    PLUG_IN,
+    UNPLUG,
+    HV_KILL,
+    CHARGERS_HOT,
+    CHARGERS_COOL,
+    PACK_HOT,
+    REFUSE,
+    CHARGER_QUIET
+};
+
+struct timed_action {
+    uint64_t at_us;
+    action what;
+};
+
+struct scenario {
+    const char* name;
+    bool refusing;  // the BMS never grants charging
+    bool silent;    // the chargers never report
+    bool full;      // the pack starts near its charging target
+    std::vector<timed_action> actions;
+    std::vector<charge_state> path;
+};
+
+using cs = charge_state;
+const std::vector<scenario> SCENARIOS = {
+    {"charge to done, unplug",
+     false,
+     false,
+     true,
+     {{PLUG_IN_US, action::PLUG_IN}, {30000000, action::UNPLUG}},
+     {cs::IDLE, cs::CONNECTED, cs::THUNDERSTRUCK_POWER_ON, cs::CHARGING,
+      cs::CHARGING_DONE, cs::IDLE}},
+    {"HV kill, idle",
+     false,
+     false,
+     false,
+     {{2000000, action::HV_KILL}},
+     {cs::IDLE, cs::FAULT_LATCHING}},
+    {"chargers hot, idle",
+     false,
+     false,
+     false,
+     {{2000000, action::CHARGERS_HOT}, {4000000, action::CHARGERS_COOL}},
+     {cs::IDLE, cs::FAULT_RESETTABLE, cs::IDLE}},
+    {"HV kill, connected",
+     true,
+     false,
+     false,
+     {{PLUG_IN_US, action::PLUG_IN}, {3000000, action::HV_KILL}},
+     {cs::IDLE, cs::CONNECTED, cs::FAULT_LATCHING}},
+    {"chargers hot, connected",
+     true,
+     false,
+     false,
+     {{PLUG_IN_US, action::PLUG_IN},
+      {3000000, action::CHARGERS_HOT},
+      {5000000, action::CHARGERS_COOL},
+      {6000000, action::UNPLUG}},
+     {cs::IDLE, cs::CONNECTED, cs::FAULT_RESETTABLE, cs::IDLE}},
+    {"unplug, connected",
+     true,
+     false,
+     false,
+     {{PLUG_IN_US, action::PLUG_IN}, {3000000, action::UNPLUG}},
+     {cs::IDLE, cs::CONNECTED, cs::IDLE}},
+    {"HV kill, power on",
+     false,
+     true,
+     false,
+     {{PLUG_IN_US, action::PLUG_IN}, {4000000, action::HV_KILL}},
+     {cs::IDLE, cs::CONNECTED, cs::THUNDERSTRUCK_POWER_ON,
+      cs::FAULT_LATCHING}},
+    {"pack hot, power on",
+     false,
+     true,
+     false,
+     {{PLUG_IN_US, action::PLUG_IN}, {4000000, action::PACK_HOT}},
+     {cs::IDLE, cs::CONNECTED, cs::THUNDERSTRUCK_POWER_ON,
+      cs::FAULT_RESETTABLE}},
+    {"unplug, power on",
+     false,
+     true,
+     false,
+     {{PLUG_IN_US, action::PLUG_IN}, {4000000, action::UNPLUG}},
+     {cs::IDLE, cs::CONNECTED, cs::THUNDERSTRUCK_POWER_ON, cs::IDLE}},
+    {"BMS refuses, power on",
+     false,
+     true,
+     false,
+     {{PLUG_IN_US, action::PLUG_IN}, {4000000, action::REFUSE}},
+     {cs::IDLE, cs::CONNECTED, cs::THUNDERSTRUCK_POWER_ON, cs::CONNECTED}},
+    {"HV kill, charging",
+     false,
+     false,
+     false,
+     {{PLUG_IN_US, action::PLUG_IN}, {10000000, action::HV_KILL}},
+     {cs::IDLE, cs::CONNECTED, cs::THUNDERSTRUCK_POWER_ON, cs::CHARGING,
+      cs::FAULT_LATCHING}},
+    {"chargers hot, then HV kill",
+     false,
+     false,
+     false,
+     {{PLUG_IN_US, action::PLUG_IN},
+      {10000000, action::CHARGERS_HOT},
+      {12000000, action::HV_KILL}},
+     {cs::IDLE, cs::CONNECTED, cs::THUNDERSTRUCK_POWER_ON, cs::CHARGING,
+      cs::FAULT_RESETTABLE, cs::FAULT_LATCHING}},
+    {"unplug, charging",
+     false,
+     false,
+     false,
+     {{PLUG_IN_US, action::PLUG_IN}, {10000000, action::UNPLUG}},
+     {cs::IDLE, cs::CONNECTED, cs::THUNDERSTRUCK_POWER_ON, cs::CHARGING,
+      cs::IDLE}},
+    {"charger quiet, charging",
+     false,
+     false,
+     false,
+     {{PLUG_IN_US, action::PLUG_IN}, {10000000, action::CHARGER_QUIET}},
+     {cs::IDLE, cs::CONNECTED, cs::THUNDERSTRUCK_POWER_ON, cs::CHARGING,
+      cs::FAULT_RESETTABLE}},
+    {"BMS refuses, charging",
+     false,
+     false,
+     false,
+     {{PLUG_IN_US, action::PLUG_IN}, {10000000, action::REFUSE}},
+     {cs::IDLE, cs::CONNECTED, cs::THUNDERSTRUCK_POWER_ON, cs::CHARGING,
+      cs::CONNECTED}},
+    {"HV kill, done",
+     false,
+     false,
+     true,
+     {{PLUG_IN_US, action::PLUG_IN}, {30000000, action::HV_KILL}},
+     {cs::IDLE, cs::CONNECTED, cs::THUNDERSTRUCK_POWER_ON, cs::CHARGING,
+      cs::CHARGING_DONE, cs::FAULT_LATCHING}},
+    {"chargers hot, done",
+     false,
+     false,
+     true,
+     {{PLUG_IN_US, action::PLUG_IN}, {30000000, action::CHARGERS_HOT}},
+     {cs::IDLE, cs::CONNECTED, cs::THUNDERSTRUCK_POWER_ON, cs::CHARGING,
+      cs::CHARGING_DONE, cs::FAULT_RESETTABLE}},
+};
+
+void apply(sim::Plant& plant, action what) {
+    switch (what) {
+        case action::PLUG_IN:
+            sim::set_input_pin(PROX_PORT, PROX_PIN, true);
+            break;
+        case action::UNPLUG:
+            sim::set_input_pin(PROX_PORT, PROX_PIN, false);
+            break;
+        case action::HV_KILL:
+            plant.bms.killed = true;
+            break;
+        case action::CHARGERS_HOT:
+        case action::CHARGERS_COOL:
+            for (sim::ThunderstruckModel& charger : plant.chargers) {
+                charger.ambient = what == action::CHARGERS_HOT ? HOT : 25;
+                charger.temperature = charger.ambient;
+            }
+            break;
+        case action::PACK_HOT:
+            plant.bms.pack.temperature = HOT;
+            break;
+        case action::REFUSE:
+            plant.bms.refusing = true;
+            break;
+        case action::CHARGER_QUIET:
+            plant.chargers[0].silent = true;
+            break;
+    }
+}
+
+std::string path_names(const std::vector<charge_state>& path) {
+    std::string names;
+    for (charge_state state : path) {
+        names += (names.empty() ? "" : " > ") +
+                 std::string(sim::state_name(state));
+    }
+    return names;
+}
+
+struct totals {
+    std::vector<uint32_t> taken;
+    uint32_t entries[CHARGE_STATES] = {};
+    uint64_t residency[CHARGE_STATES] = {};  // ms
+};
+
+bool run_scenario(const scenario& s, totals& t) {
+    sim::reset();
+    board.emplace();
+    sim::set_irq_handler(CAN1_RX0_IRQn, [] { board->can1_rx_callback(); });
+    sim::set_irq_handler(CAN1_RX1_IRQn, [] { board->can1_rx1_callback(); });
+    sim::set_irq_handler(CAN1_TX_IRQn, [] { board->can1_tx_callback(); });
+    sim::set_irq_handler(CAN2_RX1_IRQn, [] { board->can2_rx_callback(); });
+    sim::set_irq_handler(CAN2_TX_IRQn, [] { board->can2_tx_callback(); });
+    sim::set_irq_handler(EXTI9_5_IRQn, [] { board->prox_callback(); });
+    sim::Plant plant(static_cast<uint8_t>(NUMBER_CHARGERS), STATUS_PERIOD_US);
+    plant.bms.refusing = s.refusing;
+    for (sim::ThunderstruckModel& charger : plant.chargers) {
+        charger.silent = s.silent;
+    }
+    if (s.full) {
+        plant.bms.pack.soc = FULL_SOC;
+    }
+    plant.attach(PLANT_STEP_US);
+    // the current the charger reports to the car
+    float reported = 0;
+    sim::on_transmit(CAN1, [&reported](const umnsvp::can::packet& p) {
+        if (p.get_id() == static_cast<uint32_t>(
+                              skylab2::CANPacketId::CAN_PACKET_CHARGER_STATE)) {
+            reported =
+                skylab2::unpack<skylab2::can_packet_charger_state>(p.get_data())
+                    .charging_current;
+        }
+    });
+    sim::set_pilot(1000.0f, 0.5f);
+    uint64_t end = 0;
+    for (const timed_action& a : s.actions) {
+        sim::at(a.at_us, [&plant, a] { apply(plant, a.what); });
+        end = std::max(end, a.at_us + SETTLE_US);
+    }
+
+    sim::advance_us(STATUS_PERIOD_US);
+    board->start();
+    std::vector<charge_state> path = {board->get_charge_state()};
+    while (sim::now_us() < end) {
+        board->step();
+        sim::advance_us(LOOP_COST_US);
+        if (board->get_charge_state() != path.back()) {
+            path.push_back(board->get_charge_state());
+        }
+    }
+
+    bool ok = path == s.path;
+    t.taken.resize(board->get_transition_count());
+    // one entry per transition into the state, plus the initial IDLE
+    uint32_t into[CHARGE_STATES] = {1};
+    for (uint8_t i = 0; i < board->get_transition_count(); i++) {
+        const uint32_t taken = board->get_transition_taken(i);
+        t.taken[i] += taken;
+        into[static_cast<uint8_t>(board->get_transition(i).to)] += taken;
+    }
+    for (uint8_t state = 0; state < CHARGE_STATES; state++) {
+        const charge_state c = static_cast<charge_state>(state);
+        ok = ok && board->get_state_stats(c).entries == into[state];
+        t.entries[state] += board->get_state_stats(c).entries;
+        t.residency[state] += board->get_state_residency(c);
+    }
+    // leaving CHARGING for CONNECTED disables the chargers
+    if (s.path.back() == cs::CONNECTED) {
+        for (const sim::ThunderstruckModel& charger : plant.chargers) {
+            ok = ok && !charger.enabled() && charger.output_current == 0;
+        }
+    }
+    // a charger that went quiet stops counting toward the current once its
+    // link expires, so the car sees no more than a status period of ramp on
+    // top of what the chargers really put out
+    const bool quiet =
+        std::any_of(s.actions.begin(), s.actions.end(), [](timed_action a) {
+            return a.what == action::CHARGER_QUIET;
+        });
+    if (quiet) {
+        float output = 0;
+        for (const sim::ThunderstruckModel& charger : plant.chargers) {
+            output += charger.output_current;
+        }
+        ok = ok && reported <= output + sim::ThunderstruckModel::RAMP_RATE *
+                                            STATUS_PERIOD_US / 1e6f;
+    }
+    std::printf("%-28s %s%s\n", s.name, path_names(path).c_str(),
+                ok ? "" : "  FAIL");
+    if (path != s.path) {
+        std::printf("%-28s %s expected\n", "", path_names(s.path).c_str());
+    }
+    return ok;
+}
+}  // namespace
+
+int main() {
+    bool ok = true;
+    totals t;
+    for (const scenario& s : SCENARIOS) {
+        ok = run_scenario(s, t) && ok;
+    }
+
+    std::printf("\n%-24s %8s %12s\n", "state", "entries", "residency s");
+    for (uint8_t state = 0; state < CHARGE_STATES; state++) {
+        std::printf("%-24s %8u %12.1f\n",
+                    sim::state_name(static_cast<charge_state>(state)),
+                    t.entries[state], t.residency[state] / 1e3);
+    }
+    std::printf("\n%-24s %-24s %6s\n", "from", "to", "taken");
+    for (uint8_t i = 0; i < t.taken.size(); i++) {
+        const auto& row = board->get_transition(i);
+        std::printf("%-24s %-24s %6u%s\n", sim::state_name(row.from),
+                    sim::state_name(row.to), t.taken[i],
+                    t.taken[i] == 0 ? "  NOT COVERED" : "");
+        ok = ok && t.taken[i] != 0;
+    }
+    return ok ? 0 : 1;
+}
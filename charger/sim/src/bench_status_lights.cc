@@ -0,0 +1,236 @@
+/**
+ * @file bench_status_lights.cc
+ * @brief Reads the fault blink codes back off the FAULT light, and measures
+ * what driving the lights costs while the charger sits idle or faulted.
+ *
+ * Each fault scenario boots the real Application against the sim plant,
+ * charges, provokes one or two faults and then samples the FAULT light pin
+ * every 10 ms. The samples are split into codes at the long pauses, and the
+ * codes must repeat the ones documented for the faults: a reader with only
+ * the board in view can tell the faults apart.
+ *
+ * The cost scenarios run a minute unplugged in IDLE and a minute latched in
+ * a fault, counting GPIO register writes (HAL_GPIO_WritePin/TogglePin calls
+ * and direct BSRR writes) and the host time of a main loop pass, scheduler
+ * tick interrupts included.
+ *
+ * Exits non-zero if a code is wrong.
+ *
+ * Usage: bench_status_lights
+ *
+ */
+#include <chrono>
+#include <cstdio>
+#include <optional>
+#include <vector>
+
+#include "application.h"
+#include "devices.h"
+#include "main.h"
+#include "sim.h"
+#include "state_names.h"
+
+using namespace umnsvp::charger;
+
+namespace {
+std::optional<Application> board;
+}  // namespace
+
+void timer_handler_callback(TIM_HandleTypeDef* htim) {
+    if (htim->Instance == TIM6) {
+        board->scheduler_tick();
+    }
+}
+
+namespace {
+constexpr uint64_t LOOP_COST_US = 20;
+constexpr uint64_t PLANT_STEP_US = 10000;
+constexpr uint64_t STATUS_PERIOD_US = 100000;
+constexpr uint64_t PLUG_IN_US = 1000000;
+constexpr uint64_t CHARGE_US = 10000000;  // from boot to a steady current
+constexpr uint64_t SETTLE_US = 5000000;   // from the fault to reading codes
+constexpr uint64_t READ_US = 15000000;
+constexpr uint64_t SAMPLE_US = 10000;
+constexpr uint64_t PAUSE_US = 500000;  // off this long ends a code
+constexpr uint64_t COST_US = 60000000;
+
+struct scenario {
+    const char* name;
+    bool overtemp;  // a charger overheats first
+    bool kill;      // then the BMS kills HV
+    bool silent;    // or the BMS stops talking
+    std::vector<uint32_t> codes;
+};
+
+const scenario SCENARIOS[] = {
+    {"HV kill", false, true, false, {1}},
+    {"BMS CAN timeout", false, false, true, {5}},
+    {"charger overtemp", true, false, false, {7}},
+    {"overtemp, then HV kill", true, true, false, {1, 7}},
+};
+
+void boot(sim::Plant& plant, bool plug_in) {
+    sim::reset();
+    board.emplace();
+    sim::set_irq_handler(CAN1_RX0_IRQn, [] { board->can1_rx_callback(); });
+    sim::set_irq_handler(CAN1_RX1_IRQn, [] { board->can1_rx1_callback(); });
+    sim::set_irq_handler(CAN1_TX_IRQn, [] { board->can1_tx_callback(); });
+    sim::set_irq_handler(CAN2_RX1_IRQn, [] { board->can2_rx_callback(); });
+    sim::set_irq_handler(CAN2_TX_IRQn, [] { board->can2_tx_callback(); });
+    sim::set_irq_handler(EXTI9_5_IRQn, [] { board->prox_callback(); });
+    plant.attach(PLANT_STEP_US);
+    if (plug_in) {
+        sim::at(PLUG_IN_US, [] {
+            sim::set_input_pin(PROX_PORT, PROX_PIN, true);
+            sim::set_pilot(1000.0f, 0.5f);
+        });
+    }
+    sim::advance_us(STATUS_PERIOD_US);
+    board->start();
+}
+
+void run(uint64_t us) {
+    const uint64_t end = sim::now_us() + us;
+    while (sim::now_us() < end) {
+        board->step();
+        sim::advance_us(LOOP_COST_US);
+    }
+}
+
+// the LEDs are lit by pulling their pin low
+bool fault_light_on() {
+    return !sim::read_output_pin(PORT_COMM_LIGHT_3, PIN_COMM_LIGHT_3);
+}
+
+/**
+ * @brief Sample the FAULT light and count the blinks of each code.
+ *
+ * @return std::vector<uint32_t> Blinks per code, in order, leaving out the
+ * first and last codes, which the reading may have cut short.
+ */
+std::vector<uint32_t> read_codes(uint64_t us) {
+    std::vector<uint32_t> codes;
+    uint32_t blinks = 0;
+    bool was_on = false;
+    bool started = false;  // seen a pause, so the next code is whole
+    uint64_t off_since = sim::now_us();
+    const uint64_t end = sim::now_us() + us;
+    while (sim::now_us() < end) {
+        const uint64_t next = sim::now_us() + SAMPLE_US;
+        while (sim::now_us() < next) {
+            board->step();
+            sim::advance_us(LOOP_COST_US);
+        }
+        const bool on = fault_light_on();
+        if (on && !was_on) {
+            if (sim::now_us() - off_since >= PAUSE_US) {
+                if (started && blinks != 0) {
+                    codes.push_back(blinks);
+                }
+                started = true;
+                blinks = 0;
+            }
+            blinks++;
+        } else if (!on && was_on) {
+            off_since = sim::now_us();
+        }
+        was_on = on;
+    }
+    return codes;
+}
+
+bool check_codes(const scenario& s) {
+    sim::Plant plant(static_cast<uint8_t>(NUMBER_CHARGERS), STATUS_PERIOD_US);
+    boot(plant, true);
+    run(CHARGE_US);
+    if (s.overtemp) {
+        plant.chargers[0].ambient = 80;
+        plant.chargers[0].temperature = 80;
+        run(1000000);
+    }
+    plant.bms.killed = s.kill;
+    plant.bms.silent = s.silent;
+    run(SETTLE_US);
+    const std::vector<uint32_t> codes = read_codes(READ_US);
+
+    std::printf("%-24s %-18s %-34s", s.name,
+                sim::state_name(board->get_charge_state()),
+                (sim::fault_names(board->get_bms_fault()) + " " +
+                 sim::fault_names(board->get_charger_fault()))
+                    .c_str());
+    for (uint32_t code : codes) {
+        std::printf(" %u", code);
+    }
+    // the reading starts at any code of the cycle
+    bool ok = false;
+    for (size_t start = 0; start < s.codes.size(); start++) {
+        bool cycle = codes.size() >= 2 * s.codes.size();
+        for (size_t i = 0; i < codes.size(); i++) {
+            cycle = cycle &&
+                    codes[i] == s.codes[(start + i) % s.codes.size()];
+        }
+        ok = ok || cycle;
+    }
+    std::printf("%s\n", ok ? "" : "  FAIL");
+    return ok;
+}
+
+struct cost {
+    double writes_per_s;  // GPIO register writes
+    double bsrr_share;    // of those, BSRR writes
+    double ns_per_pass;   // host
+    uint32_t passes;
+};
+
+cost measure(uint64_t us) {
+    const sim::gpio_stats gpio_start = sim::get_gpio_stats();
+    const uint32_t wakeups_start = board->get_loop_stats().wakeups;
+    const auto start = std::chrono::steady_clock::now();
+    run(us);
+    const auto elapsed = std::chrono::steady_clock::now() - start;
+    const sim::gpio_stats gpio = sim::get_gpio_stats();
+    const uint32_t pin = gpio.pin_writes - gpio_start.pin_writes;
+    const uint32_t bsrr = gpio.bsrr_writes - gpio_start.bsrr_writes;
+    cost c;
+    c.passes = board->get_loop_stats().wakeups - wakeups_start;
+    c.writes_per_s = (pin + bsrr) / (us / 1e6);
+    c.bsrr_share = pin + bsrr ? 100.0 * bsrr / (pin + bsrr) : 0;
+    c.ns_per_pass =
+        std::chrono::duration<double, std::nano>(elapsed).count() / c.passes;
+    return c;
+}
+
+void print_cost(const char* name, const cost& c) {
+    std::printf("%-24s %8u %12.1f %9.0f %% %12.0f\n", name, c.passes,
+                c.writes_per_s, c.bsrr_share, c.ns_per_pass);
+}
+}  // namespace
+
+int main() {
+    std::printf("%-24s %-18s %-34s %s\n", "fault", "state", "faults",
+                "codes read");
+    bool ok = true;
+    for (const scenario& s : SCENARIOS) {
+        ok = check_codes(s) && ok;
+    }
+
+    std::printf("\n%-24s %8s %12s %11s %12s\n", "idle cost, 60 s", "passes",
+                "GPIO wr/s", "BSRR", "ns/pass");
+    {
+        sim::Plant plant(static_cast<uint8_t>(NUMBER_CHARGERS),
+                         STATUS_PERIOD_US);
+        boot(plant, false);
+        run(CHARGE_US);
+        print_cost("unplugged, IDLE", measure(COST_US));
+    }
+    {
+        sim::Plant plant(static_cast<uint8_t>(NUMBER_CHARGERS),
+                         STATUS_PERIOD_US);
+        boot(plant, true);
+        run(CHARGE_US);
+        plant.bms.killed = true;
+        run(SETTLE_US);
+        print_cost("HV kill, FAULT_LATCHING", measure(COST_US));
+    }
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,70 @@
+#include "bxcan.h"
+
+#include <algorithm>
+
+#include "sim_internal.h"
+
+namespace umnsvp {
+namespace can {
+
+using namespace charger;
+
+bxcan_driver::bxcan_driver(CAN_TypeDef* instance) {
+    handle.Instance = instance;
+}
+
+void bxcan_driver::init(baud_rate, bool) {
+}
+
+void bxcan_driver::start() {
+}
+
+/**
+ * @brief Accept every frame through the instance's first filter bank. The
+ * sim keeps the FIFO each sender picks rather than forcing one.
+ *
+ */
+void bxcan_driver::filter_all() {
+    sim::can_filter_bank bank;
+    bank.accept_all = true;
+    sim::bus_for(handle.Instance)
+        .filters[handle.Instance == CAN1 ? 0 : sim::CAN2_FIRST_FILTER_BANK] =
+        bank;
+}
+
+/**
+ * @brief Claim a TX mailbox and put the frame on the bus after any frame
+ * already in flight.
+ *
+ */
+status bxcan_driver::send(const packet& p) {
+    sim::can_bus& bus = sim::bus_for(handle.Instance);
+    if (bus.mailboxes_busy >= sim::CAN_TX_MAILBOXES) {
+        bus.stats.tx_mailbox_full++;
+        return status::ERROR;
+    }
+    bus.mailboxes_busy++;
+    const uint64_t start = std::max(sim::now_us(), bus.bus_free_at);
+    bus.bus_free_at = start + sim::CAN_FRAME_TIME_US;
+    CAN_TypeDef* instance = handle.Instance;
+    sim::at(bus.bus_free_at, [instance, p] { sim::complete_tx(instance, p); });
+    return status::OK;
+}
+
+status bxcan_driver::receive(packet& p, fifo f) {
+    std::deque<packet>& queue =
+        sim::bus_for(handle.Instance).rx[static_cast<int>(f)];
+    if (queue.empty()) {
+        return status::ERROR;
+    }
+    p = queue.front();
+    queue.pop_front();
+    return status::OK;
+}
+
+CAN_HandleTypeDef* bxcan_driver::get_handle() {
+    return &handle;
+}
+
+}  // namespace can
+}  // namespace umnsvp
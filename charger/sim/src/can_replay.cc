@@ -0,0 +1,286 @@
+/**
+ * @file can_replay.cc
+ * @brief Play a candump trace of the car and charger buses into the real
+ * charger Application.
+ *
+ * Car bus frames go through the CAN1 filters into Application's RX interrupt
+ * and Bms::receive(), charger bus frames through the CAN2 filters into
+ * CAN2Device::receive(), exactly as on the board. The main loop runs
+ * alongside, and every change of state, fault flags or HV isolation step is
+ * printed as it happens. Frames the charger sent itself are in the trace too;
+ * the filters drop them like any other frame it does not consume.
+ *
+ * By default frames arrive at their recorded times. With -f the gaps are
+ * dropped and frames arrive back to back, one per CAN frame time, which makes
+ * the run a throughput benchmark of the decode paths.
+ *
+ * Usage: can_replay [-f] [-u] [-car IFACE] [-charger IFACE] trace.log
+ *   -f        as fast as possible instead of at the recorded times
+ *   -u        leave the connector unplugged (default: plugged in on a 30 A
+ *             pilot from the start)
+ *   -car      interface recorded on the car bus, default can0
+ *   -charger  interface recorded on the charger bus, default can1
+ *
+ */
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <optional>
+#include <string>
+#include <tuple>
+#include <vector>
+
+#include "application.h"
+#include "candump.h"
+#include "j1772.h"
+#include "main.h"
+#include "sim.h"
+#include "state_names.h"
+
+using namespace umnsvp::charger;
+using umnsvp::can::packet;
+
+umnsvp::charger::Application app;
+
+void timer_handler_callback(TIM_HandleTypeDef* htim) {
+    if (htim->Instance == TIM6) {
+        app.scheduler_tick();
+    }
+}
+
+namespace {
+// simulated cost of one main loop pass on the F405, excluding tick polls
+constexpr uint64_t LOOP_COST_US = 20;
+// keep running after the last frame so timeouts can play out
+constexpr uint64_t TAIL_US = 1000000;
+
+struct frame {
+    uint64_t at_us;
+    CAN_TypeDef* instance;
+    packet p;
+};
+
+struct options {
+    bool fast = false;
+    bool plugged_in = true;
+    std::string car_interface = "can0";
+    std::string charger_interface = "can1";
+    const char* path = nullptr;
+};
+
+/**
+ * @brief Wall time spent in one RX interrupt handler.
+ *
+ */
+struct decode_cost {
+    uint32_t calls = 0;
+    std::chrono::steady_clock::duration time{};
+
+    template <class Fn>
+    void run(Fn fn) {
+        const auto start = std::chrono::steady_clock::now();
+        fn();
+        time += std::chrono::steady_clock::now() - start;
+        calls++;
+    }
+    double per_second() const {
+        const double s = std::chrono::duration<double>(time).count();
+        return s > 0 ? calls / s : 0;
+    }
+};
+
+bool parse_options(int argc, char** argv, options& opts) {
+    for (int i = 1; i < argc; i++) {
+        if (std::strcmp(argv[i], "-f") == 0) {
+            opts.fast = true;
+        } else if (std::strcmp(argv[i], "-u") == 0) {
+            opts.plugged_in = false;
+        } else if (std::strcmp(argv[i], "-car") == 0 && i + 1 < argc) {
+            opts.car_interface = argv[++i];
+        } else if (std::strcmp(argv[i], "-charger") == 0 && i + 1 < argc) {
+            opts.charger_interface = argv[++i];
+        } else if (argv[i][0] != '-' && opts.path == nullptr) {
+            opts.path = argv[i];
+        } else {
+            return false;
+        }
+    }
+    return opts.path != nullptr;
+}
+
+/**
+ * @brief Read the trace and give each frame its replay time, relative to the
+ * first frame. Frames without a timestamp follow the previous one by a frame
+ * time, and time never runs backwards.
+ *
+ */
+std::vector<frame> load(std::istream& in, const options& opts,
+                        uint32_t& skipped) {
+    std::vector<frame> frames;
+    std::optional<double> first;
+    uint64_t last_us = 0;
+    std::string line;
+    while (std::getline(in, line)) {
+        const std::optional<sim::candump::record> r =
+            sim::candump::parse_line(line);
+        CAN_TypeDef* instance = nullptr;
+        if (r && r->interface == opts.car_interface) {
+            instance = CAN1;
+        } else if (r && r->interface == opts.charger_interface) {
+            instance = CAN2;
+        }
+        if (instance == nullptr) {
+            skipped += line.find_first_not_of(" \t\r") != std::string::npos;
+            continue;
+        }
+
+        uint64_t at_us = frames.empty() ? 0 : last_us + sim::CAN_FRAME_TIME_US;
+        if (!opts.fast && r->timestamp) {
+            if (!first) {
+                first = r->timestamp;
+            }
+            at_us = std::max<uint64_t>(
+                last_us,
+                static_cast<uint64_t>((*r->timestamp - *first) * 1e6 + 0.5));
+        }
+        frames.push_back({at_us, instance, r->packet});
+        last_us = at_us;
+    }
+    return frames;
+}
+
+/**
+ * @brief When every BMS packet has arrived at least once. Application::start()
+ * spins on the BMS without polling the tick, so in the sim it only returns if
+ * the BMS has already been heard, as charger_sim also arranges.
+ *
+ */
+std::optional<uint64_t> bms_ready_at(const std::vector<frame>& frames) {
+    std::array<bool, Bms::RX_IDS.size()> seen = {};
+    for (const frame& f : frames) {
+        for (size_t i = 0; i < Bms::RX_IDS.size(); i++) {
+            seen[i] |= f.instance == CAN1 && !f.p.is_extended() &&
+                       f.p.get_id() == static_cast<uint32_t>(Bms::RX_IDS[i]);
+        }
+        if (std::all_of(seen.begin(), seen.end(), [](bool s) { return s; })) {
+            return f.at_us;
+        }
+    }
+    return std::nullopt;
+}
+
+void print_bus(const char* name, uint32_t offered, const sim::can_stats& s) {
+    std::printf("%-8s %8u frames, %8u accepted, %8u filtered, %u overrun\n",
+                name, offered, s.rx_frames, s.rx_filtered, s.rx_overruns);
+}
+}  // namespace
+
+int main(int argc, char** argv) {
+    options opts;
+    if (!parse_options(argc, argv, opts)) {
+        std::fprintf(stderr,
+                     "usage: %s [-f] [-u] [-car IFACE] [-charger IFACE] "
+                     "trace.log\n",
+                     argv[0]);
+        return 2;
+    }
+    std::ifstream in(opts.path);
+    if (!in) {
+        std::perror(opts.path);
+        return 1;
+    }
+    uint32_t skipped = 0;
+    const std::vector<frame> frames = load(in, opts, skipped);
+    const std::optional<uint64_t> bms_ready_us = bms_ready_at(frames);
+    if (!bms_ready_us) {
+        std::fprintf(stderr, "%s: not every BMS packet appears on %s\n",
+                     opts.path, opts.car_interface.c_str());
+        return 1;
+    }
+
+    sim::reset();
+    decode_cost car_decode;
+    decode_cost charger_decode;
+    sim::set_irq_handler(CAN1_RX0_IRQn, [&car_decode] {
+        car_decode.run([] { app.can1_rx_callback(); });
+    });
+    sim::set_irq_handler(CAN1_RX1_IRQn, [] { app.can1_rx1_callback(); });
+    sim::set_irq_handler(CAN1_TX_IRQn, [] { app.can1_tx_callback(); });
+    sim::set_irq_handler(CAN2_RX1_IRQn, [&charger_decode] {
+        charger_decode.run([] { app.can2_rx_callback(); });
+    });
+    sim::set_irq_handler(CAN2_TX_IRQn, [] { app.can2_tx_callback(); });
+    sim::set_irq_handler(EXTI9_5_IRQn, [] { app.prox_callback(); });
+
+    uint32_t car_offered = 0;
+    uint32_t charger_offered = 0;
+    for (const frame& f : frames) {
+        const umnsvp::can::fifo fifo = f.instance == CAN1
+                                           ? umnsvp::can::fifo::FIFO0
+                                           : umnsvp::can::fifo::FIFO1;
+        (f.instance == CAN1 ? car_offered : charger_offered)++;
+        sim::at(f.at_us,
+                [f, fifo] { sim::inject(f.instance, fifo, f.p); });
+    }
+    if (opts.plugged_in) {
+        sim::set_input_pin(PROX_PORT, PROX_PIN, true);
+        sim::set_pilot(1000.0f, 0.5f);
+    }
+
+    const auto wall_start = std::chrono::steady_clock::now();
+    sim::advance_us(*bms_ready_us + 1);
+    app.start();
+
+    const uint64_t end_us = frames.back().at_us + TAIL_US;
+    auto last = std::make_tuple(app.get_charge_state(), app.get_bms_fault(),
+                                app.get_charger_fault(),
+                                app.get_isolation_state());
+    const auto print_state = [] {
+        std::printf("%10.3f  %-24s %-20s %-20s %s\n", sim::now_us() / 1e6,
+                    sim::state_name(app.get_charge_state()),
+                    sim::fault_names(app.get_bms_fault()).c_str(),
+                    sim::fault_names(app.get_charger_fault()).c_str(),
+                    sim::isolation_name(app.get_isolation_state()));
+    };
+    std::printf("%10s  %-24s %-20s %-20s %s\n", "t [s]", "state", "bms fault",
+                "charger fault", "isolation");
+    print_state();
+    uint64_t passes = 0;
+    while (sim::now_us() < end_us) {
+        app.step();
+        passes++;
+        sim::advance_us(LOOP_COST_US);
+
+        const auto now = std::make_tuple(
+            app.get_charge_state(), app.get_bms_fault(),
+            app.get_charger_fault(), app.get_isolation_state());
+        if (now != last) {
+            print_state();
+            last = now;
+        }
+    }
+    const double wall_s = std::chrono::duration<double>(
+                              std::chrono::steady_clock::now() - wall_start)
+                              .count();
+
+    std::printf("\nreplayed %zu frames over %.3f s simulated in %.3f s wall%s",
+                frames.size(), end_us / 1e6, wall_s,
+                opts.fast ? " (back to back)\n" : "\n");
+    if (skipped != 0) {
+        std::printf("skipped %u lines (other interfaces or not replayable)\n",
+                    skipped);
+    }
+    print_bus("car", car_offered, sim::get_can_stats(CAN1));
+    print_bus("charger", charger_offered, sim::get_can_stats(CAN2));
+    std::printf("%llu main loop passes\n",
+                static_cast<unsigned long long>(passes));
+    std::printf("throughput %.0f frames/s wall, whole application\n",
+                frames.size() / wall_s);
+    std::printf("decode     %.0f frames/s car RX ISR, %.0f frames/s charger "
+                "RX ISR\n",
+                car_decode.per_second(), charger_decode.per_second());
+    return 0;
+}
@@ -0,0 +1,130 @@
+#include "candump.h"
+
+#include <cctype>
+#include <cstdlib>
+#include <sstream>
+
+namespace umnsvp {
+namespace charger {
+namespace sim {
+namespace candump {
+
+namespace {
+std::optional<uint32_t> parse_hex(const std::string& text) {
+    if (text.empty() || text.size() > 8) {
+        return std::nullopt;
+    }
+    for (char c : text) {
+        if (!std::isxdigit(static_cast<unsigned char>(c))) {
+            return std::nullopt;
+        }
+    }
+    return static_cast<uint32_t>(std::strtoul(text.c_str(), nullptr, 16));
+}
+
+std::optional<can::packet> make_packet(const std::string& id_text,
+                                       const uint8_t* data, size_t length) {
+    const std::optional<uint32_t> id = parse_hex(id_text);
+    if (!id || length > 8) {
+        return std::nullopt;
+    }
+    return can::packet(*id, static_cast<uint8_t>(length), data,
+                       id_text.size() > 3);
+}
+
+// "123#0102", "123#R" (remote) and "123##1..." (FD) are not replayed
+std::optional<can::packet> parse_log_frame(const std::string& frame) {
+    const size_t hash = frame.find('#');
+    const std::string payload = frame.substr(hash + 1);
+    if (payload.size() % 2 != 0 ||
+        payload.find_first_of("#Rr") != std::string::npos) {
+        return std::nullopt;
+    }
+    uint8_t data[8] = {0};
+    const size_t length = payload.size() / 2;
+    for (size_t i = 0; i < length && i < 8; i++) {
+        const std::optional<uint32_t> byte = parse_hex(payload.substr(2 * i, 2));
+        if (!byte) {
+            return std::nullopt;
+        }
+        data[i] = static_cast<uint8_t>(*byte);
+    }
+    return make_packet(frame.substr(0, hash), data, length);
+}
+
+// "123 [2] 01 02" as separate tokens
+std::optional<can::packet> parse_console_frame(const std::string& id_text,
+                                               std::istringstream& rest) {
+    std::string length_text;
+    rest >> length_text;
+    if (length_text.size() < 3 || length_text.front() != '[' ||
+        length_text.back() != ']') {
+        return std::nullopt;
+    }
+    const size_t length = std::strtoul(length_text.c_str() + 1, nullptr, 10);
+    if (length > 8) {
+        return std::nullopt;
+    }
+    uint8_t data[8] = {0};
+    for (size_t i = 0; i < length; i++) {
+        std::string byte_text;
+        rest >> byte_text;
+        const std::optional<uint32_t> byte = parse_hex(byte_text);
+        if (byte_text.size() != 2 || !byte) {
+            return std::nullopt;  // remote frames print "remote request"
+        }
+        data[i] = static_cast<uint8_t>(*byte);
+    }
+    return make_packet(id_text, data, length);
+}
+}  // namespace
+
+std::optional<record> parse_line(const std::string& line) {
+    std::istringstream tokens(line);
+    std::string token;
+    if (!(tokens >> token) || token[0] == '#') {
+        return std::nullopt;
+    }
+
+    record r;
+    if (token.front() == '(') {
+        char* end = nullptr;
+        const double timestamp = std::strtod(token.c_str() + 1, &end);
+        if (end == token.c_str() + 1 || *end != ')') {
+            return std::nullopt;
+        }
+        r.timestamp = timestamp;
+        if (!(tokens >> token)) {
+            return std::nullopt;
+        }
+    }
+    r.interface = token;
+
+    std::string frame;
+    if (!(tokens >> frame)) {
+        return std::nullopt;
+    }
+    const std::optional<can::packet> p =
+        frame.find('#') != std::string::npos ? parse_log_frame(frame)
+                                             : parse_console_frame(frame, tokens);
+    if (!p) {
+        return std::nullopt;
+    }
+    r.packet = *p;
+    return r;
+}
+
+void write(std::FILE* file, double timestamp, const char* interface,
+           const can::packet& p) {
+    std::fprintf(file, p.is_extended() ? "(%.6f) %s %08X#" : "(%.6f) %s %03X#",
+                 timestamp, interface, static_cast<unsigned>(p.get_id()));
+    for (uint8_t i = 0; i < p.get_length(); i++) {
+        std::fprintf(file, "%02X", p.get_data()[i]);
+    }
+    std::fputc('\n', file);
+}
+
+}  // namespace candump
+}  // namespace sim
+}  // namespace charger
+}  // namespace umnsvp
@@ -0,0 +1,175 @@
+/**
+ * @file charge_session.cc
+ * @brief A whole charge session, empty to full, against the real charger
+ * Application and the host pack and charger models.
+ *
+ * The BMS and Thunderstruck frames are built from the models and go through
+ * the same CAN filters and interrupts as on the car, so the firmware's
+ * current limit, regulator and end of charge logic decide the session. Hours
+ * of charging take a few seconds of wall time. The run stops at
+ * CHARGING_DONE, at a fault or after MAX_SESSION, and reports the time to
+ * full, the energy delivered, the same energy as the firmware counted it
+ * from the BMS and charger reports, and the peak temperatures.
+ *
+ * Usage: charge_session [start soc] [EVSE amps] [ambient Celsius]
+ *        [battery setpoint amps]
+ *
+ */
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+
+#include "application.h"
+#include "devices.h"
+#include "j1772.h"
+#include "main.h"
+#include "sim.h"
+#include "state_names.h"
+
+using namespace umnsvp::charger;
+
+umnsvp::charger::Application app;
+
+void timer_handler_callback(TIM_HandleTypeDef* htim) {
+    if (htim->Instance == TIM6) {
+        app.scheduler_tick();
+    }
+}
+
+namespace {
+constexpr uint64_t LOOP_COST_US = 20;
+constexpr uint64_t PLANT_STEP_US = 10000;
+constexpr uint64_t STATUS_PERIOD_US = 100000;
+constexpr uint64_t PLUG_IN_US = 1000000;
+constexpr uint64_t TRAJECTORY_PERIOD_US = 600000000;  // 10 minutes
+constexpr double MAX_SESSION = 6 * 3600.0;            // s
+
+double minutes(uint64_t us) {
+    return us / 60e6;
+}
+
+bool session_over(charge_state state) {
+    return state == charge_state::CHARGING_DONE ||
+           state == charge_state::FAULT_LATCHING ||
+           state == charge_state::FAULT_RESETTABLE;
+}
+
+void print_row(const sim::Plant& plant) {
+    float charger_temp = 0;
+    for (const sim::ThunderstruckModel& charger : plant.chargers) {
+        charger_temp = std::max(charger_temp, charger.temperature);
+    }
+    std::printf("%8.1f  %-22s %6.3f %8.2f %7.2f %7.2f %8.1f %8.1f\n",
+                minutes(sim::now_us()), sim::state_name(app.get_charge_state()),
+                plant.bms.pack.soc, plant.bms.pack_voltage(),
+                plant.total_charger_current(), plant.bms.pack.current,
+                plant.bms.max_cell_temp(), charger_temp);
+}
+}  // namespace
+
+int main(int argc, char** argv) {
+    const float start_soc = argc > 1 ? std::atof(argv[1]) : 0.0f;
+    const float evse_amps = argc > 2 ? std::atof(argv[2]) : 30.0f;
+    const float ambient = argc > 3 ? std::atof(argv[3]) : 25.0f;
+
+    sim::reset();
+    sim::set_irq_handler(CAN1_RX0_IRQn, [] { app.can1_rx_callback(); });
+    sim::set_irq_handler(CAN1_RX1_IRQn, [] { app.can1_rx1_callback(); });
+    sim::set_irq_handler(CAN1_TX_IRQn, [] { app.can1_tx_callback(); });
+    sim::set_irq_handler(CAN2_RX1_IRQn, [] { app.can2_rx_callback(); });
+    sim::set_irq_handler(CAN2_TX_IRQn, [] { app.can2_tx_callback(); });
+    sim::set_irq_handler(EXTI9_5_IRQn, [] { app.prox_callback(); });
+
+    sim::Plant plant(static_cast<uint8_t>(NUMBER_CHARGERS), STATUS_PERIOD_US);
+    sim::pack_params params;
+    params.ambient = ambient;
+    plant.bms.pack = sim::PackModel(params);
+    plant.bms.pack.soc = start_soc;
+    for (sim::ThunderstruckModel& charger : plant.chargers) {
+        charger.ambient = ambient;
+        charger.temperature = ambient;
+    }
+    plant.attach(PLANT_STEP_US);
+    if (argc > 4) {
+        app.set_current_setpoint(deci_amps::from(std::atof(argv[4])));
+    }
+
+    float peak_cell_temp = plant.bms.max_cell_temp();
+    float peak_charger_temp = ambient;
+    sim::every(PLANT_STEP_US, 0, [&] {
+        peak_cell_temp = std::max(peak_cell_temp, plant.bms.max_cell_temp());
+        for (const sim::ThunderstruckModel& charger : plant.chargers) {
+            peak_charger_temp = std::max(peak_charger_temp, charger.temperature);
+        }
+    });
+    sim::at(PLUG_IN_US, [evse_amps] {
+        sim::set_input_pin(PROX_PORT, PROX_PIN, true);
+        // J1772: 0.6 A per percent of duty below 85 %
+        sim::set_pilot(1000.0f, evse_amps / 60.0f);
+    });
+    sim::every(TRAJECTORY_PERIOD_US, TRAJECTORY_PERIOD_US,
+               [&plant] { print_row(plant); });
+
+    std::printf("pack %us%up %.1f Ah, start soc %.2f, EVSE %.0f A, ambient "
+                "%.0f C\n\n",
+                plant.bms.pack.params.series, plant.bms.pack.params.parallel,
+                plant.bms.pack.capacity_Ah(), start_soc, evse_amps, ambient);
+    std::printf("%8s  %-22s %6s %8s %7s %7s %8s %8s\n", "t [min]", "state",
+                "soc", "pack V", "chg A", "pack A", "cell C", "chg C");
+
+    const auto wall_start = std::chrono::steady_clock::now();
+    sim::advance_us(STATUS_PERIOD_US);
+    app.start();
+    charge_state last = app.get_charge_state();
+    uint64_t charging_us = 0;
+    float charging_soc = start_soc;
+    float charging_Wh = 0;
+    float charging_ac_Wh = 0;
+    float counted_Wh = 0;
+    float counted_output_Wh = 0;
+    while (!session_over(last) && sim::now_us() < MAX_SESSION * 1e6) {
+        app.step();
+        sim::advance_us(LOOP_COST_US);
+        const charge_state state = app.get_charge_state();
+        if (state != last) {
+            print_row(plant);
+            if (state == charge_state::CHARGING && charging_us == 0) {
+                charging_us = sim::now_us();
+                charging_soc = plant.bms.pack.soc;
+                charging_Wh = plant.bms.pack.energy_Wh;
+                charging_ac_Wh = plant.ac_energy_Wh;
+                counted_Wh = app.get_pack_energy();
+                counted_output_Wh = app.get_charger_output_energy();
+            }
+            last = state;
+        }
+    }
+    const double wall_s = std::chrono::duration<double>(
+                              std::chrono::steady_clock::now() - wall_start)
+                              .count();
+
+    const float delivered_Wh = plant.bms.pack.energy_Wh - charging_Wh;
+    const float drawn_Wh = plant.ac_energy_Wh - charging_ac_Wh;
+    std::printf("\nsimulated %.1f min in %.2f s wall (%.0fx real time)\n",
+                minutes(sim::now_us()), wall_s, sim::now_us() / 1e6 / wall_s);
+    if (last == charge_state::CHARGING_DONE) {
+        std::printf("time to full: %.1f min, soc %.3f -> %.3f\n",
+                    minutes(sim::now_us() - charging_us), charging_soc,
+                    plant.bms.pack.soc);
+    } else {
+        std::printf("not full: ended in %s at soc %.3f\n",
+                    sim::state_name(last), plant.bms.pack.soc);
+    }
+    std::printf("energy into the pack: %.0f Wh, from the EVSE: %.0f Wh "
+                "(%.1f %% to the pack)\n",
+                delivered_Wh, drawn_Wh,
+                drawn_Wh > 0 ? 100.0f * delivered_Wh / drawn_Wh : 0.0f);
+    std::printf("counted by the firmware: %.0f Wh into the pack (BMS), %.0f "
+                "Wh out of the chargers\n",
+                app.get_pack_energy() - counted_Wh,
+                app.get_charger_output_energy() - counted_output_Wh);
+    std::printf("peak temperature: cells %.1f C, chargers %.1f C\n",
+                peak_cell_temp, peak_charger_temp);
+    return last == charge_state::CHARGING_DONE ? 0 : 1;
+}
@@ -0,0 +1,230 @@
+#include "devices.h"
+
+#include <algorithm>
+
+#include "battery_charging_limits.h"
+#include "j1772.h"
+#include "sim.h"
+#include "thunderstruck_frames.h"
+
+namespace umnsvp {
+namespace charger {
+namespace sim {
+
+namespace {
+// TSM2500 encodings, see the charger wiki page on the packet format
+constexpr uint8_t CONTROL_ENABLE = 0xFC;
+constexpr uint16_t CURRENT_OFFSET = 3200;
+constexpr float DECI = 10.0f;
+constexpr int8_t TEMP_OFFSET = 40;
+
+template <class T>
+can::packet make_car_packet(skylab2::CANPacketId id, uint8_t length,
+                            const T& msg) {
+    uint8_t data[8] = {0};
+    skylab2::pack(msg, data);
+    return can::packet(static_cast<uint32_t>(id), length, data, false);
+}
+}  // namespace
+
+ThunderstruckModel::ThunderstruckModel(uint8_t index,
+                                       uint64_t status_period_us)
+    : index(index), status_period_us(status_period_us) {
+}
+
+void ThunderstruckModel::attach() {
+    on_transmit(CAN2, [this](const can::packet& p) {
+        if (p.get_id() != thunderstruck_frames::control_id(index)) {
+            return;
+        }
+        const uint8_t* data = p.get_data();
+        command.Enable = data[0];
+        command.CHARGE_VOLTAGE = data[1] | (data[2] << 8);
+        command.CHARGE_CURRENT = data[3] | (data[4] << 8);
+    });
+    // spread the units across the status period like free running chargers
+    const uint64_t phase = status_period_us * (index + 1) / 4;
+    every(status_period_us, now_us() + phase, [this] {
+        if (silent) {
+            return;
+        }
+        const uint16_t voltage = static_cast<uint16_t>(output_voltage * DECI);
+        const uint16_t current = static_cast<uint16_t>(
+            CURRENT_OFFSET - static_cast<uint16_t>(output_current * DECI));
+        uint8_t data[8];
+        data[0] = enabled() ? 0x00 : 0x08;  // STATUS_FLAGS, 0x08 = disabled
+        data[1] = 0;                        // CHARGE_FLAGS
+        data[2] = voltage >> 0;
+        data[3] = voltage >> 8;
+        data[4] = current >> 0;
+        data[5] = current >> 8;
+        data[6] = static_cast<uint8_t>(temperature + TEMP_OFFSET);
+        data[7] = 0;
+        inject(CAN2, can::fifo::FIFO1,
+               can::packet(thunderstruck_frames::status_id(index), 8, data,
+                           true));
+    });
+}
+
+bool ThunderstruckModel::enabled() const {
+    return command.Enable == CONTROL_ENABLE;
+}
+
+float ThunderstruckModel::commanded_current() const {
+    if (command.CHARGE_CURRENT > CURRENT_OFFSET) {
+        return 0;
+    }
+    return (CURRENT_OFFSET - command.CHARGE_CURRENT) / DECI;
+}
+
+float ThunderstruckModel::commanded_voltage() const {
+    return command.CHARGE_VOLTAGE / DECI;
+}
+
+/**
+ * @brief Slew the output toward the commanded current, within the unit's
+ * output power and backing off as the pack reaches the commanded voltage.
+ *
+ */
+void ThunderstruckModel::update(float dt, float pack_voltage,
+                                bool ac_present) {
+    float target = 0;
+    if (enabled() && ac_present && pack_voltage > 0) {
+        // constant voltage region: CV_GAIN of headroom per volt below the
+        // limit
+        const float headroom = (commanded_voltage() - pack_voltage) * CV_GAIN;
+        target = std::max(
+            0.0f, std::min({commanded_current(), MAX_POWER / pack_voltage,
+                            headroom}));
+    }
+    const float step = RAMP_RATE * dt;
+    if (output_current < target) {
+        output_current = std::min(target, output_current + step);
+    } else {
+        output_current = std::max(target, output_current - step);
+    }
+    output_voltage = (output_current > 0 || ac_present) ? pack_voltage : 0;
+    const float loss = input_power() - output_current * output_voltage;
+    temperature +=
+        (loss - COOLING * (temperature - ambient)) * dt / HEAT_CAPACITY;
+}
+
+/**
+ * @brief Power drawn from the AC side, W.
+ *
+ */
+float ThunderstruckModel::input_power() const {
+    return output_current * output_voltage / EFFICIENCY;
+}
+
+float BmsModel::pack_voltage() const {
+    return pack.terminal_voltage();
+}
+
+float BmsModel::max_cell_voltage() const {
+    // the highest cell sits a few millivolts over the average
+    return pack_voltage() / pack.params.series + 0.005f;
+}
+
+float BmsModel::max_cell_temp() const {
+    // the middle of the pack runs a little hotter than the mean
+    return pack.temperature + 1.0f;
+}
+
+void BmsModel::update(float dt, float charge_current) {
+    pack.update(dt, charge_current);
+}
+
+void BmsModel::attach(uint64_t period_us) {
+    on_transmit(CAN1, [this](const can::packet& p) {
+        if (p.get_id() ==
+            static_cast<uint32_t>(
+                skylab2::CANPacketId::CAN_PACKET_CHARGER_BMS_REQUEST)) {
+            charging_requested =
+                skylab2::unpack<skylab2::can_packet_charger_bms_request>(
+                    p.get_data())
+                    .request_flags.charging_requested;
+        }
+    });
+    every(period_us, now_us(), [this] {
+        if (!silent) {
+            publish();
+        }
+    });
+}
+
+void BmsModel::publish() {
+    using namespace skylab2;
+    can_packet_bms_measurement measurement = {};
+    measurement.battery_voltage =
+        static_cast<uint16_t>(pack_voltage() * 100.0f);
+    measurement.current = pack.current;
+    inject(CAN1, can::fifo::FIFO0,
+           make_car_packet(CANPacketId::CAN_PACKET_BMS_MEASUREMENT,
+                           CAN_LENGTH_BMS_MEASUREMENT, measurement));
+
+    can_packet_battery_status status = {};
+    status.battery_state.killed = killed;
+    inject(CAN1, can::fifo::FIFO0,
+           make_car_packet(CANPacketId::CAN_PACKET_BATTERY_STATUS,
+                           CAN_LENGTH_BATTERY_STATUS, status));
+
+    can_packet_bms_module_min_max min_max = {};
+    min_max.module_max_voltage =
+        static_cast<uint16_t>(max_cell_voltage() * 1000.0f);
+    min_max.module_min_voltage =
+        static_cast<uint16_t>((max_cell_voltage() - 0.01f) * 1000.0f);
+    min_max.module_max_temp = static_cast<int16_t>(max_cell_temp() * 100.0f);
+    min_max.module_min_temp =
+        static_cast<int16_t>((pack.temperature - 1.0f) * 100.0f);
+    inject(CAN1, can::fifo::FIFO0,
+           make_car_packet(CANPacketId::CAN_PACKET_BMS_MODULE_MIN_MAX,
+                           CAN_LENGTH_BMS_MODULE_MIN_MAX, min_max));
+
+    can_packet_bms_capacity capacity = {};
+    capacity.Wh = pack.soc * pack.capacity_Ah() * pack.open_circuit_voltage();
+    inject(CAN1, can::fifo::FIFO0,
+           make_car_packet(CANPacketId::CAN_PACKET_BMS_CAPACITY,
+                           CAN_LENGTH_BMS_CAPACITY, capacity));
+
+    can_packet_bms_charger_response response = {};
+    response.response_flags.charging_ready =
+        charging_requested && !killed && !refusing;
+    inject(CAN1, can::fifo::FIFO0,
+           make_car_packet(CANPacketId::CAN_PACKET_BMS_CHARGER_RESPONSE,
+                           CAN_LENGTH_BMS_CHARGER_RESPONSE, response));
+}
+
+Plant::Plant(uint8_t number_chargers, uint64_t status_period_us) {
+    for (uint8_t i = 0; i < number_chargers; i++) {
+        chargers.emplace_back(i, status_period_us);
+    }
+}
+
+void Plant::attach(uint64_t step_us) {
+    bms.attach(100000);
+    for (ThunderstruckModel& charger : chargers) {
+        charger.attach();
+    }
+    every(step_us, now_us(), [this, step_us] {
+        const float dt = step_us / 1e6f;
+        const bool ac_present = read_output_pin(CONTROL_PORT, CONTROL_PIN);
+        for (ThunderstruckModel& charger : chargers) {
+            charger.update(dt, bms.pack_voltage(), ac_present);
+            ac_energy_Wh += charger.input_power() * dt / 3600.0f;
+        }
+        bms.update(dt, total_charger_current() - aux_load);
+    });
+}
+
+float Plant::total_charger_current() const {
+    float total = 0;
+    for (const ThunderstruckModel& charger : chargers) {
+        total += charger.output_current;
+    }
+    return total;
+}
+
+}  // namespace sim
+}  // namespace charger
+}  // namespace umnsvp
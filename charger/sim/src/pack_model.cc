@@ -0,0 +1,81 @@
+#include "pack_model.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace umnsvp {
+namespace charger {
+namespace sim {
+
+namespace {
+// open circuit voltage below MAX_CELL_VOLTAGE at 0 %, 10 %, ... 100 % state
+// of charge, from a typical NMC discharge curve
+constexpr float OCV_BELOW_FULL[] = {1.20f, 0.75f, 0.65f, 0.58f, 0.52f, 0.45f,
+                                    0.36f, 0.27f, 0.18f, 0.10f, 0.00f};
+constexpr int OCV_POINTS = sizeof(OCV_BELOW_FULL) / sizeof(OCV_BELOW_FULL[0]);
+}  // namespace
+
+PackModel::PackModel(const pack_params& params)
+    : params(params), temperature(params.ambient) {
+}
+
+float PackModel::capacity_Ah() const {
+    return params.parallel * params.cell_capacity_Ah;
+}
+
+// series resistance of the whole pack
+float PackModel::resistance() const {
+    return params.cell_r0 * params.series / params.parallel;
+}
+
+float PackModel::cell_open_circuit_voltage() const {
+    const float x = std::clamp(soc, 0.0f, 1.0f) * (OCV_POINTS - 1);
+    const int i = std::min(static_cast<int>(x), OCV_POINTS - 2);
+    const float below = OCV_BELOW_FULL[i] +
+                        (OCV_BELOW_FULL[i + 1] - OCV_BELOW_FULL[i]) * (x - i);
+    return MAX_CELL_VOLTAGE - below;
+}
+
+float PackModel::open_circuit_voltage() const {
+    return params.series * cell_open_circuit_voltage();
+}
+
+float PackModel::terminal_voltage() const {
+    return open_circuit_voltage() + polarisation + current * resistance();
+}
+
+/**
+ * @brief Power lost in the pack, W.
+ *
+ */
+float PackModel::heat() const {
+    const float r1 = params.cell_r1 * params.series / params.parallel;
+    return current * current * resistance() + polarisation * polarisation / r1;
+}
+
+/**
+ * @brief Step the pack by dt seconds at a constant current.
+ *
+ * @param dt Seconds.
+ * @param charge_current A, positive into the pack.
+ */
+void PackModel::update(float dt, float charge_current) {
+    current = charge_current;
+    const float r1 = params.cell_r1 * params.series / params.parallel;
+    // exact step of the RC pair for a constant current
+    const float decay = std::exp(-dt / params.cell_tau1);
+    polarisation = polarisation * decay + current * r1 * (1.0f - decay);
+    soc = std::clamp(soc + current * dt / (capacity_Ah() * 3600.0f), 0.0f,
+                     1.0f);
+    energy_Wh += terminal_voltage() * current * dt / 3600.0f;
+
+    const float heat_capacity =
+        params.cell_heat_capacity * params.series * params.parallel;
+    temperature +=
+        (heat() - params.cooling * (temperature - params.ambient)) * dt /
+        heat_capacity;
+}
+
+}  // namespace sim
+}  // namespace charger
+}  // namespace umnsvp
@@ -0,0 +1,716 @@
+#include "sim.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <iterator>
+#include <map>
+
+#include "sim_internal.h"
+
+GPIO_TypeDef sim_GPIOA;
+GPIO_TypeDef sim_GPIOB;
+GPIO_TypeDef sim_GPIOC;
+TIM_TypeDef sim_TIM1;
+TIM_TypeDef sim_TIM5;
+TIM_TypeDef sim_TIM6;
+TIM_TypeDef sim_TIM7;
+DMA_Stream_TypeDef sim_DMA2_Stream1;
+DMA_Stream_TypeDef sim_DMA2_Stream2;
+CAN_TypeDef sim_CAN1;
+CAN_TypeDef sim_CAN2;
+DWT_Type sim_DWT;
+CoreDebug_Type sim_CoreDebug;
+RCC_TypeDef sim_RCC;
+IWDG_TypeDef sim_IWDG;
+uint32_t sim_BKPSRAM[1024];
+uint32_t SystemCoreClock = 160000000;
+
+namespace umnsvp {
+namespace charger {
+namespace sim {
+
+namespace {
+// timers are clocked from APB1/APB2 at 80 MHz, see timing.cc
+constexpr uint64_t TIMER_CLOCK_MHZ = 80;
+// TIM1 input capture reference clock, see pwm_driver::timer_ref_clock
+constexpr float PILOT_CAPTURE_CLOCK = 800000.0f;
+constexpr uint64_t LSI_HZ = 32000;
+constexpr uint32_t CSR_SFTRSTF = 1U << 28;
+constexpr uint32_t CSR_IWDGRSTF = 1U << 29;
+
+struct event {
+    isr fn;
+    uint64_t period_us;
+};
+
+uint64_t now = 0;
+uint64_t sequence = 0;
+uint32_t tick_poll_cost = 1;
+int isr_depth = 0;
+bool advancing = false;
+bool sleeping = false;
+bool irq_masked = false;
+bool watchdog_running = false;
+uint64_t watchdog_expires = 0;
+
+// keyed by (time, insertion order) so same-time events run FIFO
+std::map<std::pair<uint64_t, uint64_t>, event> events;
+isr irq_handlers[NUM_SIM_IRQn];
+
+float pilot_frequency = 0;
+float pilot_duty = 0;
+uint32_t pilot_generation = 0;
+uint64_t pilot_last_rising = 0;  // TIM1 is reset on every rising edge
+TIM_HandleTypeDef* capture_timer = nullptr;
+bool capture_interrupt = false;
+
+/**
+ * @brief A circular DMA transfer of one TIM1 capture channel.
+ *
+ */
+struct capture_dma {
+    uint16_t* buffer = nullptr;
+    uint16_t length = 0;
+    uint16_t position = 0;
+    DMA_HandleTypeDef* handle = nullptr;
+};
+capture_dma capture_dmas[2];
+
+can_bus buses[2];
+gpio_stats gpio;
+
+struct exti_port {
+    GPIO_TypeDef* port;
+    uint32_t pins;
+};
+exti_port exti_ports[3] = {{GPIOA, 0}, {GPIOB, 0}, {GPIOC, 0}};
+
+void set_now(uint64_t t) {
+    // CYCCNT runs at the core clock and wraps at 32 bits, counting on from
+    // whatever the firmware last wrote to it. Like the F4 with DBG_SLEEP
+    // clear, it stops while the core sleeps in WFI.
+    if (!sleeping) {
+        sim_DWT.CYCCNT += static_cast<uint32_t>((t - now) *
+                                                (SystemCoreClock / 1000000));
+    }
+    now = t;
+}
+
+uint32_t& exti_pins(GPIO_TypeDef* port) {
+    for (exti_port& p : exti_ports) {
+        if (p.port == port) {
+            return p.pins;
+        }
+    }
+    return exti_ports[0].pins;
+}
+
+void schedule(uint64_t at_us, uint64_t period_us, isr fn) {
+    events.emplace(std::make_pair(at_us, sequence++),
+                   event{std::move(fn), period_us});
+}
+
+/**
+ * @brief Reset the core if the watchdog runs out before time t.
+ *
+ */
+void check_watchdog(uint64_t t) {
+    if (watchdog_running && t > watchdog_expires) {
+        set_now(watchdog_expires);
+        watchdog_running = false;
+        sim_RCC.CSR |= CSR_IWDGRSTF;
+        throw system_reset{true};
+    }
+}
+
+bool run_next(uint64_t limit) {
+    if (events.empty() || events.begin()->first.first > limit) {
+        return false;
+    }
+    auto it = events.begin();
+    check_watchdog(it->first.first);
+    event e = std::move(it->second);
+    set_now(it->first.first);
+    events.erase(it);
+    if (e.period_us != 0) {
+        schedule(now + e.period_us, e.period_us, e.fn);
+    }
+    isr_depth++;
+    e.fn();
+    isr_depth--;
+    return true;
+}
+
+/**
+ * @brief Latch the TIM1 counter into a capture register and hand it to the
+ * channel's DMA transfer, if one is running.
+ *
+ */
+void pilot_capture(int channel) {
+    const uint64_t elapsed = now - pilot_last_rising;
+    const uint32_t counts = std::min<uint64_t>(
+        static_cast<uint64_t>(elapsed * PILOT_CAPTURE_CLOCK / 1e6f + 0.5f),
+        UINT16_MAX);
+    (channel == 0 ? TIM1->CCR1 : TIM1->CCR2) = counts;
+    capture_dma& dma = capture_dmas[channel];
+    if (dma.buffer != nullptr) {
+        dma.buffer[dma.position] = static_cast<uint16_t>(counts);
+        dma.position = (dma.position + 1) % dma.length;
+        dma.handle->Instance->NDTR = dma.length - dma.position;
+    }
+    if (channel == 0 && capture_interrupt &&
+        capture_timer->IC_CaptureCallback != nullptr) {
+        capture_timer->Channel = HAL_TIM_ACTIVE_CHANNEL_1;
+        capture_timer->IC_CaptureCallback(capture_timer);
+    }
+}
+
+// CH1 latches the period and resets the counter
+void pilot_rising_edge() {
+    pilot_capture(0);
+    pilot_last_rising = now;
+}
+
+// CH2 latches the falling edge, i.e. the low part of the period as wired on
+// the charger board
+void pilot_falling_edge() {
+    pilot_capture(1);
+}
+
+/**
+ * @brief Schedule the next update event of a basic timer. The period is read
+ * from PSC and ARR each time, so a new auto-reload value takes effect from
+ * the following period.
+ *
+ */
+void schedule_timer_update(TIM_HandleTypeDef* htim) {
+    const uint64_t period =
+        (static_cast<uint64_t>(htim->Instance->PSC) + 1) *
+        (static_cast<uint64_t>(htim->Instance->ARR) + 1) / TIMER_CLOCK_MHZ;
+    schedule(now + period, 0, [htim] {
+        schedule_timer_update(htim);
+        if ((htim->Instance->DIER & TIM_IT_UPDATE) &&
+            htim->PeriodElapsedCallback != nullptr) {
+            htim->PeriodElapsedCallback(htim);
+        }
+    });
+}
+
+void schedule_pilot_edge(uint32_t generation) {
+    if (pilot_frequency <= 0) {
+        return;
+    }
+    const uint64_t period = static_cast<uint64_t>(1e6f / pilot_frequency);
+    const uint64_t low = static_cast<uint64_t>(period * (1.0f - pilot_duty));
+    schedule(now + period, 0, [generation, low] {
+        if (generation != pilot_generation) {
+            return;
+        }
+        pilot_rising_edge();
+        schedule(now + low, 0, [generation] {
+            if (generation == pilot_generation) {
+                pilot_falling_edge();
+            }
+        });
+        schedule_pilot_edge(generation);
+    });
+}
+}  // namespace
+
+uint64_t now_us() {
+    return now;
+}
+
+void advance_us(uint64_t us) {
+    const uint64_t target = now + us;
+    const bool outer = !advancing;
+    advancing = true;
+    while (run_next(target)) {
+    }
+    check_watchdog(target);
+    set_now(target);
+    if (outer) {
+        advancing = false;
+    }
+}
+
+void sleep_until_event() {
+    if (!events.empty()) {
+        // asleep up to the event; its interrupt takes no simulated time
+        sleeping = true;
+        advance_us(events.begin()->first.first - now);
+        sleeping = false;
+    }
+}
+
+void set_tick_poll_cost_us(uint32_t us) {
+    tick_poll_cost = us;
+}
+
+void every(uint64_t period_us, uint64_t first_us, isr fn) {
+    schedule(first_us, period_us, std::move(fn));
+}
+
+void at(uint64_t at_us, isr fn) {
+    schedule(at_us, 0, std::move(fn));
+}
+
+void set_irq_handler(IRQn_Type irq, isr handler) {
+    irq_handlers[irq] = std::move(handler);
+}
+
+void fire_irq(IRQn_Type irq) {
+    if (irq_handlers[irq]) {
+        isr_depth++;
+        irq_handlers[irq]();
+        isr_depth--;
+    }
+}
+
+void set_input_pin(GPIO_TypeDef* port, uint16_t pin, bool high) {
+    const bool was_high = (port->IDR & pin) != 0;
+    if (high) {
+        port->IDR |= pin;
+    } else {
+        port->IDR &= ~static_cast<uint32_t>(pin);
+    }
+    if (was_high == high || !(exti_pins(port) & pin)) {
+        return;
+    }
+    // lines 5 to 9 share a vector, which is all the charger uses
+    if (isr_depth > 0 || advancing) {
+        fire_irq(EXTI9_5_IRQn);
+    } else {
+        at(now, [] { fire_irq(EXTI9_5_IRQn); });
+    }
+}
+
+bool read_output_pin(GPIO_TypeDef* port, uint16_t pin) {
+    return (port->ODR & pin) != 0;
+}
+
+void set_pilot(float frequency, float duty) {
+    pilot_frequency = frequency;
+    pilot_duty = duty;
+    pilot_generation++;
+    schedule_pilot_edge(pilot_generation);
+}
+
+void glitch_pilot() {
+    pilot_rising_edge();
+    schedule(now + 1, 0, [] { pilot_falling_edge(); });
+}
+
+can_bus& bus_for(CAN_TypeDef* instance) {
+    return instance == CAN1 ? buses[0] : buses[1];
+}
+
+static IRQn_Type rx_irq(CAN_TypeDef* instance, can::fifo fifo) {
+    if (instance == CAN1) {
+        return fifo == can::fifo::FIFO0 ? CAN1_RX0_IRQn : CAN1_RX1_IRQn;
+    }
+    return fifo == can::fifo::FIFO0 ? CAN2_RX0_IRQn : CAN2_RX1_IRQn;
+}
+
+void service_rx(CAN_TypeDef* instance, can::fifo fifo) {
+    can_bus& bus = bus_for(instance);
+    std::deque<can::packet>& queue = bus.rx[static_cast<int>(fifo)];
+    const IRQn_Type irq = rx_irq(instance, fifo);
+    while (!queue.empty() && irq_handlers[irq]) {
+        const size_t before = queue.size();
+        bus.stats.rx_interrupts++;
+        fire_irq(irq);
+        if (queue.size() == before) {
+            // handler did not drain the FIFO, leave it pending
+            break;
+        }
+    }
+}
+
+/**
+ * @brief Run a frame through the filter banks as bxCAN does: list filters
+ * win over mask filters, then the lowest bank wins.
+ *
+ * @return false if no bank accepts the frame
+ */
+static bool filter_frame(const can_bus& bus, const can::packet& p,
+                         can::fifo& fifo) {
+    if (bus.filters.empty()) {
+        return true;
+    }
+    const uint32_t reg =
+        p.is_extended() ? (p.get_id() << 3) | 0b100 : p.get_id() << 21;
+    const can_filter_bank* mask_match = nullptr;
+    for (const auto& [bank_number, bank] : bus.filters) {
+        if (bank.list) {
+            if (reg == bank.first || reg == bank.second) {
+                fifo = bank.fifo;
+                return true;
+            }
+        } else if (mask_match == nullptr &&
+                   (bank.accept_all ||
+                    (reg & bank.second) == (bank.first & bank.second))) {
+            mask_match = &bank;
+        }
+    }
+    if (mask_match == nullptr) {
+        return false;
+    }
+    if (!mask_match->accept_all) {
+        fifo = mask_match->fifo;
+    }
+    return true;
+}
+
+void inject(CAN_TypeDef* instance, can::fifo fifo, const can::packet& p) {
+    can_bus& bus = bus_for(instance);
+    for (const can_listener& listener : bus.rx_listeners) {
+        listener(p);
+    }
+    if (!filter_frame(bus, p, fifo)) {
+        bus.stats.rx_filtered++;
+        return;
+    }
+    std::deque<can::packet>& queue = bus.rx[static_cast<int>(fifo)];
+    if (queue.size() >= CAN_RX_FIFO_DEPTH) {
+        bus.stats.rx_overruns++;
+        return;
+    }
+    queue.push_back(p);
+    bus.stats.rx_frames++;
+    if (isr_depth > 0 || advancing) {
+        service_rx(instance, fifo);
+    } else {
+        at(now, [instance, fifo] { service_rx(instance, fifo); });
+    }
+}
+
+void occupy_bus(CAN_TypeDef* instance, uint32_t us) {
+    can_bus& bus = bus_for(instance);
+    bus.bus_free_at = std::max(now, bus.bus_free_at) + us;
+}
+
+void on_transmit(CAN_TypeDef* instance, can_listener listener) {
+    bus_for(instance).listeners.push_back(std::move(listener));
+}
+
+void on_receive(CAN_TypeDef* instance, can_listener listener) {
+    bus_for(instance).rx_listeners.push_back(std::move(listener));
+}
+
+void complete_tx(CAN_TypeDef* instance, const can::packet& p) {
+    can_bus& bus = bus_for(instance);
+    bus.mailboxes_busy--;
+    bus.stats.tx_frames++;
+    for (const can_listener& listener : bus.listeners) {
+        listener(p);
+    }
+    if (instance->IER & CAN_IT_TX_MAILBOX_EMPTY) {
+        fire_irq(instance == CAN1 ? CAN1_TX_IRQn : CAN2_TX_IRQn);
+    }
+}
+
+can_stats get_can_stats(CAN_TypeDef* instance) {
+    return bus_for(instance).stats;
+}
+
+gpio_stats get_gpio_stats() {
+    return gpio;
+}
+
+void reset() {
+    now = 0;
+    sequence = 0;
+    isr_depth = 0;
+    advancing = false;
+    sleeping = false;
+    irq_masked = false;
+    watchdog_running = false;
+    events.clear();
+    for (isr& handler : irq_handlers) {
+        handler = nullptr;
+    }
+    pilot_frequency = 0;
+    pilot_duty = 0;
+    pilot_generation++;
+    pilot_last_rising = 0;
+    capture_timer = nullptr;
+    capture_interrupt = false;
+    for (capture_dma& dma : capture_dmas) {
+        dma = capture_dma();
+    }
+    for (can_bus& bus : buses) {
+        bus = can_bus();
+    }
+    gpio = gpio_stats();
+    sim_GPIOA = GPIO_TypeDef();
+    sim_GPIOB = GPIO_TypeDef();
+    sim_GPIOC = GPIO_TypeDef();
+    sim_TIM1 = TIM_TypeDef();
+    sim_TIM5 = TIM_TypeDef();
+    sim_TIM6 = TIM_TypeDef();
+    sim_TIM7 = TIM_TypeDef();
+    sim_DMA2_Stream1 = DMA_Stream_TypeDef();
+    sim_DMA2_Stream2 = DMA_Stream_TypeDef();
+    sim_CAN1 = CAN_TypeDef();
+    sim_CAN2 = CAN_TypeDef();
+    sim_DWT = DWT_Type();
+    sim_CoreDebug = CoreDebug_Type();
+    sim_IWDG = IWDG_TypeDef();
+    for (exti_port& p : exti_ports) {
+        p.pins = 0;
+    }
+}
+
+void clear_backup_sram() {
+    std::fill(std::begin(sim_BKPSRAM), std::end(sim_BKPSRAM), 0);
+}
+
+}  // namespace sim
+}  // namespace charger
+}  // namespace umnsvp
+
+using namespace umnsvp::charger;
+
+/* HAL ----------------------------------------------------------------------*/
+uint32_t HAL_GetTick(void) {
+    // polling the tick is how firmware waits, so it is also how the
+    // simulated core lets time and interrupts happen
+    if (sim::isr_depth == 0 && !sim::advancing && !sim::irq_masked) {
+        sim::advance_us(sim::tick_poll_cost);
+    }
+    return static_cast<uint32_t>(sim::now / 1000);
+}
+
+void HAL_IncTick(void) {
+}
+
+void HAL_NVIC_SetPriority(IRQn_Type, uint32_t, uint32_t) {
+}
+
+void HAL_NVIC_EnableIRQ(IRQn_Type) {
+}
+
+void HAL_NVIC_DisableIRQ(IRQn_Type) {
+}
+
+void NVIC_SystemReset(void) {
+    sim_RCC.CSR |= sim::CSR_SFTRSTF;
+    throw sim::system_reset{false};
+}
+
+void __WFI(void) {
+    sim::sleep_until_event();
+}
+
+void __disable_irq(void) {
+    sim::irq_masked = true;
+}
+
+void __enable_irq(void) {
+    sim::irq_masked = false;
+}
+
+uint32_t __get_PRIMASK(void) {
+    return sim::irq_masked ? 1 : 0;
+}
+
+/* GPIO ---------------------------------------------------------------------*/
+void HAL_GPIO_Init(GPIO_TypeDef* GPIOx, GPIO_InitTypeDef* GPIO_Init) {
+    uint32_t& pins = sim::exti_pins(GPIOx);
+    if (GPIO_Init->Mode == GPIO_MODE_IT_RISING_FALLING) {
+        pins |= GPIO_Init->Pin;
+    } else {
+        pins &= ~GPIO_Init->Pin;
+    }
+}
+
+GPIO_PinState HAL_GPIO_ReadPin(GPIO_TypeDef* GPIOx, uint16_t GPIO_Pin) {
+    return (GPIOx->IDR & GPIO_Pin) ? GPIO_PIN_SET : GPIO_PIN_RESET;
+}
+
+void HAL_GPIO_WritePin(GPIO_TypeDef* GPIOx, uint16_t GPIO_Pin,
+                       GPIO_PinState PinState) {
+    sim::gpio.pin_writes++;
+    if (PinState == GPIO_PIN_SET) {
+        GPIOx->ODR |= GPIO_Pin;
+    } else {
+        GPIOx->ODR &= ~static_cast<uint32_t>(GPIO_Pin);
+    }
+}
+
+void HAL_GPIO_TogglePin(GPIO_TypeDef* GPIOx, uint16_t GPIO_Pin) {
+    sim::gpio.pin_writes++;
+    GPIOx->ODR ^= GPIO_Pin;
+}
+
+static_assert(offsetof(GPIO_TypeDef, BSRR) ==
+              offsetof(GPIO_TypeDef, ODR) + sizeof(uint32_t));
+
+void gpio_bsrr::operator=(uint32_t bits) {
+    sim::gpio.bsrr_writes++;
+    volatile uint32_t* odr = &value - 1;
+    *odr = (*odr & ~(bits >> 16)) | (bits & 0xFFFF);
+}
+
+void HAL_GPIO_EXTI_IRQHandler(uint16_t) {
+}
+
+/* PWR ----------------------------------------------------------------------*/
+void HAL_PWR_EnableBkUpAccess(void) {
+}
+
+HAL_StatusTypeDef HAL_PWREx_EnableBkUpReg(void) {
+    return HAL_OK;
+}
+
+/* IWDG ---------------------------------------------------------------------*/
+HAL_StatusTypeDef HAL_IWDG_Init(IWDG_HandleTypeDef* hiwdg) {
+    hiwdg->Instance->PR = hiwdg->Init.Prescaler;
+    hiwdg->Instance->RLR = hiwdg->Init.Reload;
+    sim::watchdog_running = true;
+    return HAL_IWDG_Refresh(hiwdg);
+}
+
+HAL_StatusTypeDef HAL_IWDG_Refresh(IWDG_HandleTypeDef* hiwdg) {
+    const uint64_t divider = 4ULL << hiwdg->Instance->PR;
+    sim::watchdog_expires =
+        sim::now + divider * hiwdg->Instance->RLR * 1000000 / sim::LSI_HZ;
+    return HAL_OK;
+}
+
+/* TIM ----------------------------------------------------------------------*/
+HAL_StatusTypeDef HAL_TIM_Base_Init(TIM_HandleTypeDef* htim) {
+    htim->Instance->PSC = htim->Init.Prescaler;
+    htim->Instance->ARR = htim->Init.Period;
+    return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_TIM_Base_Start_IT(TIM_HandleTypeDef* htim) {
+    htim->Instance->DIER |= TIM_IT_UPDATE;
+    sim::schedule_timer_update(htim);
+    return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_TIM_IC_Init(TIM_HandleTypeDef* htim) {
+    htim->Instance->PSC = htim->Init.Prescaler;
+    return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_TIM_IC_Start(TIM_HandleTypeDef*, uint32_t) {
+    return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_TIM_IC_Start_IT(TIM_HandleTypeDef* htim,
+                                     uint32_t Channel) {
+    if (Channel == TIM_CHANNEL_1) {
+        sim::capture_timer = htim;
+        sim::capture_interrupt = true;
+    }
+    return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_TIM_IC_Start_DMA(TIM_HandleTypeDef* htim,
+                                      uint32_t Channel, uint32_t* pData,
+                                      uint16_t Length) {
+    const int channel = Channel == TIM_CHANNEL_1 ? 0 : 1;
+    DMA_HandleTypeDef* hdma =
+        htim->hdma[channel == 0 ? TIM_DMA_ID_CC1 : TIM_DMA_ID_CC2];
+    if (hdma == nullptr || pData == nullptr || Length == 0) {
+        return HAL_ERROR;
+    }
+    // the transfers are halfword, as the charger configures them
+    sim::capture_dma& dma = sim::capture_dmas[channel];
+    dma.buffer = reinterpret_cast<uint16_t*>(pData);
+    dma.length = Length;
+    dma.position = 0;
+    dma.handle = hdma;
+    hdma->Instance->NDTR = Length;
+    sim::capture_timer = htim;
+    return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_TIM_IC_ConfigChannel(TIM_HandleTypeDef*,
+                                          TIM_IC_InitTypeDef*, uint32_t) {
+    return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_TIM_SlaveConfigSynchro(TIM_HandleTypeDef*,
+                                            TIM_SlaveConfigTypeDef*) {
+    return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_TIMEx_MasterConfigSynchronization(
+    TIM_HandleTypeDef*, TIM_MasterConfigTypeDef*) {
+    return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_TIM_RegisterCallback(
+    TIM_HandleTypeDef* htim, HAL_TIM_CallbackIDTypeDef CallbackID,
+    pTIM_CallbackTypeDef pCallback) {
+    switch (CallbackID) {
+        case HAL_TIM_PERIOD_ELAPSED_CB_ID:
+            htim->PeriodElapsedCallback = pCallback;
+            break;
+        case HAL_TIM_IC_CAPTURE_CB_ID:
+            htim->IC_CaptureCallback = pCallback;
+            break;
+        default:
+            return HAL_ERROR;
+    }
+    return HAL_OK;
+}
+
+void HAL_TIM_IRQHandler(TIM_HandleTypeDef*) {
+    // the engine calls registered callbacks directly
+}
+
+uint32_t HAL_TIM_ReadCapturedValue(TIM_HandleTypeDef* htim,
+                                   uint32_t Channel) {
+    return Channel == TIM_CHANNEL_1 ? htim->Instance->CCR1
+                                    : htim->Instance->CCR2;
+}
+
+/* DMA ----------------------------------------------------------------------*/
+HAL_StatusTypeDef HAL_DMA_Init(DMA_HandleTypeDef*) {
+    return HAL_OK;
+}
+
+/* CAN ----------------------------------------------------------------------*/
+HAL_StatusTypeDef HAL_CAN_ConfigFilter(CAN_HandleTypeDef*,
+                                       CAN_FilterTypeDef* sFilterConfig) {
+    // the banks are shared, the bank number decides which instance owns it
+    const uint32_t number = sFilterConfig->FilterBank;
+    sim::can_bus& bus = sim::bus_for(
+        number >= sFilterConfig->SlaveStartFilterBank ? CAN2 : CAN1);
+    if (sFilterConfig->FilterActivation != ENABLE) {
+        bus.filters.erase(number);
+        return HAL_OK;
+    }
+    if (sFilterConfig->FilterScale != CAN_FILTERSCALE_32BIT) {
+        return HAL_ERROR;  // not modelled
+    }
+    sim::can_filter_bank bank;
+    bank.list = sFilterConfig->FilterMode == CAN_FILTERMODE_IDLIST;
+    bank.first =
+        (sFilterConfig->FilterIdHigh << 16) | sFilterConfig->FilterIdLow;
+    bank.second = (sFilterConfig->FilterMaskIdHigh << 16) |
+                  sFilterConfig->FilterMaskIdLow;
+    bank.fifo =
+        static_cast<umnsvp::can::fifo>(sFilterConfig->FilterFIFOAssignment);
+    bus.filters[number] = bank;
+    return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_CAN_ActivateNotification(CAN_HandleTypeDef* hcan,
+                                               uint32_t ActiveITs) {
+    hcan->Instance->IER |= ActiveITs;
+    return HAL_OK;
+}
+
+uint32_t HAL_CAN_GetTxMailboxesFreeLevel(CAN_HandleTypeDef* hcan) {
+    return sim::CAN_TX_MAILBOXES - sim::bus_for(hcan->Instance).mailboxes_busy;
+}
+
+void HAL_CAN_IRQHandler(CAN_HandleTypeDef*) {
+}
@@ -0,0 +1,66 @@
+/**
+ * @file sim_internal.h
+ * @brief Engine state shared between the HAL and bxCAN stand-ins.
+ *
+ */
+#pragma once
+
+#include <deque>
+#include <map>
+#include <vector>
+
+#include "sim.h"
+
+namespace umnsvp {
+namespace charger {
+namespace sim {
+
+static constexpr uint8_t CAN_TX_MAILBOXES = 3;
+static constexpr uint8_t CAN_RX_FIFO_DEPTH = 3;
+
+static constexpr uint32_t CAN2_FIRST_FILTER_BANK = 14;
+
+/**
+ * @brief One bxCAN filter bank in 32 bit scale. first and second hold two
+ * IDs in list mode, or an ID and its mask in mask mode, laid out as the
+ * filter registers.
+ *
+ */
+struct can_filter_bank {
+    bool list = false;
+    bool accept_all = false;  // filter_all(): keeps the FIFO the sender chose
+    uint32_t first = 0;
+    uint32_t second = 0;
+    can::fifo fifo = can::fifo::FIFO0;
+};
+
+struct can_bus {
+    std::deque<can::packet> rx[2];
+    // keyed by bank number; while empty every frame is accepted
+    std::map<uint32_t, can_filter_bank> filters;
+    uint8_t mailboxes_busy = 0;
+    uint64_t bus_free_at = 0;
+    std::vector<can_listener> listeners;
+    std::vector<can_listener> rx_listeners;
+    can_stats stats;
+};
+
+can_bus& bus_for(CAN_TypeDef* instance);
+
+/**
+ * @brief Run an interrupt handler with the engine marked as in an ISR, so
+ * HAL_GetTick() polls from inside it don't advance time.
+ *
+ */
+void fire_irq(IRQn_Type irq);
+
+// Deliver pending frames from a FIFO, re-raising the interrupt while the
+// FIFO is non-empty as the bxCAN peripheral does.
+void service_rx(CAN_TypeDef* instance, can::fifo fifo);
+
+// Finish the oldest transmission in progress on a bus.
+void complete_tx(CAN_TypeDef* instance, const can::packet& p);
+
+}  // namespace sim
+}  // namespace charger
+}  // namespace umnsvp
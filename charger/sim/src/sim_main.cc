@@ -0,0 +1,344 @@
+/**
+ * @file sim_main.cc
+ * @brief Host simulation of a charge session against the real charger
+ * Application.
+ *
+ * Plugs in, charges, injects a BMS HV kill and reports the state trajectory,
+ * main loop pass latency and fault reaction time. Given a file name, both
+ * buses are also written there as a candump log (car bus as can0, charger bus
+ * as can1) that can_replay can play back. The session's telemetry log is
+ * dumped over the car bus at the end, so the file also holds it for
+ * telemetry_decode.
+ *
+ * Usage: charger_sim [session seconds] [kill at seconds] [candump log]
+ *
+ */
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#include "application.h"
+#include "candump.h"
+#include "devices.h"
+#include "j1772.h"
+#include "main.h"
+#include "sim.h"
+#include "state_names.h"
+
+using namespace umnsvp::charger;
+
+umnsvp::charger::Application app;
+
+void timer_handler_callback(TIM_HandleTypeDef* htim) {
+    if (htim->Instance == TIM6) {
+        app.scheduler_tick();
+    }
+}
+
+namespace {
+// simulated cost of one main loop pass on the F405, excluding tick polls
+constexpr uint64_t LOOP_COST_US = 20;
+constexpr uint64_t PLANT_STEP_US = 10000;
+constexpr uint64_t STATUS_PERIOD_US = 100000;
+constexpr uint64_t TRAJECTORY_PERIOD_US = 10000000;
+
+double seconds(uint64_t us) {
+    return us / 1e6;
+}
+
+const char* const JOB_NAMES[] = {"charger_control", "control_update",
+                                 "bms_request",     "charger_state",
+                                 "telemetry",       "lights",
+                                 "prox_debounce"};
+static_assert(sizeof(JOB_NAMES) / sizeof(JOB_NAMES[0]) ==
+              static_cast<size_t>(scheduled_job::COUNT));
+
+#ifdef CHARGER_PROFILE
+const char* profile_point_name(uint8_t point) {
+    static const char* const names[] = {
+        "receive_status_packet", "update_can_values", "pilot_update",
+        "check_faults",          "prox_read",         "update_state",
+        "state_action",          "regulate_current",  "telemetry",
+        "CAN1_RX0 ISR",          "CAN1_RX1 ISR",      "CAN1_TX ISR",
+        "CAN2_RX1 ISR",          "CAN2_TX ISR",       "TIM6 ISR",
+        "EXTI9_5 ISR"};
+    static_assert(sizeof(names) / sizeof(names[0]) ==
+                  static_cast<size_t>(profile_point::COUNT));
+    return point < static_cast<uint8_t>(profile_point::COUNT) ? names[point]
+                                                              : "?";
+}
+#endif
+}  // namespace
+
+int main(int argc, char** argv) {
+    const double session_s = argc > 1 ? std::atof(argv[1]) : 120.0;
+    const double kill_s = argc > 2 ? std::atof(argv[2]) : session_s * 0.75;
+    const uint64_t session_us = static_cast<uint64_t>(session_s * 1e6);
+    const uint64_t kill_us = static_cast<uint64_t>(kill_s * 1e6);
+    std::FILE* trace = argc > 3 ? std::fopen(argv[3], "w") : nullptr;
+    if (argc > 3 && trace == nullptr) {
+        std::perror(argv[3]);
+        return 1;
+    }
+
+    sim::reset();
+    if (trace != nullptr) {
+        const auto record = [trace](const char* interface) {
+            return [trace, interface](const umnsvp::can::packet& p) {
+                sim::candump::write(trace, seconds(sim::now_us()), interface,
+                                    p);
+            };
+        };
+        sim::on_receive(CAN1, record("can0"));
+        sim::on_transmit(CAN1, record("can0"));
+        sim::on_receive(CAN2, record("can1"));
+        sim::on_transmit(CAN2, record("can1"));
+    }
+    sim::set_irq_handler(CAN1_RX0_IRQn, [] {
+        PROFILE_SCOPE(profile_point::CAN1_RX0_ISR);
+        app.can1_rx_callback();
+    });
+    sim::set_irq_handler(CAN1_RX1_IRQn, [] {
+        PROFILE_SCOPE(profile_point::CAN1_RX1_ISR);
+        app.can1_rx1_callback();
+    });
+    sim::set_irq_handler(CAN1_TX_IRQn, [] {
+        PROFILE_SCOPE(profile_point::CAN1_TX_ISR);
+        app.can1_tx_callback();
+    });
+    sim::set_irq_handler(CAN2_RX1_IRQn, [] {
+        PROFILE_SCOPE(profile_point::CAN2_RX1_ISR);
+        app.can2_rx_callback();
+    });
+    sim::set_irq_handler(CAN2_TX_IRQn, [] {
+        PROFILE_SCOPE(profile_point::CAN2_TX_ISR);
+        app.can2_tx_callback();
+    });
+    sim::set_irq_handler(EXTI9_5_IRQn, [] {
+        PROFILE_SCOPE(profile_point::EXTI9_5_ISR);
+        app.prox_callback();
+    });
+#ifdef CHARGER_PROFILE
+    std::vector<umnsvp::can::packet> profile_reports;
+    sim::on_transmit(CAN1, [&](const umnsvp::can::packet& p) {
+        if (p.get_id() == PROFILE_REPORT_ID) {
+            profile_reports.push_back(p);
+        }
+    });
+#endif
+
+    sim::Plant plant(static_cast<uint8_t>(NUMBER_CHARGERS), STATUS_PERIOD_US);
+    plant.attach(PLANT_STEP_US);
+
+    // the startup wait only polls the BMS buffers, so let the BMS speak first
+    sim::advance_us(STATUS_PERIOD_US);
+    app.start();
+
+    // plug in one second after boot on a 1 kHz, 50 % (30 A) pilot
+    sim::at(1000000, [] {
+        sim::set_input_pin(PROX_PORT, PROX_PIN, true);
+        sim::set_pilot(1000.0f, 0.5f);
+    });
+    sim::at(kill_us, [&plant] { plant.bms.killed = true; });
+    sim::every(TRAJECTORY_PERIOD_US, TRAJECTORY_PERIOD_US, [&plant] {
+        std::printf("%10.3f  %-24s %8.2f %8.2f %8.3f\n",
+                    seconds(sim::now_us()),
+                    sim::state_name(app.get_charge_state()),
+                    plant.bms.pack_voltage(), plant.bms.pack.current,
+                    plant.bms.pack.soc);
+    });
+
+    // frames of a telemetry dump, and how many the start frame announced
+    uint32_t dump_frames = 0;
+    uint32_t dump_frames_expected = UINT32_MAX;
+    sim::on_transmit(CAN1, [&](const umnsvp::can::packet& p) {
+        if (p.get_id() != TELEMETRY_DUMP_ID) {
+            return;
+        }
+        if (telemetry_format::read_u16(p.get_data()) == 0) {
+            const uint32_t size = telemetry_format::read_u32(p.get_data() + 2);
+            dump_frames_expected = 1 + (size + telemetry_format::DUMP_PAYLOAD -
+                                        1) / telemetry_format::DUMP_PAYLOAD;
+        }
+        dump_frames++;
+    });
+
+    uint64_t disable_frame_us = 0;
+    sim::on_transmit(CAN2, [&](const umnsvp::can::packet& p) {
+        if (disable_frame_us == 0 && sim::now_us() >= kill_us &&
+            p.get_data()[0] == 0xFF) {
+            disable_frame_us = sim::now_us();
+        }
+    });
+
+    charge_state last = app.get_charge_state();
+    uint64_t fault_state_us = 0;
+    uint64_t passes = 0;
+    double worst_pass_ns = 0;
+    const auto wall_start = std::chrono::steady_clock::now();
+
+    std::printf("%10s  %-24s %8s %8s %8s\n", "t [s]", "state", "pack V",
+                "pack A", "soc");
+    while (sim::now_us() < session_us) {
+        const auto pass_start = std::chrono::steady_clock::now();
+        app.step();
+        const double pass_ns = std::chrono::duration<double, std::nano>(
+                                   std::chrono::steady_clock::now() -
+                                   pass_start)
+                                   .count();
+        worst_pass_ns = pass_ns > worst_pass_ns ? pass_ns : worst_pass_ns;
+        passes++;
+        sim::advance_us(LOOP_COST_US);
+
+        const charge_state state = app.get_charge_state();
+        if (state != last) {
+            std::printf("%10.3f  %-24s %8.2f %8.2f %8.3f\n",
+                        seconds(sim::now_us()), sim::state_name(state),
+                        plant.bms.pack_voltage(), plant.bms.pack.current,
+                        plant.bms.pack.soc);
+            if (state == charge_state::FAULT_LATCHING && fault_state_us == 0) {
+                fault_state_us = sim::now_us();
+            }
+            last = state;
+        }
+    }
+
+    const telemetry_stats telemetry = app.get_telemetry_stats();
+    if (trace != nullptr) {
+        // ask for the telemetry log over the car bus, as a laptop on CAN1
+        // would, so it lands in the candump log
+        const uint8_t request = static_cast<uint8_t>(telemetry_command::DUMP);
+        sim::inject(CAN1, umnsvp::can::fifo::FIFO1,
+                    umnsvp::can::packet(TELEMETRY_REQUEST_ID, 1, &request,
+                                        false));
+        const uint64_t dump_deadline = sim::now_us() + 5000000;
+        while (dump_frames < dump_frames_expected &&
+               sim::now_us() < dump_deadline) {
+            app.step();
+            sim::advance_us(LOOP_COST_US);
+        }
+    }
+
+#ifdef CHARGER_PROFILE
+    // ask for every summary over the car bus, as a laptop on CAN1 would
+    const uint8_t request = PROFILE_REQUEST_ALL;
+    sim::inject(CAN1, umnsvp::can::fifo::FIFO0,
+                umnsvp::can::packet(PROFILE_REQUEST_ID, 1, &request, false));
+    const uint64_t report_deadline = sim::now_us() + 1000000;
+    while (profile_reports.size() <
+               static_cast<size_t>(profile_point::COUNT) &&
+           sim::now_us() < report_deadline) {
+        app.step();
+        sim::advance_us(LOOP_COST_US);
+    }
+#endif
+
+    const double wall_s = std::chrono::duration<double>(
+                              std::chrono::steady_clock::now() - wall_start)
+                              .count();
+    std::printf("\nsimulated %.1f s in %.3f s wall (%.0fx real time)\n",
+                session_s, wall_s, session_s / wall_s);
+    std::printf("main loop: %llu passes, %.0f ns mean, %.0f ns worst (host)\n",
+                static_cast<unsigned long long>(passes),
+                wall_s * 1e9 / passes, worst_pass_ns);
+    if (fault_state_us != 0) {
+        std::printf("HV kill -> FAULT_LATCHING: %.3f ms\n",
+                    (fault_state_us - kill_us) / 1e3);
+    }
+    if (disable_frame_us != 0) {
+        std::printf("HV kill -> charger disable frame: %.3f ms\n",
+                    (disable_frame_us - kill_us) / 1e3);
+    }
+    std::printf("HV isolation current decay: %lu ms\n",
+                static_cast<unsigned long>(app.get_isolation_decay_time()));
+    const loop_stats loop = app.get_loop_stats();
+    const double cycles_per_us = SystemCoreClock / 1e6;
+    std::printf(
+        "awake %.2f %% of the time, %u wakeups, event latency %.1f us mean "
+        "%.1f us worst\n",
+        100.0 * loop.awake_cycles / (loop.awake_cycles + loop.asleep_cycles),
+        loop.wakeups,
+        loop.total_latency_cycles / cycles_per_us / loop.wakeups,
+        loop.max_latency_cycles / cycles_per_us);
+    const sim::can_stats car = sim::get_can_stats(CAN1);
+    const sim::can_stats charger = sim::get_can_stats(CAN2);
+    std::printf("CAN1 tx %u rx %u overrun %u | CAN2 tx %u rx %u overrun %u\n",
+                car.tx_frames, car.rx_frames, car.rx_overruns,
+                charger.tx_frames, charger.rx_frames, charger.rx_overruns);
+    const control_tx_stats& control = app.get_control_stats();
+    std::printf("control frames: %u heartbeat, %u on change (%u changes)\n",
+                control.heartbeats, control.updates, control.changes);
+    const ring_stats bms_rx = app.get_bms_rx_stats();
+    std::printf("RX queues: bms measurement high water %u overruns %u",
+                bms_rx.high_water, bms_rx.overruns);
+    for (uint8_t unit = 0; unit < NUMBER_CHARGERS; unit++) {
+        const ring_stats unit_rx = app.get_charger_rx_stats(unit);
+        std::printf(" | charger %u %u/%u", unit, unit_rx.high_water,
+                    unit_rx.overruns);
+    }
+    std::printf("\n");
+    const light_stats& lights = app.get_light_stats();
+    const sim::gpio_stats gpio = sim::get_gpio_stats();
+    std::printf("status lights: %u posts, %u steps, %u port writes | GPIO "
+                "%u pin writes %u BSRR writes\n",
+                lights.posts, lights.steps, lights.port_writes,
+                gpio.pin_writes, gpio.bsrr_writes);
+    std::printf("comm links (expiries, worst gap ms):");
+    for (uint8_t i = 0; i < static_cast<uint8_t>(comm_link::COUNT); i++) {
+        const comm_link link = static_cast<comm_link>(i);
+        const comm_link_stats& comm = app.get_comm_link_stats(link);
+        std::printf("%s %s %u/%u", i == 0 ? "" : " |",
+                    sim::link_name(link).c_str(), comm.expiries,
+                    comm.worst_gap);
+    }
+    std::printf("\n");
+    std::printf("telemetry: %u records in %u bytes over %.1f s",
+                telemetry.records, telemetry.bytes,
+                (telemetry.newest - telemetry.oldest) / 1e3);
+    if (trace != nullptr) {
+        std::printf(", dumped in %u frames", dump_frames);
+    }
+    std::printf("\n");
+    const deadline_record deadlines = app.get_deadline_record();
+    std::printf("deadlines: worst pass %.1f us (longest phase %s), %u passes "
+                "over %u us, %u phases over their deadline",
+                deadlines.worst_pass_cycles / cycles_per_us,
+                sim::phase_name(deadlines.worst_pass_phase),
+                deadlines.pass_overruns, LOOP_PASS_DEADLINE,
+                deadlines.phase_overruns);
+    if (deadlines.phase_overruns != 0) {
+        std::printf(" (last %s)",
+                    sim::phase_name(deadlines.last_overrun_phase));
+    }
+    std::printf("\n");
+    std::printf("\n%-16s %6s %9s %12s %11s %11s\n", "scheduled job", "runs",
+                "overruns", "jitter us", "worst us", "run us");
+    for (uint8_t job = 0; job < static_cast<uint8_t>(scheduled_job::COUNT);
+         job++) {
+        const job_stats& s = app.get_job_stats(static_cast<scheduled_job>(job));
+        const double mean_jitter =
+            s.runs > 1 ? s.total_jitter_cycles / (s.runs - 1.0) : 0.0;
+        std::printf("%-16s %6u %9u %12.1f %11.1f %11.1f\n", JOB_NAMES[job],
+                    s.runs, s.overruns, mean_jitter / cycles_per_us,
+                    s.max_jitter_cycles / cycles_per_us,
+                    s.max_run_cycles / cycles_per_us);
+    }
+#ifdef CHARGER_PROFILE
+    std::printf("\n%-22s %10s %10s %10s %6s\n", "profile (sim time)",
+                "min us", "mean us", "max us", "peak");
+    for (const umnsvp::can::packet& p : profile_reports) {
+        const profile_report r = profile_report_frame::unpack(p.get_data());
+        const double us_per_unit =
+            (1 << PROFILE_REPORT_SHIFT) / (SystemCoreClock / 1e6);
+        std::printf("%-22s %10.1f %10.1f %10.1f %5s%u\n",
+                    profile_point_name(r.point), r.min * us_per_unit,
+                    r.mean * us_per_unit, r.max * us_per_unit, "<2^",
+                    r.peak_bin);
+    }
+#endif
+    if (trace != nullptr) {
+        std::fclose(trace);
+    }
+    return 0;
+}
@@ -0,0 +1,77 @@
+#include "skylab2_boards.h"
+
+namespace umnsvp {
+namespace skylab2 {
+
+charger_can::charger_can(can::bxcan_driver& can_device, can::fifo rx_fifo)
+    : can_device(can_device), rx_fifo(rx_fifo) {
+}
+
+void charger_can::init() {
+    can_device.init(can::baud_rate::BAUD_RATE_500, true);
+    can_device.start();
+    can_device.filter_all();
+}
+
+template <class T>
+can::status charger_can::send(CANPacketId id, uint8_t length, const T& msg) {
+    uint8_t data[8] = {0};
+    pack(msg, data);
+    return can_device.send(
+        can::packet(static_cast<uint32_t>(id), length, data, false));
+}
+
+/**
+ * @brief Decode one frame out of the RX FIFO into its packet buffer.
+ *
+ */
+void charger_can::main_bus_rx_handler() {
+    can::packet p;
+    if (can_device.receive(p, rx_fifo) != can::status::OK) {
+        return;
+    }
+    const uint8_t* data = p.get_data();
+    switch (static_cast<CANPacketId>(p.get_id())) {
+        case CANPacketId::CAN_PACKET_BMS_MEASUREMENT:
+            bms_measurement_buffer.push(
+                unpack<can_packet_bms_measurement>(data));
+            break;
+        case CANPacketId::CAN_PACKET_BATTERY_STATUS:
+            battery_status_buffer.push(unpack<can_packet_battery_status>(data));
+            break;
+        case CANPacketId::CAN_PACKET_BMS_MODULE_MIN_MAX:
+            bms_module_min_max_buffer.push(
+                unpack<can_packet_bms_module_min_max>(data));
+            break;
+        case CANPacketId::CAN_PACKET_BMS_CAPACITY:
+            bms_capacity_buffer.push(unpack<can_packet_bms_capacity>(data));
+            break;
+        case CANPacketId::CAN_PACKET_BMS_CHARGER_RESPONSE:
+            bms_charger_response_buffer.push(
+                unpack<can_packet_bms_charger_response>(data));
+            break;
+        case CANPacketId::CAN_PACKET_CHARGER_CURRENT_VOLTAGE:
+            charger_current_voltage_buffer.push(
+                unpack<can_packet_charger_current_voltage>(data));
+            break;
+        default:
+            break;
+    }
+}
+
+void charger_can::main_bus_tx_handler() {
+}
+
+can::status charger_can::send_charger_state(can_packet_charger_state msg) {
+    return send(CANPacketId::CAN_PACKET_CHARGER_STATE,
+                CAN_LENGTH_CHARGER_STATE, msg);
+}
+
+can::status charger_can::send_charger_bms_request(
+    can_packet_charger_bms_request msg) {
+    return send(CANPacketId::CAN_PACKET_CHARGER_BMS_REQUEST,
+                CAN_LENGTH_CHARGER_BMS_REQUEST, msg);
+}
+
+}  // namespace skylab2
+}  // namespace umnsvp
@@ -0,0 +1,191 @@
+/**
+ * @file telemetry_decode.cc
+ * @brief Pull a telemetry dump out of a candump trace of the car bus and
+ * write the samples as CSV.
+ *
+ * The dump frames are put back in order by their sequence numbers, so the
+ * trace may hold them out of order or interleaved with other traffic. The
+ * last dump in the trace is decoded; frames it is missing are reported, and
+ * decoding stops at the first block they fall in.
+ *
+ * Usage: telemetry_decode [-i IFACE] trace.log > telemetry.csv
+ *   -i  interface recorded on the car bus, default can0
+ *
+ */
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "candump.h"
+#include "state_names.h"
+#include "telemetry.h"
+
+using namespace umnsvp::charger;
+
+namespace {
+constexpr uint8_t PAYLOAD = telemetry_format::DUMP_PAYLOAD;
+
+/**
+ * @brief One dump being put back together.
+ *
+ */
+struct dump {
+    uint32_t size = 0;
+    uint8_t blocks = 0;
+    std::vector<uint8_t> data;
+    std::vector<bool> received;  // per data frame
+
+    void start(const uint8_t* frame) {
+        size = telemetry_format::read_u32(frame + 2);
+        blocks = frame[6];
+        data.assign(size, 0);
+        received.assign((size + PAYLOAD - 1) / PAYLOAD, false);
+    }
+
+    void add(uint16_t sequence, const uint8_t* payload, uint8_t length) {
+        const uint32_t at = (sequence - 1) * PAYLOAD;
+        if (sequence == 0 || sequence > received.size()) {
+            return;
+        }
+        std::memcpy(data.data() + at, payload,
+                    std::min<uint32_t>(length, size - at));
+        received[sequence - 1] = true;
+    }
+
+    // first byte of the stream that did not arrive, size if none
+    uint32_t first_missing() const {
+        for (size_t i = 0; i < received.size(); i++) {
+            if (!received[i]) {
+                return i * PAYLOAD;
+            }
+        }
+        return size;
+    }
+
+    uint32_t missing_frames() const {
+        uint32_t missing = 0;
+        for (bool r : received) {
+            missing += !r;
+        }
+        return missing;
+    }
+};
+
+void print_header(uint8_t fields) {
+    std::printf(
+        "time_s,state,pilot_duty_pct,pack_v,battery_a,charger_temp_c");
+    const uint8_t first = static_cast<uint8_t>(telemetry_field::CHARGER_VOLTAGE);
+    for (uint8_t unit = 0; first + 2 * unit + 1 < fields; unit++) {
+        std::printf(",charger%u_v,charger%u_a", unit, unit);
+    }
+    std::printf("\n");
+}
+
+void print_sample(uint32_t tick, const int32_t* values, uint8_t fields) {
+    std::printf("%.3f,%s,%.1f,%.2f,%.3f,%d", tick / 1e3,
+                sim::state_name(static_cast<charge_state>(values[0])),
+                values[1] / 10.0, values[2] / 100.0, values[3] / 1000.0,
+                values[4]);
+    const uint8_t first = static_cast<uint8_t>(telemetry_field::CHARGER_VOLTAGE);
+    for (uint8_t field = first; field + 1 < fields; field += 2) {
+        std::printf(",%.1f,%.1f", values[field] / 10.0,
+                    values[field + 1] / 10.0);
+    }
+    std::printf("\n");
+}
+}  // namespace
+
+int main(int argc, char** argv) {
+    std::string interface = "can0";
+    const char* path = nullptr;
+    for (int i = 1; i < argc; i++) {
+        if (std::strcmp(argv[i], "-i") == 0 && i + 1 < argc) {
+            interface = argv[++i];
+        } else if (argv[i][0] != '-' && path == nullptr) {
+            path = argv[i];
+        } else {
+            path = nullptr;
+            break;
+        }
+    }
+    if (path == nullptr) {
+        std::fprintf(stderr, "usage: %s [-i IFACE] trace.log\n", argv[0]);
+        return 2;
+    }
+    std::ifstream in(path);
+    if (!in) {
+        std::perror(path);
+        return 1;
+    }
+
+    dump latest;
+    bool started = false;
+    uint32_t dumps = 0;
+    std::string line;
+    while (std::getline(in, line)) {
+        const auto r = sim::candump::parse_line(line);
+        if (!r || r->interface != interface ||
+            r->packet.get_id() != TELEMETRY_DUMP_ID ||
+            r->packet.get_length() < 2) {
+            continue;
+        }
+        const uint8_t* frame = r->packet.get_data();
+        const uint16_t sequence = telemetry_format::read_u16(frame);
+        if (sequence == 0) {
+            if (r->packet.get_length() < 8 ||
+                frame[7] != telemetry_format::VERSION) {
+                std::fprintf(stderr, "unsupported telemetry dump version\n");
+                continue;
+            }
+            latest.start(frame);
+            started = true;
+            dumps++;
+        } else if (started) {
+            latest.add(sequence, frame + 2, r->packet.get_length() - 2);
+        }
+    }
+    if (!started) {
+        std::fprintf(stderr, "no telemetry dump on %s\n", interface.c_str());
+        return 1;
+    }
+
+    const uint32_t missing = latest.missing_frames();
+    std::fprintf(stderr, "%u dumps, last is %u bytes in %u blocks", dumps,
+                 latest.size, latest.blocks);
+    if (missing != 0) {
+        std::fprintf(stderr, ", %u of %zu frames missing", missing,
+                     latest.received.size());
+    }
+    std::fprintf(stderr, "\n");
+
+    // blocks are whole and in order; stop at the first one not all there
+    const uint32_t complete = latest.first_missing();
+    uint32_t at = 0;
+    uint32_t records = 0;
+    bool header_printed = false;
+    for (uint8_t block = 0; block < latest.blocks && at < complete; block++) {
+        const size_t used = telemetry_format::decode_block(
+            latest.data.data() + at, complete - at,
+            [&](uint32_t tick, const int32_t* values, uint8_t fields) {
+                if (!header_printed) {
+                    print_header(fields);
+                    header_printed = true;
+                }
+                print_sample(tick, values, fields);
+                records++;
+            });
+        if (used == 0) {
+            std::fprintf(stderr, "block %u is %s\n", block,
+                         at + telemetry_format::HEADER_SIZE > complete
+                             ? "missing"
+                             : "incomplete or malformed");
+            break;
+        }
+        at += used;
+    }
+    std::fprintf(stderr, "%u records\n", records);
+    return missing == 0 ? 0 : 1;
+}
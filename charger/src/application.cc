@@ -1,8 +1,10 @@
 #include "application.h"
 
 #include <algorithm>
+#include <array>
 
 #include "battery_charging_limits.h"
+#include "can_filters.h"
 #include "main.h"
 #include "status_lights.h"
 #include "timing.h"
@@ -10,11 +12,202 @@
 namespace umnsvp {
 namespace charger {
 
+namespace {
+// car bus frames the charger consumes, everything else is rejected by the
+// CAN1 filters before it can raise an interrupt
+constexpr auto CAR_FILTERS =
+    can_filters::id_list(Bms::RX_IDS, false, CAN_FILTER_FIFO0, 0);
+// requests for the charger's own diagnostics, kept in FIFO1 away from the
+// BMS packets
+constexpr std::array DIAGNOSTIC_IDS = {
+    TELEMETRY_REQUEST_ID,
+    DEADLINE_REQUEST_ID,
+#ifdef CHARGER_PROFILE
+    PROFILE_REQUEST_ID,
+#endif
+};
+constexpr auto DIAGNOSTIC_FILTERS = can_filters::id_list(
+    DIAGNOSTIC_IDS, false, CAN_FILTER_FIFO1, CAR_FILTERS.size());
+static_assert(CAR_FILTERS.size() + DIAGNOSTIC_FILTERS.size() <=
+              can_filters::CAN2_FIRST_BANK);
+
+// TX mailboxes a telemetry dump leaves free for the scheduled car bus frames
+constexpr uint8_t TELEMETRY_DUMP_KEEP_FREE = 2;
+
+// each Thunderstruck gets a control packet this often
+constexpr uint16_t CHARGER_CONTROL_PERIOD = 100;  // ms
+// how often a changed control packet is looked for
+constexpr uint16_t CONTROL_UPDATE_PERIOD = 1;  // ms
+constexpr uint16_t CAR_BROADCAST_PERIOD = 1000;   // ms
+
+// Job table, in scheduled_job order. Phases keep frames on the same bus out
+// of each other's way: the chargers take turns through the control period,
+// and the two car bus frames go out half a period apart. A change to the
+// control packet goes out on the next tick, between the periodic ones.
+// Telemetry sends nothing on its own, so it shares the control tick and the
+// main loop wakes once for both. The lights don't wake the main loop at all,
+// and the proximity debounce only wakes it for a change.
+constexpr std::array<periodic_job<Application>,
+                     static_cast<uint8_t>(scheduled_job::COUNT)>
+    SCHEDULED_JOBS = {{
+        {&Application::send_charger_control,
+         CHARGER_CONTROL_PERIOD / NUMBER_CHARGERS, 0},
+        {&Application::send_control_updates, CONTROL_UPDATE_PERIOD, 0},
+        {&Application::send_bms_request, CAR_BROADCAST_PERIOD, 250},
+        {&Application::send_charger_state, CAR_BROADCAST_PERIOD, 750},
+        {&Application::telemetry_tick,
+         SCHEDULER_TICK_RATE / TELEMETRY_RATE_DEFAULT, 0},
+        {&Application::step_lights, LIGHT_STEP_PERIOD, 0},
+        {&Application::debounce_prox, PROX_DEBOUNCE_PERIOD, 0},
+    }};
+
+// STATE light pattern of each charge_state
+constexpr std::array<led_pattern, CHARGE_STATES> STATE_LIGHT_PATTERNS = {{
+    LED_OFF,                // IDLE
+    led_blink(1, 9),        // CONNECTED, a flash a second
+    led_blink(2, 2),        // THUNDERSTRUCK_POWER_ON
+    LED_ON,                 // CHARGING
+    led_blink(1, 1),        // FAULT_LATCHING
+    led_blink(5, 5),        // FAULT_RESETTABLE
+    led_then(led_blink(1, 1), led_blink(1, 7)),  // CHARGING_DONE, two flashes
+}};
+
+// Blink codes, counted on the FAULT light: 1 to 5 for the bms_fault_type
+// flags in order, 6 to 8 for the charger_fault_type ones. A BMS and a
+// charger fault together play one code after the other.
+constexpr uint8_t BMS_FAULT_CODES = 5;
+constexpr uint8_t CHARGER_FAULT_CODES = 3;
+
+// 1 + the number of the lowest flag set, 0 for none
+constexpr uint8_t fault_number(uint8_t flags) {
+    return flags == 0 ? 0 : __builtin_ctz(flags) + 1;
+}
+
+// FAULT light pattern, indexed by the fault_number() of each fault
+using fault_light_table =
+    std::array<std::array<led_pattern, CHARGER_FAULT_CODES + 1>,
+               BMS_FAULT_CODES + 1>;
+
+constexpr fault_light_table make_fault_light_patterns() {
+    fault_light_table table = {};
+    for (uint8_t bms = 0; bms <= BMS_FAULT_CODES; bms++) {
+        for (uint8_t charger = 0; charger <= CHARGER_FAULT_CODES; charger++) {
+            const led_pattern charger_code =
+                led_code(BMS_FAULT_CODES + charger);
+            if (bms == 0) {
+                table[bms][charger] = charger == 0 ? LED_OFF : charger_code;
+            } else if (charger == 0) {
+                table[bms][charger] = led_code(bms);
+            } else {
+                table[bms][charger] = led_then(led_code(bms), charger_code);
+            }
+        }
+    }
+    return table;
+}
+constexpr fault_light_table FAULT_LIGHT_PATTERNS = make_fault_light_patterns();
+// the two longest codes must fit one pattern
+static_assert(led_code(BMS_FAULT_CODES).length +
+                  led_code(BMS_FAULT_CODES + CHARGER_FAULT_CODES).length <=
+              64);
+
+constexpr uint8_t field_index(telemetry_field field) {
+    return static_cast<uint8_t>(field);
+}
+}  // namespace
+
+// Hooks of each state, in charge_state order: entry, exit, activity. The
+// isolating states start HV isolation on entry and advance it on each pass.
+// IDLE is entered on unplug, so it waits out the chargers' ramp down.
+constexpr std::array<state_hooks<Application>, CHARGE_STATES>
+    Application::STATE_HOOKS = {{
+        // IDLE
+        {&Application::begin_unplug_isolate, nullptr,
+         &Application::HV_isolate},
+        // CONNECTED
+        {nullptr, nullptr, &Application::request_charging},
+        // THUNDERSTRUCK_POWER_ON
+        {&Application::power_on_chargers, nullptr, nullptr},
+        // CHARGING
+        {&Application::start_charging, &Application::stop_charging,
+         &Application::command_current},
+        // FAULT_LATCHING
+        {&Application::begin_fault_isolate, nullptr, &Application::HV_isolate},
+        // FAULT_RESETTABLE
+        {&Application::begin_fault_isolate, &Application::release_trip,
+         &Application::HV_isolate},
+        // CHARGING_DONE
+        {&Application::begin_HV_isolate, nullptr, &Application::HV_isolate},
+    }};
+
+// Transitions, each state's in priority order: faults first, from
+// check_faults() earlier in the pass, then unplugging, then the charge
+// sequence. Nothing leaves FAULT_LATCHING.
+constexpr std::array<state_transition<Application, charge_state>,
+                     Application::CHARGE_TRANSITIONS>
+    Application::STATE_TRANSITIONS = {{
+        {charge_state::IDLE, charge_state::FAULT_LATCHING,
+         &Application::latching_fault},
+        {charge_state::IDLE, charge_state::FAULT_RESETTABLE,
+         &Application::resettable_fault},
+        {charge_state::IDLE, charge_state::CONNECTED,
+         &Application::plugged_in},
+
+        {charge_state::CONNECTED, charge_state::FAULT_LATCHING,
+         &Application::latching_fault},
+        {charge_state::CONNECTED, charge_state::FAULT_RESETTABLE,
+         &Application::resettable_fault},
+        {charge_state::CONNECTED, charge_state::IDLE,
+         &Application::unplugged},
+        {charge_state::CONNECTED, charge_state::THUNDERSTRUCK_POWER_ON,
+         &Application::ready_to_charge},
+
+        {charge_state::THUNDERSTRUCK_POWER_ON, charge_state::FAULT_LATCHING,
+         &Application::latching_fault},
+        {charge_state::THUNDERSTRUCK_POWER_ON, charge_state::FAULT_RESETTABLE,
+         &Application::resettable_fault},
+        {charge_state::THUNDERSTRUCK_POWER_ON, charge_state::IDLE,
+         &Application::unplugged},
+        {charge_state::THUNDERSTRUCK_POWER_ON, charge_state::CONNECTED,
+         &Application::bms_not_ready},
+        {charge_state::THUNDERSTRUCK_POWER_ON, charge_state::CHARGING,
+         &Application::chargers_alive},
+
+        {charge_state::CHARGING, charge_state::FAULT_LATCHING,
+         &Application::latching_fault},
+        {charge_state::CHARGING, charge_state::FAULT_RESETTABLE,
+         &Application::resettable_fault},
+        {charge_state::CHARGING, charge_state::IDLE, &Application::unplugged},
+        {charge_state::CHARGING, charge_state::CONNECTED,
+         &Application::bms_not_ready},
+        {charge_state::CHARGING, charge_state::CHARGING_DONE,
+         &Application::charge_complete},
+
+        {charge_state::CHARGING_DONE, charge_state::FAULT_LATCHING,
+         &Application::latching_fault},
+        {charge_state::CHARGING_DONE, charge_state::FAULT_RESETTABLE,
+         &Application::resettable_fault},
+        {charge_state::CHARGING_DONE, charge_state::IDLE,
+         &Application::unplugged},
+
+        {charge_state::FAULT_RESETTABLE, charge_state::FAULT_LATCHING,
+         &Application::latching_fault},
+        {charge_state::FAULT_RESETTABLE, charge_state::IDLE,
+         &Application::faults_cleared},
+    }};
+
 Application::Application()
-    : can_device(CAN1),
+    : charge_machine(*this, STATE_HOOKS, STATE_TRANSITIONS,
+                     charge_state::IDLE),
+      can_device(CAN1),
       skylab2(can_device, can::fifo::FIFO0),
-      bms(skylab2),
-      thunderstruck(){};
+      bms(skylab2, comm_timeouts),
+      thunderstruck(comm_timeouts),
+      scheduler(*this, SCHEDULED_JOBS) {
+    static_assert(valid_transitions(STATE_TRANSITIONS),
+                  "each transition needs a guard and another state to go to, "
+                  "and each state's transitions must be together");
+};
 
 /**
  * @brief Initalilzes all charger dependencies
@@ -22,13 +215,18 @@ Application::Application()
  */
 void Application::init() {
     sys_init();
+    // first, so the watchdog covers the rest of start up
+    supervisor.init();
+    loop_events.init();
     status_lights.init();
     skylab2.init();
+    can_filters::configure(can_device.get_handle(), CAR_FILTERS);
     openEVSE.init();
     thunderstruck.init();
+    init_diagnostic_requests();
 
-    start_car_can_send_timer(&timer_handler_callback);
-    start_charger_can_send_timer(&timer_handler_callback);
+    scheduler.start();
+    start_scheduler_timer(&timer_handler_callback);
 }
 
 /**
@@ -37,221 +235,555 @@ void Application::init() {
  *
  */
 void Application::main() {
+    start();
+    while (true) {
+        step();
+    }
+}
+
+/**
+ * @brief Initialize the charger and wait for the BMS to come alive. Each poll
+ * is a short pass for the supervisor, so a missing BMS doesn't starve the
+ * watchdog.
+ *
+ */
+void Application::start() {
     init();
-    while (!bms.check_comms_alive()) {
+    bool alive = false;
+    while (!alive) {
+        supervisor.begin_pass();
+        supervisor.check_in(loop_phase::STARTUP);
         bms.update_can_values();
+        comm_timeouts.poll(HAL_GetTick());
+        alive = bms.check_comms_alive();
+        supervisor.end_pass();
     }
-    while (true) {
+}
+
+/**
+ * @brief Sleep until an interrupt posts an event, then run one pass of the
+ * charger state machine. Only the stages fed by the events that fired are
+ * run; the state machine itself runs on every wakeup. Each stage checks in
+ * with the supervisor as it starts.
+ *
+ */
+void Application::step() {
+    const uint32_t events = loop_events.wait();
+    supervisor.begin_pass();
+
+    if (events & loop_event::CHARGER_RX) {
+        supervisor.check_in(loop_phase::RECEIVE_STATUS_PACKET);
+        PROFILE_SCOPE(profile_point::RECEIVE_STATUS_PACKET);
         thunderstruck.receive_status_packet();
+    }
+    if (events & loop_event::CAR_RX) {
+        supervisor.check_in(loop_phase::UPDATE_CAN_VALUES);
+        PROFILE_SCOPE(profile_point::UPDATE_CAN_VALUES);
         bms.update_can_values();
+    }
+    // the pilot is captured by DMA; digest it at the control packet rate,
+    // the rate its result is used at
+    if (events & loop_event::CHARGER_TICK) {
+        supervisor.check_in(loop_phase::PILOT_UPDATE);
+        PROFILE_SCOPE(profile_point::PILOT_UPDATE);
+        openEVSE.update_control_pilot();
+    }
 
-        // the only time we don't check for faults is if we're already latched
-        // faulted
-        if (charge_status != charge_state::FAULT_LATCHING) {
-            check_faults();
-        }
+    // a single compare unless a link has just gone quiet; everything after
+    // this sees the same view of which links are alive
+    if (comm_timeouts.poll(HAL_GetTick())) {
+        thunderstruck.drop_expired_units();
+    }
+
+    // faults come from new data or from comms timing out, which the periodic
+    // ticks bound
+    const uint32_t fault_inputs =
+        loop_event::CHARGER_RX | loop_event::CAR_RX |
+        loop_event::CHARGER_TICK | loop_event::CAR_TICK;
+    // the only time we don't check for faults is if we're already latched
+    // faulted
+    if ((events & fault_inputs) &&
+        charge_machine.get_state() != charge_state::FAULT_LATCHING) {
+        supervisor.check_in(loop_phase::CHECK_FAULTS);
+        PROFILE_SCOPE(profile_point::CHECK_FAULTS);
+        check_faults();
+    }
 
-        if (openEVSE.check_prox_connected()) {
+    {
+        supervisor.check_in(loop_phase::PROX_READ);
+        PROFILE_SCOPE(profile_point::PROX_READ);
+        prox_connected = openEVSE.check_prox_connected();
+        if (events & loop_event::PROX) {
+            unplug_ramping = !prox_connected;
+        }
+        // the chargers ramp down from the unplug edge, ahead of the
+        // debounced change
+        if (unplug_ramping &&
+            thunderstruck.get_charging_current() <= milli_amps(10)) {
+            unplug_ramp_time = HAL_GetTick() - openEVSE.get_prox_changed_at();
+            unplug_ramping = false;
+        }
+    }
+    {
+        supervisor.check_in(loop_phase::UPDATE_STATE);
+        PROFILE_SCOPE(profile_point::UPDATE_STATE);
+        if (prox_connected) {
             status_lights.indicate_proxy_connected();
-            update_state_connected();
         } else {
             status_lights.indicate_proxy_disconnected();
-            update_state_disconnected();
         }
-        state_action();
+        charge_machine.update(HAL_GetTick());
+    }
+    {
+        supervisor.check_in(loop_phase::STATE_ACTION);
+        PROFILE_SCOPE(profile_point::STATE_ACTION);
+        charge_machine.run();
+        update_lights();
+    }
+    // the regulator runs at the control packet rate, with the measurements
+    // the last period brought; its command goes out in the next packet
+    if ((events & loop_event::CHARGER_TICK) &&
+        charge_machine.get_state() == charge_state::CHARGING) {
+        supervisor.check_in(loop_phase::REGULATE_CURRENT);
+        PROFILE_SCOPE(profile_point::REGULATE_CURRENT);
+        regulate_current();
+    }
+    // sampled after the state machine so a record sees this pass's state
+    if (events & loop_event::TELEMETRY) {
+        supervisor.check_in(loop_phase::TELEMETRY);
+        PROFILE_SCOPE(profile_point::TELEMETRY);
+        update_telemetry();
+    }
+    // requests on CAN1 wake the loop with loop_event::DEADLINE
+    if (deadline_clear_requested) {
+        deadline_clear_requested = false;
+        supervisor.clear();
     }
+    send_deadline_report();
+#ifdef CHARGER_PROFILE
+    send_profile_report();
+#endif
+    supervisor.end_pass();
+}
+
+charge_state Application::get_charge_state() const {
+    return charge_machine.get_state();
+}
+
+const state_stats& Application::get_state_stats(charge_state state) const {
+    return charge_machine.get_stats(state);
+}
+
+// time spent in a state since power up, ms
+uint32_t Application::get_state_residency(charge_state state) const {
+    return charge_machine.residency(state, HAL_GetTick());
+}
+
+uint8_t Application::get_transition_count() const {
+    return CHARGE_TRANSITIONS;
+}
+
+const state_transition<Application, charge_state>&
+Application::get_transition(uint8_t i) const {
+    return charge_machine.get_transition(i);
 }
 
-/** @brief checks for faults, sets fault reason and changes to fault state when
- * applicable
+// times transition i of STATE_TRANSITIONS was taken
+uint32_t Application::get_transition_taken(uint8_t i) const {
+    return charge_machine.get_taken(i);
+}
+
+loop_stats Application::get_loop_stats() const {
+    return loop_events.get_stats();
+}
+
+// fault flags found by the last check_faults()
+bms_fault_type Application::get_bms_fault() const {
+    return bms_fault_reason;
+}
+
+charger_fault_type Application::get_charger_fault() const {
+    return charger_fault_reason;
+}
+
+/** @brief checks for faults and sets the fault reasons the state machine's
+ * fault guards act on
  */
 void Application::check_faults() {
     bms_fault_reason = bms.check_current_fault();
     charger_fault_reason = thunderstruck.check_current_fault();
+}
 
-    // check charger faults
-    if (charger_fault_reason != charger_fault_type::NONE) {
-        charge_status = charge_state ::FAULT_RESETTABLE;
-    }
-    // check bms faults
-    switch (bms_fault_reason) {
-        case bms_fault_type::NONE:
-            break;
-        case bms_fault_type::HV_KILL:
-        case bms_fault_type::BATTERY_UNDERVOLT:
-        case bms_fault_type::BMS_CAN_TIMEOUT:
-            charge_status = charge_state::FAULT_LATCHING;
-            break;
+/**
+ * @brief Any BMS fault that needs the car to clear it: HV kill, undervolt,
+ * CAN timeout, or several at once.
+ *
+ */
+bool Application::latching_fault() const {
+    return bms_fault_reason != bms_fault_type::NONE &&
+           bms_fault_reason != bms_fault_type::BATTERY_OVERVOLT &&
+           bms_fault_reason != bms_fault_type::CELL_OVERTEMP;
+}
 
-        case bms_fault_type::BATTERY_OVERVOLT:
-        case bms_fault_type::CELL_OVERTEMP:
-            charge_status = charge_state::FAULT_RESETTABLE;
-            break;
-        default:
-            charge_status = charge_state::FAULT_LATCHING;
-            break;
-    }
+// a fault that unplugging clears, and no latching one
+bool Application::resettable_fault() const {
+    return !latching_fault() &&
+           (bms_fault_reason != bms_fault_type::NONE ||
+            charger_fault_reason != charger_fault_type::NONE);
 }
-/**  @brief  updates state given the evse is connected to the car*/
-void Application::update_state_connected() {
-    switch (charge_status) {
-        case charge_state::IDLE:
-            // switch to connected state only when prox connected
-            charge_status = charge_state::CONNECTED;
-            break;
-        case charge_state::CONNECTED:
-            if (bms.get_max_cell_voltage() < CELL_CHARGE_TARGET_VOLTAGE &&
-                bms.get_max_cell_temp() < CHARGING_TEMP_LIMIT_FOR_BATTERY) {
-                // we think its safe to charge
-                if (bms.check_ready_to_charge()) {
-                    // wait for bms to respond that its ok
-                    charge_status = charge_state::THUNDERSTRUCK_POWER_ON;
-                }
-            }
-            break;
-        case charge_state::THUNDERSTRUCK_POWER_ON:
-            if (!bms.check_ready_to_charge()) {
-                // BMS doesn't want you to charge anymore,
-                // don't start
-                charge_status = charge_state::CONNECTED;
-            } else if (thunderstruck.coms_alive()) {
-                // thunderstruck on and bms still wants charging
-                charge_status = charge_state::CHARGING;
-            }
 
-            break;
-        case charge_state::CHARGING:
-            if (!bms.check_ready_to_charge()) {
-                // BMS doesn't want you to charge anymore, stop
-                charge_status = charge_state::CONNECTED;
-            } else if ((bms.get_battery_current() <=
-                            BATTERY_CURRENT_CHARGING_TARGET &&
-                        (BATTERY_VOLTAGE_CHARGING_TARGET -
-                             bms.get_pack_voltage() <=
-                         VOLTAGE_THRESHOLD))) {
-                charge_status = charge_state::CHARGING_DONE;
-            }
-            break;
-        case charge_state::FAULT_LATCHING:
-        case charge_state::FAULT_RESETTABLE:
-            // no transition out of fault when plugged in
-            break;
-        case charge_state::CHARGING_DONE:
-            break;
-        default:
-            charge_status = charge_state::FAULT_LATCHING;
-            break;
+// unplugged with every fault gone
+bool Application::faults_cleared() const {
+    return !prox_connected && bms_fault_reason == bms_fault_type::NONE &&
+           charger_fault_reason == charger_fault_type::NONE;
+}
+
+bool Application::plugged_in() const {
+    return prox_connected;
+}
+
+bool Application::unplugged() const {
+    return !prox_connected;
+}
+
+// we think its safe to charge, and the bms has responded that its ok
+bool Application::ready_to_charge() const {
+    return bms.get_max_cell_voltage() < CELL_VOLTAGE_CHARGING_TARGET &&
+           bms.get_max_cell_temp() < CELL_TEMP_CHARGING_LIMIT &&
+           bms.check_ready_to_charge();
+}
+
+// BMS doesn't want you to charge anymore
+bool Application::bms_not_ready() const {
+    return !bms.check_ready_to_charge();
+}
+
+// thunderstruck on and reporting
+bool Application::chargers_alive() const {
+    return thunderstruck.coms_alive();
+}
+
+bool Application::charge_complete() const {
+    return bms.get_battery_current() <= PACK_CURRENT_CHARGING_TARGET &&
+           PACK_VOLTAGE_CHARGING_TARGET - bms.get_pack_voltage() <=
+               VOLTAGE_THRESHOLD;
+}
+
+/** @brief asks the BMS for charging while the pack can take it */
+void Application::request_charging() {
+    if (bms.get_max_cell_voltage() < CELL_VOLTAGE_CHARGING_TARGET &&
+        bms.get_battery_capacity() < max_kWh &&
+        bms.get_max_cell_temp() < CELL_TEMP_CHARGING_LIMIT) {
+        bms.set_charging_request_true();
     }
 }
-/** @brief updates current state given the evse is not connected to the car*/
-void Application::update_state_disconnected() {
-    switch (charge_status) {
-        case charge_state::FAULT_LATCHING:
+
+/** @brief closes the AC to the chargers, capped at the pack's maximum */
+void Application::power_on_chargers() {
+    openEVSE.output_ac();
+    thunderstruck.set_charging_voltage_limit(
+        quantity_cast<deci_volts>(PACK_VOLTAGE_MAX));
+    status_lights.indicate_ac_connected();
+}
+
+/** @brief sets the limits of the thunderstrucks and sends the enable
+ * packet, the current regulator starting afresh */
+void Application::start_charging() {
+    current_regulator.reset(current_setpoint, find_current_limit());
+    command_current();
+    thunderstruck.set_charging_voltage_limit(
+        quantity_cast<deci_volts>(PACK_VOLTAGE_CHARGING_TARGET));
+    thunderstruck.enable_charging();
+}
+
+/** @brief passes the regulator's latest command to the chargers */
+void Application::command_current() {
+    thunderstruck.set_charging_current_limit(current_regulator.get_output());
+}
+
+/** @brief disables the chargers on the way out of CHARGING, which the
+ * states without isolation (CONNECTED) would otherwise leave running
+ */
+void Application::stop_charging() {
+    thunderstruck.disable_charging();
+}
+
+/** @brief starts HV isolation for a fault. Once in a fault state the state
+ * machine holds the chargers off itself, so the fast path trip is cleared.
+ */
+void Application::begin_fault_isolate() {
+    thunderstruck.clear_trip();
+    begin_HV_isolate();
+}
+
+/** @brief clears a trip taken while already resettable faulted, before
+ * anything can enable the chargers again */
+void Application::release_trip() {
+    thunderstruck.clear_trip();
+}
+
+/**
+ * @brief Start turning off all high voltage power. The sequence is advanced
+ * by HV_isolate() on each pass.
+ *
+ */
+void Application::begin_HV_isolate() {
+    isolation_status = isolation_state::DISABLE_REQUESTED;
+    isolation_wait = MAX_ISOLATE_WAIT;
+}
+
+/**
+ * @brief Start turning off all high voltage power after an unplug. The AC
+ * stays closed until the chargers report no current, for as long as they can
+ * take to slew down from full current, not the shorter fault wait.
+ *
+ */
+void Application::begin_unplug_isolate() {
+    begin_HV_isolate();
+    isolation_wait = MAX_UNPLUG_ISOLATE_WAIT;
+}
+
+/**
+ * @brief Advance HV isolation by one step without blocking the main loop.
+ *
+ */
+void Application::HV_isolate() {
+    switch (isolation_status) {
+        case isolation_state::DISABLE_REQUESTED:
+            thunderstruck.disable_charging();
+            isolation_started = HAL_GetTick();
+            isolation_status = isolation_state::WAITING_FOR_DECAY;
             break;
-        case charge_state::FAULT_RESETTABLE:
-            if ((bms_fault_reason == bms_fault_type::NONE) &&
-                (charger_fault_reason == charger_fault_type::NONE)) {
-                charge_status = charge_state::IDLE;
+        case isolation_state::WAITING_FOR_DECAY: {
+            // wait until the current drops below 10 mA to open contactors,
+            // or give up after the isolation's wait
+            const uint32_t waited = HAL_GetTick() - isolation_started;
+            if ((thunderstruck.get_charging_current() <= milli_amps(10)) ||
+                (waited > isolation_wait)) {
+                isolation_decay_time = waited;
+                isolation_status = isolation_state::CONTACTOR_OPEN;
             }
+        } break;
+        case isolation_state::CONTACTOR_OPEN:
+            openEVSE.isolate_interface();
+            bms.set_charging_request_false();
+            status_lights.indicate_ac_isolated();
+            isolation_status = isolation_state::DONE;
             break;
-        default:
-            charge_status = charge_state::IDLE;
+        case isolation_state::DONE:
             break;
     }
 }
-/** @brief performs the action for the current state*/
-void Application::state_action() {
-    // logic
-    switch (charge_status) {
-        case charge_state::CONNECTED:
-            if (bms.get_max_cell_voltage() < CELL_CHARGE_TARGET_VOLTAGE &&
-                bms.get_battery_capacity() < max_kWh &&
-                bms.get_max_cell_temp() < CHARGING_TEMP_LIMIT_FOR_BATTERY) {
-                bms.set_charging_request_true();
-            }
-            break;
-        case charge_state::THUNDERSTRUCK_POWER_ON:
-            openEVSE.output_ac();
-            thunderstruck.set_charging_voltage_limit(BATTERY_VOLTAGE_MAX);
-            status_lights.indicate_ac_connected();
-            break;
-        case charge_state::CHARGING:
-            enable_charge();
 
-            break;
-        case charge_state::FAULT_LATCHING:
-        case charge_state::FAULT_RESETTABLE:
-            // HV isolate for safety while in fault
-            status_lights.indicate_fault();
-            HV_isolate();
-            break;
-        case charge_state::IDLE:
-            HV_isolate();
-            break;
-        case charge_state::CHARGING_DONE:
-            HV_isolate();
-            break;
-        default:
-            HV_isolate();
-            break;
+/**
+ * @brief Time from the edge that began the last unplug to the chargers
+ * reporting no current.
+ *
+ * @return uint32_t milliseconds
+ */
+uint32_t Application::get_unplug_ramp_time() const {
+    return unplug_ramp_time;
+}
+
+const prox_stats& Application::get_prox_stats() const {
+    return openEVSE.get_prox_stats();
+}
+
+isolation_state Application::get_isolation_state() const {
+    return isolation_status;
+}
+
+/**
+ * @brief Time the last isolation waited for charger current to decay.
+ *
+ * @return uint32_t milliseconds, MAX_ISOLATE_WAIT (MAX_UNPLUG_ISOLATE_WAIT
+ * after an unplug) or more if it timed out
+ */
+uint32_t Application::get_isolation_decay_time() const {
+    return isolation_decay_time;
+}
+
+telemetry_stats Application::get_telemetry_stats() const {
+    return telemetry.get_stats();
+}
+
+const job_stats& Application::get_job_stats(scheduled_job job) const {
+    return scheduler.get_stats(static_cast<uint8_t>(job));
+}
+
+deadline_record Application::get_deadline_record() const {
+    return supervisor.get_record();
+}
+
+/**
+ * @brief Energy into the pack as the BMS measured it, Wh.
+ *
+ */
+float Application::get_pack_energy() const {
+    return bms.get_pack_energy();
+}
+
+/**
+ * @brief Energy out of all the chargers as they reported it, Wh.
+ *
+ */
+float Application::get_charger_output_energy() const {
+    return thunderstruck.get_output_energy();
+}
+
+ring_stats Application::get_bms_rx_stats() const {
+    return bms.get_rx_stats();
+}
+
+ring_stats Application::get_charger_rx_stats(uint8_t unit) const {
+    return thunderstruck.get_rx_stats(unit);
+}
+
+const control_tx_stats& Application::get_control_stats() const {
+    return thunderstruck.get_control_stats();
+}
+
+/**
+ * @brief Post the charge state and fault codes to the status lights. Only a
+ * change reaches the pattern engine.
+ *
+ */
+void Application::update_lights() {
+    status_lights.show(
+        status_light::STATE,
+        STATE_LIGHT_PATTERNS[static_cast<uint8_t>(charge_machine.get_state())]);
+    status_lights.show(
+        status_light::FAULT,
+        FAULT_LIGHT_PATTERNS[fault_number(static_cast<uint8_t>(
+            bms_fault_reason))][fault_number(static_cast<uint8_t>(
+            charger_fault_reason))]);
+}
+
+const light_stats& Application::get_light_stats() const {
+    return status_lights.get_stats();
+}
+
+// expiries and worst gap between frames of one link
+const comm_link_stats& Application::get_comm_link_stats(comm_link link) const {
+    return comm_timeouts.get_stats(link);
+}
+
+// run the TELEMETRY job rate times a second
+void Application::set_telemetry_rate(uint16_t rate) {
+    scheduler.request_period(static_cast<uint8_t>(scheduled_job::TELEMETRY),
+                             SCHEDULER_TICK_RATE / rate);
+}
+
+/**
+ * @brief Apply telemetry requests from CAN1, then either record a sample or
+ * move a running dump along. While a dump runs the TELEMETRY job paces it at
+ * TELEMETRY_DUMP_RATE.
+ *
+ */
+void Application::update_telemetry() {
+    const uint8_t rate = telemetry_rate_requested;
+    if (rate != 0) {
+        telemetry_rate_requested = 0;
+        telemetry_rate = rate;
+        if (!telemetry.dump_pending()) {
+            set_telemetry_rate(telemetry_rate);
+        }
+    }
+    if (telemetry_dump_requested) {
+        telemetry_dump_requested = false;
+        if (!telemetry.dump_pending()) {
+            telemetry.start_dump();
+            set_telemetry_rate(TELEMETRY_DUMP_RATE);
+        }
+    }
+
+    if (!telemetry.dump_pending()) {
+        record_telemetry();
+    } else if (!telemetry.send_dump(can_device, TELEMETRY_DUMP_KEEP_FREE)) {
+        set_telemetry_rate(telemetry_rate);
     }
 }
 
 /**
- * @brief Turn off all high voltage power.
+ * @brief Log the charger's state and measurements, in the resolution they
+ * are kept in.
  *
  */
-void Application::HV_isolate() {
-    thunderstruck.disable_charging();
-    const uint32_t timeout = HAL_GetTick() + MAX_ISOLATE_WAIT;
-    // either wait 500 ms or until the current drops below 10 mA to open
-    // contactors
-    while ((thunderstruck.get_charging_current() > 0.01) &&
-           (HAL_GetTick() <= timeout)) {
-        thunderstruck.receive_status_packet();
+void Application::record_telemetry() {
+    telemetry_sample sample;
+    sample[field_index(telemetry_field::CHARGE_STATE)] =
+        static_cast<int32_t>(charge_machine.get_state());
+    sample[field_index(telemetry_field::PILOT_DUTY)] =
+        openEVSE.get_pilot_duty();
+    sample[field_index(telemetry_field::PACK_VOLTAGE)] =
+        bms.get_pack_voltage().count();
+    sample[field_index(telemetry_field::BATTERY_CURRENT)] =
+        bms.get_battery_current().count();
+    sample[field_index(telemetry_field::CHARGER_TEMP)] =
+        thunderstruck.get_charger_temp().count();
+    for (uint8_t unit = 0; unit < NUMBER_CHARGERS; unit++) {
+        const charger_unit& u = thunderstruck.get_unit(unit);
+        sample[field_index(telemetry_field::CHARGER_VOLTAGE) + 2 * unit] =
+            u.charging_voltage.count();
+        sample[field_index(telemetry_field::CHARGER_CURRENT) + 2 * unit] =
+            u.charging_current.count();
     }
+    telemetry.record(sample, HAL_GetTick());
+}
 
-    openEVSE.isolate_interface();
-    bms.set_charging_request_false();
-    status_lights.indicate_ac_isolated();
+/**
+ * @brief Battery current to charge at, e.g. from the driver. Clamped to what
+ * the EVSE and chargers allow when it is used.
+ *
+ */
+void Application::set_current_setpoint(deci_amps setpoint) {
+    current_setpoint = setpoint;
 }
 
 /**
- * @brief Set limits of the thunderstrucks and send the enable packet.
+ * @brief Current the chargers were last asked for, all together.
  *
  */
-void Application::enable_charge() {
-    thunderstruck.set_charging_current_limit(find_current_limit());
-    thunderstruck.set_charging_voltage_limit(BATTERY_VOLTAGE_CHARGING_TARGET);
+deci_amps Application::get_current_command() const {
+    return current_regulator.get_output();
+}
 
-    thunderstruck.enable_charging();
+/**
+ * @brief Move the charger command toward the battery current setpoint by one
+ * control period, never past the EVSE and charger limits.
+ *
+ */
+void Application::regulate_current() {
+    current_regulator.update(current_setpoint,
+                             quantity_cast<deci_amps>(bms.get_battery_current()),
+                             find_current_limit(),
+                             thunderstruck.get_charging_current());
 }
 
 /**
  * @brief uses J1772 and battery limits to calculate a safe value of DC current
- * to provide to the battery from the AC input of the J1772
+ * to provide to the battery from the AC input of the J1772. This is the
+ * ceiling of the current regulator.
  *
- * @return float a safe current limit
+ * @return deci_amps a safe current limit for all chargers together
  */
-float Application::find_current_limit() {
+deci_amps Application::find_current_limit() {
     // check for current input from dashboard
     // check_user_defined_values();
 
     // check EVSE
-    const float charging_current_limit = openEVSE.get_j1772_current_limit();
-    const float max_ac_current =
+    const deci_amps charging_current_limit =
+        openEVSE.get_j1772_current_limit();
+    const deci_amps max_ac_current =
         std::min(charging_current_limit, MAX_AC_CURRENT);
 
-    const float ac_voltage = (max_ac_current <= AC_VOLTAGE_CHANGE_POINT)
+    const volts ac_voltage = (max_ac_current <= AC_VOLTAGE_CHANGE_POINT)
                                  ? AC_VOLTAGE_INPUT_1
                                  : AC_VOLTAGE_INPUT_2;
 
     // check user_defined_values() are commented out
     // reason: not yet functional
 
-    // check battery voltage
-    const float bat_max_cell_voltage = bms.get_max_cell_voltage();
-
     // if (user_defined_current < 40) {
     //     // if the user defines a reasonable current, let that override the
     //     // current measurement
@@ -261,40 +793,91 @@ float Application::find_current_limit() {
     // min of max available dc charge and linear decrease as we get to full
     // charge
 
-    float pack_voltage = bms.get_pack_voltage();
+    const centi_volts pack_voltage = bms.get_pack_voltage();
+    const deci_amps charger_limit = CURRENT_MIN_VAL * NUMBER_CHARGERS;
+    if (pack_voltage <= centi_volts(0)) {
+        return charger_limit;
+    }
 
-    return std::min((CHARGER_EFFICIENCY * ac_voltage * max_ac_current) /
-                        (pack_voltage * NUMBER_CHARGERS),
-                    CURRENT_MIN_VAL);
+    // efficiency * V_ac * I_ac / V_pack. With the efficiency in percent and
+    // the pack in centi-volts the two factors of 100 cancel, leaving the
+    // deci-amps of the AC current.
+    static_assert(CHARGER_EFFICIENCY_PERCENT * AC_VOLTAGE_INPUT_2.count() *
+                      MAX_AC_CURRENT.count() <
+                  INT32_MAX);
+    const deci_amps dc_current(CHARGER_EFFICIENCY_PERCENT * ac_voltage.count() *
+                               max_ac_current.count() / pack_voltage.count());
+    return std::min(dc_current, charger_limit);
 }
 
-TIM_HandleTypeDef* Application::get_pwm_handle() {
-    return openEVSE.get_pwm_timer_handle();
+
+/**
+ * @brief Scheduler tick interrupt, runs the periodic jobs that are due. It
+ * also keeps the main loop to its hard deadline: a pass that runs over trips
+ * the chargers from here, and they stay disabled until the AC is opened and
+ * the core reset.
+ *
+ */
+void Application::scheduler_tick() {
+    switch (supervisor.tick()) {
+        case deadline_action::ISOLATE:
+            thunderstruck.trip();
+            bms.set_charging_request_false();
+            bms.can_send_charging_request_status();
+            status_lights.indicate_fault();
+            break;
+        case deadline_action::HOLD:
+            // the late pass may still get as far as requesting charging again
+            bms.set_charging_request_false();
+            break;
+        case deadline_action::RESET:
+            openEVSE.isolate_interface();
+            supervisor.reset();
+            break;  // not reached, reset() doesn't return
+        case deadline_action::NONE:
+            break;
+    }
+    scheduler.tick();
 }
 
 /**
- * @brief Send all outgoing messages on the charger CAN Network.
+ * @brief Send the next charger its control packet. A round of every unit is
+ * one control period.
  *
  */
-void Application::broadcast_charger_can() {
-    status_lights.toggle_charger_can_light();
-    thunderstruck.send_control_packet();
+void Application::send_charger_control() {
+    if (next_control_unit == 0) {
+        loop_events.post(loop_event::CHARGER_TICK);
+        status_lights.toggle_charger_can_light();
+    }
+    thunderstruck.send_control_packet(next_control_unit);
+    next_control_unit = (next_control_unit + 1) % NUMBER_CHARGERS;
 }
 
-void Application::pwm_measure() {
-    openEVSE.measure_control_pilot_duty();
+/**
+ * @brief Send a changed control packet to the chargers that haven't had it.
+ *
+ */
+void Application::send_control_updates() {
+    thunderstruck.send_control_updates();
 }
 
 /**
- * @brief Send all outgoing CAN messages to the car on a timer.
+ * @brief Send the contactor request to the BMS.
  *
  */
-void Application::broadcast_car_can() {
-    status_lights.toggle_car_can_light();
-    // send contactor request
+void Application::send_bms_request() {
     bms.can_send_charging_request_status();
+}
+
+/**
+ * @brief Send the charger's state and faults to the car.
+ *
+ */
+void Application::send_charger_state() {
+    loop_events.post(loop_event::CAR_TICK);
+    status_lights.toggle_car_can_light();
 
-    // send state message
 
     skylab2::can_packet_charger_state state_msg = {0};
     switch (charger_fault_reason) {
@@ -341,13 +924,13 @@ void Application::broadcast_car_can() {
     }
 
     state_msg.charging_current =
-        thunderstruck.get_charging_current() * NUMBER_CHARGERS;
+        thunderstruck.get_charging_current().to_float();
 
     state_msg.state_flags.charger_plugged = openEVSE.check_prox_connected();
 
-    // conversion of 0.001
+    // conversion of 0.001, hottest charger
     state_msg.charger_max_temp =
-        static_cast<uint16_t>(thunderstruck.get_charger_temp() * 1000);
+        static_cast<uint16_t>(thunderstruck.get_charger_temp().count() * 1000);
 
     skylab2.send_charger_state(state_msg);
 }
@@ -365,20 +948,171 @@ void Application::broadcast_car_can() {
 
 // skylab necessary functions
 
+/**
+ * @brief CAN1 FIFO0 interrupt. BMS packets go straight to the Bms, which
+ * marks them for decoding in the main loop. The filters keep other car bus
+ * traffic out of the FIFO.
+ *
+ */
 void Application::can1_rx_callback(void) {
-    skylab2.main_bus_rx_handler();
+    can::packet p;
+    if (can_device.receive(p, can::fifo::FIFO0) != can::status::OK) {
+        return;
+    }
+    if (bms.receive(p)) {
+        // a kill or overvolt stops the chargers from here rather than after
+        // the main loop and the next control frame
+        if (bms.get_urgent_fault() != bms_fault_type::NONE) {
+            thunderstruck.trip();
+        }
+        loop_events.post(loop_event::CAR_RX);
+    }
 }
 
 void Application::can1_tx_callback(void) {
     skylab2.main_bus_tx_handler();
 }
 
+/**
+ * @brief Route telemetry and profile requests on CAN1 to FIFO1, away from
+ * the BMS packets in FIFO0.
+ *
+ */
+void Application::init_diagnostic_requests() {
+    can_filters::configure(can_device.get_handle(), DIAGNOSTIC_FILTERS);
+    HAL_CAN_ActivateNotification(can_device.get_handle(),
+                                 CAN_IT_RX_FIFO1_MSG_PENDING);
+    HAL_NVIC_SetPriority(CAN1_RX1_IRQn, 7, 0);
+    HAL_NVIC_EnableIRQ(CAN1_RX1_IRQn);
+}
+
+/**
+ * @brief CAN1 FIFO1 interrupt. Hands each request to its handler by ID.
+ *
+ */
+void Application::can1_rx1_callback(void) {
+    can::packet request;
+    if (can_device.receive(request, can::fifo::FIFO1) != can::status::OK ||
+        request.get_length() < 1) {
+        return;
+    }
+    switch (request.get_id()) {
+        case TELEMETRY_REQUEST_ID:
+            telemetry_request(request);
+            break;
+        case DEADLINE_REQUEST_ID:
+            deadline_request(request);
+            break;
+#ifdef CHARGER_PROFILE
+        case PROFILE_REQUEST_ID:
+            profile_request(request);
+            break;
+#endif
+        default:
+            break;
+    }
+}
+
+/**
+ * @brief Byte 0 of the request is a telemetry_command. The main loop acts on
+ * it, since the log is only touched from there.
+ *
+ */
+void Application::telemetry_request(const can::packet& request) {
+    switch (static_cast<telemetry_command>(request.get_data()[0])) {
+        case telemetry_command::DUMP:
+            telemetry_dump_requested = true;
+            break;
+        case telemetry_command::SET_RATE: {
+            const uint8_t rate =
+                request.get_length() >= 2 ? request.get_data()[1] : 0;
+            if (rate == 0 || rate > TELEMETRY_RATE_MAX) {
+                return;
+            }
+            telemetry_rate_requested = rate;
+        } break;
+        default:
+            return;
+    }
+    loop_events.post(loop_event::TELEMETRY);
+}
+
+/**
+ * @brief Handle a deadline_command from CAN1. Called from the CAN1 RX1
+ * interrupt; the main loop clears the statistics and sends the report.
+ *
+ */
+void Application::deadline_request(const can::packet& request) {
+    switch (static_cast<deadline_command>(request.get_data()[0])) {
+        case deadline_command::REPORT:
+            deadline_report_next = 0;
+            deadline_report_end = 2;
+            break;
+        case deadline_command::CLEAR:
+            deadline_clear_requested = true;
+            break;
+        default:
+            return;
+    }
+    loop_events.post(loop_event::DEADLINE);
+}
+
+/**
+ * @brief Send the deadline report frames that are left. One that finds no
+ * free mailbox is tried again on the next pass.
+ *
+ */
+void Application::send_deadline_report() {
+    uint8_t index = deadline_report_next;
+    while (index < deadline_report_end &&
+           can_device.send(supervisor.report(index)) == can::status::OK) {
+        index++;
+    }
+    deadline_report_next = index;
+}
+
+#ifdef CHARGER_PROFILE
+/**
+ * @brief Byte 0 of the request is the profile_point to report, or
+ * PROFILE_REQUEST_ALL.
+ *
+ */
+void Application::profile_request(const can::packet& request) {
+    const uint8_t point = request.get_data()[0];
+    if (point == PROFILE_REQUEST_ALL) {
+        profile_report_next = 0;
+        profile_report_end = static_cast<uint8_t>(profile_point::COUNT);
+    } else if (point < static_cast<uint8_t>(profile_point::COUNT)) {
+        profile_report_next = point;
+        profile_report_end = point + 1;
+    }
+    loop_events.post(loop_event::PROFILE);
+}
+
+/**
+ * @brief Send the next requested profile summary. One frame per pass, so the
+ * scheduled car bus frames still find a free mailbox.
+ *
+ */
+void Application::send_profile_report() {
+    const uint8_t point = profile_report_next;
+    if (point >= profile_report_end) {
+        return;
+    }
+    if (can_device.send(profiler::summary(static_cast<profile_point>(
+            point))) == can::status::OK) {
+        profile_report_next = point + 1;
+    }
+}
+#endif
+
 CAN_HandleTypeDef* Application::get_can1_handle() {
     return can_device.get_handle();
 }
 
 void Application::can2_rx_callback(void) {
     thunderstruck.receive_callback();
+    loop_events.post(loop_event::CHARGER_RX);
 }
 
 void Application::can2_tx_callback(void) {
@@ -388,5 +1122,46 @@ CAN_HandleTypeDef* Application::get_can2_handle() {
     return thunderstruck.get_can_handle();
 }
 
+/**
+ * @brief A proximity pin edge. An edge towards unplugged while plugged in
+ * holds the charger current at zero at once; the state machine only sees the
+ * unplug once the pin has settled, and opens the AC after that.
+ *
+ */
+void Application::prox_callback(void) {
+    if (!openEVSE.prox_edge(HAL_GetTick()) &&
+        openEVSE.check_prox_connected()) {
+        thunderstruck.hold_current();
+    }
+}
+
+void Application::telemetry_tick(void) {
+    loop_events.post(loop_event::TELEMETRY);
+}
+
+void Application::step_lights(void) {
+    status_lights.step();
+}
+
+/**
+ * @brief Settle the proximity pin. Once it has settled plugged in, whether
+ * after a plug in or a glitch, the charger current is let through again.
+ * Only a change wakes the main loop.
+ *
+ */
+void Application::debounce_prox(void) {
+    __disable_irq();
+    const bool was_connected = openEVSE.check_prox_connected();
+    const bool settled = openEVSE.debounce_prox(HAL_GetTick());
+    const bool connected = openEVSE.check_prox_connected();
+    if (settled && connected) {
+        thunderstruck.release_current();
+    }
+    __enable_irq();
+    if (connected != was_connected) {
+        loop_events.post(loop_event::PROX);
+    }
+}
+
 }  // namespace charger
 }  // namespace umnsvp
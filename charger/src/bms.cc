@@ -1,9 +1,80 @@
 #include "bms.h"
 
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <iterator>
+
 namespace umnsvp {
 namespace charger {
 
-Bms::Bms(skylab2::charger_can &skylab2) : skylab2(skylab2) {
+namespace {
+// largest ID lookup table receive() may use
+constexpr uint32_t MAX_ID_SLOTS = 64;
+constexpr uint8_t NOT_BMS = 0xFF;
+
+// true if two BMS IDs land in the same slot of a table of this size
+constexpr bool ids_collide(uint32_t slots) {
+    for (size_t i = 0; i < Bms::RX_IDS.size(); i++) {
+        for (size_t j = i + 1; j < Bms::RX_IDS.size(); j++) {
+            if (static_cast<uint32_t>(Bms::RX_IDS[i]) % slots ==
+                static_cast<uint32_t>(Bms::RX_IDS[j]) % slots) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+// the smallest table that gives each BMS ID a slot of its own, whatever the
+// IDs are, or 0 if none up to MAX_ID_SLOTS does
+constexpr uint32_t id_slots() {
+    for (uint32_t slots = Bms::RX_IDS.size(); slots <= MAX_ID_SLOTS;
+         slots++) {
+        if (!ids_collide(slots)) {
+            return slots;
+        }
+    }
+    return 0;
+}
+
+constexpr uint32_t ID_SLOTS = id_slots();
+static_assert(ID_SLOTS != 0, "BMS IDs don't fit a lookup table");
+
+// bms_packet for each slot, ID % ID_SLOTS, NOT_BMS for the empty ones
+constexpr std::array<uint8_t, ID_SLOTS> make_packet_for_slot() {
+    std::array<uint8_t, ID_SLOTS> table = {};
+    for (uint8_t &entry : table) {
+        entry = NOT_BMS;
+    }
+    for (uint8_t i = 0; i < Bms::RX_IDS.size(); i++) {
+        table[static_cast<uint32_t>(Bms::RX_IDS[i]) % ID_SLOTS] = i;
+    }
+    return table;
+}
+constexpr std::array<uint8_t, ID_SLOTS> PACKET_FOR_SLOT =
+    make_packet_for_slot();
+
+// links that must all be alive for BMS comms to be
+constexpr std::array<comm_link, 4> BMS_LINKS = {
+    comm_link::BMS_MEASUREMENT, comm_link::BMS_BATTERY_STATUS,
+    comm_link::BMS_MIN_MAX, comm_link::BMS_CHARGER_RESPONSE};
+
+constexpr uint32_t bms_link_mask() {
+    uint32_t mask = 0;
+    for (comm_link link : BMS_LINKS) {
+        mask |= link_bit(link);
+    }
+    return mask;
+}
+constexpr uint32_t BMS_LINK_MASK = bms_link_mask();
+}  // namespace
+
+Bms::Bms(skylab2::charger_can &skylab2, CommTimeouts &timeouts)
+    : skylab2(skylab2), timeouts(timeouts) {
+    for (comm_link link : BMS_LINKS) {
+        timeouts.track(link, TIMEOUT);
+    }
 }
 
 void Bms::set_charging_request_true() {
@@ -24,15 +95,15 @@ void Bms::can_send_charging_request_status(void) {
     skylab2.send_charger_bms_request(msg);
 }
 
-float Bms::get_max_cell_voltage() const {
+milli_volts Bms::get_max_cell_voltage() const {
     return max_cell_voltage;
 }
 
-float Bms::get_max_cell_temp() const {
+centi_celsius Bms::get_max_cell_temp() const {
     return max_cell_temp;
 }
 
-float Bms::get_pack_voltage() const {
+centi_volts Bms::get_pack_voltage() const {
     return pack_voltage;
 }
 
@@ -40,7 +111,7 @@ bool Bms::check_battery_killed() {
     return killed;
 }
 
-bool Bms::check_ready_to_charge() {
+bool Bms::check_ready_to_charge() const {
     return charging_ready;
 }
 
@@ -48,31 +119,55 @@ float Bms::get_battery_capacity() const {
     return current_battery_pack_capacity;
 }
 
-float Bms::get_battery_current() const {
+milli_amps Bms::get_battery_current() const {
     return battery_current;
 }
 
+/**
+ * @brief Energy the BMS measured going into the pack since power up,
+ * negative if more came out.
+ *
+ * @return float Wh
+ */
+float Bms::get_pack_energy() const {
+    return pack_energy / PACK_ENERGY_PER_WH;
+}
+
+// counters of the MEASUREMENT queue
+ring_stats Bms::get_rx_stats() const {
+    return charger::get_rx_stats(measurement_rx);
+}
+
 /**
  * @brief Check for any faults from BMS.
  *
  * @return bms_fault_type Fault received from BMS.
  */
 bms_fault_type Bms::check_current_fault() {
+    // a fault the RX interrupt already acted on is reported once, even if a
+    // newer frame has cleared it since
+    __disable_irq();
+    const bms_fault_type urgent = urgent_fault;
+    urgent_fault = bms_fault_type::NONE;
+    __enable_irq();
+    if (urgent != bms_fault_type::NONE) {
+        return urgent;
+    }
+
     // fault handling
     if (check_battery_killed()) {  // killed
         return bms_fault_type::HV_KILL;
     }
 
-    if (get_pack_voltage() <= BATTERY_VOLTAGE_MIN) {  // undervolt
+    if (get_pack_voltage() <= PACK_VOLTAGE_MIN) {  // undervolt
         return bms_fault_type::BATTERY_UNDERVOLT;
     }
 
-    if (get_pack_voltage() >= BATTERY_VOLTAGE_MAX) {  // overvolt
+    if (get_pack_voltage() >= PACK_VOLTAGE_MAX) {  // overvolt
         return bms_fault_type::BATTERY_OVERVOLT;
     }
 
-    if (get_max_cell_temp() >=
-        CHARGING_TEMP_LIMIT_FOR_BATTERY) {  // cell overtemp
+    if (get_max_cell_temp() >= CELL_TEMP_CHARGING_LIMIT) {  // cell overtemp
         return bms_fault_type::CELL_OVERTEMP;
     }
 
@@ -84,68 +179,164 @@ bms_fault_type Bms::check_current_fault() {
 }
 
 /**
- * @brief Probe all CAN values coming from BMS.
+ * @brief Keep a frame from the car bus if it is a BMS packet. Called from
+ * the CAN1 RX interrupt; only copies the frame and marks it dirty, or
+ * queues it for MEASUREMENT. A kill or a pack overvolt is also flagged for
+ * get_urgent_fault() here, so the chargers can be stopped before the main
+ * loop decodes the frame.
  *
+ * @param p The received frame.
+ * @return true If the frame was a BMS packet.
  */
-void Bms::update_can_values() {
-    // mod min max
-    if (skylab2.bms_module_min_max_buffer.pop()) {
-        skylab2::can_packet_bms_module_min_max msg =
-            skylab2.bms_module_min_max_buffer.output();
-        max_cell_voltage = msg.module_max_voltage * CELL_VOLTAGE_CONVERSION;
-        max_cell_temp = msg.module_max_temp * CELL_TEMP_CONVERSION;
-        received_min_max = HAL_GetTick();
+bool Bms::receive(const can::packet &p) {
+    const uint32_t id = p.get_id();
+    const uint8_t packet = PACKET_FOR_SLOT[id % ID_SLOTS];
+    // another ID may share the slot
+    if (p.is_extended() || packet == NOT_BMS ||
+        static_cast<uint32_t>(RX_IDS[packet]) != id) {
+        return false;
+    }
+    const uint8_t *data = p.get_data();
+    if (urgent_fault == bms_fault_type::NONE) {
+        if (packet == static_cast<uint8_t>(bms_packet::BATTERY_STATUS) &&
+            skylab2::unpack<skylab2::can_packet_battery_status>(data)
+                .battery_state.killed) {
+            urgent_fault = bms_fault_type::HV_KILL;
+        } else if (packet == static_cast<uint8_t>(bms_packet::MEASUREMENT) &&
+                   centi_volts(
+                       skylab2::unpack<skylab2::can_packet_bms_measurement>(
+                           data)
+                           .battery_voltage) >= PACK_VOLTAGE_MAX) {
+            urgent_fault = bms_fault_type::BATTERY_OVERVOLT;
+        }
+    }
+    bms_rx_frame frame;
+    std::memcpy(frame.data, data, sizeof(frame.data));
+    frame.tick = HAL_GetTick();
+    if (packet == static_cast<uint8_t>(bms_packet::MEASUREMENT)) {
+        measurement_rx.push(frame);
+        return true;
     }
+    rx_frames[packet] = frame;
+    dirty = dirty | (0b1 << packet);
+    return true;
+}
 
-    // ready to charge
-    if (skylab2.bms_charger_response_buffer.pop()) {
-        skylab2::can_packet_bms_charger_response msg =
-            skylab2.bms_charger_response_buffer.output();
-        charging_ready = msg.response_flags.charging_ready == 1;
-        received_charging_ready = HAL_GetTick();
+/**
+ * @brief Fault flagged by receive() that check_current_fault() hasn't
+ * reported yet.
+ *
+ */
+bms_fault_type Bms::get_urgent_fault() const {
+    return urgent_fault;
+}
+
+/**
+ * @brief Decode the BMS packets that arrived since the last call.
+ *
+ */
+void Bms::update_can_values() {
+    while (measurement_rx.pop()) {
+        const bms_rx_frame &frame = measurement_rx.output();
+        decode_measurement(frame.data, frame.tick);
+    }
+    if (dirty == 0) {
+        return;
     }
 
-    // battery killed
-    if (skylab2.battery_status_buffer.pop()) {
-        skylab2::can_packet_battery_status msg =
-            skylab2.battery_status_buffer.output();
-        killed = msg.battery_state.killed;
-        received_killed = HAL_GetTick();
+    // take the new frames with the RX interrupt masked so none is half
+    // written, then decode outside the critical section
+    bms_rx_frame frames[static_cast<uint8_t>(bms_packet::COUNT)];
+    __disable_irq();
+    const uint32_t pending = dirty;
+    dirty = 0;
+    for (uint32_t copy = pending; copy != 0; copy &= copy - 1) {
+        const uint8_t packet = __builtin_ctz(copy);
+        frames[packet] = rx_frames[packet];
     }
+    __enable_irq();
 
-    // pack voltage
-    if (skylab2.bms_measurement_buffer.pop()) {
-        skylab2::can_packet_bms_measurement msg =
-            skylab2.bms_measurement_buffer.output();
-        pack_voltage = msg.battery_voltage * PACK_VOLTAGE_CONVERSION;
-        battery_current = msg.current;
-        received_pack_voltage = HAL_GetTick();
+    for (uint32_t decode = pending; decode != 0; decode &= decode - 1) {
+        const uint8_t packet = __builtin_ctz(decode);
+        const bms_rx_frame &frame = frames[packet];
+        switch (static_cast<bms_packet>(packet)) {
+            case bms_packet::BATTERY_STATUS:
+                decode_battery_status(frame.data, frame.tick);
+                break;
+            case bms_packet::MODULE_MIN_MAX:
+                decode_module_min_max(frame.data, frame.tick);
+                break;
+            case bms_packet::CAPACITY:
+                decode_capacity(frame.data);
+                break;
+            case bms_packet::CHARGER_RESPONSE:
+                decode_charger_response(frame.data, frame.tick);
+                break;
+            case bms_packet::MEASUREMENT:  // queued, never dirty
+            case bms_packet::COUNT:
+                break;
+        }
     }
+}
 
-    // battery capacity
-    if (skylab2.bms_capacity_buffer.pop()) {
-        skylab2::can_packet_bms_capacity msg =
-            skylab2.bms_capacity_buffer.output();
-        current_battery_pack_capacity = msg.Wh / 1000;
+// pack voltage and current, stamped with the tick the frame arrived at. The
+// last measurement is held until this one for the energy count.
+void Bms::decode_measurement(const uint8_t *data, uint32_t tick) {
+    if (timeouts.heard(comm_link::BMS_MEASUREMENT)) {
+        const uint32_t dt =
+            tick - timeouts.last_frame(comm_link::BMS_MEASUREMENT);
+        if (dt < TIMEOUT) {
+            pack_energy += static_cast<int64_t>(pack_voltage.count()) *
+                           battery_current.count() * dt;
+        }
     }
+    const skylab2::can_packet_bms_measurement msg =
+        skylab2::unpack<skylab2::can_packet_bms_measurement>(data);
+    pack_voltage = centi_volts(msg.battery_voltage);
+    // the only scaled value the BMS sends as a float
+    battery_current = milli_amps::from(msg.current);
+    timeouts.refresh(comm_link::BMS_MEASUREMENT, tick);
+}
+
+// battery killed
+void Bms::decode_battery_status(const uint8_t *data, uint32_t tick) {
+    killed = skylab2::unpack<skylab2::can_packet_battery_status>(data)
+                 .battery_state.killed;
+    timeouts.refresh(comm_link::BMS_BATTERY_STATUS, tick);
+}
+
+// mod min max
+void Bms::decode_module_min_max(const uint8_t *data, uint32_t tick) {
+    const skylab2::can_packet_bms_module_min_max msg =
+        skylab2::unpack<skylab2::can_packet_bms_module_min_max>(data);
+    max_cell_temp = centi_celsius(msg.module_max_temp);
+    max_cell_voltage = milli_volts(msg.module_max_voltage);
+    timeouts.refresh(comm_link::BMS_MIN_MAX, tick);
+}
+
+// battery capacity, not a tracked link
+void Bms::decode_capacity(const uint8_t *data) {
+    current_battery_pack_capacity =
+        skylab2::unpack<skylab2::can_packet_bms_capacity>(data).Wh / 1000;
+}
+
+// ready to charge
+void Bms::decode_charger_response(const uint8_t *data, uint32_t tick) {
+    charging_ready =
+        skylab2::unpack<skylab2::can_packet_bms_charger_response>(data)
+            .response_flags.charging_ready == 1;
+    timeouts.refresh(comm_link::BMS_CHARGER_RESPONSE, tick);
 }
 
 /**
- * @brief Confirm that communication with BMS is still active.
+ * @brief Confirm that communication with BMS is still active, as of the last
+ * CommTimeouts::poll().
  *
- * @return true If we've recently received communication.
+ * @return true If every tracked packet has been received within TIMEOUT.
  * @return false otherwise.
  */
 bool Bms::check_comms_alive() {
-    if (received_min_max.has_value() && received_charging_ready.has_value() &&
-        received_killed.has_value() && received_pack_voltage.has_value()) {
-        uint32_t tick = HAL_GetTick();
-        return (((tick - received_min_max.value()) < TIMEOUT) &&
-                ((tick - received_charging_ready.value()) < TIMEOUT) &&
-                ((tick - received_killed.value()) < TIMEOUT) &&
-                ((tick - received_pack_voltage.value()) < TIMEOUT));
-    }
-    return false;
+    return timeouts.all_alive(BMS_LINK_MASK);
 }
 
 }  // namespace charger
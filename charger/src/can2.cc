@@ -3,51 +3,174 @@
 namespace umnsvp {
 namespace charger {
 
+namespace {
+constexpr auto RX_FILTERS = can_filters::id_list(
+    CAN2Device::RX_IDS, true, CAN_FILTER_FIFO1, can_filters::CAN2_FIRST_BANK);
+static_assert(can_filters::CAN2_FIRST_BANK + RX_FILTERS.size() <=
+              can_filters::NUM_BANKS);
+}  // namespace
+
 CAN2Device::CAN2Device() : can_device(CAN2) {
 }
 
 void CAN2Device::start() {
     can_device.init(can::baud_rate::BAUD_RATE_250, true);
     can_device.start();
-    can_device.filter_all();
+    can_filters::configure(get_handle(), RX_FILTERS);
+    HAL_NVIC_SetPriority(CAN2_TX_IRQn, 5, 5);
+    HAL_NVIC_EnableIRQ(CAN2_TX_IRQn);
 }
 
+/**
+ * @brief TX mailbox empty interrupt. Refill the mailboxes from the queue and
+ * stop the interrupt once the queue is empty.
+ *
+ */
 void CAN2Device::tx_handler() {
-    // this function may be blocking until the queue is cleared
-    if (tx_buffer.peek()) {  // peek don't pop in case sending fails again
-        can::status result = can_device.send(tx_buffer.output());
-        if (result == can::status::OK) {
+    __HAL_CAN_CLEAR_FLAG(get_handle(), CAN_FLAG_RQCP0);
+    __HAL_CAN_CLEAR_FLAG(get_handle(), CAN_FLAG_RQCP1);
+    __HAL_CAN_CLEAR_FLAG(get_handle(), CAN_FLAG_RQCP2);
+    // masked like enqueue(): the CAN1 RX fault path sends control frames and
+    // can preempt this interrupt, and a drain it started inside this one
+    // would send a frame this drain then resets
+    const uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    drain_tx();
+    if (!tx_pending()) {
+        __HAL_CAN_DISABLE_IT(get_handle(), CAN_IT_TX_MAILBOX_EMPTY);
+    }
+    if (primask == 0) {
+        __enable_irq();
+    }
+}
+
+/**
+ * @brief Find the next charger with a control frame waiting, starting after
+ * the one sent last so every unit gets its turn.
+ *
+ * @return std::optional<uint8_t> unit index, nullopt if none are waiting
+ */
+std::optional<uint8_t> CAN2Device::next_pending_control() {
+    for (uint8_t i = 0; i < NUMBER_CHARGERS; i++) {
+        const uint8_t unit = (next_control + i) % NUMBER_CHARGERS;
+        if (pending_control[unit].has_value()) {
+            return unit;
+        }
+    }
+    return std::nullopt;
+}
+
+/**
+ * @brief Move queued frames into free mailboxes until the queue is empty or
+ * the mailboxes are full. Pending control frames go first, but never twice
+ * in a row while other frames wait, so a saturated bus can't starve the
+ * queue.
+ *
+ */
+void CAN2Device::drain_tx() {
+    while (true) {
+        const bool queued = tx_buffer.peek();
+        const std::optional<uint8_t> unit = next_pending_control();
+        if (unit.has_value() && !(control_sent_last && queued)) {
+            std::optional<can::packet>& control = pending_control[unit.value()];
+            if (can_device.send(control.value()) != can::status::OK) {
+                tx_stats.retried++;
+                return;
+            }
+            control.reset();
+            next_control = (unit.value() + 1) % NUMBER_CHARGERS;
+            control_sent_last = true;
+        } else if (queued) {  // peek don't pop in case sending fails
+            if (can_device.send(tx_buffer.output()) != can::status::OK) {
+                tx_stats.retried++;
+                return;
+            }
             tx_buffer.pop();  // if we were successful it's okay to pop now
+            control_sent_last = false;
+        } else {
+            return;
         }
+    }
+}
+
+bool CAN2Device::tx_pending() {
+    return next_pending_control().has_value() || tx_buffer.peek();
+}
+
+/**
+ * @brief Queue a frame and start transmitting it if a mailbox is free. The
+ * rest of the queue is sent from the TX mailbox empty interrupt.
+ *
+ * @param p The frame to send.
+ * @param control_unit For control frames, the charger it is addressed to;
+ * replaces that charger's control frame already waiting, if any.
+ * @return can::status ERROR if the queue was full and the frame dropped.
+ */
+can::status CAN2Device::enqueue(const can::packet& p,
+                                std::optional<uint8_t> control_unit) {
+    can::status result = can::status::OK;
+
+    // keep the TX interrupt from draining the queue while we change it, and
+    // the scheduler tick and the CAN1 RX fault path, which both send control
+    // frames, from preempting each other
+    const uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    if (control_unit.has_value()) {
+        std::optional<can::packet>& control =
+            pending_control[control_unit.value()];
+        if (control.has_value()) {
+            tx_stats.coalesced++;
+        }
+        control = p;
+        tx_stats.enqueued++;
+    } else if (tx_buffer.push(p)) {
+        tx_stats.enqueued++;
     } else {
-        __HAL_CAN_DISABLE_IT(get_handle(), 0x01);
+        tx_stats.dropped++;
+        result = can::status::ERROR;
+    }
+    drain_tx();
+    if (tx_pending()) {
+        __HAL_CAN_ENABLE_IT(get_handle(), CAN_IT_TX_MAILBOX_EMPTY);
+    }
+    if (primask == 0) {
+        __enable_irq();
     }
+
+    return result;
+}
+
+const tx_queue_stats& CAN2Device::get_tx_stats() const {
+    return tx_stats;
 }
 
 /**
- * @brief Send control message.
+ * @brief Send control message to one charger.
  *
  * @param msg The message to send.
+ * @param unit Index of the charger it is for.
  * @return can::bxcan_driver::status
  */
 can::status CAN2Device::send_thunderstruck_control_message(
-    skylab2::can_packet_thunderstruck_control_message msg) {
-    uint8_t data[8];
-    data[0] = msg.Enable >> 0;
-    data[1] = msg.CHARGE_VOLTAGE >> 0;
-    data[2] = msg.CHARGE_VOLTAGE >> 8;
-    data[3] = msg.CHARGE_CURRENT >> 0;
-    data[4] = msg.CHARGE_CURRENT >> 8;
-    data[5] = msg.LED_BLINK_PATTERN >> 0;
-    data[6] = msg.RESERVED >> 0;
-    data[7] = msg.RESERVED >> 8;
-    // TODO: use ID enum and length constexpr instead of hardcoding values
-    umnsvp::can::packet p = can::packet(
-        ((uint32_t)
-             skylab2::CANPacketId::CAN_PACKET_THUNDERSTRUCK_CONTROL_MESSAGE),
-        ((uint8_t)skylab2::CAN_LENGTH_THUNDERSTRUCK_CONTROL_MESSAGE), data,
-        true);
-    return can_device.send(p);
+    skylab2::can_packet_thunderstruck_control_message msg, uint8_t unit) {
+    return enqueue(thunderstruck_frames::control::to_packet(
+                       msg, thunderstruck_frames::control_id(unit)),
+                   unit);
+}
+
+/**
+ * @brief Send an already packed control message to one charger.
+ *
+ * @param payload thunderstruck_frames::control::length bytes.
+ * @param unit Index of the charger it is for.
+ * @return can::bxcan_driver::status
+ */
+can::status CAN2Device::send_thunderstruck_control_frame(const uint8_t* payload,
+                                                         uint8_t unit) {
+    return enqueue(can::packet(thunderstruck_frames::control_id(unit),
+                               thunderstruck_frames::control::length, payload,
+                               thunderstruck_frames::control::extended),
+                   unit);
 }
 
 /**
@@ -58,22 +181,7 @@ can::status CAN2Device::send_thunderstruck_control_message(
  */
 can::status CAN2Device::send_thunderstruck_status_message(
     skylab2::can_packet_thunderstruck_status_message msg) {
-    uint8_t data[8];
-    data[0] = msg.STATUS_FLAGS >> 0;
-    data[1] = msg.CHARGE_FLAGS >> 0;
-    data[2] = msg.OUTPUT_VOLTAGE >> 0;
-    data[3] = msg.OUTPUT_VOLTAGE >> 8;
-    data[4] = msg.OUTPUT_CURRENT >> 0;
-    data[5] = msg.OUTPUT_CURRENT >> 8;
-    data[6] = msg.CHARGER_TEMP >> 0;
-    data[7] = msg.RESERVED >> 0;
-    // TODO: use ID enum and length constexpr instead of hardcoding values
-    can::packet p = can::packet(
-        ((uint32_t)
-             skylab2::CANPacketId::CAN_PACKET_THUNDERSTRUCK_STATUS_MESSAGE),
-        ((uint8_t)skylab2::CAN_LENGTH_THUNDERSTRUCK_STATUS_MESSAGE), data,
-        true);
-    return can_device.send(p);
+    return enqueue(thunderstruck_frames::status::to_packet(msg), std::nullopt);
 }
 
 CAN_HandleTypeDef* CAN2Device::get_handle() {
@@ -91,28 +199,11 @@ void CAN2Device::receive() {
         return;
     }
     const uint8_t* data = recv.get_data();
-    switch (recv.get_id()) {
-        case ((uint32_t)skylab2::CANPacketId::
-                  CAN_PACKET_THUNDERSTRUCK_CONTROL_MESSAGE): {
-            skylab2::can_packet_thunderstruck_control_message msg;
-            msg.Enable = (uint8_t)((data[0] << 0));
-            msg.CHARGE_VOLTAGE = (uint16_t)((data[1] << 0) | (data[2] << 8));
-            msg.CHARGE_CURRENT = (uint16_t)((data[3] << 0) | (data[4] << 8));
-            msg.LED_BLINK_PATTERN = (uint8_t)((data[5] << 0));
-            msg.RESERVED = (uint16_t)((data[6] << 0) | (data[7] << 8));
-            thunderstruck_control_message_buffer.push(msg);
-        } break;
-        case ((uint32_t)skylab2::CANPacketId::
-                  CAN_PACKET_THUNDERSTRUCK_STATUS_MESSAGE): {
-            skylab2::can_packet_thunderstruck_status_message msg;
-            msg.STATUS_FLAGS = (uint8_t)((data[0] << 0));
-            msg.CHARGE_FLAGS = (uint8_t)((data[1] << 0));
-            msg.OUTPUT_VOLTAGE = (uint16_t)((data[2] << 0) | (data[3] << 8));
-            msg.OUTPUT_CURRENT = (uint16_t)((data[4] << 0) | (data[5] << 8));
-            msg.CHARGER_TEMP = (uint8_t)((data[6] << 0));
-            msg.RESERVED = (uint8_t)((data[7] << 0));
-            thunderstruck_status_message_buffer.push(msg);
-        } break;
+    const std::optional<uint8_t> unit =
+        thunderstruck_frames::status_unit(recv.get_id());
+    if (unit.has_value() && unit.value() < NUMBER_CHARGERS) {
+        thunderstruck_status_message_buffer[unit.value()].push(
+            {thunderstruck_frames::status::unpack(data), HAL_GetTick()});
     }
 }
 
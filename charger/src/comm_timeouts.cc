@@ -0,0 +1,145 @@
+#include "comm_timeouts.h"
+
+#include <algorithm>
+
+namespace umnsvp {
+namespace charger {
+
+CommTimeouts::CommTimeouts() {
+    positions.fill(NOT_ARMED);
+}
+
+/**
+ * @brief Start tracking a link. It isn't armed until its first frame, so a
+ * link that was never heard from doesn't expire.
+ *
+ * @param link
+ * @param timeout Most time allowed between two frames, in ms.
+ */
+void CommTimeouts::track(comm_link link, uint32_t timeout) {
+    timeouts[static_cast<uint8_t>(link)] = timeout;
+}
+
+/**
+ * @brief Note a frame on a link and push its deadline back.
+ *
+ * @param link
+ * @param tick When the frame arrived.
+ */
+void CommTimeouts::refresh(comm_link link, uint32_t tick) {
+    const uint8_t i = static_cast<uint8_t>(link);
+    if (timeouts[i] == 0) {
+        return;
+    }
+    comm_link_stats &s = stats[i];
+    if (heard_links & link_bit(link)) {
+        s.worst_gap = std::max(s.worst_gap, tick - last_frames[i]);
+    }
+    last_frames[i] = tick;
+    deadlines[i] = tick + timeouts[i];
+    heard_links |= link_bit(link);
+    alive_links |= link_bit(link);
+
+    if (positions[i] == NOT_ARMED) {
+        heap[armed] = i;
+        positions[i] = armed;
+        armed++;
+        sift_up(positions[i]);
+    } else {
+        // frames come in order, so the deadline only moves later
+        sift_down(positions[i]);
+    }
+}
+
+/**
+ * @brief Treat a link as never heard from, so it can't expire until its next
+ * frame.
+ *
+ */
+void CommTimeouts::forget(comm_link link) {
+    const uint8_t i = static_cast<uint8_t>(link);
+    if (positions[i] != NOT_ARMED) {
+        remove(positions[i]);
+    }
+    heard_links &= ~link_bit(link);
+    alive_links &= ~link_bit(link);
+}
+
+// poll() once the earliest deadline has passed
+bool CommTimeouts::expire(uint32_t now) {
+    do {
+        const uint8_t link = heap[0];
+        remove(0);
+        alive_links &= ~link_bit(static_cast<comm_link>(link));
+        stats[link].expiries++;
+    } while (armed != 0 &&
+             static_cast<int32_t>(now - deadlines[heap[0]]) >= 0);
+    return true;
+}
+
+// tick of the last frame on a link, only meaningful once heard()
+uint32_t CommTimeouts::last_frame(comm_link link) const {
+    return last_frames[static_cast<uint8_t>(link)];
+}
+
+const comm_link_stats &CommTimeouts::get_stats(comm_link link) const {
+    return stats[static_cast<uint8_t>(link)];
+}
+
+// deadline of link a is before link b's, allowing for the tick wrapping
+bool CommTimeouts::earlier(uint8_t a, uint8_t b) const {
+    return static_cast<int32_t>(deadlines[a] - deadlines[b]) < 0;
+}
+
+void CommTimeouts::swap(uint8_t i, uint8_t j) {
+    std::swap(heap[i], heap[j]);
+    positions[heap[i]] = i;
+    positions[heap[j]] = j;
+}
+
+void CommTimeouts::sift_up(uint8_t i) {
+    while (i > 0) {
+        const uint8_t parent = (i - 1) / 2;
+        if (!earlier(heap[i], heap[parent])) {
+            return;
+        }
+        swap(i, parent);
+        i = parent;
+    }
+}
+
+void CommTimeouts::sift_down(uint8_t i) {
+    while (true) {
+        const uint8_t left = 2 * i + 1;
+        const uint8_t right = left + 1;
+        uint8_t first = i;
+        if (left < armed && earlier(heap[left], heap[first])) {
+            first = left;
+        }
+        if (right < armed && earlier(heap[right], heap[first])) {
+            first = right;
+        }
+        if (first == i) {
+            return;
+        }
+        swap(i, first);
+        i = first;
+    }
+}
+
+// disarm the link at index i of the heap
+void CommTimeouts::remove(uint8_t i) {
+    const uint8_t link = heap[i];
+    armed--;
+    if (i != armed) {
+        swap(i, armed);
+        // the last link, moved into the gap, may belong above or below it
+        const uint8_t moved = heap[i];
+        sift_up(i);
+        sift_down(positions[moved]);
+    }
+    positions[link] = NOT_ARMED;
+}
+
+}  // namespace charger
+}  // namespace umnsvp
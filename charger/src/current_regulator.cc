@@ -0,0 +1,58 @@
+#include "current_regulator.h"
+
+#include <algorithm>
+
+namespace umnsvp {
+namespace charger {
+
+CurrentRegulator::CurrentRegulator(regulator_gains gains) : gains(gains) {
+}
+
+/**
+ * @brief Start over from the feed-forward alone, e.g. on entering CHARGING.
+ *
+ */
+void CurrentRegulator::reset(deci_amps setpoint, deci_amps ceiling) {
+    integral = 0;
+    target = std::clamp(setpoint, deci_amps(0), ceiling);
+    output = target;
+}
+
+/**
+ * @brief Run one control period.
+ *
+ * @param setpoint Battery current wanted.
+ * @param measured Battery current the BMS last reported.
+ * @param ceiling Most current the chargers may be asked for.
+ * @param charger_output Current the chargers last reported, all together.
+ * @return deci_amps the charger command, also kept for get_output()
+ */
+deci_amps CurrentRegulator::update(deci_amps setpoint, deci_amps measured,
+                                   deci_amps ceiling,
+                                   deci_amps charger_output) {
+    const deci_amps high = std::max(ceiling, deci_amps(0));
+    const deci_amps slew = charger_output - output;
+    const bool tracking = slew <= REGULATOR_TRACKING_BAND &&
+                          -slew <= REGULATOR_TRACKING_BAND;
+    const int32_t error = tracking ? (target - measured).count() : 0;
+    target = std::clamp(setpoint, deci_amps(0), high);
+
+    const int32_t feed_forward = target.count() * REGULATOR_GAIN_ONE;
+    const int32_t limit = high.count() * REGULATOR_GAIN_ONE;
+    const int32_t proportional = gains.kp * error;
+    // anti-windup: the integrator alone never asks for more than the range
+    integral = std::clamp(integral + gains.ki * error, -feed_forward,
+                          limit - feed_forward);
+    const int32_t command =
+        std::clamp(feed_forward + proportional + integral, 0, limit);
+    // round to the nearest count
+    output = deci_amps((command + REGULATOR_GAIN_ONE / 2) / REGULATOR_GAIN_ONE);
+    return output;
+}
+
+deci_amps CurrentRegulator::get_output() const {
+    return output;
+}
+
+}  // namespace charger
+}  // namespace umnsvp
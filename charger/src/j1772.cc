@@ -1,5 +1,7 @@
 #include "j1772.h"
 
+#include "j1772_table.h"
+
 namespace umnsvp {
 namespace charger {
 
@@ -10,15 +12,22 @@ namespace charger {
 void J1772::init() {
     // Initialize the proximity pin and LED
     __HAL_RCC_GPIOA_CLK_ENABLE();
+    // EXTI line routing lives in SYSCFG
+    __HAL_RCC_SYSCFG_CLK_ENABLE();
 
     // Pack the pin configuration into a struct.
     GPIO_InitTypeDef GPIO_InitStruct = {0};
     GPIO_InitStruct.Pin = PROX_PIN;
-    GPIO_InitStruct.Mode = GPIO_MODE_INPUT;
+    // interrupt on both edges, each timestamped for the debounce
+    GPIO_InitStruct.Mode = GPIO_MODE_IT_RISING_FALLING;
     GPIO_InitStruct.Speed = GPIO_SPEED_FAST;
 
     // Configure the GPIO port with the packed pin configuration.
     HAL_GPIO_Init(PROX_PORT, &GPIO_InitStruct);
+    prox_connected =
+        HAL_GPIO_ReadPin(PROX_PORT, PROX_PIN) == GPIO_PinState::GPIO_PIN_SET;
+    HAL_NVIC_SetPriority(PROX_IRQn, 6, 6);
+    HAL_NVIC_EnableIRQ(PROX_IRQn);
 
     // Initialize the pin for the prox_enable
     GPIO_InitTypeDef gpio = {0};
@@ -34,14 +43,71 @@ void J1772::init() {
 
 /**
  * @brief Returns true if prox is connected, prox is low when the plug is in th
- * car
+ * car. This is the debounced state; the pin itself is only read on an edge.
  *
  * @return true
  * @return false
  */
-bool J1772::check_prox_connected() {
-    return (HAL_GPIO_ReadPin(PROX_PORT, PROX_PIN) ==
-            GPIO_PinState::GPIO_PIN_SET);
+bool J1772::check_prox_connected() const {
+    return prox_connected;
+}
+
+/**
+ * @brief Timestamp a proximity pin edge. Call from the EXTI interrupt.
+ *
+ * @param tick When the edge was taken.
+ * @return true The pin now reads connected.
+ * @return false The pin now reads disconnected.
+ */
+bool J1772::prox_edge(uint32_t tick) {
+    if (!prox_settling) {
+        prox_first_edge = tick;
+        prox_settling = true;
+    }
+    prox_last_edge = tick;
+    prox_pending_edges = prox_pending_edges + 1;
+    prox_counts.edges++;
+    return HAL_GPIO_ReadPin(PROX_PORT, PROX_PIN) ==
+           GPIO_PinState::GPIO_PIN_SET;
+}
+
+/**
+ * @brief Take the pin's level once it has held for PROX_DEBOUNCE_TIME since
+ * the last edge. Call periodically with interrupts masked, so an edge can't
+ * land halfway through.
+ *
+ * @param now
+ * @return true The edges since the last call settled, changing the debounced
+ * state or not.
+ * @return false Nothing settled.
+ */
+bool J1772::debounce_prox(uint32_t now) {
+    if (!prox_settling || now - prox_last_edge < PROX_DEBOUNCE_TIME) {
+        return false;
+    }
+    const bool connected =
+        HAL_GPIO_ReadPin(PROX_PORT, PROX_PIN) == GPIO_PinState::GPIO_PIN_SET;
+    uint32_t bounces = prox_pending_edges;
+    if (connected != prox_connected) {
+        // one edge made the change, the rest bounced
+        bounces--;
+        prox_connected = connected;
+        prox_changed_at = prox_first_edge;
+        prox_counts.changes++;
+    }
+    prox_counts.bounces += bounces;
+    prox_pending_edges = 0;
+    prox_settling = false;
+    return true;
+}
+
+// tick of the first edge of the last debounced change
+uint32_t J1772::get_prox_changed_at() const {
+    return prox_changed_at;
+}
+
+const prox_stats& J1772::get_prox_stats() const {
+    return prox_counts;
 }
 
 /**
@@ -60,39 +126,43 @@ void J1772::isolate_interface(void) {
     HAL_GPIO_WritePin(CONTROL_PORT, CONTROL_PIN, GPIO_PIN_RESET);
 }
 
-TIM_HandleTypeDef* J1772::get_pwm_timer_handle() {
-    return pwm.get_handler();
-}
-
-void J1772::measure_control_pilot_duty() {
-    pwm.measure_duty();
+/**
+ * @brief Recompute the control pilot period and high time from the
+ * captures since the last call. The rate is up to the caller.
+ *
+ */
+void J1772::update_control_pilot() {
+    pwm.update();
 }
 
 /**
  * @brief Read current limit given by the J1772.
  *
- * @return float The current limit.
+ * @return deci_amps The current limit.
  *
  */
-float J1772::get_j1772_current_limit() {
+deci_amps J1772::get_j1772_current_limit() {
     // assuming a 4% tolerance
     // see Table 6A/B for current limit signaling protocol in
     // https://wiki.umnsvp.org/wiki/uberwiki_files/images/f/f1/SAE_J1772-2010.pdf
     if (!check_prox_connected()) {
-        return 0;
+        return deci_amps(0);
     }
-    float duty_cycle = pwm.get_duty();
-    if (pwm.get_frequency() <= 1400 && pwm.get_frequency() >= 600) {
-        if (duty_cycle > 0.1 && duty_cycle < 0.86) {
-            return duty_cycle * 60;
-        }
-        if (duty_cycle >= 0.86 && duty_cycle <= 0.96) {
-            return (duty_cycle * 100 - 64) * 2.5;
-        }
+    // 0 A outside of the expected frequency and duty cycle ranges
+    return j1772_table::decode(pwm.get_period(), pwm.get_high_time()).current;
+}
+
+/**
+ * @brief Duty cycle of the last pilot measurement, for telemetry.
+ *
+ * @return uint16_t tenths of a percent, 0 with no pilot
+ */
+uint16_t J1772::get_pilot_duty() const {
+    const uint16_t period = pwm.get_period();
+    if (period == 0) {
         return 0;
-    } else {
-        return 0;  // outside of expected range
     }
+    return static_cast<uint32_t>(pwm.get_high_time()) * 1000 / period;
 }
 }  // namespace charger
 }  // namespace umnsvp
\ No newline at end of file
@@ -0,0 +1,83 @@
+#include "loop_events.h"
+
+namespace umnsvp {
+namespace charger {
+
+/**
+ * @brief Start the DWT cycle counter used to time sleep and latency.
+ *
+ */
+void LoopEvents::init() {
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+    DWT->CYCCNT = 0;
+    DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+    pending = 0;
+    woke_at = DWT->CYCCNT;
+    started = HAL_GetTick();
+}
+
+/**
+ * @brief Flag an event for the main loop. Call from interrupt context.
+ *
+ * Interrupts of several priorities post, so the flags are updated masked: a
+ * post preempting another between its read and its write would lose one.
+ *
+ * @param event The source that fired.
+ */
+void LoopEvents::post(loop_event event) {
+    const uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    if (pending == 0) {
+        first_posted = DWT->CYCCNT;
+    }
+    pending = pending | static_cast<uint32_t>(event);
+    if (primask == 0) {
+        __enable_irq();
+    }
+}
+
+/**
+ * @brief Sleep until an event is pending, then take every pending event.
+ *
+ * Interrupts are masked while checking the flags so a post between the check
+ * and WFI still wakes the core; the ISR runs once they are unmasked.
+ *
+ * @return uint32_t Bitmask of loop_event that fired since the last call.
+ */
+uint32_t LoopEvents::wait() {
+    const uint32_t sleep_start = DWT->CYCCNT;
+    stats.awake_cycles += sleep_start - woke_at;
+
+    __disable_irq();
+    while (pending == 0) {
+        __WFI();
+        __enable_irq();
+        __disable_irq();
+    }
+    const uint32_t events = pending;
+    const uint32_t posted = first_posted;
+    pending = 0;
+    __enable_irq();
+
+    // the core never sleeps with an event pending, so the cycle counter ran
+    // from the post to here even if it stops in WFI
+    woke_at = DWT->CYCCNT;
+    const uint32_t latency = woke_at - posted;
+    stats.total_latency_cycles += latency;
+    if (latency > stats.max_latency_cycles) {
+        stats.max_latency_cycles = latency;
+    }
+    stats.wakeups++;
+    return events;
+}
+
+loop_stats LoopEvents::get_stats() const {
+    loop_stats s = stats;
+    const uint64_t elapsed = static_cast<uint64_t>(HAL_GetTick() - started) *
+                             (SystemCoreClock / 1000);
+    s.asleep_cycles = elapsed > s.awake_cycles ? elapsed - s.awake_cycles : 0;
+    return s;
+}
+
+}  // namespace charger
+}  // namespace umnsvp
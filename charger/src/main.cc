@@ -30,12 +30,8 @@ int main(void) {
 }
 
 void timer_handler_callback(TIM_HandleTypeDef* htim) {
-    if (htim->Instance == TIM7) {
-        app.broadcast_car_can();
-    } else if (htim->Instance == TIM6) {
-        app.broadcast_charger_can();
-    } else if (htim->Instance == TIM1) {
-        app.pwm_measure();
+    if (htim->Instance == TIM6) {
+        app.scheduler_tick();
     }
 }
 
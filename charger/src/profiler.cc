@@ -0,0 +1,96 @@
+#include "profiler.h"
+
+#ifdef CHARGER_PROFILE
+
+#include <algorithm>
+#include <iterator>
+
+namespace umnsvp {
+namespace charger {
+
+namespace {
+profile_stats stats[static_cast<uint8_t>(profile_point::COUNT)];
+
+uint8_t histogram_bin(uint32_t cycles) {
+    // number of significant bits, so bin i holds cycles < 2^i
+    const uint8_t bits = cycles == 0 ? 0 : 32 - __builtin_clz(cycles);
+    return std::min<uint8_t>(bits, PROFILE_HISTOGRAM_BINS - 1);
+}
+
+uint16_t report_units(uint32_t cycles) {
+    return static_cast<uint16_t>(
+        std::min<uint32_t>(cycles >> PROFILE_REPORT_SHIFT, UINT16_MAX));
+}
+}  // namespace
+
+uint32_t profile_stats::mean_cycles() const {
+    if (count == 0) {
+        return 0;
+    }
+    return static_cast<uint32_t>(total_cycles / count);
+}
+
+namespace profiler {
+
+/**
+ * @brief Add one sample. Each point is only recorded from one context, so
+ * this needs no locking.
+ *
+ * @param point What was timed.
+ * @param cycles How long it took.
+ */
+void record(profile_point point, uint32_t cycles) {
+    profile_stats& s = stats[static_cast<uint8_t>(point)];
+    s.count++;
+    s.total_cycles += cycles;
+    s.min_cycles = std::min(s.min_cycles, cycles);
+    s.max_cycles = std::max(s.max_cycles, cycles);
+    s.histogram[histogram_bin(cycles)]++;
+}
+
+/**
+ * @brief Copy of the statistics for one point, taken with interrupts masked
+ * so an ISR can't update it halfway through.
+ *
+ */
+profile_stats get(profile_point point) {
+    __disable_irq();
+    const profile_stats s = stats[static_cast<uint8_t>(point)];
+    __enable_irq();
+    return s;
+}
+
+void reset() {
+    __disable_irq();
+    for (profile_stats& s : stats) {
+        s = profile_stats();
+    }
+    __enable_irq();
+}
+
+/**
+ * @brief Encode the summary of one point for the car bus, see
+ * profile_report.
+ *
+ * @param point The point to report.
+ * @return can::packet
+ */
+can::packet summary(profile_point point) {
+    const profile_stats s = get(point);
+    const uint32_t* peak =
+        std::max_element(std::begin(s.histogram), std::end(s.histogram));
+
+    profile_report report;
+    report.point = static_cast<uint8_t>(point);
+    report.peak_bin = static_cast<uint8_t>(peak - std::begin(s.histogram));
+    report.min = report_units(s.count == 0 ? 0 : s.min_cycles);
+    report.mean = report_units(s.mean_cycles());
+    report.max = report_units(s.max_cycles);
+    return profile_report_frame::to_packet(report);
+}
+
+}  // namespace profiler
+}  // namespace charger
+}  // namespace umnsvp
+
+#endif
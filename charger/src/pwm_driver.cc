@@ -1,68 +1,129 @@
 
 #include "pwm_driver.h"
 
+#include <algorithm>
+
 #include "hal.h"
-#include "main.h"
 
 namespace umnsvp {
 namespace charger {
 
+namespace {
+/**
+ * @brief Move the captures DMA has written since the last call out of a
+ * buffer, zeroing their slots. A real capture is never 0: the counter is
+ * reset on every rising edge.
+ *
+ * @return uint16_t number of captures copied to out
+ */
+uint16_t take_samples(volatile uint16_t* buffer, uint16_t* out,
+                      uint16_t size) {
+    uint16_t count = 0;
+    for (uint16_t i = 0; i < size; i++) {
+        const uint16_t sample = buffer[i];
+        if (sample != 0) {
+            buffer[i] = 0;
+            out[count++] = sample;
+        }
+    }
+    return count;
+}
+
+uint16_t median(uint16_t* samples, uint16_t count) {
+    std::nth_element(samples, samples + count / 2, samples + count);
+    return samples[count / 2];
+}
+}  // namespace
+
 TIM_HandleTypeDef* pwm_driver::get_handler() {
     return &htim_handle;
 }
 
 /**
- * @brief This function initalizes the duty cycle timer
+ * @brief This function initalizes the duty cycle timer and starts capturing
+ * into the DMA buffers.
  *
  */
 void pwm_driver::init() {
     duty_cycle_measure_timer_init();
-    HAL_TIM_IC_Start_IT(&htim_handle, TIM_CHANNEL_1);  // main channel
-    HAL_TIM_IC_Start(&htim_handle, TIM_CHANNEL_2);
+    capture_dma_init();
+    HAL_TIM_IC_Start_DMA(
+        &htim_handle, TIM_CHANNEL_1,  // main channel
+        reinterpret_cast<uint32_t*>(const_cast<uint16_t*>(period_samples)),
+        PILOT_SAMPLES);
+    HAL_TIM_IC_Start_DMA(
+        &htim_handle, TIM_CHANNEL_2,
+        reinterpret_cast<uint32_t*>(const_cast<uint16_t*>(low_samples)),
+        PILOT_SAMPLES);
 }
 
 /**
- * @brief This function calculates the frequency of the duty cycle
- * using the captured period and timer 1's reference clock.
+ * @brief Recompute the pilot period and high time from the captures that
+ * arrived since the last call. The medians of the period and low time are
+ * used, so a glitched edge or two in the window has no effect. Without enough
+ * fresh captures the pilot is reported as absent (both 0), which limits the
+ * current to 0 A.
  *
- * @return float The frequency (Hz).
  */
-float pwm_driver::get_frequency() {
-    uint16_t captured_period = get_capture_period();
-    return (static_cast<float>(timer_ref_clock) / captured_period);
+void pwm_driver::update() {
+    uint16_t periods[PILOT_SAMPLES];
+    uint16_t lows[PILOT_SAMPLES];
+    const uint16_t period_count =
+        take_samples(period_samples, periods, PILOT_SAMPLES);
+    const uint16_t low_count = take_samples(low_samples, lows, PILOT_SAMPLES);
+    if (period_count < PILOT_MIN_SAMPLES || low_count < PILOT_MIN_SAMPLES) {
+        period = 0;
+        high_time = 0;
+        return;
+    }
+    period = median(periods, period_count);
+    const uint16_t low = median(lows, low_count);
+    high_time = low < period ? period - low : 0;
 }
 
 /**
- * @brief This function returns the captured period of
- * channel 1 (low and high) in periods.
+ * @brief Pilot period as of the last update().
  *
- * @return uint16_t The captured period.
+ * @return uint16_t The period (counts of timer_ref_clock).
  */
-uint16_t pwm_driver::get_capture_period() {
-    uint16_t captured_period = 0;
-    captured_period = HAL_TIM_ReadCapturedValue(&htim_handle, TIM_CHANNEL_1);
-    return captured_period;
+uint16_t pwm_driver::get_period() const {
+    return period;
+}
+
+uint16_t pwm_driver::get_high_time() const {
+    return high_time;
 }
 
 /**
- * @brief This function calculates the duty cycle by
- * subtracting the percentage of the low of the period
- * by one (AKA 100 percent of the period).
+ * @brief Set up DMA2 to copy every CH1 and CH2 capture into the circular
+ * sample buffers. The DMA interrupts are left disabled in the NVIC.
  *
  */
-void pwm_driver::measure_duty() {
-    uint16_t captured_period = get_capture_period();
-    float calculated_duty_cycle = 0.0;
-    float read_capture_value =
-        (HAL_TIM_ReadCapturedValue(&htim_handle, TIM_CHANNEL_2));
-    calculated_duty_cycle =
-        1.00 - (read_capture_value / captured_period);  // this is a decimal and
-                                                        // not a percentage
-    duty_cycle = calculated_duty_cycle;
-}
-
-float pwm_driver::get_duty() const {
-    return duty_cycle;
+void pwm_driver::capture_dma_init() {
+    __HAL_RCC_DMA2_CLK_ENABLE();
+
+    // TIM1_CH1 and TIM1_CH2 requests are on channel 6 of streams 1 and 2
+    DMA_HandleTypeDef* const handles[] = {&period_dma, &low_dma};
+    DMA_Stream_TypeDef* const streams[] = {DMA2_Stream1, DMA2_Stream2};
+    for (size_t i = 0; i < 2; i++) {
+        DMA_HandleTypeDef& dma = *handles[i];
+        dma.Instance = streams[i];
+        dma.Init.Channel = DMA_CHANNEL_6;
+        dma.Init.Direction = DMA_PERIPH_TO_MEMORY;
+        dma.Init.PeriphInc = DMA_PINC_DISABLE;
+        dma.Init.MemInc = DMA_MINC_ENABLE;
+        dma.Init.PeriphDataAlignment = DMA_PDATAALIGN_HALFWORD;
+        dma.Init.MemDataAlignment = DMA_MDATAALIGN_HALFWORD;
+        dma.Init.Mode = DMA_CIRCULAR;
+        dma.Init.Priority = DMA_PRIORITY_LOW;
+        dma.Init.FIFOMode = DMA_FIFOMODE_DISABLE;
+        if (HAL_DMA_Init(&dma) != HAL_OK) {
+            while (1)
+                ;
+        }
+    }
+    __HAL_LINKDMA(&htim_handle, hdma[TIM_DMA_ID_CC1], period_dma);
+    __HAL_LINKDMA(&htim_handle, hdma[TIM_DMA_ID_CC2], low_dma);
 }
 
 /**
@@ -130,14 +191,6 @@ void pwm_driver::duty_cycle_measure_timer_init() {
         while (1)
             ;
     }
-
-    HAL_NVIC_SetPriority(TIM1_CC_IRQn, 7, 7);
-    HAL_NVIC_EnableIRQ(TIM1_CC_IRQn);
-    if (HAL_TIM_RegisterCallback(&htim_handle, HAL_TIM_IC_CAPTURE_CB_ID,
-                                 &timer_handler_callback) != HAL_OK) {
-        while (1)
-            ;
-    }
 }
 
 }  // namespace charger
@@ -1,18 +1,58 @@
 #include "status_lights.h"
 
+#include <cstddef>
+
 #include "hal.h"
 
 namespace umnsvp {
 namespace charger {
 
+namespace {
+struct light_pin {
+    uint8_t port;  // index into LIGHT_PORTS
+    uint16_t pin;
+};
+
+GPIO_TypeDef* const LIGHT_PORTS[] = {GPIOA, GPIOB, GPIOC};
+constexpr uint8_t LIGHT_PORT_COUNT =
+    sizeof(LIGHT_PORTS) / sizeof(LIGHT_PORTS[0]);
+
+// in status_light order
+constexpr light_pin LIGHT_PINS[] = {
+    {1, PIN_COMM_LIGHT_1},
+    {1, PIN_COMM_LIGHT_2},
+    {2, PIN_COMM_LIGHT_3},
+    {2, PIN_COMM_LIGHT_4},
+    {0, PROX_LIGHT_PIN},
+    {0, CHARGER_CONTACTOR_CLOSE_INDICATOR_LED},
+};
+static_assert(sizeof(LIGHT_PINS) / sizeof(LIGHT_PINS[0]) ==
+              static_cast<size_t>(status_light::COUNT));
+
+constexpr uint8_t bit(status_light light) {
+    return 0b1 << static_cast<uint8_t>(light);
+}
+}  // namespace
+
+Status_lights::Status_lights() {
+    patterns.fill(LED_OFF);
+}
+
 /**
  * @brief This initalizes the GPIOs neccessary for all LEDs on the charger
- * board.
+ * board, all off.
  *
  */
 void Status_lights::init() {
     __HAL_RCC_GPIOB_CLK_ENABLE();
     __HAL_RCC_GPIOA_CLK_ENABLE();
+    __HAL_RCC_GPIOC_CLK_ENABLE();
+    // off before they are outputs, so none flashes on
+    PORT_COMM_LIGHT_1->BSRR = PIN_COMM_LIGHT_1 | PIN_COMM_LIGHT_2;
+    PORT_COMM_LIGHT_3->BSRR = PIN_COMM_LIGHT_3 | PIN_COMM_LIGHT_4;
+    PROX_LIGHT_PORT->BSRR = PROX_LIGHT_PIN |
+                            CHARGER_CONTACTOR_CLOSE_INDICATOR_LED;
+
     // Pack the pin configuration into a struct.
     GPIO_InitTypeDef GPIO_InitStruct = {0};
     GPIO_InitStruct.Pin = PIN_COMM_LIGHT_1;
@@ -35,47 +75,103 @@ void Status_lights::init() {
     // init light
     GPIO_InitStruct.Pin = CHARGER_CONTACTOR_CLOSE_INDICATOR_LED;
     HAL_GPIO_Init(PORT_CHARGER_CONTACTOR_LED, &GPIO_InitStruct);
-    HAL_GPIO_WritePin(PORT_CHARGER_CONTACTOR_LED,
-                      CHARGER_CONTACTOR_CLOSE_INDICATOR_LED, GPIO_PIN_SET);
 
     // PROX LED
     GPIO_InitStruct.Pin = PROX_LIGHT_PIN;
     GPIO_InitStruct.Mode = GPIO_MODE_OUTPUT_OD;
     GPIO_InitStruct.Speed = GPIO_SPEED_MEDIUM;
     HAL_GPIO_Init(PROX_LIGHT_PORT, &GPIO_InitStruct);
-    HAL_GPIO_WritePin(PROX_LIGHT_PORT, PROX_LIGHT_PIN, GPIO_PIN_SET);
 
     return;
 }
-/** @brief sets the signal light to indicate a fault state*/
+
+/**
+ * @brief Play a pattern on one LED from its first step. Posting the pattern
+ * it already has does nothing, so the main loop can post every pass.
+ *
+ */
+void Status_lights::show(status_light light, led_pattern pattern) {
+    const uint8_t i = static_cast<uint8_t>(light);
+    if (patterns[i] == pattern) {
+        return;
+    }
+    __disable_irq();
+    patterns[i] = pattern;
+    positions[i] = 0;
+    __enable_irq();
+    stats.posts++;
+}
+
+/**
+ * @brief Advance every pattern by one step and drive the LEDs that changed,
+ * with one BSRR write per port. Run by the scheduler every
+ * LIGHT_STEP_PERIOD.
+ *
+ */
+void Status_lights::step() {
+    uint8_t on = can_toggles | forced_on;
+    for (uint8_t i = 0; i < LIGHTS; i++) {
+        const led_pattern& pattern = patterns[i];
+        on |= ((pattern.steps >> positions[i]) & 0b1) << i;
+        positions[i] =
+            positions[i] + 1 == pattern.length ? 0 : positions[i] + 1;
+    }
+    stats.steps++;
+    const uint8_t changed = on ^ lit;
+    if (changed == 0) {
+        return;
+    }
+    lit = on;
+
+    // lit by pulling the pin low: reset to turn on, set to turn off
+    uint32_t bsrr[LIGHT_PORT_COUNT] = {0};
+    for (uint8_t i = 0; i < LIGHTS; i++) {
+        if (changed & (0b1 << i)) {
+            const light_pin& light = LIGHT_PINS[i];
+            bsrr[light.port] |=
+                (on & (0b1 << i)) ? uint32_t(light.pin) << 16 : light.pin;
+        }
+    }
+    for (uint8_t port = 0; port < LIGHT_PORT_COUNT; port++) {
+        if (bsrr[port] != 0) {
+            LIGHT_PORTS[port]->BSRR = bsrr[port];
+            stats.port_writes++;
+        }
+    }
+}
+
+/** @brief holds the fault light on, from the scheduler tick when the main
+ * loop has missed its deadline and can't post a fault code itself*/
 void Status_lights::indicate_fault() {
-    HAL_GPIO_WritePin(PORT_COMM_LIGHT_3, PIN_COMM_LIGHT_3, GPIO_PIN_RESET);
+    forced_on |= bit(status_light::FAULT);
 }
 /** @brief toggles charger CAN signal light to indicate communcation*/
 void Status_lights::toggle_charger_can_light() {
-    HAL_GPIO_TogglePin(PORT_COMM_LIGHT_2, PIN_COMM_LIGHT_2);
+    can_toggles ^= bit(status_light::CHARGER_CAN);
 }
 /** @brief toggles car CAN signal light to indicate communication*/
 void Status_lights::toggle_car_can_light() {
-    HAL_GPIO_TogglePin(PORT_COMM_LIGHT_1, PIN_COMM_LIGHT_1);
+    can_toggles ^= bit(status_light::CAR_CAN);
 }
 /** @brief sets light to indicate j1772 proxy is connected*/
 void Status_lights::indicate_proxy_connected() {
-    HAL_GPIO_WritePin(PROX_LIGHT_PORT, PROX_LIGHT_PIN, GPIO_PIN_RESET);
+    show(status_light::PROX, LED_ON);
 }
 /** @brief sets light to indicate j1772 proxy is disconnected*/
 void Status_lights::indicate_proxy_disconnected() {
-    HAL_GPIO_WritePin(PROX_LIGHT_PORT, PROX_LIGHT_PIN, GPIO_PIN_SET);
+    show(status_light::PROX, LED_OFF);
 }
 /** @brief sets light to indicate j1772 ac contactor is connected*/
 void Status_lights::indicate_ac_connected() {
-    HAL_GPIO_WritePin(PORT_CHARGER_CONTACTOR_LED,
-                      CHARGER_CONTACTOR_CLOSE_INDICATOR_LED, GPIO_PIN_RESET);
+    show(status_light::AC, LED_ON);
 }
 /** @brief sets light to indicate j1772 ac contactor is isolated*/
 void Status_lights::indicate_ac_isolated() {
-    HAL_GPIO_WritePin(PORT_CHARGER_CONTACTOR_LED,
-                      CHARGER_CONTACTOR_CLOSE_INDICATOR_LED, GPIO_PIN_SET);
+    show(status_light::AC, LED_OFF);
+}
+
+const light_stats& Status_lights::get_stats() const {
+    return stats;
 }
 
 }  // namespace charger
@@ -23,6 +23,7 @@
 
 #include "application.h"
 #include "main.h"
+#include "profiler.h"
 #include "pwm_driver.h"
 
 /* Private includes ----------------------------------------------------------*/
@@ -71,7 +72,6 @@
 /**
  * @brief This function handles Non maskable interrupt.
  */
-extern TIM_HandleTypeDef htim7;
 extern "C" void NMI_Handler(void) {
     /* USER CODE BEGIN NonMaskableInt_IRQn 0 */
 
@@ -192,11 +192,8 @@ extern "C" void SysTick_Handler(void) {
 
 /* USER CODE BEGIN 1 */
 
-extern "C" void TIM1_CC_IRQHandler(void) {
-    HAL_TIM_IRQHandler(app.get_pwm_handle());
-}
-
 extern "C" void CAN1_RX0_IRQHandler(void) {
+    PROFILE_SCOPE(umnsvp::charger::profile_point::CAN1_RX0_ISR);
     HAL_CAN_IRQHandler(app.get_can1_handle());
 }
 
@@ -205,32 +202,53 @@ extern "C" void HAL_CAN_RxFifo0MsgPendingCallback(CAN_HandleTypeDef* hcan) {
 }
 
 extern "C" void CAN1_TX_IRQHandler(void) {
+    PROFILE_SCOPE(umnsvp::charger::profile_point::CAN1_TX_ISR);
     app.can1_tx_callback();
 }
 
 // CAN2
 extern "C" void CAN2_RX1_IRQHandler(void) {
+    PROFILE_SCOPE(umnsvp::charger::profile_point::CAN2_RX1_ISR);
     HAL_CAN_IRQHandler(app.get_can2_handle());
 }
 
+// Telemetry and profile requests, filtered into CAN1 FIFO1
+extern "C" void CAN1_RX1_IRQHandler(void) {
+    PROFILE_SCOPE(umnsvp::charger::profile_point::CAN1_RX1_ISR);
+    HAL_CAN_IRQHandler(app.get_can1_handle());
+}
+
 extern "C" void HAL_CAN_RxFifo1MsgPendingCallback(CAN_HandleTypeDef* hcan) {
+    if (hcan->Instance == CAN1) {
+        app.can1_rx1_callback();
+        return;
+    }
     app.can2_rx_callback();
 }
 
 // Leaving empty for now...
 extern "C" void CAN2_TX_IRQHandler(void) {
+    PROFILE_SCOPE(umnsvp::charger::profile_point::CAN2_TX_ISR);
     app.can2_tx_callback();
 }
 
-extern TIM_HandleTypeDef htim7;
-extern "C" void TIM7_IRQHandler(void) {
-    HAL_TIM_IRQHandler(&htim7);
-}
-
 extern TIM_HandleTypeDef htim6;
 extern "C" void TIM6_DAC_IRQHandler(void) {
+    PROFILE_SCOPE(umnsvp::charger::profile_point::TIM6_ISR);
     HAL_TIM_IRQHandler(&htim6);
 }
 
+// Proximity pin
+extern "C" void EXTI9_5_IRQHandler(void) {
+    PROFILE_SCOPE(umnsvp::charger::profile_point::EXTI9_5_ISR);
+    HAL_GPIO_EXTI_IRQHandler(PROX_PIN);
+}
+
+extern "C" void HAL_GPIO_EXTI_Callback(uint16_t GPIO_Pin) {
+    if (GPIO_Pin == PROX_PIN) {
+        app.prox_callback();
+    }
+}
+
 /* USER CODE END 1 */
 /************************ (C) COPYRIGHT STMicroelectronics *****END OF FILE****/
\ No newline at end of file
@@ -0,0 +1,214 @@
+#include "supervisor.h"
+
+#include <algorithm>
+
+namespace umnsvp {
+namespace charger {
+
+namespace {
+constexpr uint32_t DEADLINE_RECORD_MAGIC = 0x444C4E31;  // "DLN1"
+
+// soft deadline of each loop_phase, in us
+constexpr uint16_t PHASE_DEADLINES[] = {
+    100,   // WAKE
+    200,   // RECEIVE_STATUS_PACKET
+    200,   // UPDATE_CAN_VALUES
+    200,   // PILOT_UPDATE
+    100,   // CHECK_FAULTS
+    50,    // PROX_READ
+    100,   // UPDATE_STATE
+    500,   // STATE_ACTION
+    100,   // REGULATE_CURRENT
+    1000,  // TELEMETRY, a dump queues frames
+    1000,  // STARTUP
+};
+static_assert(sizeof(PHASE_DEADLINES) / sizeof(PHASE_DEADLINES[0]) ==
+              static_cast<size_t>(loop_phase::COUNT));
+
+template <class T>
+T saturate(uint32_t value) {
+    return static_cast<T>(std::min<uint32_t>(value, T(~T(0))));
+}
+
+uint8_t increment(uint8_t count) {
+    return count == UINT8_MAX ? count : count + 1;
+}
+}  // namespace
+
+/**
+ * @brief Find the record in backup SRAM, note how the last reset came about
+ * and start the watchdog. Call before anything that can stall.
+ *
+ */
+void LoopSupervisor::init() {
+    __HAL_RCC_PWR_CLK_ENABLE();
+    HAL_PWR_EnableBkUpAccess();
+    __HAL_RCC_BKPSRAM_CLK_ENABLE();
+    // keep backup SRAM on VBAT too
+    HAL_PWREx_EnableBkUpReg();
+    record = reinterpret_cast<deadline_record *>(BKPSRAM_BASE);
+    if (record->magic != DEADLINE_RECORD_MAGIC) {
+        clear();
+    }
+
+    if (__HAL_RCC_GET_FLAG(RCC_FLAG_IWDGRST)) {
+        record->watchdog_resets = increment(record->watchdog_resets);
+        record->reset_phase = record->phase;
+        record->pending_reset = static_cast<uint8_t>(reset_cause::WATCHDOG);
+    }
+    record->last_reset = record->pending_reset;
+    record->pending_reset = static_cast<uint8_t>(reset_cause::NONE);
+    __HAL_RCC_CLEAR_RESET_FLAGS();
+    record->phase = static_cast<uint8_t>(loop_phase::STARTUP);
+
+    cycles_per_us = SystemCoreClock / 1000000;
+    hard_deadline_cycles = LOOP_HARD_DEADLINE * 1000 * cycles_per_us;
+    watchdog.Instance = IWDG;
+    watchdog.Init.Prescaler = WATCHDOG_PRESCALER;
+    watchdog.Init.Reload = WATCHDOG_RELOAD;
+    HAL_IWDG_Init(&watchdog);
+}
+
+/**
+ * @brief Start timing a pass, as the main loop wakes.
+ *
+ */
+void LoopSupervisor::begin_pass() {
+    const uint32_t now = DWT->CYCCNT;
+    phase_start = now;
+    longest_phase_cycles = 0;
+    longest_phase = loop_phase::WAKE;
+    record->phase = static_cast<uint8_t>(loop_phase::WAKE);
+    pass_start = now;
+    in_pass = true;
+}
+
+// time the phase that ran up to now against its deadline
+void LoopSupervisor::close_phase(uint32_t now) {
+    const uint32_t cycles = now - phase_start;
+    const uint8_t phase = record->phase;
+    if (cycles > PHASE_DEADLINES[phase] * cycles_per_us) {
+        record->phase_overruns++;
+        record->last_overrun_phase = phase;
+    }
+    if (cycles > longest_phase_cycles) {
+        longest_phase_cycles = cycles;
+        longest_phase = static_cast<loop_phase>(phase);
+    }
+}
+
+/**
+ * @brief Mark the start of a stage of the pass, ending the one before.
+ *
+ */
+void LoopSupervisor::check_in(loop_phase phase) {
+    const uint32_t now = DWT->CYCCNT;
+    close_phase(now);
+    phase_start = now;
+    record->phase = static_cast<uint8_t>(phase);
+}
+
+/**
+ * @brief Finish the pass and feed the watchdog.
+ *
+ */
+void LoopSupervisor::end_pass() {
+    const uint32_t now = DWT->CYCCNT;
+    close_phase(now);
+    in_pass = false;
+    const uint32_t cycles = now - pass_start;
+    if (cycles > LOOP_PASS_DEADLINE * cycles_per_us) {
+        record->pass_overruns++;
+    }
+    if (cycles > record->worst_pass_cycles) {
+        record->worst_pass_cycles = cycles;
+        record->worst_pass_phase = static_cast<uint8_t>(longest_phase);
+    }
+    // asleep until the next pass
+    record->phase = static_cast<uint8_t>(loop_phase::WAKE);
+    HAL_IWDG_Refresh(&watchdog);
+}
+
+/**
+ * @brief Check the running pass against the hard deadline. Call from the
+ * scheduler tick, which keeps running while the main loop is stuck.
+ *
+ * @return deadline_action ISOLATE once when the pass runs over, then HOLD
+ * until RESET DEADLINE_ISOLATE_TIME later, NONE otherwise.
+ */
+deadline_action LoopSupervisor::tick() {
+    if (isolating) {
+        return HAL_GetTick() - isolate_started >= DEADLINE_ISOLATE_TIME
+                   ? deadline_action::RESET
+                   : deadline_action::HOLD;
+    }
+    if (in_pass && DWT->CYCCNT - pass_start > hard_deadline_cycles) {
+        isolating = true;
+        isolate_started = HAL_GetTick();
+        return deadline_action::ISOLATE;
+    }
+    return deadline_action::NONE;
+}
+
+/**
+ * @brief Record the pass that missed the hard deadline and reset the core.
+ * HV must already be isolated.
+ *
+ */
+void LoopSupervisor::reset() {
+    const uint32_t cycles = DWT->CYCCNT - pass_start;
+    if (cycles > record->worst_pass_cycles) {
+        record->worst_pass_cycles = cycles;
+        record->worst_pass_phase = record->phase;
+    }
+    record->deadline_resets = increment(record->deadline_resets);
+    record->reset_phase = record->phase;
+    record->pending_reset = static_cast<uint8_t>(reset_cause::DEADLINE);
+    NVIC_SystemReset();
+}
+
+/**
+ * @brief Start the statistics over, resets included.
+ *
+ */
+void LoopSupervisor::clear() {
+    const uint8_t phase = record->phase;
+    *record = deadline_record();
+    record->magic = DEADLINE_RECORD_MAGIC;
+    record->phase = phase < static_cast<uint8_t>(loop_phase::COUNT)
+                        ? phase
+                        : static_cast<uint8_t>(loop_phase::STARTUP);
+}
+
+deadline_record LoopSupervisor::get_record() const {
+    return *record;
+}
+
+/**
+ * @brief Encode one of the deadline_report frames for the car bus.
+ *
+ * @param index 0 for the pass timing, 1 for the overruns and resets.
+ * @return can::packet
+ */
+can::packet LoopSupervisor::report(uint8_t index) const {
+    const deadline_record r = *record;
+    deadline_report report = {};
+    report.index = index;
+    if (index == 0) {
+        report.worst_pass_phase = r.worst_pass_phase;
+        report.worst_pass_us = std::min<uint32_t>(
+            r.worst_pass_cycles / cycles_per_us, 0xFFFFFF);
+        report.pass_overruns = saturate<uint16_t>(r.pass_overruns);
+        report.last_overrun_phase = r.last_overrun_phase;
+        return deadline_pass_frame::to_packet(report);
+    }
+    report.phase_overruns = saturate<uint16_t>(r.phase_overruns);
+    report.deadline_resets = r.deadline_resets;
+    report.watchdog_resets = r.watchdog_resets;
+    report.last_reset = r.last_reset;
+    report.reset_phase = r.reset_phase;
+    return deadline_reset_frame::to_packet(report);
+}
+
+}  // namespace charger
+}  // namespace umnsvp
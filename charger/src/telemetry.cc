@@ -0,0 +1,188 @@
+#include "telemetry.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace umnsvp {
+namespace charger {
+
+namespace {
+void write_u32(uint8_t *out, uint32_t value) {
+    out[0] = static_cast<uint8_t>(value);
+    out[1] = static_cast<uint8_t>(value >> 8);
+    out[2] = static_cast<uint8_t>(value >> 16);
+    out[3] = static_cast<uint8_t>(value >> 24);
+}
+
+void write_u16(uint8_t *out, uint16_t value) {
+    out[0] = static_cast<uint8_t>(value);
+    out[1] = static_cast<uint8_t>(value >> 8);
+}
+}  // namespace
+
+uint8_t TelemetryLog::block_index(uint8_t from_oldest) const {
+    return (newest + BLOCKS - count + 1 + from_oldest) % BLOCKS;
+}
+
+uint16_t TelemetryLog::block_used(uint8_t from_oldest) const {
+    return telemetry_format::read_u16(blocks[block_index(from_oldest)] + 4);
+}
+
+/**
+ * @brief Start a new block, dropping the oldest if the ring is full. The
+ * block's first record is coded against an all zero sample.
+ *
+ */
+void TelemetryLog::open_block(uint32_t tick) {
+    newest = (newest + 1) % BLOCKS;
+    if (count < BLOCKS) {
+        count++;
+    } else {
+        records -= block_records[newest];
+    }
+    block_records[newest] = 0;
+    uint8_t *header = blocks[newest];
+    write_u32(header, tick);
+    write_u16(header + 4, telemetry_format::HEADER_SIZE);
+    header[6] = TELEMETRY_FIELDS;
+    header[7] = telemetry_format::VERSION;
+    used = telemetry_format::HEADER_SIZE;
+    last = {};
+    last_tick = tick;
+}
+
+/**
+ * @brief Append a sample if any field changed since the last one. Call from
+ * the main loop only.
+ *
+ * @param sample Values in telemetry_field order.
+ * @param tick HAL tick the sample was taken at, ms.
+ */
+void TelemetryLog::record(const telemetry_sample &sample, uint32_t tick) {
+    if (dumping) {
+        dropped++;
+        return;
+    }
+    if (count != 0 && sample == last) {
+        return;
+    }
+    if (count == 0 || used + MAX_RECORD > BLOCK_SIZE) {
+        open_block(tick);
+    }
+
+    uint32_t mask = 0;
+    for (uint8_t field = 0; field < TELEMETRY_FIELDS; field++) {
+        if (sample[field] != last[field]) {
+            mask |= 0b1u << field;
+        }
+    }
+    uint8_t *const block = blocks[newest];
+    uint8_t *out = block + used;
+    out += telemetry_format::put_varint(out, tick - last_tick);
+    out += telemetry_format::put_varint(out, mask);
+    for (uint8_t field = 0; field < TELEMETRY_FIELDS; field++) {
+        if (mask & (0b1u << field)) {
+            out += telemetry_format::put_varint(
+                out, telemetry_format::zigzag(sample[field] - last[field]));
+        }
+    }
+    used = static_cast<uint16_t>(out - block);
+    write_u16(block + 4, used);
+
+    last = sample;
+    last_tick = tick;
+    records++;
+    block_records[newest]++;
+}
+
+/**
+ * @brief Begin sending the log. Recording stops until send_dump() has sent
+ * the last frame, so the dump is a consistent copy.
+ *
+ */
+void TelemetryLog::start_dump() {
+    dumping = true;
+    dump_sequence = 0;
+    dump_at = dump_cursor();
+}
+
+bool TelemetryLog::dump_pending() const {
+    return dumping;
+}
+
+/**
+ * @brief Build the dump frame with the given sequence number, taking its
+ * data from the cursor and moving the cursor past it.
+ *
+ */
+can::packet TelemetryLog::dump_frame(uint16_t sequence,
+                                     dump_cursor &at) const {
+    uint8_t data[8];
+    write_u16(data, sequence);
+    uint8_t length = 2;
+    if (sequence == 0) {
+        uint32_t size = 0;
+        for (uint8_t block = 0; block < count; block++) {
+            size += block_used(block);
+        }
+        write_u32(data + 2, size);
+        data[6] = count;
+        data[7] = telemetry_format::VERSION;
+        length = 8;
+    }
+    while (length < 8 && at.block < count) {
+        const uint16_t block_size = block_used(at.block);
+        const uint16_t n = std::min<uint16_t>(8 - length, block_size - at.byte);
+        std::memcpy(data + length, blocks[block_index(at.block)] + at.byte, n);
+        length += n;
+        at.byte += n;
+        if (at.byte == block_size) {
+            at.block++;
+            at.byte = 0;
+        }
+    }
+    return can::packet(TELEMETRY_DUMP_ID, length, data, false);
+}
+
+/**
+ * @brief Send as much of a running dump as the TX mailboxes take, leaving
+ * keep_free of them for the periodic broadcasts.
+ *
+ * @return true while frames remain to be sent
+ */
+bool TelemetryLog::send_dump(can::bxcan_driver &can_device,
+                             uint8_t keep_free) {
+    while (dumping &&
+           HAL_CAN_GetTxMailboxesFreeLevel(can_device.get_handle()) >
+               keep_free) {
+        dump_cursor next = dump_at;
+        if (can_device.send(dump_frame(dump_sequence, next)) !=
+            can::status::OK) {
+            break;
+        }
+        dump_at = next;
+        dump_sequence++;
+        if (dump_at.block >= count) {
+            dumping = false;
+        }
+    }
+    return dumping;
+}
+
+telemetry_stats TelemetryLog::get_stats() const {
+    telemetry_stats stats;
+    stats.records = records;
+    stats.dropped = dropped;
+    if (count == 0) {
+        return stats;
+    }
+    for (uint8_t block = 0; block < count; block++) {
+        stats.bytes += block_used(block);
+    }
+    stats.oldest = telemetry_format::read_u32(blocks[block_index(0)]);
+    stats.newest = last_tick;
+    return stats;
+}
+
+}  // namespace charger
+}  // namespace umnsvp
@@ -1,9 +1,26 @@
 #include "thunderstruck.h"
 
+#include <algorithm>
+
 namespace umnsvp {
 namespace charger {
 
-Thunderstruck::Thunderstruck() : CANDevice() {
+namespace {
+constexpr uint32_t charger_link_mask() {
+    uint32_t mask = 0;
+    for (uint8_t unit = 0; unit < NUMBER_CHARGERS; unit++) {
+        mask |= link_bit(charger_status_link(unit));
+    }
+    return mask;
+}
+constexpr uint32_t CHARGER_LINK_MASK = charger_link_mask();
+}  // namespace
+
+Thunderstruck::Thunderstruck(CommTimeouts &timeouts)
+    : CANDevice(), timeouts(timeouts) {
+    for (uint8_t unit = 0; unit < NUMBER_CHARGERS; unit++) {
+        timeouts.track(charger_status_link(unit), TIMEOUT);
+    }
 }
 
 /**
@@ -11,22 +28,28 @@ Thunderstruck::Thunderstruck() : CANDevice() {
  *
  * @param limit
  */
-void Thunderstruck::set_charging_voltage_limit(float limit) {
-    uint16_t voltage_int_limit =
-        static_cast<uint16_t>(limit * VOLTAGE_LIMIT_INT_CONVERSION);
-    control_packet.CHARGE_VOLTAGE = voltage_int_limit;
+void Thunderstruck::set_charging_voltage_limit(deci_volts limit) {
+    set_control_field(
+        &skylab2::can_packet_thunderstruck_control_message::CHARGE_VOLTAGE,
+        thunderstruck_frames::control_voltage::from_physical(limit));
 }
 
 /**
- * @brief Set the charging current limit with the resolution of 100mA
+ * @brief Set the total charging current limit. It is split evenly between
+ * the chargers, each with the resolution of 100mA.
  *
  * @param limit
  */
-void Thunderstruck::set_charging_current_limit(float limit) {
-    uint16_t current_int_limit =
-        charging_current_packet_offset -
-        static_cast<uint16_t>(limit * CURRENT_LIMIT_INT_CONVERSION);
-    control_packet.CHARGE_CURRENT = current_int_limit;
+void Thunderstruck::set_charging_current_limit(deci_amps limit) {
+    // checked with interrupts masked so a hold can't land between the check
+    // and the write and be undone
+    __disable_irq();
+    const deci_amps unit_limit =
+        current_held ? deci_amps(0) : limit / NUMBER_CHARGERS;
+    set_control_field(
+        &skylab2::can_packet_thunderstruck_control_message::CHARGE_CURRENT,
+        thunderstruck_frames::control_current::from_physical(unit_limit));
+    __enable_irq();
 }
 
 /**
@@ -34,68 +57,245 @@ void Thunderstruck::set_charging_current_limit(float limit) {
  *
  */
 void Thunderstruck::enable_charging(void) {
-    control_packet.Enable = CONTROL_PACKET_ENABLE;
+    // checked with interrupts masked so a trip can't land between the check
+    // and the write and be undone
+    __disable_irq();
+    if (!tripped) {
+        set_control_field(
+            &skylab2::can_packet_thunderstruck_control_message::Enable,
+            CONTROL_PACKET_ENABLE);
+    }
+    __enable_irq();
 }
 
 void Thunderstruck::disable_charging(void) {
-    control_packet.Enable = CONTROL_PACKET_DISABLE;
-    // reset charger timeout indicator
-    received_status.reset();
+    set_control_field(
+        &skylab2::can_packet_thunderstruck_control_message::Enable,
+        CONTROL_PACKET_DISABLE);
+    // reset charger timeout indicators
+    for (uint8_t unit = 0; unit < NUMBER_CHARGERS; unit++) {
+        timeouts.forget(charger_status_link(unit));
+    }
+}
+
+/**
+ * @brief Disable every charger now, from interrupt context, without waiting
+ * for the control job. enable_charging() does nothing until clear_trip().
+ *
+ */
+void Thunderstruck::trip() {
+    if (tripped) {
+        return;
+    }
+    tripped = true;
+    set_control_field(
+        &skylab2::can_packet_thunderstruck_control_message::Enable,
+        CONTROL_PACKET_DISABLE);
+    for (uint8_t unit = 0; unit < NUMBER_CHARGERS; unit++) {
+        send_control_frame(unit);
+        control_stats.updates++;
+    }
+}
+
+/**
+ * @brief Allow enable_charging() again, once the state machine is holding
+ * the chargers off itself.
+ *
+ */
+void Thunderstruck::clear_trip() {
+    tripped = false;
+}
+
+bool Thunderstruck::is_tripped() const {
+    return tripped;
+}
+
+/**
+ * @brief Command zero current from every charger now, from interrupt
+ * context, so their output is ramping down before the AC is opened. The
+ * chargers stay enabled; set_charging_current_limit() sets 0 until
+ * release_current().
+ *
+ */
+void Thunderstruck::hold_current() {
+    if (current_held) {
+        return;
+    }
+    current_held = true;
+    set_control_field(
+        &skylab2::can_packet_thunderstruck_control_message::CHARGE_CURRENT,
+        thunderstruck_frames::control_current::from_physical(deci_amps(0)));
+    for (uint8_t unit = 0; unit < NUMBER_CHARGERS; unit++) {
+        send_control_frame(unit);
+        control_stats.updates++;
+    }
+}
+
+/**
+ * @brief Let set_charging_current_limit() through again. The limit stays 0
+ * until it is next set.
+ *
+ */
+void Thunderstruck::release_current() {
+    current_held = false;
+}
+
+bool Thunderstruck::is_current_held() const {
+    return current_held;
+}
+
+// send the cached payload to one unit. Masked so a trip can't change the
+// payload halfway through the copy and be overtaken by the stale frame.
+void Thunderstruck::send_control_frame(uint8_t unit) {
+    const uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    CANDevice.send_thunderstruck_control_frame(control_payload, unit);
+    control_sent[unit] = HAL_GetTick();
+    control_pending = control_pending & ~(0b1 << unit);
+    if (primask == 0) {
+        __enable_irq();
+    }
 }
 
 /**
- * @brief Call this in a timer to send the packet
+ * @brief Call this in a timer to send a charger its packet. This is the
+ * heartbeat; changes go out sooner through send_control_updates().
  *
+ * @param unit Index of the charger, below NUMBER_CHARGERS
  */
-void Thunderstruck::send_control_packet() {
-    CANDevice.send_thunderstruck_control_message(control_packet);
+void Thunderstruck::send_control_packet(uint8_t unit) {
+    send_control_frame(unit);
+    control_stats.heartbeats++;
 }
 
 /**
- * @brief Probe for new values on the status packet.
+ * @brief Send a changed control message to every unit that hasn't had it,
+ * no sooner than CONTROL_MIN_SPACING after that unit's last frame. Call from
+ * the scheduler tick.
+ *
+ */
+void Thunderstruck::send_control_updates() {
+    const uint8_t pending = control_pending;
+    if (pending == 0) {
+        return;
+    }
+    const uint32_t now = HAL_GetTick();
+    for (uint8_t unit = 0; unit < NUMBER_CHARGERS; unit++) {
+        if ((pending & (0b1 << unit)) &&
+            now - control_sent[unit] >= CONTROL_MIN_SPACING) {
+            send_control_frame(unit);
+            control_stats.updates++;
+        }
+    }
+}
+
+/**
+ * @brief Take every status frame each charger sent since the last call. The
+ * output energy is integrated over all of them, holding each unit's power
+ * from one report to the next; a frame lost to a full queue is bridged the
+ * same way.
  *
  */
 void Thunderstruck::receive_status_packet() {
-    if (CANDevice.thunderstruck_status_message_buffer.pop()) {
-        skylab2::can_packet_thunderstruck_status_message msg =
-            CANDevice.thunderstruck_status_message_buffer.output();
+    for (uint8_t i = 0; i < NUMBER_CHARGERS; i++) {
+        while (CANDevice.thunderstruck_status_message_buffer[i].pop()) {
+            const thunderstruck_status_rx rx =
+                CANDevice.thunderstruck_status_message_buffer[i].output();
+            const skylab2::can_packet_thunderstruck_status_message &msg =
+                rx.msg;
 
-        charging_voltage = msg.OUTPUT_VOLTAGE / 10.0;
-        charging_current =
-            (charging_current_packet_offset - msg.OUTPUT_CURRENT) / 10.0;
-        charger_temp = msg.CHARGER_TEMP - 40;
-        received_status = HAL_GetTick();
+            charger_unit &unit = units[i];
+            const comm_link link = charger_status_link(i);
+            if (timeouts.heard(link)) {
+                const uint32_t dt = rx.tick - timeouts.last_frame(link);
+                if (dt < TIMEOUT) {
+                    output_energy +=
+                        static_cast<int64_t>(unit.charging_voltage.count()) *
+                        unit.charging_current.count() * dt;
+                }
+            }
+            unit.charging_voltage =
+                thunderstruck_frames::status_voltage::to_physical<deci_volts>(
+                    msg.OUTPUT_VOLTAGE);
+            unit.charging_current =
+                thunderstruck_frames::status_current::to_physical<deci_amps>(
+                    msg.OUTPUT_CURRENT);
+            unit.charger_temp =
+                thunderstruck_frames::status_temp::to_physical<celsius>(
+                    msg.CHARGER_TEMP);
+            timeouts.refresh(link, rx.tick);
+        }
     }
 }
 
 /**
- * @brief Returns the charging current as reported by the thunderstrucks
+ * @brief Energy the chargers reported putting out since power up.
+ *
+ * @return float Wh
+ */
+float Thunderstruck::get_output_energy() const {
+    return output_energy / OUTPUT_ENERGY_PER_WH;
+}
+
+ring_stats Thunderstruck::get_rx_stats(uint8_t unit) const {
+    return charger::get_rx_stats(
+        CANDevice.thunderstruck_status_message_buffer[unit]);
+}
+
+/**
+ * @brief Returns the total charging current reported by the thunderstrucks
  *
- * @return float
+ * @return deci_amps
  */
-float Thunderstruck::get_charging_current() {
-    return charging_current;
+deci_amps Thunderstruck::get_charging_current() {
+    deci_amps current;
+    for (const charger_unit &unit : units) {
+        current += unit.charging_current;
+    }
+    return current;
 }
 
 /**
- * @brief Returns the charging voltage as reported by the thunderstrucks
+ * @brief Returns the highest charging voltage reported by the thunderstrucks
  *
- * @return float
+ * @return deci_volts
  */
-float Thunderstruck::get_charging_voltage() {
-    return charging_voltage;
+deci_volts Thunderstruck::get_charging_voltage() {
+    deci_volts voltage;
+    for (const charger_unit &unit : units) {
+        voltage = std::max(voltage, unit.charging_voltage);
+    }
+    return voltage;
 }
 
 /**
- * @brief Returns the charging voltage as reported by the thunderstrucks
+ * @brief Returns the temperature of the hottest thunderstruck
  *
- * @return float
+ * @return celsius
  */
-float Thunderstruck::get_charger_temp() {
-    if (charger_temp.has_value()) {
-        return charger_temp.value();
+celsius Thunderstruck::get_charger_temp() {
+    std::optional<celsius> hottest;
+    for (const charger_unit &unit : units) {
+        if (unit.charger_temp.has_value() &&
+            (!hottest.has_value() ||
+             unit.charger_temp.value() > hottest.value())) {
+            hottest = unit.charger_temp;
+        }
+    }
+    if (hottest.has_value()) {
+        return hottest.value();
     }
-    return 0;
+    return celsius(0);
+}
+
+/**
+ * @brief Telemetry from a single charger.
+ *
+ * @param unit Index of the charger.
+ * @return const charger_unit&
+ */
+const charger_unit &Thunderstruck::get_unit(uint8_t unit) const {
+    return units[unit];
 }
 
 /**
@@ -104,23 +304,25 @@ float Thunderstruck::get_charger_temp() {
  * @return charger_fault_type
  */
 charger_fault_type Thunderstruck::check_current_fault() {
+    for (uint8_t i = 0; i < NUMBER_CHARGERS; i++) {
+        // if coms are dead assume the charger has had time to cool down
+        // to a low temp
+        if (!timeouts.alive(charger_status_link(i))) {
+            units[i].charger_temp = std::nullopt;
+        }
+    }
+
     if (get_charging_voltage() >= CHARGER_VOLTAGE_MAX) {  // charger overvoltage
         return charger_fault_type::CHARGER_OVERVOLT;
     }
 
-    // if coms are dead assume the charger has had time to cool down
-    // to a low temp
-    if (!coms_alive())
-        charger_temp = std::nullopt;
-    if (charger_temp.has_value()) {  // charge overtemp
-        if (charger_temp.value() >= CHARGER_TEMP_MAX) {
-            return charger_fault_type::CHARGER_OVERTEMP;
-        }
+    if (get_charger_temp() >= CHARGER_TEMP_MAX) {  // hottest charger overtemp
+        return charger_fault_type::CHARGER_OVERTEMP;
     }
 
-    // don't want to fault if the charger hasn't been connected yet, just if it
+    // don't want to fault if a charger hasn't been connected yet, just if it
     // times out when it has
-    if (received_status.has_value() && !coms_alive()) {  // charger can timeout
+    if (timeouts.any_expired(CHARGER_LINK_MASK)) {  // charger can timeout
         return charger_fault_type::CHARGER_CAN_TIMEOUT;
     }
 
@@ -128,17 +330,31 @@ charger_fault_type Thunderstruck::check_current_fault() {
 }
 
 /**
- * @brief Check if we have recently received communications from the chargers.
+ * @brief Zero the output of every charger whose status link has expired, so
+ * a unit that went quiet mid-charge stops counting toward the current and
+ * voltage. Call when CommTimeouts::poll() reports an expiry. A link dropped
+ * by forget() isn't expired, so a unit still putting out current after
+ * disable_charging() keeps counting until its next frame.
  *
- * @return true If we have received communication within the time value.
- * @return false otherwise
  */
-bool Thunderstruck::coms_alive() {
-    if (received_status.has_value()) {
-        uint32_t tick = HAL_GetTick();
-        return ((tick - received_status.value()) < TIMEOUT);
+void Thunderstruck::drop_expired_units() {
+    for (uint8_t i = 0; i < NUMBER_CHARGERS; i++) {
+        if (timeouts.any_expired(link_bit(charger_status_link(i)))) {
+            units[i].charging_current = deci_amps(0);
+            units[i].charging_voltage = deci_volts(0);
+        }
     }
-    return false;
+}
+
+/**
+ * @brief Check if we have recently received communications from any charger,
+ * as of the last CommTimeouts::poll().
+ *
+ * @return true If at least one charger has been heard within the time value.
+ * @return false otherwise
+ */
+bool Thunderstruck::coms_alive() const {
+    return timeouts.any_alive(CHARGER_LINK_MASK);
 }
 
 /**
@@ -161,5 +377,13 @@ void Thunderstruck::tx_callback() {
     CANDevice.tx_handler();
 }
 
+const tx_queue_stats &Thunderstruck::get_tx_stats() const {
+    return CANDevice.get_tx_stats();
+}
+
+const control_tx_stats &Thunderstruck::get_control_stats() const {
+    return control_stats;
+}
+
 }  // namespace charger
 }  // namespace umnsvp